@@ -0,0 +1,132 @@
+#!/usr/bin/env python
+'''
+run Replay over a set of logs and/or a grid of parameter overrides,
+spreading the runs over a pool of worker processes
+
+Each run is a separate Replay process with its own working directory,
+so every run gets an isolated EKF3 instance, parameter storage and
+output log. Per-run EKF3 summary metrics (from Replay --summary) are
+collected into a single tab separated results file.
+'''
+
+import optparse, os, sys, glob, itertools, multiprocessing, subprocess, time
+
+parser = optparse.OptionParser("BatchReplay [options] LOG|LOGDIR...")
+parser.add_option("--replay", type='string', default='./Replay.elf', help='path to Replay binary')
+parser.add_option("--jobs", "-j", type=int, default=multiprocessing.cpu_count(), help='number of parallel Replay processes')
+parser.add_option("--outdir", type='string', default='batch_results', help='directory for per-run output')
+parser.add_option("--param", action='append', default=[], help="parameter override NAME=VALUE or sweep NAME=V1,V2,...")
+parser.add_option("--param-file", type='string', default=None, help="parameter file applied to every run")
+parser.add_option("--keep-logs", action='store_true', default=False, help="keep the output log of each run")
+parser.add_option("--extra-args", type='string', default='', help="extra arguments passed to Replay")
+
+opts, args = parser.parse_args()
+
+def get_log_list():
+    '''get a list of log files to process'''
+    file_list = []
+    for a in args:
+        if os.path.isdir(a):
+            file_list.extend(sorted(glob.glob(os.path.join(a, "*.bin")) +
+                                    glob.glob(os.path.join(a, "*.BIN"))))
+        else:
+            file_list.append(a)
+    if len(file_list) == 0:
+        print("No logs to process")
+        sys.exit(1)
+    return [os.path.abspath(f) for f in file_list]
+
+def get_param_grid():
+    '''expand --param options into a list of parameter sets'''
+    names = []
+    values = []
+    for p in opts.param:
+        if '=' not in p:
+            print("Bad parameter %s, expected NAME=VALUE" % p)
+            sys.exit(1)
+        (name, vlist) = p.split('=', 1)
+        names.append(name)
+        values.append(vlist.split(','))
+    return [list(zip(names, v)) for v in itertools.product(*values)]
+
+def run_replay(job):
+    '''run Replay on one logfile with one parameter set'''
+    (idx, logfile, params) = job
+    rundir = os.path.abspath(os.path.join(opts.outdir, "run%05u" % idx))
+    if not os.path.isdir(rundir):
+        os.makedirs(rundir)
+    summary = os.path.join(rundir, "summary.txt")
+    if os.path.exists(summary):
+        os.unlink(summary)
+    cmd = [os.path.abspath(opts.replay), "--", "--summary", summary]
+    if opts.param_file is not None:
+        cmd.extend(["--param-file", os.path.abspath(opts.param_file)])
+    for (name, value) in params:
+        cmd.extend(["--parm", "%s=%s" % (name, value)])
+    cmd.extend(opts.extra_args.split())
+    cmd.append(logfile)
+    out = open(os.path.join(rundir, "replay.txt"), "w")
+    t0 = time.time()
+    ret = subprocess.call(cmd, cwd=rundir, stdout=out, stderr=subprocess.STDOUT)
+    out.close()
+    result = { 'run' : "%u" % idx, 'status' : "%d" % ret }
+    for (name, value) in params:
+        result[name] = value
+    if os.path.exists(summary):
+        for field in open(summary).read().strip().split('\t'):
+            (name, value) = field.split('=', 1)
+            result[name] = value
+    else:
+        result['log'] = logfile
+        result['wall_time'] = "%.3f" % (time.time() - t0)
+    if not opts.keep_logs:
+        for f in glob.glob(os.path.join(rundir, "logs", "*.BIN")):
+            os.unlink(f)
+    return result
+
+def write_results(results, param_names):
+    '''write all run summaries to a single tab separated file'''
+    columns = ['run', 'status', 'log'] + param_names
+    for r in results:
+        for k in sorted(r.keys()):
+            if k not in columns:
+                columns.append(k)
+    filename = os.path.join(opts.outdir, "batch_results.txt")
+    f = open(filename, "w")
+    f.write("\t".join(columns) + "\n")
+    for r in results:
+        f.write("\t".join([r.get(c, "") for c in columns]) + "\n")
+    f.close()
+    print("Wrote %s" % filename)
+
+def batch_replay():
+    '''run all logs against all parameter sets'''
+    log_list = get_log_list()
+    grid = get_param_grid()
+    param_names = [name for (name, value) in grid[0]]
+    jobs = []
+    for logfile in log_list:
+        for params in grid:
+            jobs.append((len(jobs), logfile, params))
+    print("Running %u jobs (%u logs x %u parameter sets) on %u workers" % (
+        len(jobs), len(log_list), len(grid), opts.jobs))
+
+    t0 = time.time()
+    pool = multiprocessing.Pool(opts.jobs)
+    results = []
+    for r in pool.imap_unordered(run_replay, jobs):
+        results.append(r)
+        print("%u/%u run%s status=%s %s" % (len(results), len(jobs), r['run'], r['status'], r['log']))
+    pool.close()
+    pool.join()
+    results.sort(key=lambda r: int(r['run']))
+
+    write_results(results, param_names)
+    failed = len([r for r in results if r['status'] != "0"])
+    print("Completed %u runs (%u failed) in %.1f seconds" % (len(results), failed, time.time() - t0))
+
+if len(args) == 0:
+    parser.print_help()
+    sys.exit(1)
+
+batch_replay()
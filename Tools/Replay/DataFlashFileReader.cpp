@@ -1,9 +1,15 @@
 #include "DataFlashFileReader.h"
 
+#include <AP_Logger/LogCompress.h>
+
+#include <errno.h>
 #include <fcntl.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <time.h>
 #include <cinttypes>
@@ -12,6 +18,9 @@
 #define PRIu64 "llu"
 #endif
 
+#define LOGREADER_INDEX_MAGIC   0x5849524c // "LRIX"
+#define LOGREADER_INDEX_VERSION 1
+
 // flogged from AP_Hal_Linux/system.cpp; we don't want to use stopped clock here
 uint64_t now() {
     struct timespec ts;
@@ -21,7 +30,11 @@ uint64_t now() {
 
 AP_LoggerFileReader::AP_LoggerFileReader() :
     start_micros(now())
-{}
+{
+    // format messages are always handled
+    wanted.set(LOG_FORMAT_MSG);
+    seek_keep.set(LOG_FORMAT_MSG);
+}
 
 AP_LoggerFileReader::~AP_LoggerFileReader()
 {
@@ -29,6 +42,14 @@ AP_LoggerFileReader::~AP_LoggerFileReader()
     const uint64_t delta = micros - start_micros;
     ::printf("Replay counts: %" PRIu64 " bytes  %u entries\n", bytes_read, message_count);
     ::printf("Replay rates: %" PRIu64 " bytes/second  %" PRIu64 " messages/second\n", bytes_read*1000000/delta, message_count*1000000/delta);
+
+    free_index();
+    if (map_allocated) {
+        free((void *)map);
+    } else if (map != nullptr) {
+        munmap((void *)map, map_size);
+    }
+    free(log_filename);
 }
 
 bool AP_LoggerFileReader::open_log(const char *logfile)
@@ -37,6 +58,43 @@ bool AP_LoggerFileReader::open_log(const char *logfile)
     if (fd == -1) {
         return false;
     }
+    log_filename = strdup(logfile);
+
+    // map the whole log; fall back to read() if we can't
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            map = (const uint8_t *)p;
+            map_size = st.st_size;
+            madvise(p, map_size, MADV_SEQUENTIAL);
+        }
+    }
+    if (map != nullptr && LogDecompressor::is_compressed(map, map_size)) {
+        return decompress_log();
+    }
+    return true;
+}
+
+/*
+  replace a mapped compressed log with its decompressed contents. The
+  index, if used, describes the decompressed log
+ */
+bool AP_LoggerFileReader::decompress_log(void)
+{
+    const uint64_t t0 = now();
+    uint8_t *out;
+    uint64_t out_len;
+    if (!LogDecompressor::decompress(map, map_size, out, out_len)) {
+        ::printf("Failed to decompress log\n");
+        return false;
+    }
+    ::printf("Decompressed %" PRIu64 " bytes to %" PRIu64 " in %.3f seconds\n",
+             map_size, out_len, (now() - t0)*1.0e-6);
+    munmap((void *)map, map_size);
+    map = out;
+    map_size = out_len;
+    map_allocated = true;
     return true;
 }
 
@@ -63,6 +121,10 @@ void AP_LoggerFileReader::get_packet_counts(uint64_t dest[])
 
 bool AP_LoggerFileReader::update(char type[5])
 {
+    if (map != nullptr) {
+        return update_mapped(type);
+    }
+
     uint8_t hdr[3];
     if (read_input(hdr, 3) != 3) {
         return false;
@@ -109,3 +171,345 @@ bool AP_LoggerFileReader::update(char type[5])
     message_count++;
     return handle_msg(f,msg);
 }
+
+/*
+  return the next message from the mapped log, advancing map_ofs
+ */
+bool AP_LoggerFileReader::next_message(const uint8_t *&msg, uint8_t &len)
+{
+    if (map_ofs + 3 > map_size) {
+        return false;
+    }
+    const uint8_t *hdr = &map[map_ofs];
+    if (hdr[0] != HEAD_BYTE1 || hdr[1] != HEAD_BYTE2) {
+        printf("bad log header\n");
+        return false;
+    }
+    if (hdr[2] == LOG_FORMAT_MSG) {
+        len = sizeof(struct log_Format);
+    } else {
+        len = formats[hdr[2]].length;
+        if (len == 0) {
+            ::printf("No format defined for type (%d)\n", hdr[2]);
+            exit(1);
+        }
+    }
+    if (map_ofs + len > map_size) {
+        return false;
+    }
+    msg = hdr;
+    map_ofs += len;
+    return true;
+}
+
+bool AP_LoggerFileReader::update_mapped(char type[5])
+{
+    while (true) {
+        skip_unwanted_intervals();
+
+        const uint64_t msg_ofs = map_ofs;
+        const uint8_t *msg;
+        uint8_t len;
+        if (!next_message(msg, len)) {
+            return false;
+        }
+        bytes_read += len;
+
+        const uint8_t msgid = msg[2];
+        packet_counts[msgid]++;
+
+        if (msgid == LOG_FORMAT_MSG) {
+            struct log_Format f;
+            memcpy(&f, msg, sizeof(f));
+            memcpy(&formats[f.type], &f, sizeof(formats[f.type]));
+            strncpy(type, "FMT", 3);
+            type[3] = 0;
+
+            message_count++;
+            const bool ret = handle_log_format_msg(f);
+            if (want_type(f)) {
+                wanted.set(f.type);
+            } else {
+                wanted.clear(f.type);
+            }
+            if (keep_during_seek(f)) {
+                seek_keep.set(f.type);
+            } else {
+                seek_keep.clear(f.type);
+            }
+            return ret;
+        }
+
+        if (!wanted.get(msgid)) {
+            continue;
+        }
+        if (msg_ofs < seek_target_ofs && !seek_keep.get(msgid)) {
+            continue;
+        }
+
+        // handlers are allowed to modify the message, so give them a copy
+        const struct log_Format &f = formats[msgid];
+        uint8_t buf[f.length];
+        memcpy(buf, msg, f.length);
+
+        strncpy(type, f.name, 4);
+        type[4] = 0;
+
+        message_count++;
+        return handle_msg(f, buf);
+    }
+}
+
+/*
+  if we are at the start of an index interval which contains no
+  message types we want then jump to the next one
+ */
+void AP_LoggerFileReader::skip_unwanted_intervals(void)
+{
+    if (index == nullptr) {
+        return;
+    }
+    const uint32_t n = index->num_checkpoints;
+    while (next_checkpoint < n) {
+        const struct index_checkpoint &cp = checkpoints[next_checkpoint];
+        if (map_ofs < cp.offset) {
+            // still inside the previous interval
+            break;
+        }
+        next_checkpoint++;
+        if (map_ofs > cp.offset) {
+            continue;
+        }
+        const bool seeking = map_ofs < seek_target_ofs;
+        if (cp.types.intersects(seeking ? seek_keep : wanted)) {
+            break;
+        }
+        map_ofs = (next_checkpoint < n) ? checkpoints[next_checkpoint].offset : index->indexed_length;
+    }
+}
+
+/*
+  extract the TimeUS (or TimeMS) first field from a message
+ */
+bool AP_LoggerFileReader::message_time(const struct log_Format &f, const uint8_t *msg, uint64_t &time_us) const
+{
+    if (f.format[0] == 'Q' && strncmp(f.labels, "TimeUS", 6) == 0) {
+        memcpy(&time_us, &msg[3], sizeof(time_us));
+        return true;
+    }
+    if (f.format[0] == 'I' && strncmp(f.labels, "TimeMS", 6) == 0) {
+        uint32_t time_ms;
+        memcpy(&time_ms, &msg[3], sizeof(time_ms));
+        time_us = time_ms * 1000ULL;
+        return true;
+    }
+    return false;
+}
+
+bool AP_LoggerFileReader::use_index(void)
+{
+    if (index != nullptr) {
+        return true;
+    }
+    if (map == nullptr) {
+        ::printf("Log is not mapped; index unavailable\n");
+        return false;
+    }
+
+    char filename[strlen(log_filename) + 5];
+    snprintf(filename, sizeof(filename), "%s.idx", log_filename);
+    if (load_index(filename)) {
+        ::printf("Loaded index %s (%u checkpoints)\n", filename, (unsigned)index->num_checkpoints);
+        return true;
+    }
+
+    const uint64_t t0 = now();
+    if (!build_index()) {
+        return false;
+    }
+    ::printf("Built index of %" PRIu64 " bytes in %.2f seconds (%u checkpoints)\n",
+             index->indexed_length, (now() - t0)*1.0e-6, (unsigned)index->num_checkpoints);
+    save_index(filename);
+    return true;
+}
+
+/*
+  scan the mapped log recording message counts, the first offset of
+  each message type and time checkpoints
+ */
+bool AP_LoggerFileReader::build_index(void)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+
+    index = (struct index_header *)calloc(1, sizeof(struct index_header));
+    struct log_Format *fmts = (struct log_Format *)calloc(256, sizeof(struct log_Format));
+    uint32_t max_checkpoints = 1024;
+    checkpoints = (struct index_checkpoint *)calloc(max_checkpoints, sizeof(struct index_checkpoint));
+    if (index == nullptr || fmts == nullptr || checkpoints == nullptr) {
+        free(fmts);
+        free_index();
+        return false;
+    }
+
+    index->magic = LOGREADER_INDEX_MAGIC;
+    index->version = LOGREADER_INDEX_VERSION;
+    index->log_size = st.st_size;
+    index->log_mtime = st.st_mtime;
+    index->interval_us = LOGREADER_INDEX_INTERVAL_US;
+
+    // the first checkpoint is always the start of the log
+    index->num_checkpoints = 1;
+    bool have_time = false;
+    uint64_t checkpoint_time = 0;
+
+    uint64_t ofs = 0;
+    while (ofs + 3 <= map_size) {
+        const uint8_t *msg = &map[ofs];
+        if (msg[0] != HEAD_BYTE1 || msg[1] != HEAD_BYTE2) {
+            ::printf("bad log header at offset %" PRIu64 "; index truncated\n", ofs);
+            break;
+        }
+        const uint8_t msgid = msg[2];
+        const uint8_t len = (msgid == LOG_FORMAT_MSG) ? sizeof(struct log_Format) : fmts[msgid].length;
+        if (len == 0 || ofs + len > map_size) {
+            break;
+        }
+
+        uint64_t time_us;
+        if (msgid == LOG_FORMAT_MSG) {
+            const uint8_t type = msg[3];
+            memcpy(&fmts[type], msg, sizeof(struct log_Format));
+        } else if (message_time(fmts[msgid], msg, time_us)) {
+            if (!have_time) {
+                checkpoints[0].time_us = time_us;
+                checkpoint_time = time_us;
+                have_time = true;
+            } else if (time_us >= checkpoint_time + LOGREADER_INDEX_INTERVAL_US) {
+                if (index->num_checkpoints == max_checkpoints) {
+                    max_checkpoints *= 2;
+                    struct index_checkpoint *new_checkpoints = (struct index_checkpoint *)
+                        realloc(checkpoints, max_checkpoints * sizeof(struct index_checkpoint));
+                    if (new_checkpoints == nullptr) {
+                        free(fmts);
+                        free_index();
+                        return false;
+                    }
+                    checkpoints = new_checkpoints;
+                }
+                struct index_checkpoint &cp = checkpoints[index->num_checkpoints++];
+                memset(&cp, 0, sizeof(cp));
+                cp.time_us = time_us;
+                cp.offset = ofs;
+                checkpoint_time = time_us;
+            }
+        }
+
+        if (index->type_counts[msgid]++ == 0) {
+            index->type_first_ofs[msgid] = ofs;
+        }
+        checkpoints[index->num_checkpoints-1].types.set(msgid);
+        ofs += len;
+    }
+    index->indexed_length = ofs;
+
+    free(fmts);
+    return true;
+}
+
+bool AP_LoggerFileReader::load_index(const char *filename)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+    int ifd = ::open(filename, O_RDONLY|O_CLOEXEC);
+    if (ifd == -1) {
+        return false;
+    }
+
+    index = (struct index_header *)calloc(1, sizeof(struct index_header));
+    if (index == nullptr ||
+        ::read(ifd, index, sizeof(*index)) != sizeof(*index) ||
+        index->magic != LOGREADER_INDEX_MAGIC ||
+        index->version != LOGREADER_INDEX_VERSION ||
+        index->log_size != (uint64_t)st.st_size ||
+        index->log_mtime != st.st_mtime ||
+        index->interval_us != LOGREADER_INDEX_INTERVAL_US ||
+        index->num_checkpoints == 0) {
+        ::close(ifd);
+        free_index();
+        return false;
+    }
+
+    const ssize_t len = index->num_checkpoints * sizeof(struct index_checkpoint);
+    checkpoints = (struct index_checkpoint *)malloc(len);
+    if (checkpoints == nullptr || ::read(ifd, checkpoints, len) != len) {
+        ::close(ifd);
+        free_index();
+        return false;
+    }
+    ::close(ifd);
+    return true;
+}
+
+void AP_LoggerFileReader::save_index(const char *filename)
+{
+    // write to a temporary file and rename so concurrent readers never
+    // see a partial index
+    char tmpname[strlen(filename) + 16];
+    snprintf(tmpname, sizeof(tmpname), "%s.%u", filename, (unsigned)getpid());
+    int ifd = ::open(tmpname, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+    if (ifd == -1) {
+        ::printf("Unable to save index %s: %s\n", filename, strerror(errno));
+        return;
+    }
+    const ssize_t len = index->num_checkpoints * sizeof(struct index_checkpoint);
+    if (::write(ifd, index, sizeof(*index)) != sizeof(*index) ||
+        ::write(ifd, checkpoints, len) != len) {
+        ::printf("Unable to save index %s: %s\n", filename, strerror(errno));
+        ::close(ifd);
+        unlink(tmpname);
+        return;
+    }
+    ::close(ifd);
+    if (rename(tmpname, filename) != 0) {
+        unlink(tmpname);
+    }
+}
+
+void AP_LoggerFileReader::free_index(void)
+{
+    free(index);
+    free(checkpoints);
+    index = nullptr;
+    checkpoints = nullptr;
+    next_checkpoint = 0;
+}
+
+bool AP_LoggerFileReader::seek_time(uint64_t time_us)
+{
+    if (!use_index()) {
+        return false;
+    }
+
+    // find the last checkpoint at or before time_us
+    uint32_t lo = 0;
+    uint32_t hi = index->num_checkpoints;
+    while (hi - lo > 1) {
+        const uint32_t mid = (lo + hi) / 2;
+        if (checkpoints[mid].time_us <= time_us) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    if (checkpoints[lo].offset > map_ofs) {
+        seek_target_ofs = checkpoints[lo].offset;
+    }
+    ::printf("Seeking to %.1f seconds at offset %" PRIu64 "\n",
+             checkpoints[lo].time_us*1.0e-6, checkpoints[lo].offset);
+    return true;
+}
@@ -4,6 +4,12 @@
 
 #define LOGREADER_MAX_FORMATS 255 // must be >= highest MESSAGE
 
+// time between index checkpoints
+#define LOGREADER_INDEX_INTERVAL_US 1000000ULL
+
+// monotonic wall-clock time in microseconds
+uint64_t now();
+
 class AP_LoggerFileReader
 {
 public:
@@ -17,6 +23,23 @@ public:
     virtual bool handle_log_format_msg(const struct log_Format &f) = 0;
     virtual bool handle_msg(const struct log_Format &f, uint8_t *msg) = 0;
 
+    // return false to have update() skip messages of this format
+    // without passing them to handle_msg.  Called once per FMT.
+    virtual bool want_type(const struct log_Format &f) { return true; }
+
+    // return true for formats which must still be handled while
+    // skipping ahead to a seek_time() target (e.g. parameters)
+    virtual bool keep_during_seek(const struct log_Format &f) { return false; }
+
+    // load the sidecar index for the open log, building and saving
+    // it if it is missing or stale
+    bool use_index(void);
+
+    // position the reader at the last index checkpoint at or before
+    // time_us.  FMT messages and keep_during_seek() types before
+    // that point are still handled.
+    bool seek_time(uint64_t time_us);
+
     void format_type(uint16_t type, char dest[5]);
     void get_packet_counts(uint64_t dest[]);
 
@@ -33,4 +56,68 @@ private:
     uint64_t start_micros;
 
     uint64_t packet_counts[LOGREADER_MAX_FORMATS] = {};
+
+    // set of message types, indexed by msgid
+    struct type_mask {
+        uint32_t bits[8];
+        void set(uint8_t t) { bits[t/32] |= (1U << (t & 0x1f)); }
+        void clear(uint8_t t) { bits[t/32] &= ~(1U << (t & 0x1f)); }
+        bool get(uint8_t t) const { return (bits[t/32] & (1U << (t & 0x1f))) != 0; }
+        bool intersects(const type_mask &other) const {
+            for (uint8_t i=0; i<8; i++) {
+                if (bits[i] & other.bits[i]) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    // memory-mapped log; nullptr if mmap failed and we are using read()
+    const uint8_t *map = nullptr;
+    uint64_t map_size = 0;
+    // true if map holds a decompressed copy of the log from malloc()
+    bool map_allocated = false;
+    uint64_t map_ofs = 0;
+    char *log_filename = nullptr;
+
+    type_mask wanted {};
+    type_mask seek_keep {};
+    uint64_t seek_target_ofs = 0;
+
+    /*
+      sidecar index, stored as <logname>.idx.  A checkpoint is
+      recorded each LOGREADER_INDEX_INTERVAL_US of log time along
+      with the set of message types found up to the next checkpoint,
+      allowing whole intervals to be skipped when filtering
+     */
+    struct PACKED index_header {
+        uint32_t magic;
+        uint16_t version;
+        uint64_t log_size;
+        int64_t log_mtime;
+        uint64_t indexed_length;
+        uint32_t interval_us;
+        uint32_t num_checkpoints;
+        uint64_t type_counts[256];
+        uint64_t type_first_ofs[256];
+    };
+    struct PACKED index_checkpoint {
+        uint64_t time_us;
+        uint64_t offset;
+        type_mask types;
+    };
+    struct index_header *index = nullptr;
+    struct index_checkpoint *checkpoints = nullptr;
+    uint32_t next_checkpoint = 0;
+
+    bool decompress_log(void);
+    bool update_mapped(char type[5]);
+    bool next_message(const uint8_t *&msg, uint8_t &len);
+    bool message_time(const struct log_Format &f, const uint8_t *msg, uint64_t &time_us) const;
+    bool load_index(const char *filename);
+    bool build_index(void);
+    void save_index(const char *filename);
+    void free_index(void);
+    void skip_unwanted_intervals(void);
 };
@@ -440,6 +440,27 @@ bool LogReader::handle_msg(const struct log_Format &f, uint8_t *msg) {
     return true;
 }
 
+/*
+  when only handling types we have parsers for, skip everything else
+  (including messages which would be passed through to the output log)
+ */
+bool LogReader::want_type(const struct log_Format &f)
+{
+    if (!handled_types_only) {
+        return true;
+    }
+    return msgparser[f.type] != nullptr || deferred_formats[f.type].type != 0;
+}
+
+/*
+  parameters and the vehicle type are needed even when seeking past
+  the start of the log
+ */
+bool LogReader::keep_during_seek(const struct log_Format &f)
+{
+    return strncmp(f.name, "PARM", 4) == 0 || strncmp(f.name, "MSG", 4) == 0;
+}
+
 bool LogReader::wait_type(const char *wtype)
 {
     while (true) {
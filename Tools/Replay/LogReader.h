@@ -32,10 +32,13 @@ public:
     void set_gyro_mask(uint8_t mask) { gyro_mask = mask; }
     void set_use_imt(bool _use_imt) { use_imt = _use_imt; }
     void set_save_chek_messages(bool _save_chek_messages) { save_chek_messages = _save_chek_messages; }
+    void set_handled_types_only(bool _handled_types_only) { handled_types_only = _handled_types_only; }
 
     uint64_t last_timestamp_us(void) const { return last_timestamp_usec; }
     bool handle_log_format_msg(const struct log_Format &f) override;
     bool handle_msg(const struct log_Format &f, uint8_t *msg) override;
+    bool want_type(const struct log_Format &f) override;
+    bool keep_during_seek(const struct log_Format &f) override;
 
     static bool in_list(const char *type, const char *list[]);
 
@@ -78,6 +81,7 @@ private:
     const char **&nottypes;
 
     bool save_chek_messages;
+    bool handled_types_only = false;
 
     void maybe_install_vehicle_specific_parsers();
 
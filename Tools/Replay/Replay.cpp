@@ -153,6 +153,10 @@ void Replay::usage(void)
     ::printf("\t--no-params        don't use parameters from the log\n");
     ::printf("\t--no-fpe           do not generate floating point exceptions\n");
     ::printf("\t--packet-counts    print packet counts at end of processing\n");
+    ::printf("\t--summary FILE     append EKF3 summary metrics for this run to FILE\n");
+    ::printf("\t--index            use a sidecar index and only read message types with handlers\n");
+    ::printf("\t--start-time time  start replay at log time (seconds), implies --index\n");
+    ::printf("\t--end-time time    stop replay at log time (seconds)\n");
 }
 
 
@@ -169,6 +173,10 @@ enum {
     OPT_PARAM_FILE,
     OPT_NO_FPE,
     OPT_PACKET_COUNTS,
+    OPT_SUMMARY,
+    OPT_INDEX,
+    OPT_START_TIME,
+    OPT_END_TIME,
 };
 
 void Replay::flush_logger(void) {
@@ -226,6 +234,10 @@ void Replay::_parse_command_line(uint8_t argc, char * const argv[])
         {"no-params",       false,  0, OPT_NOPARAMS},
         {"no-fpe",          false,  0, OPT_NO_FPE},
         {"packet-counts",   false,  0, OPT_PACKET_COUNTS},
+        {"summary",         true,   0, OPT_SUMMARY},
+        {"index",           false,  0, OPT_INDEX},
+        {"start-time",      true,   0, OPT_START_TIME},
+        {"end-time",        true,   0, OPT_END_TIME},
         {0, false, 0, 0}
     };
 
@@ -313,6 +325,23 @@ void Replay::_parse_command_line(uint8_t argc, char * const argv[])
             packet_counts = true;
             break;
 
+        case OPT_SUMMARY:
+            summary_filename = gopt.optarg;
+            break;
+
+        case OPT_INDEX:
+            use_index = true;
+            break;
+
+        case OPT_START_TIME:
+            start_time_ms = atof(gopt.optarg) * 1000;
+            use_index = true;
+            break;
+
+        case OPT_END_TIME:
+            end_time_ms = atof(gopt.optarg) * 1000;
+            break;
+
         case 'h':
         default:
             usage();
@@ -502,6 +531,8 @@ void Replay::setup()
 {
     ::printf("Starting\n");
 
+    start_wall_us = now();
+
     uint8_t argc;
     char * const *argv;
 
@@ -532,6 +563,18 @@ void Replay::setup()
         exit(1);
     }
 
+    if (use_index) {
+        logreader.set_handled_types_only(true);
+        if (!logreader.use_index()) {
+            ::printf("Failed to index %s\n", filename);
+            exit(1);
+        }
+        if (start_time_ms >= 0 && !logreader.seek_time(start_time_ms*1000ULL)) {
+            ::printf("Failed to seek to %.1f seconds\n", start_time_ms*0.001f);
+            exit(1);
+        }
+    }
+
     _vehicle.setup();
 
     inhibit_gyro_cal();
@@ -699,6 +742,9 @@ void Replay::read_sensors(const char *type)
         if ((downsample == 0 || ++output_counter % downsample == 0) && !logmatch) {
             write_ekf_logs();
         }
+        if (summary_filename != nullptr) {
+            update_ekf3_summary();
+        }
         if (_vehicle.ahrs.healthy() != ahrs_healthy) {
             ahrs_healthy = _vehicle.ahrs.healthy();
             printf("AHRS health: %u at %lu\n", 
@@ -778,10 +824,79 @@ void Replay::log_check_solution(void)
     check_result.max_pos_error   = MAX(check_result.max_pos_error,   pos_error);
 }
 
+/*
+  accumulate EKF3 innovation test ratios for --summary
+ */
+void Replay::update_ekf3_summary(void)
+{
+    if (!_vehicle.EKF3.activeCores()) {
+        return;
+    }
+    float velVar, posVar, hgtVar, tasVar;
+    Vector3f magVar;
+    Vector2f offset;
+    uint16_t faults;
+    _vehicle.EKF3.getVariances(-1, velVar, posVar, hgtVar, magVar, tasVar, offset);
+    _vehicle.EKF3.getFilterFaults(-1, faults);
+    const float magRatio = magVar.length();
+
+    ekf3_summary.updates++;
+    if (_vehicle.EKF3.healthy()) {
+        ekf3_summary.healthy_updates++;
+    }
+    ekf3_summary.faults |= faults;
+    ekf3_summary.max_vel_ratio = MAX(ekf3_summary.max_vel_ratio, velVar);
+    ekf3_summary.max_pos_ratio = MAX(ekf3_summary.max_pos_ratio, posVar);
+    ekf3_summary.max_hgt_ratio = MAX(ekf3_summary.max_hgt_ratio, hgtVar);
+    ekf3_summary.max_mag_ratio = MAX(ekf3_summary.max_mag_ratio, magRatio);
+    ekf3_summary.max_tas_ratio = MAX(ekf3_summary.max_tas_ratio, tasVar);
+    ekf3_summary.sum_vel_ratio += velVar;
+    ekf3_summary.sum_pos_ratio += posVar;
+    ekf3_summary.sum_hgt_ratio += hgtVar;
+    ekf3_summary.sum_mag_ratio += magRatio;
+}
+
+/*
+  append one line of NAME=VALUE pairs describing this run
+ */
+void Replay::write_summary(void)
+{
+    FILE *f = fopen(summary_filename, "a");
+    if (f == nullptr) {
+        ::fprintf(stderr, "Failed to open (%s): %m\n", summary_filename);
+        return;
+    }
+    const float n = MAX(ekf3_summary.updates, 1U);
+    fprintf(f, "log=%s\tlog_time=%.3f\twall_time=%.3f\tupdates=%u\thealthy=%.4f\tfaults=%u"
+            "\tmax_vel=%.4f\tmax_pos=%.4f\tmax_hgt=%.4f\tmax_mag=%.4f\tmax_tas=%.4f"
+            "\tmean_vel=%.4f\tmean_pos=%.4f\tmean_hgt=%.4f\tmean_mag=%.4f\n",
+            log_filename,
+            AP_HAL::millis()*0.001f,
+            (now() - start_wall_us)*1.0e-6f,
+            (unsigned)ekf3_summary.updates,
+            ekf3_summary.healthy_updates / n,
+            (unsigned)ekf3_summary.faults,
+            ekf3_summary.max_vel_ratio,
+            ekf3_summary.max_pos_ratio,
+            ekf3_summary.max_hgt_ratio,
+            ekf3_summary.max_mag_ratio,
+            ekf3_summary.max_tas_ratio,
+            ekf3_summary.sum_vel_ratio / n,
+            ekf3_summary.sum_pos_ratio / n,
+            ekf3_summary.sum_hgt_ratio / n,
+            ekf3_summary.sum_mag_ratio / n);
+    fclose(f);
+}
+
 void Replay::flush_and_exit()
 {
     flush_logger();
 
+    // written before report_checks() as that exits on failure
+    if (summary_filename != nullptr) {
+        write_summary();
+    }
+
     if (check_solution) {
         report_checks();
     }
@@ -826,6 +941,11 @@ void Replay::loop()
         flush_and_exit();
     }
 
+    if (end_time_ms >= 0 && AP_HAL::millis() > (uint32_t)end_time_ms) {
+        ::printf("End of replay window at %.1f seconds\n", AP_HAL::millis()*0.001f);
+        flush_and_exit();
+    }
+
     if (last_timestamp != 0) {
         uint64_t gap = AP_HAL::micros64() - last_timestamp;
         if (gap > 40000) {
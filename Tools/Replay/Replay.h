@@ -149,6 +149,11 @@ private:
     uint32_t output_counter = 0;
     uint64_t last_timestamp = 0;
     bool packet_counts = false;
+    const char *summary_filename = nullptr;
+    bool use_index = false;
+    int32_t start_time_ms = -1;
+    int32_t end_time_ms = -1;
+    uint64_t start_wall_us;
 
     struct {
         float max_roll_error;
@@ -159,6 +164,25 @@ private:
         float max_vel_error;
     } check_result {};
 
+    /*
+      per-run EKF3 metrics, written as a single line by --summary so
+      that batch runs (see BatchReplay.py) can compare runs
+     */
+    struct {
+        uint32_t updates;
+        uint32_t healthy_updates;
+        uint16_t faults;
+        float max_vel_ratio;
+        float max_pos_ratio;
+        float max_hgt_ratio;
+        float max_mag_ratio;
+        float max_tas_ratio;
+        double sum_vel_ratio;
+        double sum_pos_ratio;
+        double sum_hgt_ratio;
+        double sum_mag_ratio;
+    } ekf3_summary {};
+
     void _parse_command_line(uint8_t argc, char * const argv[]);
 
     struct user_parameter {
@@ -179,6 +203,8 @@ private:
     void log_check_solution();
     bool show_error(const char *text, float max_error, float tolerance);
     void report_checks();
+    void update_ekf3_summary();
+    void write_summary();
     bool find_log_info(struct log_information &info);
     const char **parse_list_from_string(const char *str);
     bool parse_param_line(char *line, char **vname, float &value);
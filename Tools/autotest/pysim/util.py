@@ -241,7 +241,10 @@ def start_SITL(binary,
                breakpoints=[],
                disable_breakpoints=False,
                vicon=False,
-               lldb=False):
+               lldb=False,
+               max_speed=False,
+               seed=None,
+               snapshot_at=None):
     """Launch a SITL instance."""
     cmd = []
     if valgrind and os.path.exists('/usr/bin/valgrind'):
@@ -314,6 +317,12 @@ def start_SITL(binary,
         cmd.extend(['--model', model])
     if speedup != 1:
         cmd.extend(['--speedup', str(speedup)])
+    if max_speed:
+        cmd.append('--max-speed')
+    if seed is not None:
+        cmd.extend(['--seed', str(seed)])
+    if snapshot_at is not None:
+        cmd.extend(['--snapshot-at', str(snapshot_at)])
     if defaults_file is not None:
         cmd.extend(['--defaults', defaults_file])
     if unhide_parameters:
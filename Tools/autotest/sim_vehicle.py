@@ -595,6 +595,10 @@ def start_vehicle(binary, autotest, opts, stuff, loc=None):
         cmd.append("-w")
     cmd.extend(["--model", stuff["model"]])
     cmd.extend(["--speedup", str(opts.speedup)])
+    if opts.max_speed:
+        cmd.append("--max-speed")
+    if opts.seed is not None:
+        cmd.extend(["--seed", str(opts.seed)])
     if opts.sitl_instance_args:
         # this could be a lot better:
         cmd.extend(opts.sitl_instance_args.split(" "))
@@ -890,6 +894,14 @@ group_sim.add_option("-S", "--speedup",
                      default=1,
                      type='int',
                      help="set simulation speedup (1 for wall clock time)")
+group_sim.add_option("--max-speed",
+                     action='store_true',
+                     default=False,
+                     help="run the simulation as fast as possible in deterministic lockstep")
+group_sim.add_option("--seed",
+                     default=None,
+                     type='int',
+                     help="seed the simulation random number generator")
 group_sim.add_option("-t", "--tracker-location",
                      default='CMAC_PILOTSBOX',
                      type='string',
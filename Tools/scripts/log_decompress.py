@@ -0,0 +1,146 @@
+#!/usr/bin/env python
+'''
+convert a compressed dataflash log (LOG_FILE_OPTS bit 3) back to a
+plain .BIN log readable by pymavlink, MAVExplorer and other log tools
+
+See libraries/AP_Logger/LogCompress.h for the format
+'''
+
+import optparse, os, struct, sys
+
+parser = optparse.OptionParser("log_decompress.py [options] LOG...")
+parser.add_option("--output", type='string', default=None, help="output file (default LOG with .BIN replaced by -plain.BIN)")
+(opts, args) = parser.parse_args()
+
+MAGIC = b'APLZ'
+VERSION = 1
+FRAME_SYNC = 0x5A4C
+HEAD_BYTE1 = 0xA3
+HEAD_BYTE2 = 0x95
+LOG_FORMAT_MSG = 128
+FMT_LEN = 89
+MIN_MATCH = 4
+
+class DecompressError(Exception):
+    pass
+
+def lz_decompress(data, raw_len):
+    '''decompress one LZ4 format block'''
+    out = bytearray()
+    i = 0
+    n = len(data)
+    while i < n:
+        token = data[i]
+        i += 1
+        lit_len = token >> 4
+        if lit_len == 15:
+            while True:
+                if i >= n:
+                    raise DecompressError("truncated literal length")
+                b = data[i]
+                i += 1
+                lit_len += b
+                if b != 255:
+                    break
+        if i + lit_len > n:
+            raise DecompressError("literals past end of block")
+        out += data[i:i+lit_len]
+        i += lit_len
+        if i == n:
+            break
+        if i + 2 > n:
+            raise DecompressError("truncated match offset")
+        offset = data[i] | (data[i+1] << 8)
+        i += 2
+        if offset == 0 or offset > len(out):
+            raise DecompressError("bad match offset")
+        match_len = token & 0x0F
+        if match_len == 15:
+            while True:
+                if i >= n:
+                    raise DecompressError("truncated match length")
+                b = data[i]
+                i += 1
+                match_len += b
+                if b != 255:
+                    break
+        match_len += MIN_MATCH
+        start = len(out) - offset
+        for k in range(match_len):
+            out.append(out[start + k])
+    if len(out) != raw_len:
+        raise DecompressError("block length mismatch")
+    return out
+
+def decompress_block(block, raw_len, msg_len, prev):
+    '''undo the per-type delta encoding of one block'''
+    bofs = 0
+    while bofs < raw_len:
+        if raw_len - bofs < 3 or block[bofs] != HEAD_BYTE1 or block[bofs+1] != HEAD_BYTE2:
+            raise DecompressError("bad message header")
+        mtype = block[bofs+2]
+        mlen = msg_len[mtype]
+        if mlen < 3 or bofs + mlen > raw_len:
+            raise DecompressError("bad message type %u" % mtype)
+        msg = block[bofs:bofs+mlen]
+        if mtype != LOG_FORMAT_MSG and prev[mtype] is not None:
+            p = prev[mtype]
+            for k in range(3, mlen):
+                msg[k] = (msg[k] + p[k]) & 0xFF
+        prev[mtype] = msg
+        if mtype == LOG_FORMAT_MSG:
+            # a redefined type starts its delta chain again
+            msg_len[msg[3]] = msg[4]
+            prev[msg[3]] = None
+        block[bofs:bofs+mlen] = msg
+        bofs += mlen
+
+def decompress(data):
+    '''decompress a whole log, returning the plain log'''
+    if data[:4] != MAGIC:
+        raise DecompressError("not a compressed log")
+    (version, block_size) = struct.unpack('<HH', data[4:8])
+    if version != VERSION:
+        raise DecompressError("unsupported version %u" % version)
+    msg_len = [0] * 256
+    msg_len[LOG_FORMAT_MSG] = FMT_LEN
+    prev = [None] * 256
+    out = bytearray()
+    ofs = 8
+    while ofs + 6 <= len(data):
+        (sync, raw_len, data_len) = struct.unpack('<HHH', data[ofs:ofs+6])
+        if sync != FRAME_SYNC or ofs + 6 + data_len > len(data):
+            print("Ignoring %u bytes of partial frame" % (len(data) - ofs))
+            break
+        try:
+            if data_len == raw_len:
+                block = bytearray(data[ofs+6:ofs+6+data_len])
+            else:
+                block = lz_decompress(bytearray(data[ofs+6:ofs+6+data_len]), raw_len)
+            decompress_block(block, raw_len, msg_len, prev)
+        except DecompressError as e:
+            # keep the frames decoded so far, as for a partial frame
+            print("Ignoring %u bytes from corrupt frame: %s" % (len(data) - ofs, str(e)))
+            break
+        out += block
+        ofs += 6 + data_len
+    return out
+
+if len(args) == 0:
+    parser.print_help()
+    sys.exit(1)
+
+for logfile in args:
+    data = bytearray(open(logfile, 'rb').read())
+    try:
+        plain = decompress(data)
+    except DecompressError as e:
+        print("%s: %s" % (logfile, str(e)))
+        sys.exit(1)
+    if opts.output is not None:
+        outfile = opts.output
+    else:
+        (base, ext) = os.path.splitext(logfile)
+        outfile = base + "-plain" + ext
+    open(outfile, 'wb').write(plain)
+    print("%s: %u bytes -> %s: %u bytes" % (logfile, len(data), outfile, len(plain)))
@@ -362,32 +362,10 @@ bool AP_OABendyRuler::calc_margin_from_object_database(const Location &start, co
         return false;
     }
 
-    // convert start and end to offsets (in cm) from EKF origin
-    Vector2f start_NE, end_NE;
-    if (!start.get_vector_xy_from_origin_NE(start_NE) || !end.get_vector_xy_from_origin_NE(end_NE)) {
-        return false;
-    }
-
-    // check each obstacle's distance from segment
-    float smallest_margin = FLT_MAX;
-    for (uint16_t i=0; i<oaDb->database_count(); i++) {
-
-        // convert obstacle's location to offset (in cm) from EKF origin
-        Vector2f point;
-        if (!oaDb->get_item(i).loc.get_vector_xy_from_origin_NE(point)) {
-            continue;
-        }
-
-        // margin is distance between line segment and obstacle minus obstacle's radius
-        const float m = Vector2f::closest_distance_between_line_and_point(start_NE, end_NE, point) * 0.01f - oaDb->get_accuracy();
-        if (m < smallest_margin) {
-            smallest_margin = m;
-        }
-    }
-
-    // return smallest margin
-    if (smallest_margin < FLT_MAX) {
-        margin = smallest_margin;
+    // margin is distance between line segment and closest obstacle minus obstacle's radius
+    float distance_m;
+    if (oaDb->get_closest_distance_to_segment(start, end, distance_m)) {
+        margin = distance_m - oaDb->get_accuracy();
         return true;
     }
 
@@ -33,6 +33,12 @@ extern const AP_HAL::HAL& hal;
     #define AP_OADATABASE_QUEUE_SIZE_DEFAULT 80
 #endif
 
+// size of the spatial index cells in meters. Matches the largest item radius so
+// the closeness check in process_queue looks at no more than 3x3 cells
+#ifndef AP_OADATABASE_GRID_CELL_M
+    #define AP_OADATABASE_GRID_CELL_M 10.0f
+#endif
+
 
 const AP_Param::GroupInfo AP_OADatabase::var_info[] = {
 
@@ -90,6 +96,9 @@ void AP_OADatabase::init()
         gcs().send_text(MAV_SEVERITY_INFO, "DB init failed . Sizes queue:%u, db:%u", (unsigned int)_queue.size, (unsigned int)_database.size);
         delete _queue.items;
         delete[] _database.items;
+        delete[] _grid.nodes;
+        delete[] _grid.buckets;
+        _grid.nodes = nullptr;
         return;
     }
 }
@@ -164,6 +173,25 @@ void AP_OADatabase::init_database()
     }
 
     _database.items = new OA_DbItem[_database.size];
+    grid_init();
+}
+
+// allocate the spatial index, with roughly two items per bucket when the database is full
+void AP_OADatabase::grid_init()
+{
+    _grid.num_buckets = 16;
+    while (_grid.num_buckets < _database.size / 2) {
+        _grid.num_buckets *= 2;
+    }
+
+    _grid.buckets = new uint16_t[_grid.num_buckets];
+    if (_grid.buckets == nullptr) {
+        return;
+    }
+    for (uint16_t i=0; i<_grid.num_buckets; i++) {
+        _grid.buckets[i] = GRID_NONE;
+    }
+    _grid.nodes = new GridNode[_database.size];
 }
 
 void AP_OADatabase::optimize_db_filter()
@@ -266,17 +294,11 @@ bool AP_OADatabase::process_queue()
         item.radius = get_radius(item.importance);
         item.send_to_gcs = get_send_to_gcs_flags(item.importance);
 
-        // compare item to all items in database. If found a similar item, update the existing, else add it as a new one
-        bool found = false;
-        for (uint16_t i=0; i<_database.count; i++) {
-            if (is_close_to_item_in_database(i, item)) {
-                database_item_refresh(i, item.timestamp_ms, item.radius);
-                found = true;
-                break;
-            }
-        }
-
-        if (!found) {
+        // look for a similar item in the database. If found update the existing, else add it as a new one
+        uint16_t index;
+        if (find_closest_item(item.loc, item.radius, index)) {
+            database_item_refresh(index, item.timestamp_ms, item.radius);
+        } else {
             database_item_add(item);
         }
     }
@@ -291,6 +313,12 @@ void AP_OADatabase::database_item_add(const OA_DbItem &item)
     _database.items[_database.count] = item;
     _database.items[_database.count].send_to_gcs = get_send_to_gcs_flags(_database.items[_database.count].importance);
     _database.count++;
+
+    if (_database.count == 1) {
+        // keep the grid origin close to the items
+        _grid.origin = item.loc;
+    }
+    grid_insert(_database.count-1);
 }
 
 void AP_OADatabase::database_item_remove(const uint16_t index)
@@ -303,6 +331,7 @@ void AP_OADatabase::database_item_remove(const uint16_t index)
     // radius of 0 tells the GCS we don't care about it any more (aka it expired)
     _database.items[index].radius = 0;
     _database.items[index].send_to_gcs = get_send_to_gcs_flags(_database.items[index].importance);
+    grid_remove(index);
 
     _database.count--;
     if (_database.count == 0) {
@@ -311,8 +340,10 @@ void AP_OADatabase::database_item_remove(const uint16_t index)
 
     if (index != _database.count) {
         // copy last object in array over expired object
+        grid_remove(_database.count);
         _database.items[index] = _database.items[_database.count];
         _database.items[index].send_to_gcs = get_send_to_gcs_flags(_database.items[index].importance);
+        grid_insert(index);
     }
 }
 
@@ -364,15 +395,150 @@ void AP_OADatabase::database_items_remove_all_expired()
     }
 }
 
-// returns true if a similar object already exists in database. When true, the object timer is also reset
-bool AP_OADatabase::is_close_to_item_in_database(const uint16_t index, const OA_DbItem &item) const
+// hash a grid cell into a bucket
+uint16_t AP_OADatabase::grid_bucket(const int32_t cell_x, const int32_t cell_y) const
 {
-    if (index >= _database.count) {
-        // index out of range
+    return ((uint32_t)cell_x * 73856093U ^ (uint32_t)cell_y * 19349663U) & (_grid.num_buckets - 1);
+}
+
+// get the grid cell holding an offset from the grid origin. Cells are
+// clamped to the int16 range, which keeps queries correct as they are
+// clamped the same way
+static int16_t grid_cell(const float ofs_m)
+{
+    return constrain_float(floorf(ofs_m / AP_OADATABASE_GRID_CELL_M), INT16_MIN, INT16_MAX);
+}
+
+// add database item "index" to the spatial index
+void AP_OADatabase::grid_insert(const uint16_t index)
+{
+    GridNode &node = _grid.nodes[index];
+    node.pos = _grid.origin.get_distance_NE(_database.items[index].loc);
+    node.cell_x = grid_cell(node.pos.x);
+    node.cell_y = grid_cell(node.pos.y);
+
+    uint16_t &head = _grid.buckets[grid_bucket(node.cell_x, node.cell_y)];
+    node.next = head;
+    head = index;
+}
+
+// remove database item "index" from the spatial index
+void AP_OADatabase::grid_remove(const uint16_t index)
+{
+    uint16_t *link = &_grid.buckets[grid_bucket(_grid.nodes[index].cell_x, _grid.nodes[index].cell_y)];
+    while (*link != GRID_NONE) {
+        if (*link == index) {
+            *link = _grid.nodes[index].next;
+            return;
+        }
+        link = &_grid.nodes[*link].next;
+    }
+}
+
+// find the item closest to the line segment seg_start->seg_end, looking only in the grid cells within
+// range_m of the segment. Returns true if an item no further than range_m was found, in which case it
+// is the closest item in the whole database
+bool AP_OADatabase::grid_closest(const Vector2f &seg_start, const Vector2f &seg_end, float range_m, uint16_t &index, float &distance_m) const
+{
+    const int16_t x_min = grid_cell(MIN(seg_start.x, seg_end.x) - range_m);
+    const int16_t x_max = grid_cell(MAX(seg_start.x, seg_end.x) + range_m);
+    const int16_t y_min = grid_cell(MIN(seg_start.y, seg_end.y) - range_m);
+    const int16_t y_max = grid_cell(MAX(seg_start.y, seg_end.y) + range_m);
+
+    float closest_sq = sq(range_m);
+    bool found = false;
+    for (int32_t x=x_min; x<=x_max; x++) {
+        for (int32_t y=y_min; y<=y_max; y++) {
+            // several cells can share a bucket so check each item's cell
+            for (uint16_t i=_grid.buckets[grid_bucket(x, y)]; i!=GRID_NONE; i=_grid.nodes[i].next) {
+                const GridNode &node = _grid.nodes[i];
+                if (node.cell_x != x || node.cell_y != y) {
+                    continue;
+                }
+                const float dist_sq = Vector2f::closest_distance_between_line_and_point_squared(seg_start, seg_end, node.pos);
+                if (dist_sq <= closest_sq) {
+                    closest_sq = dist_sq;
+                    index = i;
+                    found = true;
+                }
+            }
+        }
+    }
+    if (found) {
+        distance_m = sqrtf(closest_sq);
+    }
+    return found;
+}
+
+// find the item closest to the line segment seg_start->seg_end by checking every item
+bool AP_OADatabase::linear_closest(const Vector2f &seg_start, const Vector2f &seg_end, uint16_t &index, float &distance_m) const
+{
+    float closest_sq = FLT_MAX;
+    for (uint16_t i=0; i<_database.count; i++) {
+        const float dist_sq = Vector2f::closest_distance_between_line_and_point_squared(seg_start, seg_end, _grid.nodes[i].pos);
+        if (dist_sq < closest_sq) {
+            closest_sq = dist_sq;
+            index = i;
+        }
+    }
+    if (closest_sq < FLT_MAX) {
+        distance_m = sqrtf(closest_sq);
+        return true;
+    }
+    return false;
+}
+
+// number of grid cells within range_m of a line segment's bounding box
+static float grid_cells_in_range(const Vector2f &seg_start, const Vector2f &seg_end, float range_m)
+{
+    const float cells_x = (fabsf(seg_end.x - seg_start.x) + 2 * range_m) / AP_OADATABASE_GRID_CELL_M + 2;
+    const float cells_y = (fabsf(seg_end.y - seg_start.y) + 2 * range_m) / AP_OADATABASE_GRID_CELL_M + 2;
+    return cells_x * cells_y;
+}
+
+// find the item closest to loc within radius_m (in meters). Returns true and sets index if one is found
+bool AP_OADatabase::find_closest_item(const Location &loc, float radius_m, uint16_t &index) const
+{
+    if (!healthy() || _database.count == 0) {
+        return false;
+    }
+
+    const Vector2f pos = _grid.origin.get_distance_NE(loc);
+    float distance_m;
+    if (grid_cells_in_range(pos, pos, radius_m) > _database.count) {
+        // checking every item is cheaper than checking every cell
+        if (!linear_closest(pos, pos, index, distance_m)) {
+            return false;
+        }
+    } else if (!grid_closest(pos, pos, radius_m, index, distance_m)) {
         return false;
     }
+    return distance_m < radius_m;
+}
 
-    return (_database.items[index].loc.get_distance(item.loc) < item.radius);
+// get the distance (in meters) from the line segment start->end to the closest item's location.
+// returns false if the database is empty
+bool AP_OADatabase::get_closest_distance_to_segment(const Location &start, const Location &end, float &distance_m) const
+{
+    if (!healthy() || _database.count == 0) {
+        return false;
+    }
+
+    const Vector2f seg_start = _grid.origin.get_distance_NE(start);
+    const Vector2f seg_end = _grid.origin.get_distance_NE(end);
+
+    // widen the search around the segment until an item is found. Once
+    // the search covers more cells than there are items fall back to
+    // checking every item
+    uint16_t index;
+    for (float range_m = AP_OADATABASE_GRID_CELL_M; ; range_m *= 2) {
+        if (grid_cells_in_range(seg_start, seg_end, range_m) > _database.count) {
+            return linear_closest(seg_start, seg_end, index, distance_m);
+        }
+        if (grid_closest(seg_start, seg_end, range_m, index, distance_m)) {
+            return true;
+        }
+    }
 }
 
 // send ADSB_VEHICLE mavlink messages
@@ -40,7 +40,7 @@ public:
     void queue_push(const Location &loc, const uint32_t timestamp_ms, const float distance, const float angle);
 
     // returns true if database is healthy
-    bool healthy() const { return (_queue.items != nullptr) && (_database.items != nullptr); }
+    bool healthy() const { return (_queue.items != nullptr) && (_database.items != nullptr) && (_grid.nodes != nullptr); }
 
     // fetch an item in database. Undefined result when i >= _database.count.
     const OA_DbItem& get_item(uint32_t i) const { return _database.items[i]; }
@@ -54,6 +54,13 @@ public:
     // empty queue and try and put into database. Return true if there's more work to do
     bool process_queue();
 
+    // find the item closest to loc within radius_m (in meters). Returns true and sets index if one is found
+    bool find_closest_item(const Location &loc, float radius_m, uint16_t &index) const;
+
+    // get the distance (in meters) from the line segment start->end to the closest item's location.
+    // returns false if the database is empty
+    bool get_closest_distance_to_segment(const Location &start, const Location &end, float &distance_m) const;
+
     // send ADSB_VEHICLE mavlink messages
     void send_adsb_vehicle(mavlink_channel_t chan, uint16_t interval_ms);
 
@@ -81,8 +88,13 @@ private:
     // used to determine the filter radius
     float get_radius(const OA_DbItemImportance importance);
 
-    // returns true if database item "index" is close to "item"
-    bool is_close_to_item_in_database(const uint16_t index, const OA_DbItem &item) const;
+    // spatial index of database items
+    void grid_init();
+    void grid_insert(const uint16_t index);
+    void grid_remove(const uint16_t index);
+    uint16_t grid_bucket(const int32_t cell_x, const int32_t cell_y) const;
+    bool grid_closest(const Vector2f &seg_start, const Vector2f &seg_end, float range_m, uint16_t &index, float &distance_m) const;
+    bool linear_closest(const Vector2f &seg_start, const Vector2f &seg_end, uint16_t &index, float &distance_m) const;
 
     // enum for use with _OUTPUT parameter
     enum class OA_DbOutputLevel {
@@ -116,6 +128,22 @@ private:
         uint16_t        size;                               // cached value of _database_size_param that sticks after initialized
     } _database;
 
+    // uniform grid over the database items, hashed into a fixed number of buckets.
+    // Each bucket holds a linked list of the items in the cells that hash to it
+    struct GridNode {
+        Vector2f        pos;                                // offset (in meters) of item from the grid origin
+        int16_t         cell_x;                             // grid cell holding the item
+        int16_t         cell_y;
+        uint16_t        next;                               // next item in the same bucket or GRID_NONE
+    };
+    static const uint16_t GRID_NONE = 0xFFFF;
+    struct {
+        GridNode        *nodes;                             // one node per database item, indexed as _database.items
+        uint16_t        *buckets;                           // first item in each bucket or GRID_NONE
+        uint16_t        num_buckets;                        // always a power of two
+        Location        origin;                             // location of the corner of cell 0,0
+    } _grid;
+
     uint16_t _next_index_to_send[MAVLINK_COMM_NUM_BUFFERS]; // index of next object in _database to send to GCS
     uint16_t _highest_index_sent[MAVLINK_COMM_NUM_BUFFERS]; // highest index in _database sent to GCS
     uint32_t _last_send_to_gcs_ms[MAVLINK_COMM_NUM_BUFFERS];// system time that send_adsb_vehicle was last called
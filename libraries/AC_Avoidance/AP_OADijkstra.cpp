@@ -22,13 +22,17 @@
 #define OA_DIJKSTRA_EXPANDING_ARRAY_ELEMENTS_PER_CHUNK  32      // expanding arrays for fence points and paths to destination will grow in increments of 20 elements
 #define OA_DIJKSTRA_POLYGON_SHORTPATH_NOTSET_IDX        255     // index use to indicate we do not have a tentative short path for a node
 #define OA_DIJKSTRA_ERROR_REPORTING_INTERVAL_MS         5000    // failure messages sent to GCS every 5 seconds
+#define OA_DIJKSTRA_NOT_IN_HEAP                         0xFFFF  // heap position used to indicate a node is not in the heap
 
 /// Constructor
 AP_OADijkstra::AP_OADijkstra() :
         _inclusion_polygon_pts(OA_DIJKSTRA_EXPANDING_ARRAY_ELEMENTS_PER_CHUNK),
         _exclusion_polygon_pts(OA_DIJKSTRA_EXPANDING_ARRAY_ELEMENTS_PER_CHUNK),
         _exclusion_circle_pts(OA_DIJKSTRA_EXPANDING_ARRAY_ELEMENTS_PER_CHUNK),
+        _fence_visgraph_start(OA_DIJKSTRA_EXPANDING_ARRAY_ELEMENTS_PER_CHUNK),
+        _fence_visgraph_index(OA_DIJKSTRA_EXPANDING_ARRAY_ELEMENTS_PER_CHUNK),
         _short_path_data(OA_DIJKSTRA_EXPANDING_ARRAY_ELEMENTS_PER_CHUNK),
+        _heap(OA_DIJKSTRA_EXPANDING_ARRAY_ELEMENTS_PER_CHUNK),
         _path(OA_DIJKSTRA_EXPANDING_ARRAY_ELEMENTS_PER_CHUNK)
 {
 }
@@ -64,6 +68,7 @@ AP_OADijkstra::AP_OADijkstra_State AP_OADijkstra::update(const Location &current
     // check for inclusion polygon updates
     if (check_inclusion_polygon_updated()) {
         _inclusion_polygon_with_margin_ok = false;
+        _fence_edge_grid_ok = false;
         _polyfence_visgraph_ok = false;
         _shortest_path_ok = false;
     }
@@ -71,6 +76,7 @@ AP_OADijkstra::AP_OADijkstra_State AP_OADijkstra::update(const Location &current
     // check for exclusion polygon updates
     if (check_exclusion_polygon_updated()) {
         _exclusion_polygon_with_margin_ok = false;
+        _fence_edge_grid_ok = false;
         _polyfence_visgraph_ok = false;
         _shortest_path_ok = false;
     }
@@ -113,6 +119,16 @@ AP_OADijkstra::AP_OADijkstra_State AP_OADijkstra::update(const Location &current
         }
     }
 
+    // create grid of polygon fence edges
+    if (!_fence_edge_grid_ok) {
+        _fence_edge_grid_ok = create_fence_edge_grid(error_id);
+        if (!_fence_edge_grid_ok) {
+            report_error(error_id);
+            AP::logger().Write_OADijkstra(DIJKSTRA_STATE_ERROR, (uint8_t)error_id, 0, 0, destination, destination);
+            return DIJKSTRA_STATE_ERROR;
+        }
+    }
+
     // create visgraph for all fence (with margin) points
     if (!_polyfence_visgraph_ok) {
         _polyfence_visgraph_ok = create_fence_visgraph(error_id);
@@ -530,38 +546,61 @@ bool AP_OADijkstra::get_point(uint16_t index, Vector2f &point) const
     return false;
 }
 
-// returns true if line segment intersects polygon or circular fence
-bool AP_OADijkstra::intersects_fence(const Vector2f &seg_start, const Vector2f &seg_end) const
+// create grid of inclusion and exclusion polygon edges used by intersects_fence
+// returns true on success.  returns false on failure and err_id is updated
+bool AP_OADijkstra::create_fence_edge_grid(AP_OADijkstra_Error &err_id)
 {
-    // return immediately if fence is not enabled
     const AC_Fence *fence = AC_Fence::get_singleton();
     if (fence == nullptr) {
+        err_id = AP_OADijkstra_Error::DIJKSTRA_ERROR_FENCE_DISABLED;
         return false;
     }
 
-    // determine if segment crosses any of the inclusion polygons
+    _fence_edge_grid.clear();
+
+    // add inclusion polygons
     uint16_t num_points = 0;
     for (uint8_t i = 0; i < fence->polyfence().get_inclusion_polygon_count(); i++) {
         const Vector2f* boundary = fence->polyfence().get_inclusion_polygon(i, num_points);
         if ((boundary != nullptr) && (num_points >= 3)) {
-            Vector2f intersection;
-            if (Polygon_intersects(boundary, num_points, seg_start, seg_end, intersection)) {
-                return true;
+            if (!_fence_edge_grid.add_polygon(boundary, num_points)) {
+                err_id = AP_OADijkstra_Error::DIJKSTRA_ERROR_OUT_OF_MEMORY;
+                return false;
             }
         }
     }
 
-    // determine if segment crosses any of the exclusion polygons
+    // add exclusion polygons
     for (uint8_t i = 0; i < fence->polyfence().get_exclusion_polygon_count(); i++) {
         const Vector2f* boundary = fence->polyfence().get_exclusion_polygon(i, num_points);
         if ((boundary != nullptr) && (num_points >= 3)) {
-            Vector2f intersection;
-            if (Polygon_intersects(boundary, num_points, seg_start, seg_end, intersection)) {
-                return true;
+            if (!_fence_edge_grid.add_polygon(boundary, num_points)) {
+                err_id = AP_OADijkstra_Error::DIJKSTRA_ERROR_OUT_OF_MEMORY;
+                return false;
             }
         }
     }
 
+    // if there is not enough memory for the grid, intersects_fence checks every edge
+    _fence_edge_grid.build();
+
+    return true;
+}
+
+// returns true if line segment intersects polygon or circular fence
+bool AP_OADijkstra::intersects_fence(const Vector2f &seg_start, const Vector2f &seg_end) const
+{
+    // return immediately if fence is not enabled
+    const AC_Fence *fence = AC_Fence::get_singleton();
+    if (fence == nullptr) {
+        return false;
+    }
+
+    // determine if segment crosses any of the inclusion or exclusion polygons
+    if (_fence_edge_grid.intersects(seg_start, seg_end)) {
+        return true;
+    }
+
     // determine if segment crosses any of the inclusion circles
     for (uint8_t i = 0; i < fence->polyfence().get_inclusion_circle_count(); i++) {
         Vector2f center_pos_cm;
@@ -640,6 +679,51 @@ bool AP_OADijkstra::create_fence_visgraph(AP_OADijkstra_Error &err_id)
         }
     }
 
+    // index visgraph by fence point for the shortest path search
+    if (!create_fence_visgraph_index()) {
+        err_id = AP_OADijkstra_Error::DIJKSTRA_ERROR_OUT_OF_MEMORY;
+        return false;
+    }
+
+    return true;
+}
+
+// create the index of the fence visgraph by fence point
+// returns false if out of memory
+bool AP_OADijkstra::create_fence_visgraph_index()
+{
+    const uint16_t num_points = total_numpoints();
+    const uint16_t num_items = _fence_visgraph.num_items();
+    if (!_fence_visgraph_start.expand_to_hold(num_points + 1) ||
+        !_fence_visgraph_index.expand_to_hold(num_items * 2)) {
+        return false;
+    }
+
+    // count items touching each point, with the count for point i held in _fence_visgraph_start[i+1]
+    for (uint16_t i = 0; i <= num_points; i++) {
+        _fence_visgraph_start[i] = 0;
+    }
+    for (uint16_t i = 0; i < num_items; i++) {
+        _fence_visgraph_start[_fence_visgraph[i].id1.id_num + 1]++;
+        _fence_visgraph_start[_fence_visgraph[i].id2.id_num + 1]++;
+    }
+
+    // turn counts into the start of each point's items
+    for (uint16_t i = 0; i < num_points; i++) {
+        _fence_visgraph_start[i+1] += _fence_visgraph_start[i];
+    }
+
+    // fill in each point's items using _fence_visgraph_start[i] as the next free slot of point i,
+    // which leaves it holding the start of point i+1
+    for (uint16_t i = 0; i < num_items; i++) {
+        _fence_visgraph_index[_fence_visgraph_start[_fence_visgraph[i].id1.id_num]++] = i;
+        _fence_visgraph_index[_fence_visgraph_start[_fence_visgraph[i].id2.id_num]++] = i;
+    }
+    for (uint16_t i = num_points; i > 0; i--) {
+        _fence_visgraph_start[i] = _fence_visgraph_start[i-1];
+    }
+    _fence_visgraph_start[0] = 0;
+
     return true;
 }
 
@@ -694,35 +778,62 @@ void AP_OADijkstra::update_visible_node_distances(node_index curr_node_idx)
     // get current node for convenience
     const ShortPathNode &curr_node = _short_path_data[curr_node_idx];
 
-    // for each visibility graph
-    const AP_OAVisGraph* visgraphs[] = {&_fence_visgraph, &_destination_visgraph};
-    for (uint8_t v=0; v<ARRAY_SIZE(visgraphs); v++) {
+    switch (curr_node.id.id_type) {
+    case AP_OAVisGraph::OATYPE_SOURCE:
+        // update nodes visible from source point, which may include the destination
+        for (uint16_t i = 0; i < _source_visgraph.num_items(); i++) {
+            node_index node_idx;
+            if (find_node_from_id(_source_visgraph[i].id2, node_idx)) {
+                update_node_distance(curr_node_idx, node_idx, _source_visgraph[i].distance_cm);
+            }
+        }
+        break;
 
-        // skip if empty
-        const AP_OAVisGraph &curr_visgraph = *visgraphs[v];
-        if (curr_visgraph.num_items() == 0) {
-            continue;
+    case AP_OAVisGraph::OATYPE_DESTINATION:
+        // search ends at the destination
+        break;
+
+    case AP_OAVisGraph::OATYPE_INTERMEDIATE_POINT: {
+        // update fence points visible from this fence point
+        const uint16_t start = _fence_visgraph_start[curr_node.id.id_num];
+        const uint16_t end = _fence_visgraph_start[curr_node.id.id_num + 1];
+        for (uint16_t i = start; i < end; i++) {
+            const AP_OAVisGraph::VisGraphItem &item = _fence_visgraph[_fence_visgraph_index[i]];
+            // match either end of the vector
+            const AP_OAVisGraph::OAItemID &matching_id = (curr_node.id == item.id1) ? item.id2 : item.id1;
+            node_index item_node_idx;
+            if (find_node_from_id(matching_id, item_node_idx)) {
+                update_node_distance(curr_node_idx, item_node_idx, item.distance_cm);
+            }
         }
 
-        // search visibility graph for items visible from current_node
-        for (uint16_t i = 0; i < curr_visgraph.num_items(); i++) {
-            const AP_OAVisGraph::VisGraphItem &item = curr_visgraph[i];
-            // match if current node's id matches either of the id's in the graph (i.e. either end of the vector)
-            if ((curr_node.id == item.id1) || (curr_node.id == item.id2)) {
-                AP_OAVisGraph::OAItemID matching_id = (curr_node.id == item.id1) ? item.id2 : item.id1;
-                // find item's id in node array
-                node_index item_node_idx;
-                if (find_node_from_id(matching_id, item_node_idx)) {
-                    // if current node's distance + distance to item is less than item's current distance, update item's distance
-                    const float dist_to_item_via_current_node = _short_path_data[curr_node_idx].distance_cm + item.distance_cm;
-                    if (dist_to_item_via_current_node < _short_path_data[item_node_idx].distance_cm) {
-                        // update item's distance and set "distance_from_idx" to current node's index
-                        _short_path_data[item_node_idx].distance_cm = dist_to_item_via_current_node;
-                        _short_path_data[item_node_idx].distance_from_idx = curr_node_idx;
-                    }
-                }
+        // update destination if visible
+        if (curr_node.destination_cm < FLT_MAX) {
+            node_index dest_node_idx;
+            if (find_node_from_id({AP_OAVisGraph::OATYPE_DESTINATION, 0}, dest_node_idx)) {
+                update_node_distance(curr_node_idx, dest_node_idx, curr_node.destination_cm);
             }
         }
+        break;
+    }
+    }
+}
+
+// update a node's distance if it is shorter to reach it via from_idx
+void AP_OADijkstra::update_node_distance(node_index from_idx, node_index node_idx, float distance_cm)
+{
+    ShortPathNode &node = _short_path_data[node_idx];
+    if (node.visited) {
+        return;
+    }
+
+    // if from node's distance + distance to node is less than node's current distance, update node's distance
+    const float dist_via_from_node = _short_path_data[from_idx].distance_cm + distance_cm;
+    if (dist_via_from_node < node.distance_cm) {
+        // update node's distance and set "distance_from_idx" to from node's index
+        node.distance_cm = dist_via_from_node;
+        node.distance_from_idx = from_idx;
+        heap_update(node_idx);
     }
 }
 
@@ -758,27 +869,79 @@ bool AP_OADijkstra::find_node_from_id(const AP_OAVisGraph::OAItemID &id, node_in
     return false;
 }
 
-// find index of node with lowest tentative distance (ignore visited nodes)
+// returns true if node a should be taken from heap before node b
+bool AP_OADijkstra::heap_before(node_index a, node_index b) const
+{
+    return (_short_path_data[a].distance_cm + _short_path_data[a].heuristic_cm) <
+           (_short_path_data[b].distance_cm + _short_path_data[b].heuristic_cm);
+}
+
+// add node to heap or move it up after its distance has been reduced
+void AP_OADijkstra::heap_update(node_index node_idx)
+{
+    uint16_t pos = _short_path_data[node_idx].heap_pos;
+    if (pos == OA_DIJKSTRA_NOT_IN_HEAP) {
+        pos = _heap_numpoints++;
+        _heap[pos] = node_idx;
+    }
+    heap_sift_up(pos);
+}
+
+// remove node with lowest distance plus heuristic from heap
 // returns true if successful and node_idx argument is updated
-bool AP_OADijkstra::find_closest_node_idx(node_index &node_idx) const
+bool AP_OADijkstra::heap_pop(node_index &node_idx)
 {
-    node_index lowest_idx = 0;
-    float lowest_dist = FLT_MAX;
+    if (_heap_numpoints == 0) {
+        return false;
+    }
+    node_idx = _heap[0];
+    _short_path_data[node_idx].heap_pos = OA_DIJKSTRA_NOT_IN_HEAP;
+    _heap_numpoints--;
+    if (_heap_numpoints > 0) {
+        _heap[0] = _heap[_heap_numpoints];
+        heap_sift_down(0);
+    }
+    return true;
+}
 
-    // scan through all nodes looking for closest
-    for (node_index i=0; i<_short_path_data_numpoints; i++) {
-        const ShortPathNode &node = _short_path_data[i];
-        if (!node.visited && (node.distance_cm < lowest_dist)) {
-            lowest_idx = i;
-            lowest_dist = node.distance_cm;
+// move node at heap position pos up to restore the heap order
+void AP_OADijkstra::heap_sift_up(uint16_t pos)
+{
+    const node_index node_idx = _heap[pos];
+    while (pos > 0) {
+        const uint16_t parent = (pos - 1) / 2;
+        if (!heap_before(node_idx, _heap[parent])) {
+            break;
         }
+        _heap[pos] = _heap[parent];
+        _short_path_data[_heap[pos]].heap_pos = pos;
+        pos = parent;
     }
+    _heap[pos] = node_idx;
+    _short_path_data[node_idx].heap_pos = pos;
+}
 
-    if (lowest_dist < FLT_MAX) {
-        node_idx = lowest_idx;
-        return true;
+// move node at heap position pos down to restore the heap order
+void AP_OADijkstra::heap_sift_down(uint16_t pos)
+{
+    const node_index node_idx = _heap[pos];
+    while (true) {
+        uint16_t child = pos * 2 + 1;
+        if (child >= _heap_numpoints) {
+            break;
+        }
+        if ((child + 1 < _heap_numpoints) && heap_before(_heap[child + 1], _heap[child])) {
+            child++;
+        }
+        if (!heap_before(_heap[child], node_idx)) {
+            break;
+        }
+        _heap[pos] = _heap[child];
+        _short_path_data[_heap[pos]].heap_pos = pos;
+        pos = child;
     }
-    return false;
+    _heap[pos] = node_idx;
+    _short_path_data[node_idx].heap_pos = pos;
 }
 
 // calculate shortest path from origin to destination
@@ -793,7 +956,12 @@ bool AP_OADijkstra::calc_shortest_path(const Location &origin, const Location &d
         err_id = AP_OADijkstra_Error::DIJKSTRA_ERROR_NO_POSITION_ESTIMATE;
         return false;
     }
+    return calc_shortest_path(origin_NE, destination_NE, err_id);
+}
 
+// calculate shortest path from origin to destination, as offsets (in cm) from the EKF origin
+bool AP_OADijkstra::calc_shortest_path(const Vector2f &origin_NE, const Vector2f &destination_NE, AP_OADijkstra_Error &err_id)
+{
     // create visgraphs of origin and destination to fence points
     if (!update_visgraph(_source_visgraph, {AP_OAVisGraph::OATYPE_SOURCE, 0}, origin_NE, true, destination_NE)) {
         err_id = AP_OADijkstra_Error::DIJKSTRA_ERROR_OUT_OF_MEMORY;
@@ -804,46 +972,49 @@ bool AP_OADijkstra::calc_shortest_path(const Location &origin, const Location &d
         return false;
     }
 
-    // expand _short_path_data if necessary
-    if (!_short_path_data.expand_to_hold(2 + total_numpoints())) {
+    // expand _short_path_data and _heap if necessary
+    if (!_short_path_data.expand_to_hold(2 + total_numpoints()) || !_heap.expand_to_hold(2 + total_numpoints())) {
         err_id = AP_OADijkstra_Error::DIJKSTRA_ERROR_OUT_OF_MEMORY;
         return false;
     }
 
-    // add origin and destination (node_type, id, visited, distance_from_idx, distance_cm) to short_path_data array
-    _short_path_data[0] = {{AP_OAVisGraph::OATYPE_SOURCE, 0}, false, 0, 0};
-    _short_path_data[1] = {{AP_OAVisGraph::OATYPE_DESTINATION, 0}, false, OA_DIJKSTRA_POLYGON_SHORTPATH_NOTSET_IDX, FLT_MAX};
+    // add origin and destination (node_type, id, visited, distance_from_idx, distance_cm, heuristic_cm, destination_cm, heap_pos) to short_path_data array
+    _short_path_data[0] = {{AP_OAVisGraph::OATYPE_SOURCE, 0}, false, 0, 0, (destination_NE - origin_NE).length(), FLT_MAX, OA_DIJKSTRA_NOT_IN_HEAP};
+    _short_path_data[1] = {{AP_OAVisGraph::OATYPE_DESTINATION, 0}, false, OA_DIJKSTRA_POLYGON_SHORTPATH_NOTSET_IDX, FLT_MAX, 0, 0, OA_DIJKSTRA_NOT_IN_HEAP};
     _short_path_data_numpoints = 2;
 
-    // add all inclusion and exclusion fence points to short_path_data array (node_type, id, visited, distance_from_idx, distance_cm)
+    // add all inclusion and exclusion fence points to short_path_data array
     for (uint8_t i=0; i<total_numpoints(); i++) {
-        _short_path_data[_short_path_data_numpoints++] = {{AP_OAVisGraph::OATYPE_INTERMEDIATE_POINT, i}, false, OA_DIJKSTRA_POLYGON_SHORTPATH_NOTSET_IDX, FLT_MAX};
+        Vector2f point;
+        const float heuristic_cm = get_point(i, point) ? (destination_NE - point).length() : 0;
+        _short_path_data[_short_path_data_numpoints++] = {{AP_OAVisGraph::OATYPE_INTERMEDIATE_POINT, i}, false, OA_DIJKSTRA_POLYGON_SHORTPATH_NOTSET_IDX, FLT_MAX, heuristic_cm, FLT_MAX, OA_DIJKSTRA_NOT_IN_HEAP};
     }
 
-    // start algorithm from source point
-    node_index current_node_idx = 0;
-
-    // update nodes visible from source point
-    for (uint16_t i = 0; i < _source_visgraph.num_items(); i++) {
+    // record distance to destination of fence points visible from destination
+    for (uint16_t i = 0; i < _destination_visgraph.num_items(); i++) {
         node_index node_idx;
-        if (find_node_from_id(_source_visgraph[i].id2, node_idx)) {
-            _short_path_data[node_idx].distance_cm = _source_visgraph[i].distance_cm;
-            _short_path_data[node_idx].distance_from_idx = current_node_idx;
-        } else {
-            err_id = AP_OADijkstra_Error::DIJKSTRA_ERROR_COULD_NOT_FIND_PATH;
-            return false;
+        if (find_node_from_id(_destination_visgraph[i].id2, node_idx)) {
+            _short_path_data[node_idx].destination_cm = _destination_visgraph[i].distance_cm;
         }
     }
-    // mark source node as visited
-    _short_path_data[current_node_idx].visited = true;
-
-    // move current_node_idx to node with lowest distance
-    while (find_closest_node_idx(current_node_idx)) {
-        // update distances to all neighbours of current node
-        update_visible_node_distances(current_node_idx);
 
+    // start algorithm from source point and always move to the node with the lowest
+    // distance from the source plus straight line distance to the destination.  The
+    // straight line distance is never more than the remaining path so the search can
+    // stop once the destination is reached
+    _heap_numpoints = 0;
+    heap_update(0);
+    node_index current_node_idx;
+    while (heap_pop(current_node_idx)) {
         // mark current node as visited
         _short_path_data[current_node_idx].visited = true;
+
+        if (_short_path_data[current_node_idx].id.id_type == AP_OAVisGraph::OATYPE_DESTINATION) {
+            break;
+        }
+
+        // update distances to all neighbours of current node
+        update_visible_node_distances(current_node_idx);
     }
 
     // extract path starting from destination
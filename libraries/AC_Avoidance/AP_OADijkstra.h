@@ -5,12 +5,15 @@
 #include <AP_Math/AP_Math.h>
 #include <AP_HAL/AP_HAL.h>
 #include "AP_OAVisGraph.h"
+#include "AP_OAEdgeGrid.h"
 
 /*
- * Dijkstra's algorithm for path planning around polygon fence
+ * Dijkstra's algorithm for path planning around polygon fence.
+ * The search is run as A* using the straight line distance to the destination as the heuristic
  */
 
 class AP_OADijkstra {
+    friend class AP_OADijkstra_Test;
 public:
 
     AP_OADijkstra();
@@ -103,6 +106,10 @@ private:
     // also returns the type of point
     bool get_point(uint16_t index, Vector2f& point) const;
 
+    // create grid of inclusion and exclusion polygon edges used by intersects_fence
+    // returns true on success.  returns false on failure and err_id is updated
+    bool create_fence_edge_grid(AP_OADijkstra_Error &err_id);
+
     // returns true if line segment intersects polygon or circular fence
     bool intersects_fence(const Vector2f &seg_start, const Vector2f &seg_end) const;
 
@@ -115,11 +122,13 @@ private:
     // requires create_polygon_fence_with_margin and create_polygon_fence_visgraph to have been run
     // resulting path is stored in _shortest_path array as vector offsets from EKF origin
     bool calc_shortest_path(const Location &origin, const Location &destination, AP_OADijkstra_Error &err_id);
+    bool calc_shortest_path(const Vector2f &origin_NE, const Vector2f &destination_NE, AP_OADijkstra_Error &err_id);
 
     // shortest path state variables
     bool _inclusion_polygon_with_margin_ok;
     bool _exclusion_polygon_with_margin_ok;
     bool _exclusion_circle_with_margin_ok;
+    bool _fence_edge_grid_ok;
     bool _polyfence_visgraph_ok;
     bool _shortest_path_ok;
 
@@ -142,11 +151,23 @@ private:
     uint8_t _exclusion_circle_numpoints;    // number of points held in above array
     uint32_t _exclusion_circle_update_ms;   // system time exclusion circles were updated (used to detect changes)
 
+    // grid of inclusion and exclusion polygon edges
+    AP_OAEdgeGrid _fence_edge_grid;
+
     // visibility graphs
     AP_OAVisGraph _fence_visgraph;          // holds distances between all inclusion/exclusion fence points (with margin)
     AP_OAVisGraph _source_visgraph;         // holds distances from source point to all other nodes
     AP_OAVisGraph _destination_visgraph;    // holds distances from the destination to all other nodes
 
+    // index of the fence visgraph by fence point. The visgraph items touching fence point i are
+    // _fence_visgraph_index[_fence_visgraph_start[i]] to _fence_visgraph_index[_fence_visgraph_start[i+1]-1]
+    AP_ExpandingArray<uint16_t> _fence_visgraph_start;
+    AP_ExpandingArray<uint16_t> _fence_visgraph_index;
+
+    // create the index of the fence visgraph by fence point
+    // returns false if out of memory
+    bool create_fence_visgraph_index();
+
     // updates visibility graph for a given position which is an offset (in cm) from the ekf origin
     // to add an additional position (i.e. the destination) set add_extra_position = true and provide the position in the extra_position argument
     // requires create_polygon_fence_with_margin to have been run
@@ -159,6 +180,9 @@ private:
         bool visited;                   // true if all this node's neighbour's distances have been updated
         node_index distance_from_idx;   // index into _short_path_data from where distance was updated (or 255 if not set)
         float distance_cm;              // distance from source (number is tentative until this node is the current node and/or visited = true)
+        float heuristic_cm;             // straight line distance to destination
+        float destination_cm;           // distance to destination if visible from this node, FLT_MAX if not
+        uint16_t heap_pos;              // position in _heap or OA_DIJKSTRA_NOT_IN_HEAP
     };
     AP_ExpandingArray<ShortPathNode> _short_path_data;
     node_index _short_path_data_numpoints;  // number of elements in _short_path_data array
@@ -167,13 +191,30 @@ private:
     // curr_node_idx is an index into the _short_path_data array
     void update_visible_node_distances(node_index curr_node_idx);
 
+    // update a node's distance if it is shorter to reach it via from_idx
+    void update_node_distance(node_index from_idx, node_index node_idx, float distance_cm);
+
     // find a node's index into _short_path_data array from it's id (i.e. id type and id number)
     // returns true if successful and node_idx is updated
     bool find_node_from_id(const AP_OAVisGraph::OAItemID &id, node_index &node_idx) const;
 
-    // find index of node with lowest tentative distance (ignore visited nodes)
+    // binary heap of unvisited nodes with a tentative distance, ordered by distance plus heuristic
+    AP_ExpandingArray<node_index> _heap;
+    uint16_t _heap_numpoints;               // number of nodes in _heap
+
+    // add node to heap or move it up after its distance has been reduced
+    void heap_update(node_index node_idx);
+
+    // remove node with lowest distance plus heuristic from heap
     // returns true if successful and node_idx argument is updated
-    bool find_closest_node_idx(node_index &node_idx) const;
+    bool heap_pop(node_index &node_idx);
+
+    // move node at heap position pos up or down to restore the heap order
+    void heap_sift_up(uint16_t pos);
+    void heap_sift_down(uint16_t pos);
+
+    // returns true if node a should be taken from heap before node b
+    bool heap_before(node_index a, node_index b) const;
 
     // final path variables and functions
     AP_ExpandingArray<AP_OAVisGraph::OAItemID> _path;   // ids of points on return path in reverse order (i.e. destination is first element)
@@ -0,0 +1,284 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AP_OAEdgeGrid.h"
+
+#define OA_EDGEGRID_EXPANDING_ARRAY_ELEMENTS_PER_CHUNK  32  // edges array grows in increments of 32 elements
+#define OA_EDGEGRID_CELLS_MAX                           64  // maximum number of rows and columns
+#define OA_EDGEGRID_CELL_MARGIN_RATIO                   0.01f
+
+// constructor
+AP_OAEdgeGrid::AP_OAEdgeGrid() :
+    _edges(OA_EDGEGRID_EXPANDING_ARRAY_ELEMENTS_PER_CHUNK)
+{
+}
+
+AP_OAEdgeGrid::~AP_OAEdgeGrid()
+{
+    clear();
+}
+
+// remove all edges
+void AP_OAEdgeGrid::clear()
+{
+    _num_edges = 0;
+    delete[] _cell_start;
+    delete[] _cell_edges;
+    _cell_start = nullptr;
+    _cell_edges = nullptr;
+}
+
+// add the edges of a polygon. The boundary may be closed or unclosed
+// returns false if out of memory
+bool AP_OAEdgeGrid::add_polygon(const Vector2f *boundary, uint16_t num_points)
+{
+    if (Polygon_complete(boundary, num_points)) {
+        // if the last point is the same as the first point
+        // treat as if the last point wasn't passed in
+        num_points--;
+    }
+    if ((uint32_t)_num_edges + num_points > UINT16_MAX) {
+        return false;
+    }
+    if (!_edges.expand_to_hold(_num_edges + num_points)) {
+        return false;
+    }
+    for (uint16_t i = 0; i < num_points; i++) {
+        const uint16_t j = (i == num_points-1) ? 0 : i+1;
+        _edges[_num_edges++] = {boundary[i], boundary[j]};
+    }
+    return true;
+}
+
+// build the grid once all polygons have been added
+// returns false if out of memory, in which case intersects() checks every edge
+bool AP_OAEdgeGrid::build()
+{
+    delete[] _cell_start;
+    delete[] _cell_edges;
+    _cell_start = nullptr;
+    _cell_edges = nullptr;
+
+    if (_num_edges == 0) {
+        return true;
+    }
+
+    // find extent of edges
+    Vector2f corner_max = _edges[0].start;
+    _corner = _edges[0].start;
+    for (uint16_t i = 0; i < _num_edges; i++) {
+        const Vector2f pts[] = {_edges[i].start, _edges[i].end};
+        for (const Vector2f &pt : pts) {
+            _corner.x = MIN(_corner.x, pt.x);
+            _corner.y = MIN(_corner.y, pt.y);
+            corner_max.x = MAX(corner_max.x, pt.x);
+            corner_max.y = MAX(corner_max.y, pt.y);
+        }
+    }
+
+    // aim for about one edge per cell
+    const float width = corner_max.x - _corner.x;
+    const float height = corner_max.y - _corner.y;
+    _cell_size = sqrtf(width * height / _num_edges);
+    _cell_size = MAX(_cell_size, MAX(width, height) / OA_EDGEGRID_CELLS_MAX);
+    _cell_size = MAX(_cell_size, 1.0f);
+    _cell_margin = _cell_size * OA_EDGEGRID_CELL_MARGIN_RATIO;
+    _num_rows = MIN(uint16_t(width / _cell_size) + 1, OA_EDGEGRID_CELLS_MAX);
+    _num_columns = MIN(uint16_t(height / _cell_size) + 1, OA_EDGEGRID_CELLS_MAX);
+    const uint16_t num_cells = _num_rows * _num_columns;
+
+    // count edges in each cell, with the count for cell n held in _cell_start[n+1]
+    _cell_start = new uint16_t[num_cells + 1];
+    if (_cell_start == nullptr) {
+        return false;
+    }
+    memset(_cell_start, 0, (num_cells + 1) * sizeof(_cell_start[0]));
+    uint32_t total = 0;
+    for (uint16_t i = 0; i < _num_edges; i++) {
+        uint8_t row_min, row_max;
+        if (!get_rows(_edges[i].start, _edges[i].end, row_min, row_max)) {
+            continue;
+        }
+        for (uint8_t r = row_min; r <= row_max; r++) {
+            uint8_t col_min, col_max;
+            if (get_columns(_edges[i].start, _edges[i].end, r, col_min, col_max)) {
+                for (uint8_t c = col_min; c <= col_max; c++) {
+                    _cell_start[r * _num_columns + c + 1]++;
+                    total++;
+                }
+            }
+        }
+    }
+    if (total > UINT16_MAX) {
+        delete[] _cell_start;
+        _cell_start = nullptr;
+        return false;
+    }
+    _cell_edges = new uint16_t[total];
+    if (_cell_edges == nullptr) {
+        delete[] _cell_start;
+        _cell_start = nullptr;
+        return false;
+    }
+
+    // turn counts into the start of each cell
+    for (uint16_t n = 0; n < num_cells; n++) {
+        _cell_start[n+1] += _cell_start[n];
+    }
+
+    // fill in each cell's edges using _cell_start[n] as the next free slot of cell n,
+    // which leaves it holding the start of cell n+1
+    for (uint16_t i = 0; i < _num_edges; i++) {
+        uint8_t row_min, row_max;
+        if (!get_rows(_edges[i].start, _edges[i].end, row_min, row_max)) {
+            continue;
+        }
+        for (uint8_t r = row_min; r <= row_max; r++) {
+            uint8_t col_min, col_max;
+            if (get_columns(_edges[i].start, _edges[i].end, r, col_min, col_max)) {
+                for (uint8_t c = col_min; c <= col_max; c++) {
+                    _cell_edges[_cell_start[r * _num_columns + c]++] = i;
+                }
+            }
+        }
+    }
+    for (uint16_t n = num_cells; n > 0; n--) {
+        _cell_start[n] = _cell_start[n-1];
+    }
+    _cell_start[0] = 0;
+
+    return true;
+}
+
+// returns true if the line segment crosses any edge
+bool AP_OAEdgeGrid::intersects(const Vector2f &seg_start, const Vector2f &seg_end) const
+{
+    if (_cell_start == nullptr) {
+        // no grid so check every edge
+        for (uint16_t i = 0; i < _num_edges; i++) {
+            if (edge_intersects(i, seg_start, seg_end)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // check the edges of the cells the segment passes through. An edge in several
+    // of these cells may be checked more than once which is cheaper than tracking
+    // which edges have been checked
+    uint8_t row_min, row_max;
+    if (!get_rows(seg_start, seg_end, row_min, row_max)) {
+        return false;
+    }
+    for (uint8_t r = row_min; r <= row_max; r++) {
+        uint8_t col_min, col_max;
+        if (!get_columns(seg_start, seg_end, r, col_min, col_max)) {
+            continue;
+        }
+        for (uint8_t c = col_min; c <= col_max; c++) {
+            const uint16_t cell = r * _num_columns + c;
+            for (uint16_t k = _cell_start[cell]; k < _cell_start[cell+1]; k++) {
+                if (edge_intersects(_cell_edges[k], seg_start, seg_end)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// returns true if the line segment crosses edge "index"
+bool AP_OAEdgeGrid::edge_intersects(uint16_t index, const Vector2f &seg_start, const Vector2f &seg_end) const
+{
+    const Vector2f &v1 = _edges[index].start;
+    const Vector2f &v2 = _edges[index].end;
+
+    // optimisations for common cases as in Polygon_intersects
+    if (v1.x > seg_start.x && v2.x > seg_start.x && v1.x > seg_end.x && v2.x > seg_end.x) {
+        return false;
+    }
+    if (v1.y > seg_start.y && v2.y > seg_start.y && v1.y > seg_end.y && v2.y > seg_end.y) {
+        return false;
+    }
+    if (v1.x < seg_start.x && v2.x < seg_start.x && v1.x < seg_end.x && v2.x < seg_end.x) {
+        return false;
+    }
+    if (v1.y < seg_start.y && v2.y < seg_start.y && v1.y < seg_end.y && v2.y < seg_end.y) {
+        return false;
+    }
+    Vector2f intersection;
+    return Vector2f::segment_intersection(v1, v2, seg_start, seg_end, intersection);
+}
+
+// get the range of rows the segment passes through
+// returns false if the segment misses the grid
+bool AP_OAEdgeGrid::get_rows(const Vector2f &seg_start, const Vector2f &seg_end, uint8_t &row_min, uint8_t &row_max) const
+{
+    const float x_min = MIN(seg_start.x, seg_end.x) - _corner.x - _cell_margin;
+    const float x_max = MAX(seg_start.x, seg_end.x) - _corner.x + _cell_margin;
+    if ((x_max < 0) || (x_min > _num_rows * _cell_size)) {
+        return false;
+    }
+    row_min = get_cell(x_min, _num_rows);
+    row_max = get_cell(x_max, _num_rows);
+    return true;
+}
+
+// get the range of columns the segment passes through within a row
+// returns false if the segment misses the row
+bool AP_OAEdgeGrid::get_columns(const Vector2f &seg_start, const Vector2f &seg_end, uint8_t row, uint8_t &col_min, uint8_t &col_max) const
+{
+    // clip the segment to the row, including the margins
+    const float row_x_min = _corner.x + row * _cell_size - _cell_margin;
+    const float row_x_max = row_x_min + _cell_size + 2 * _cell_margin;
+    const Vector2f seg = seg_end - seg_start;
+    float t_min = 0;
+    float t_max = 1;
+    if (is_zero(seg.x)) {
+        if ((seg_start.x < row_x_min) || (seg_start.x > row_x_max)) {
+            return false;
+        }
+    } else {
+        float t1 = (row_x_min - seg_start.x) / seg.x;
+        float t2 = (row_x_max - seg_start.x) / seg.x;
+        if (t1 > t2) {
+            const float tmp = t1;
+            t1 = t2;
+            t2 = tmp;
+        }
+        t_min = MAX(t_min, t1);
+        t_max = MIN(t_max, t2);
+        if (t_min > t_max) {
+            return false;
+        }
+    }
+
+    const float y1 = seg_start.y + seg.y * t_min - _corner.y;
+    const float y2 = seg_start.y + seg.y * t_max - _corner.y;
+    const float y_min = MIN(y1, y2) - _cell_margin;
+    const float y_max = MAX(y1, y2) + _cell_margin;
+    if ((y_max < 0) || (y_min > _num_columns * _cell_size)) {
+        return false;
+    }
+    col_min = get_cell(y_min, _num_columns);
+    col_max = get_cell(y_max, _num_columns);
+    return true;
+}
+
+// get the row or column holding an offset from the grid's corner
+uint8_t AP_OAEdgeGrid::get_cell(float ofs, uint8_t num_cells) const
+{
+    return constrain_float(floorf(ofs / _cell_size), 0, num_cells - 1);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <AP_Common/AP_Common.h>
+#include <AP_Common/AP_ExpandingArray.h>
+#include <AP_HAL/AP_HAL.h>
+#include <AP_Math/AP_Math.h>
+
+/*
+ * Uniform grid over the edges of polygon fences, used to check whether a line segment crosses
+ * any of the edges without testing every edge. Each cell holds the edges passing through it so
+ * a check only tests the edges in the cells the segment passes through
+ */
+class AP_OAEdgeGrid {
+    friend class AP_OAEdgeGrid_Test;
+public:
+    AP_OAEdgeGrid();
+    ~AP_OAEdgeGrid();
+
+    /* Do not allow copies */
+    AP_OAEdgeGrid(const AP_OAEdgeGrid &other) = delete;
+    AP_OAEdgeGrid &operator=(const AP_OAEdgeGrid&) = delete;
+
+    // remove all edges
+    void clear();
+
+    // add the edges of a polygon. The boundary may be closed or unclosed
+    // returns false if out of memory
+    bool add_polygon(const Vector2f *boundary, uint16_t num_points);
+
+    // build the grid once all polygons have been added
+    // returns false if out of memory, in which case intersects() checks every edge
+    bool build();
+
+    // returns true if the line segment crosses any edge
+    bool intersects(const Vector2f &seg_start, const Vector2f &seg_end) const;
+
+    // get number of edges
+    uint16_t num_edges() const { return _num_edges; }
+
+private:
+
+    struct Edge {
+        Vector2f start;
+        Vector2f end;
+    };
+
+    // returns true if the line segment crosses edge "index"
+    bool edge_intersects(uint16_t index, const Vector2f &seg_start, const Vector2f &seg_end) const;
+
+    // get the range of rows the segment passes through
+    // returns false if the segment misses the grid
+    bool get_rows(const Vector2f &seg_start, const Vector2f &seg_end, uint8_t &row_min, uint8_t &row_max) const;
+
+    // get the range of columns the segment passes through within a row
+    // returns false if the segment misses the row
+    bool get_columns(const Vector2f &seg_start, const Vector2f &seg_end, uint8_t row, uint8_t &col_min, uint8_t &col_max) const;
+
+    // get the row or column holding an offset from the grid's corner
+    uint8_t get_cell(float ofs, uint8_t num_cells) const;
+
+    AP_ExpandingArray<Edge> _edges;
+    uint16_t _num_edges;
+
+    Vector2f _corner;           // corner of the grid with the lowest x and y
+    float _cell_size;           // length of the cells' sides
+    float _cell_margin;         // cells are treated as this much larger on each side so edges along a cell boundary are in both cells
+    uint8_t _num_rows;
+    uint8_t _num_columns;
+    uint16_t *_cell_start = nullptr;  // index into _cell_edges of the first edge of each cell, plus one past the end of the last cell
+    uint16_t *_cell_edges = nullptr;  // edge indexes of each cell in turn
+};
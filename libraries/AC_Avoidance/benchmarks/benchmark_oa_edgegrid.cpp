@@ -0,0 +1,115 @@
+#include <AP_gbenchmark.h>
+
+#include <stdlib.h>
+
+#include <AP_Math/AP_Math.h>
+#include <AC_Avoidance/AP_OAEdgeGrid.h>
+
+/*
+  cost of building the visibility graph of a fence, checking the line
+  between every pair of fence points against every fence edge, as
+  AP_OADijkstra does. The fence is a 250 point inclusion polygon with
+  40 square exclusion zones inside it
+ */
+
+#define NUM_INCLUSION_POINTS 250
+#define NUM_EXCLUSION_ZONES  40
+#define NUM_POINTS           (NUM_INCLUSION_POINTS + NUM_EXCLUSION_ZONES * 4)
+
+static Vector2f inclusion[NUM_INCLUSION_POINTS];
+static Vector2f exclusion[NUM_EXCLUSION_ZONES][4];
+static Vector2f points[NUM_POINTS];
+static AP_OAEdgeGrid edge_grid;
+
+static float rand_float(float min, float max)
+{
+    return min + (max - min) * (float(random()) / RAND_MAX);
+}
+
+static void setup_fence(void)
+{
+    static bool done;
+    if (done) {
+        return;
+    }
+    done = true;
+
+    srandom(1);
+    uint16_t n = 0;
+    for (uint16_t i=0; i<NUM_INCLUSION_POINTS; i++) {
+        const float angle = -M_2PI * i / NUM_INCLUSION_POINTS;
+        const float radius = rand_float(85000, 100000);
+        inclusion[i] = Vector2f(radius * cosf(angle), radius * sinf(angle));
+        // fence points are just inside the inclusion polygon
+        points[n++] = inclusion[i] * 0.98f;
+    }
+    for (uint16_t i=0; i<NUM_EXCLUSION_ZONES; i++) {
+        const Vector2f center(rand_float(-60000, 60000), rand_float(-60000, 60000));
+        const float size = rand_float(1000, 5000);
+        exclusion[i][0] = center + Vector2f(-size, -size);
+        exclusion[i][1] = center + Vector2f(size, -size);
+        exclusion[i][2] = center + Vector2f(size, size);
+        exclusion[i][3] = center + Vector2f(-size, size);
+        for (uint8_t j=0; j<4; j++) {
+            // fence points are just outside the exclusion polygon
+            points[n++] = center + (exclusion[i][j] - center) * 1.2f;
+        }
+    }
+
+    edge_grid.add_polygon(inclusion, NUM_INCLUSION_POINTS);
+    for (uint16_t i=0; i<NUM_EXCLUSION_ZONES; i++) {
+        edge_grid.add_polygon(exclusion[i], 4);
+    }
+    edge_grid.build();
+}
+
+static void BM_VisGraphPolygonIntersects(benchmark::State& state)
+{
+    setup_fence();
+    while (state.KeepRunning()) {
+        uint32_t visible = 0;
+        for (uint16_t i=0; i<NUM_POINTS-1; i++) {
+            for (uint16_t j=i+1; j<NUM_POINTS; j++) {
+                Vector2f intersection;
+                bool intersects = Polygon_intersects(inclusion, NUM_INCLUSION_POINTS, points[i], points[j], intersection);
+                for (uint16_t k=0; k<NUM_EXCLUSION_ZONES && !intersects; k++) {
+                    intersects = Polygon_intersects(exclusion[k], 4, points[i], points[j], intersection);
+                }
+                if (!intersects) {
+                    visible++;
+                }
+            }
+        }
+        gbenchmark_escape(&visible);
+    }
+}
+
+static void BM_VisGraphEdgeGrid(benchmark::State& state)
+{
+    setup_fence();
+    while (state.KeepRunning()) {
+        uint32_t visible = 0;
+        for (uint16_t i=0; i<NUM_POINTS-1; i++) {
+            for (uint16_t j=i+1; j<NUM_POINTS; j++) {
+                if (!edge_grid.intersects(points[i], points[j])) {
+                    visible++;
+                }
+            }
+        }
+        gbenchmark_escape(&visible);
+    }
+}
+
+static void BM_EdgeGridBuild(benchmark::State& state)
+{
+    setup_fence();
+    while (state.KeepRunning()) {
+        edge_grid.build();
+    }
+}
+
+BENCHMARK(BM_VisGraphPolygonIntersects);
+BENCHMARK(BM_VisGraphEdgeGrid);
+BENCHMARK(BM_EdgeGridBuild);
+
+BENCHMARK_MAIN()
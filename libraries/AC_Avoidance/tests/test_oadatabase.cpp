@@ -0,0 +1,212 @@
+#include <AP_gtest.h>
+
+#include <stdlib.h>
+#include <vector>
+
+#include <AC_Avoidance/AP_OADatabase.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+#if !HAL_MINIMIZE_FEATURES
+
+/*
+  check the spatial index queries of the object avoidance database
+  against a scan of every item. Items are scattered over an area many
+  grid cells across, with some either side of cell boundaries
+ */
+
+// the database is a singleton, so the tests share one and run in order
+static AP_OADatabase db;
+static Location home;
+
+#define CELL_M 10.0f
+#define AREA_M 200.0f
+
+static float rand_float(float min, float max)
+{
+    return min + (max - min) * (float(random()) / RAND_MAX);
+}
+
+static Location offset_loc(float north, float east)
+{
+    Location loc = home;
+    loc.offset(north, east);
+    return loc;
+}
+
+// offset of a location from home, as the database sees it
+static Vector2f ne(const Location &loc)
+{
+    return home.get_distance_NE(loc);
+}
+
+static Vector2f item_pos(uint16_t i)
+{
+    return ne(db.get_item(i).loc);
+}
+
+static void push(const Location &loc)
+{
+    db.queue_push(loc, AP_HAL::millis(), 0, 0);
+    while (db.process_queue()) {
+    }
+}
+
+// closest item to a segment by checking every item
+static float linear_closest(const Vector2f &start, const Vector2f &end)
+{
+    float closest = FLT_MAX;
+    for (uint16_t i=0; i<db.database_count(); i++) {
+        closest = MIN(closest, Vector2f::closest_distance_between_line_and_point(start, end, item_pos(i)));
+    }
+    return closest;
+}
+
+static void check_radius_queries(uint16_t num_queries)
+{
+    for (uint16_t q=0; q<num_queries; q++) {
+        const Location loc = offset_loc(rand_float(-AREA_M/2, AREA_M/2), rand_float(-AREA_M/2, AREA_M/2));
+        const Vector2f pos = ne(loc);
+        const float radius = rand_float(0.1f, 3 * CELL_M);
+        const float closest = linear_closest(pos, pos);
+        if (fabsf(closest - radius) < 0.001f) {
+            // too close to call with float rounding
+            continue;
+        }
+        uint16_t index;
+        const bool found = db.find_closest_item(loc, radius, index);
+        ASSERT_EQ(found, closest < radius) << "query " << q << " closest " << closest << " radius " << radius;
+        if (found) {
+            EXPECT_NEAR((item_pos(index) - pos).length(), closest, 0.001f);
+        }
+    }
+}
+
+static void check_segment_queries(uint16_t num_queries)
+{
+    for (uint16_t q=0; q<num_queries; q++) {
+        Vector2f start(rand_float(-AREA_M/2, AREA_M/2), rand_float(-AREA_M/2, AREA_M/2));
+        Vector2f end;
+        switch (q % 3) {
+        case 0:
+            // short segments, as BendyRuler checks
+            end = start + Vector2f(rand_float(-5, 5), rand_float(-5, 5));
+            break;
+        case 1:
+            // long segments across many cells
+            end = Vector2f(rand_float(-AREA_M/2, AREA_M/2), rand_float(-AREA_M/2, AREA_M/2));
+            break;
+        default:
+            // segments well outside the items, where the search widens
+            start *= 5;
+            end = start + Vector2f(rand_float(-50, 50), rand_float(-50, 50));
+            break;
+        }
+        const Location start_loc = offset_loc(start.x, start.y);
+        const Location end_loc = offset_loc(end.x, end.y);
+        float distance;
+        ASSERT_TRUE(db.get_closest_distance_to_segment(start_loc, end_loc, distance));
+        EXPECT_NEAR(distance, linear_closest(ne(start_loc), ne(end_loc)), 0.001f) << "query " << q;
+    }
+}
+
+class OADatabaseTest : public ::testing::Test {
+protected:
+    static void SetUpTestCase() {
+        AP_Param::set_object_value(&db, db.var_info, "SIZE", 2000);
+        AP_Param::set_object_value(&db, db.var_info, "QUEUE_SIZE", 200);
+        db.init();
+        home.lat = -353632610;
+        home.lng = 1491652300;
+    }
+};
+
+TEST_F(OADatabaseTest, Empty)
+{
+    ASSERT_TRUE(db.healthy());
+    uint16_t index;
+    float distance;
+    EXPECT_FALSE(db.find_closest_item(home, 100, index));
+    EXPECT_FALSE(db.get_closest_distance_to_segment(home, offset_loc(10, 10), distance));
+}
+
+TEST_F(OADatabaseTest, Queries)
+{
+    srandom(17);
+
+    // the first item is the grid origin, so cell boundaries fall on
+    // multiples of CELL_M from home
+    push(home);
+    for (int8_t n=-5; n<=5; n++) {
+        for (int8_t e=-5; e<=5; e++) {
+            push(offset_loc(n * CELL_M - 0.15f, e * CELL_M + 0.15f));
+            push(offset_loc(n * CELL_M + 0.15f, e * CELL_M - 0.15f));
+        }
+    }
+    while (db.database_count() < 1500) {
+        push(offset_loc(rand_float(-AREA_M/2, AREA_M/2), rand_float(-AREA_M/2, AREA_M/2)));
+    }
+
+    check_radius_queries(3000);
+    check_segment_queries(3000);
+
+    // queries centred on and around cell boundaries
+    for (int8_t n=-3; n<=3; n++) {
+        for (int8_t e=-3; e<=3; e++) {
+            const Location corner = offset_loc(n * CELL_M, e * CELL_M);
+            const float closest = linear_closest(ne(corner), ne(corner));
+            for (float radius : { 0.1f, 0.2f, 0.3f, 5.0f }) {
+                if (fabsf(closest - radius) < 0.001f) {
+                    continue;
+                }
+                uint16_t index;
+                EXPECT_EQ(db.find_closest_item(corner, radius, index), closest < radius);
+            }
+            // along a cell boundary, just inside the cells to the west
+            const Location start = offset_loc(n * CELL_M, e * CELL_M - 0.01f);
+            const Location end = offset_loc(n * CELL_M + CELL_M * 0.5f, e * CELL_M - 0.01f);
+            float distance;
+            ASSERT_TRUE(db.get_closest_distance_to_segment(start, end, distance));
+            EXPECT_NEAR(distance, linear_closest(ne(start), ne(end)), 0.001f);
+        }
+    }
+}
+
+TEST_F(OADatabaseTest, Removal)
+{
+    srandom(18);
+    ASSERT_GT(db.database_count(), 1000);
+
+    // items not refreshed grow until they are removed, which moves the
+    // last item into their place
+    for (uint8_t i=0; i<20; i++) {
+        db.update();
+    }
+    std::vector<Location> kept;
+    for (uint16_t i=0; i<db.database_count(); i++) {
+        if (random() % 3 == 0) {
+            kept.push_back(db.get_item(i).loc);
+        }
+    }
+    for (const Location &loc : kept) {
+        push(loc);
+    }
+    for (uint8_t i=0; i<25; i++) {
+        db.update();
+    }
+    ASSERT_EQ(db.database_count(), kept.size());
+
+    // each remaining item is still in the grid, under its new index
+    for (const Location &loc : kept) {
+        uint16_t index;
+        ASSERT_TRUE(db.find_closest_item(loc, 0.05f, index));
+        EXPECT_NEAR(db.get_item(index).loc.get_distance(loc), 0, 0.01f);
+    }
+
+    check_radius_queries(2000);
+    check_segment_queries(2000);
+}
+
+#endif // !HAL_MINIMIZE_FEATURES
+
+AP_GTEST_MAIN()
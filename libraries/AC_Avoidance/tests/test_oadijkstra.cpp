@@ -0,0 +1,210 @@
+#include <AP_gtest.h>
+
+#include <stdlib.h>
+#include <vector>
+
+#include <AC_Avoidance/AP_OADijkstra.h>
+#include <AC_Fence/AC_Fence.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+// the planner only checks the fence is there. Its polygons are put
+// straight into the planner, with no fences loaded
+static AC_Fence fence;
+
+/*
+  check the lengths of the paths found by the A* search against a
+  plain Dijkstra search over every pair of points. The fence is an
+  inclusion polygon with square exclusion polygons inside it, in cm
+  from the EKF origin
+ */
+class AP_OADijkstra_Test {
+public:
+    typedef AP_OADijkstra::AP_OADijkstra_Error Error;
+
+    // allocated so that, as for the vehicle's instance, it starts zeroed
+    AP_OADijkstra_Test() :
+        oa(*new AP_OADijkstra())
+    {
+    }
+
+    ~AP_OADijkstra_Test() {
+        delete &oa;
+    }
+
+    static float rand_float(float min, float max) {
+        return min + (max - min) * (float(random()) / RAND_MAX);
+    }
+
+    /*
+      make a fence, with the planner's points just inside the
+      inclusion polygon and just outside the exclusion polygons as
+      create_inclusion_polygon_with_margin and
+      create_exclusion_polygon_with_margin make them
+     */
+    void make_fence(uint8_t num_inclusion_points, uint8_t num_exclusion_zones) {
+        std::vector<Vector2f> inclusion;
+        for (uint8_t i=0; i<num_inclusion_points; i++) {
+            const float angle = -M_2PI * i / num_inclusion_points;
+            const float radius = rand_float(60000, 100000);
+            inclusion.push_back(Vector2f(radius * cosf(angle), radius * sinf(angle)));
+        }
+        polygons.push_back(inclusion);
+        ASSERT_TRUE(oa._inclusion_polygon_pts.expand_to_hold(num_inclusion_points));
+        for (const Vector2f &pt : inclusion) {
+            oa._inclusion_polygon_pts[oa._inclusion_polygon_numpoints++] = pt * 0.98f;
+        }
+
+        ASSERT_TRUE(oa._exclusion_polygon_pts.expand_to_hold(num_exclusion_zones * 4));
+        for (uint8_t i=0; i<num_exclusion_zones; i++) {
+            const Vector2f center(rand_float(-40000, 40000), rand_float(-40000, 40000));
+            const float size = rand_float(2000, 8000);
+            const std::vector<Vector2f> exclusion {
+                center + Vector2f(-size, -size),
+                center + Vector2f(size, -size),
+                center + Vector2f(size, size),
+                center + Vector2f(-size, size)};
+            polygons.push_back(exclusion);
+            for (const Vector2f &pt : exclusion) {
+                oa._exclusion_polygon_pts[oa._exclusion_polygon_numpoints++] = center + (pt - center) * 1.2f;
+            }
+        }
+
+        for (const std::vector<Vector2f> &polygon : polygons) {
+            ASSERT_TRUE(oa._fence_edge_grid.add_polygon(&polygon[0], polygon.size()));
+        }
+        ASSERT_TRUE(oa._fence_edge_grid.build());
+
+        Error err_id;
+        ASSERT_TRUE(oa.create_fence_visgraph(err_id));
+    }
+
+    // true if the segment crosses an edge of any polygon
+    bool polygons_intersect(const Vector2f &seg_start, const Vector2f &seg_end) const {
+        for (const std::vector<Vector2f> &polygon : polygons) {
+            Vector2f intersection;
+            if (Polygon_intersects(&polygon[0], polygon.size(), seg_start, seg_end, intersection)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // a point inside the inclusion polygon and outside the exclusion polygons
+    Vector2f rand_position() const {
+        while (true) {
+            const Vector2f pos(rand_float(-100000, 100000), rand_float(-100000, 100000));
+            bool ok = !Polygon_outside(pos, &polygons[0][0], polygons[0].size());
+            for (uint8_t i=1; i<polygons.size() && ok; i++) {
+                ok = Polygon_outside(pos, &polygons[i][0], polygons[i].size());
+            }
+            if (ok) {
+                return pos;
+            }
+        }
+    }
+
+    /*
+      length of the shortest path by Dijkstra's algorithm, checking
+      every node for the closest one and every other node for
+      visibility. Returns -1 if there is no path
+     */
+    float plain_dijkstra(const Vector2f &origin, const Vector2f &destination) const {
+        // origin, destination and then the fence points
+        std::vector<Vector2f> nodes {origin, destination};
+        for (uint16_t i=0; i<oa.total_numpoints(); i++) {
+            Vector2f pt;
+            EXPECT_TRUE(oa.get_point(i, pt));
+            nodes.push_back(pt);
+        }
+        std::vector<float> distance(nodes.size(), FLT_MAX);
+        std::vector<bool> visited(nodes.size(), false);
+        distance[0] = 0;
+        while (true) {
+            int16_t curr = -1;
+            for (uint16_t i=0; i<nodes.size(); i++) {
+                if (!visited[i] && distance[i] < FLT_MAX && (curr == -1 || distance[i] < distance[curr])) {
+                    curr = i;
+                }
+            }
+            if (curr == -1) {
+                return -1;
+            }
+            if (curr == 1) {
+                return distance[1];
+            }
+            visited[curr] = true;
+            for (uint16_t i=0; i<nodes.size(); i++) {
+                if (!visited[i] && !polygons_intersect(nodes[curr], nodes[i])) {
+                    distance[i] = MIN(distance[i], distance[curr] + (nodes[i] - nodes[curr]).length());
+                }
+            }
+        }
+    }
+
+    /*
+      length of the path found by the planner, checking each leg of it
+      is clear of the fence. Returns -1 if there is no path
+     */
+    float planner(const Vector2f &origin, const Vector2f &destination) {
+        Error err_id;
+        if (!oa.calc_shortest_path(origin, destination, err_id)) {
+            EXPECT_EQ(err_id, Error::DIJKSTRA_ERROR_COULD_NOT_FIND_PATH);
+            return -1;
+        }
+        float length = 0;
+        Vector2f prev;
+        EXPECT_TRUE(oa.get_shortest_path_point(0, prev));
+        EXPECT_EQ(prev, origin);
+        for (uint8_t i=1; i<oa._path_numpoints; i++) {
+            Vector2f pt;
+            EXPECT_TRUE(oa.get_shortest_path_point(i, pt));
+            EXPECT_FALSE(polygons_intersect(prev, pt));
+            length += (pt - prev).length();
+            prev = pt;
+        }
+        EXPECT_EQ(prev, destination);
+        return length;
+    }
+
+    AP_OADijkstra &oa;
+    std::vector<std::vector<Vector2f>> polygons;
+};
+
+static void check_paths(uint8_t num_inclusion_points, uint8_t num_exclusion_zones, uint16_t num_paths)
+{
+    AP_OADijkstra_Test t;
+    t.make_fence(num_inclusion_points, num_exclusion_zones);
+
+    uint16_t detours = 0;
+    for (uint16_t i=0; i<num_paths; i++) {
+        const Vector2f origin = t.rand_position();
+        const Vector2f destination = t.rand_position();
+        const float expected = t.plain_dijkstra(origin, destination);
+        const float length = t.planner(origin, destination);
+        if (expected < 0) {
+            EXPECT_LT(length, 0) << "path " << i;
+            continue;
+        }
+        EXPECT_NEAR(length, expected, expected * 1e-5f) << "path " << i;
+        if (expected > (destination - origin).length() * 1.001f) {
+            detours++;
+        }
+    }
+    // some paths should have to go around something
+    EXPECT_GT(detours, num_paths / 10);
+}
+
+TEST(AP_OADijkstra, SmallFence)
+{
+    srandom(31);
+    check_paths(8, 4, 200);
+}
+
+TEST(AP_OADijkstra, LargeFence)
+{
+    srandom(32);
+    check_paths(60, 40, 50);
+}
+
+AP_GTEST_MAIN()
@@ -0,0 +1,167 @@
+#include <AP_gtest.h>
+
+#include <stdlib.h>
+#include <vector>
+
+#include <AC_Avoidance/AP_OAEdgeGrid.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+/*
+  check the edge grid's intersection test against Polygon_intersects
+  on each polygon. The fence is an inclusion polygon with square and
+  triangular exclusion polygons inside it, in cm as AP_OADijkstra
+  uses it
+ */
+
+class AP_OAEdgeGrid_Test {
+public:
+    // the grid is allocated so that, as in AP_OADijkstra, it starts zeroed
+    AP_OAEdgeGrid_Test() :
+        grid(*new AP_OAEdgeGrid())
+    {
+        srandom(23);
+        const uint16_t num_inclusion_points = 60;
+        std::vector<Vector2f> inclusion;
+        for (uint16_t i=0; i<num_inclusion_points; i++) {
+            const float angle = -M_2PI * i / num_inclusion_points;
+            const float radius = rand_float(85000, 100000);
+            inclusion.push_back(Vector2f(radius * cosf(angle), radius * sinf(angle)));
+        }
+        polygons.push_back(inclusion);
+        for (uint8_t i=0; i<20; i++) {
+            const Vector2f center(rand_float(-60000, 60000), rand_float(-60000, 60000));
+            const float size = rand_float(1000, 5000);
+            if (i % 2 == 0) {
+                polygons.push_back({center + Vector2f(-size, -size),
+                                    center + Vector2f(size, -size),
+                                    center + Vector2f(size, size),
+                                    center + Vector2f(-size, size)});
+            } else {
+                polygons.push_back({center + Vector2f(-size, 0),
+                                    center + Vector2f(size, -size),
+                                    center + Vector2f(0, size)});
+            }
+        }
+        for (const std::vector<Vector2f> &polygon : polygons) {
+            EXPECT_TRUE(grid.add_polygon(&polygon[0], polygon.size()));
+        }
+        EXPECT_TRUE(grid.build());
+    }
+
+    ~AP_OAEdgeGrid_Test() {
+        delete &grid;
+    }
+
+    static float rand_float(float min, float max) {
+        return min + (max - min) * (float(random()) / RAND_MAX);
+    }
+
+    Vector2f rand_point() const {
+        return Vector2f(rand_float(-110000, 110000), rand_float(-110000, 110000));
+    }
+
+    // x or y of a random line between the grid's cells
+    float rand_grid_line(bool x) const {
+        const uint8_t num_cells = x ? grid._num_rows : grid._num_columns;
+        const float corner = x ? grid._corner.x : grid._corner.y;
+        return corner + (random() % (num_cells + 1)) * grid._cell_size;
+    }
+
+    const Vector2f &rand_vertex() const {
+        const std::vector<Vector2f> &polygon = polygons[random() % polygons.size()];
+        return polygon[random() % polygon.size()];
+    }
+
+    // true if the segment crosses an edge of any polygon
+    bool polygons_intersect(const Vector2f &seg_start, const Vector2f &seg_end) const {
+        for (const std::vector<Vector2f> &polygon : polygons) {
+            Vector2f intersection;
+            if (Polygon_intersects(&polygon[0], polygon.size(), seg_start, seg_end, intersection)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t check(const Vector2f &seg_start, const Vector2f &seg_end) const {
+        const bool expected = polygons_intersect(seg_start, seg_end);
+        EXPECT_EQ(grid.intersects(seg_start, seg_end), expected)
+            << "segment (" << seg_start.x << "," << seg_start.y << ") to (" << seg_end.x << "," << seg_end.y << ")";
+        return expected ? 1 : 0;
+    }
+
+    uint8_t num_rows() const { return grid._num_rows; }
+    uint8_t num_columns() const { return grid._num_columns; }
+
+    AP_OAEdgeGrid &grid;
+    std::vector<std::vector<Vector2f>> polygons;
+};
+
+TEST(AP_OAEdgeGrid, Grid)
+{
+    AP_OAEdgeGrid_Test t;
+    EXPECT_GT(t.num_rows(), 10);
+    EXPECT_GT(t.num_columns(), 10);
+}
+
+TEST(AP_OAEdgeGrid, RandomSegments)
+{
+    AP_OAEdgeGrid_Test t;
+    uint32_t hits = 0;
+    for (uint16_t i=0; i<5000; i++) {
+        const Vector2f start = t.rand_point();
+        // long segments across many cells, and short ones within a few
+        const Vector2f end = (i % 2 == 0) ? t.rand_point() : start + Vector2f(AP_OAEdgeGrid_Test::rand_float(-3000, 3000), AP_OAEdgeGrid_Test::rand_float(-3000, 3000));
+        hits += t.check(start, end);
+    }
+    EXPECT_GT(hits, 500U);
+    EXPECT_LT(hits, 4500U);
+}
+
+TEST(AP_OAEdgeGrid, VerticalSegments)
+{
+    AP_OAEdgeGrid_Test t;
+    for (uint16_t i=0; i<2000; i++) {
+        const Vector2f start = t.rand_point();
+        const float length = AP_OAEdgeGrid_Test::rand_float(-50000, 50000);
+        t.check(start, Vector2f(start.x, start.y + length));
+        t.check(start, Vector2f(start.x + length, start.y));
+        // and zero length
+        t.check(start, start);
+    }
+}
+
+TEST(AP_OAEdgeGrid, GridLines)
+{
+    AP_OAEdgeGrid_Test t;
+    for (uint16_t i=0; i<2000; i++) {
+        // along a line between rows or columns
+        const float x = t.rand_grid_line(true);
+        t.check(Vector2f(x, t.rand_point().y), Vector2f(x, t.rand_point().y));
+        const float y = t.rand_grid_line(false);
+        t.check(Vector2f(t.rand_point().x, y), Vector2f(t.rand_point().x, y));
+        // starting and ending on lines
+        t.check(Vector2f(x, t.rand_point().y), t.rand_point());
+        t.check(t.rand_point(), Vector2f(t.rand_point().x, y));
+        // from one crossing of the lines to another
+        t.check(Vector2f(x, y), Vector2f(t.rand_grid_line(true), t.rand_grid_line(false)));
+    }
+}
+
+TEST(AP_OAEdgeGrid, Vertices)
+{
+    AP_OAEdgeGrid_Test t;
+    for (uint16_t i=0; i<2000; i++) {
+        const Vector2f &vertex = t.rand_vertex();
+        t.check(vertex, t.rand_point());
+        t.check(t.rand_point(), vertex);
+        t.check(vertex, t.rand_vertex());
+        // vertical and horizontal from a vertex
+        const float length = AP_OAEdgeGrid_Test::rand_float(-20000, 20000);
+        t.check(vertex, Vector2f(vertex.x, vertex.y + length));
+        t.check(vertex, Vector2f(vertex.x + length, vertex.y));
+    }
+}
+
+AP_GTEST_MAIN()
@@ -366,6 +366,13 @@ private:
     //keep track of which calibrators have been saved
     bool _cal_saved[COMPASS_MAX_INSTANCES];
     bool _cal_autosave;
+
+#if COMPASS_CAL_THREAD
+    // thread running the fits of all the calibrators
+    bool _cal_thread_started;
+    void _start_cal_thread();
+    void _cal_thread();
+#endif
 #endif
 
     //autoreboot after compass calibration
@@ -19,6 +19,12 @@ void Compass::cal_update()
 
     bool running = false;
 
+#if COMPASS_CAL_THREAD
+    if (!_cal_thread_started && is_calibrating()) {
+        _start_cal_thread();
+    }
+#endif
+
     for (uint8_t i=0; i<COMPASS_MAX_INSTANCES; i++) {
         bool failure;
         _calibrator[i].update(failure);
@@ -49,6 +55,44 @@ void Compass::cal_update()
     }
 }
 
+#if COMPASS_CAL_THREAD
+/*
+  start the thread that runs the fits. The calibrators run the fits
+  from update() until it has started
+ */
+void Compass::_start_cal_thread()
+{
+    _cal_thread_started = true;
+    if (!hal.scheduler->thread_create(FUNCTOR_BIND_MEMBER(&Compass::_cal_thread, void),
+                                      "compass_cal",
+                                      4096, AP_HAL::Scheduler::PRIORITY_IO, -1)) {
+        return;
+    }
+    for (uint8_t i=0; i<COMPASS_MAX_INSTANCES; i++) {
+        _calibrator[i].set_fit_in_thread(true);
+    }
+}
+
+/*
+  run fit iterations of all the calibrators in turn, so they progress
+  together, sleeping when none of them has a fit to run
+ */
+void Compass::_cal_thread()
+{
+    while (true) {
+        bool busy = false;
+        for (uint8_t i=0; i<COMPASS_MAX_INSTANCES; i++) {
+            if (_calibrator[i].update_fit()) {
+                busy = true;
+            }
+        }
+        if (!busy) {
+            hal.scheduler->delay(10);
+        }
+    }
+}
+#endif
+
 bool Compass::_start_calibration(uint8_t i, bool retry, float delay)
 {
     if (!healthy(i)) {
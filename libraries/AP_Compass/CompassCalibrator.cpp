@@ -55,6 +55,20 @@
  *
  * The fitting algorithm used is Levenberg-Marquardt. See also:
  * http://en.wikipedia.org/wiki/Levenberg%E2%80%93Marquardt_algorithm
+ *
+ * The first sphere fit is run from several initial guesses at once and the
+ * best of them kept, as a single guess can leave the fit in a local minimum
+ * and the calibration to be retried. The fits work on a copy of the samples
+ * held as separate x, y and z arrays, calculating the residuals and jacobians
+ * of a block of samples at a time so they can use vector instructions.
+ *
+ * Where COMPASS_CAL_THREAD is set the fit iterations of all compasses are run
+ * by a thread of their own as fast as it can, rather than one per update().
+ * update() then only moves the state machine on when the iterations of a
+ * step are done. _sem protects the calibrator from the thread, which holds
+ * it only to copy the samples and the state of the fit before an iteration
+ * and to store the result after it, so the fit does not hold up
+ * new_sample() and update().
  */
 
 #include "CompassCalibrator.h"
@@ -75,16 +89,19 @@ extern const AP_HAL::HAL& hal;
 
 CompassCalibrator::CompassCalibrator()
 {
-    stop();
+    // no need for the semaphore, and the HAL may not be ready to take it yet
+    set_status(Status::NOT_STARTED);
 }
 
 void CompassCalibrator::stop()
 {
+    WITH_SEMAPHORE(_sem);
     set_status(Status::NOT_STARTED);
 }
 
 void CompassCalibrator::set_orientation(enum Rotation orientation, bool is_external, bool fix_orientation)
 {
+    WITH_SEMAPHORE(_sem);
     _check_orientation = true;
     _orientation = orientation;
     _orig_orientation = orientation;
@@ -94,6 +111,7 @@ void CompassCalibrator::set_orientation(enum Rotation orientation, bool is_exter
 
 void CompassCalibrator::start(bool retry, float delay, uint16_t offset_max, uint8_t compass_idx)
 {
+    WITH_SEMAPHORE(_sem);
     if (running()) {
         return;
     }
@@ -169,6 +187,7 @@ void CompassCalibrator::update_completion_mask()
 
 bool CompassCalibrator::check_for_timeout()
 {
+    WITH_SEMAPHORE(_sem);
     uint32_t tnow = AP_HAL::millis();
     if (running() && tnow - _last_sample_ms > 1000) {
         _retry = false;
@@ -180,6 +199,7 @@ bool CompassCalibrator::check_for_timeout()
 
 void CompassCalibrator::new_sample(const Vector3f& sample)
 {
+    WITH_SEMAPHORE(_sem);
     _last_sample_ms = AP_HAL::millis();
 
     if (_status == Status::WAITING_TO_START) {
@@ -198,11 +218,18 @@ void CompassCalibrator::update(bool &failure)
 {
     failure = false;
 
+    WITH_SEMAPHORE(_sem);
+
     // collect the minimum number of samples
     if (!fitting()) {
         return;
     }
 
+    // run the next iteration of the fit, unless the calibration thread does
+    if (!_fit_in_thread && run_fit_iteration()) {
+        return;
+    }
+
     if (_status == Status::RUNNING_STEP_ONE) {
         if (_fit_step >= 10) {
             if (is_equal(_fitness, _initial_fitness) || isnan(_fitness)) {  // if true, means that fitness is diverging instead of converging
@@ -211,31 +238,61 @@ void CompassCalibrator::update(bool &failure)
             } else {
                 set_status(Status::RUNNING_STEP_TWO);
             }
-        } else {
-            if (_fit_step == 0) {
-                calc_initial_offset();
-            }
-            run_sphere_fit();
-            _fit_step++;
         }
     } else if (_status == Status::RUNNING_STEP_TWO) {
         if (_fit_step >= 35) {
             if (fit_acceptable() && fix_radius() && calculate_orientation()) {
+                gcs().send_text(MAV_SEVERITY_INFO, "Mag(%u) fit %.1fms, converged at iteration %u",
+                                _compass_idx, (double)(_fit_time_us * 1.0e-3f), _converged_iteration);
                 set_status(Status::SUCCESS);
             } else {
                 set_status(Status::FAILED);
                 failure = true;
             }
-        } else if (_fit_step < 15) {
-            run_sphere_fit();
-            _fit_step++;
-        } else {
-            run_ellipsoid_fit();
-            _fit_step++;
         }
     }
 }
 
+bool CompassCalibrator::update_fit()
+{
+    Status status;
+    uint16_t fit_step;
+    uint32_t generation;
+    fit_state_t state;
+    {
+        WITH_SEMAPHORE(_sem);
+        if (!start_fit_iteration()) {
+            // the copy of the samples is not needed until the next fit
+            free(_thread_samples);
+            _thread_samples = nullptr;
+            return false;
+        }
+        if (_thread_samples == nullptr) {
+            _thread_samples = (FitSamples*)malloc(sizeof(FitSamples));
+            if (_thread_samples == nullptr) {
+                // run the iteration holding the semaphore instead
+                return run_fit_iteration();
+            }
+        }
+        memcpy(_thread_samples, _fit_samples, sizeof(FitSamples));
+        status = _status;
+        fit_step = _fit_step;
+        generation = _fit_generation;
+        get_fit_state(state);
+    }
+
+    const uint32_t start_us = AP_HAL::micros();
+    const bool improved = run_fit_iteration(*_thread_samples, status, fit_step, state);
+    const uint32_t fit_time_us = AP_HAL::micros() - start_us;
+
+    WITH_SEMAPHORE(_sem);
+    // drop the result if the calibration was stopped, restarted or moved on while the fit ran
+    if (_status == status && _fit_generation == generation && _fit_step == fit_step) {
+        finish_fit_iteration(state, improved, fit_time_us);
+    }
+    return true;
+}
+
 /////////////////////////////////////////////////////////////
 ////////////////////// PRIVATE METHODS //////////////////////
 /////////////////////////////////////////////////////////////
@@ -249,11 +306,109 @@ bool CompassCalibrator::fitting() const
     return running() && (_samples_collected == COMPASS_CAL_NUM_SAMPLES);
 }
 
+// check there is an iteration of the fit to run for the current step, preparing the initial
+// guesses before the first. returns false if there is none to run
+bool CompassCalibrator::start_fit_iteration()
+{
+    if (!fitting()) {
+        return false;
+    }
+
+    const uint16_t num_steps = (_status == Status::RUNNING_STEP_ONE) ? 10 : 35;
+    if (_fit_step >= num_steps) {
+        return false;
+    }
+    if (_fit_step == 0) {
+        // the sample buffer has been filled since the fit was initialised
+        load_fit_samples();
+        if (_status == Status::RUNNING_STEP_ONE) {
+            calc_initial_starts();
+        }
+    }
+    return true;
+}
+
+// run one iteration of the fit for the current step
+// returns false if there was none to run
+bool CompassCalibrator::run_fit_iteration()
+{
+    if (!start_fit_iteration()) {
+        return false;
+    }
+
+    const uint32_t start_us = AP_HAL::micros();
+    fit_state_t state;
+    get_fit_state(state);
+    const bool improved = run_fit_iteration(*_fit_samples, _status, _fit_step, state);
+    finish_fit_iteration(state, improved, AP_HAL::micros() - start_us);
+    return true;
+}
+
+// run one iteration of the fit for a step on a set of samples
+// returns true if the fitness improved
+bool CompassCalibrator::run_fit_iteration(const FitSamples& samples, Status status, uint16_t fit_step, fit_state_t& state) const
+{
+    if (status == Status::RUNNING_STEP_ONE) {
+        // iterate each of the initial guesses, keeping the best fit found
+        bool improved = false;
+        for (uint8_t i = 0; i < COMPASS_CAL_NUM_STARTS; i++) {
+            start_t &start = state.starts[i];
+            run_sphere_fit(samples, start.params, start.fitness, start.lambda);
+            if (!isnan(start.fitness) && start.fitness < state.fitness) {
+                state.fitness = start.fitness;
+                state.params = start.params;
+                improved = true;
+            }
+        }
+        return improved;
+    }
+
+    if (fit_step < 15) {
+        return run_sphere_fit(samples, state.params, state.fitness, state.sphere_lambda);
+    }
+    return run_ellipsoid_fit(samples, state.params, state.fitness, state.ellipsoid_lambda);
+}
+
+// copy the values an iteration of the fit reads
+void CompassCalibrator::get_fit_state(fit_state_t& state) const
+{
+    state.params = _params;
+    state.fitness = _fitness;
+    state.sphere_lambda = _sphere_lambda;
+    state.ellipsoid_lambda = _ellipsoid_lambda;
+    memcpy(state.starts, _starts, sizeof(state.starts));
+}
+
+// store the values an iteration of the fit updated
+void CompassCalibrator::finish_fit_iteration(const fit_state_t& state, bool improved, uint32_t fit_time_us)
+{
+    _params = state.params;
+    _fitness = state.fitness;
+    _sphere_lambda = state.sphere_lambda;
+    _ellipsoid_lambda = state.ellipsoid_lambda;
+    memcpy(_starts, state.starts, sizeof(_starts));
+    if (improved) {
+        fit_improved();
+    }
+
+    _fit_step++;
+    _fit_iterations++;
+    _fit_time_us += fit_time_us;
+}
+
+// record an improvement of the fit
+void CompassCalibrator::fit_improved()
+{
+    _converged_iteration = _fit_iterations + 1;
+    update_completion_mask();
+}
+
 // initialize fitness before starting a fit
 void CompassCalibrator::initialize_fit()
 {
-    if (_samples_collected != 0) {
-        _fitness = calc_mean_squared_residuals(_params);
+    load_fit_samples();
+    if (_fit_samples != nullptr && _samples_collected != 0) {
+        _fitness = calc_mean_squared_residuals(*_fit_samples, _params);
     } else {
         _fitness = 1.0e30f;
     }
@@ -261,6 +416,7 @@ void CompassCalibrator::initialize_fit()
     _sphere_lambda = 1.0f;
     _ellipsoid_lambda = 1.0f;
     _fit_step = 0;
+    _fit_generation++;
 }
 
 void CompassCalibrator::reset_state()
@@ -274,9 +430,39 @@ void CompassCalibrator::reset_state()
     _params.scale_factor = 0;
 
     memset(_completion_mask, 0, sizeof(_completion_mask));
+    _fit_iterations = 0;
+    _converged_iteration = 0;
+    _fit_time_us = 0;
     initialize_fit();
 }
 
+void CompassCalibrator::free_sample_buffers()
+{
+    if (_sample_buffer != nullptr) {
+        free(_sample_buffer);
+        _sample_buffer = nullptr;
+    }
+    if (_fit_samples != nullptr) {
+        free(_fit_samples);
+        _fit_samples = nullptr;
+    }
+}
+
+// copy the sample buffer into the arrays used by the fits
+void CompassCalibrator::load_fit_samples()
+{
+    if (_sample_buffer == nullptr || _fit_samples == nullptr) {
+        return;
+    }
+    for (uint16_t i = 0; i < _samples_collected; i++) {
+        const Vector3f v = _sample_buffer[i].get();
+        _fit_samples->x[i] = v.x;
+        _fit_samples->y[i] = v.y;
+        _fit_samples->z[i] = v.z;
+    }
+    _fit_samples->count = _samples_collected;
+}
+
 bool CompassCalibrator::set_status(CompassCalibrator::Status status)
 {
     if (status != Status::NOT_STARTED && _status == status) {
@@ -287,10 +473,7 @@ bool CompassCalibrator::set_status(CompassCalibrator::Status status)
         case Status::NOT_STARTED:
             reset_state();
             _status = Status::NOT_STARTED;
-            if (_sample_buffer != nullptr) {
-                free(_sample_buffer);
-                _sample_buffer = nullptr;
-            }
+            free_sample_buffers();
             return true;
 
         case Status::WAITING_TO_START:
@@ -312,7 +495,10 @@ bool CompassCalibrator::set_status(CompassCalibrator::Status status)
             if (_sample_buffer == nullptr) {
                 _sample_buffer = (CompassSample*)calloc(COMPASS_CAL_NUM_SAMPLES, sizeof(CompassSample));
             }
-            if (_sample_buffer != nullptr) {
+            if (_fit_samples == nullptr) {
+                _fit_samples = (FitSamples*)calloc(1, sizeof(FitSamples));
+            }
+            if (_sample_buffer != nullptr && _fit_samples != nullptr) {
                 initialize_fit();
                 _status = Status::RUNNING_STEP_ONE;
                 return true;
@@ -333,10 +519,7 @@ bool CompassCalibrator::set_status(CompassCalibrator::Status status)
                 return false;
             }
 
-            if (_sample_buffer != nullptr) {
-                free(_sample_buffer);
-                _sample_buffer = nullptr;
-            }
+            free_sample_buffers();
 
             _status = Status::SUCCESS;
             return true;
@@ -360,10 +543,7 @@ bool CompassCalibrator::set_status(CompassCalibrator::Status status)
                 return true;
             }
 
-            if (_sample_buffer != nullptr) {
-                free(_sample_buffer);
-                _sample_buffer = nullptr;
-            }
+            free_sample_buffers();
 
             _status = status;
             return true;
@@ -445,12 +625,13 @@ bool CompassCalibrator::accept_sample(const Vector3f& sample, uint16_t skip_inde
         return false;
     }
 
-    float min_distance = _params.radius * 2*sinf(theta/2);
+    // compare squared distances to save a square root per sample
+    const float min_distance_sq = sq(_params.radius * 2*sinf(theta/2));
 
     for (uint16_t i = 0; i<_samples_collected; i++) {
         if (i != skip_index) {
-            float distance = (sample - _sample_buffer[i].get()).length();
-            if (distance < min_distance) {
+            float distance_sq = (sample - _sample_buffer[i].get()).length_squared();
+            if (distance_sq < min_distance_sq) {
                 return false;
             }
         }
@@ -463,118 +644,256 @@ bool CompassCalibrator::accept_sample(const CompassSample& sample, uint16_t skip
     return accept_sample(sample.get(), skip_index);
 }
 
-float CompassCalibrator::calc_residual(const Vector3f& sample, const param_t& params) const
-{
-    Matrix3f softiron(
-        params.diag.x    , params.offdiag.x , params.offdiag.y,
-        params.offdiag.x , params.diag.y    , params.offdiag.z,
-        params.offdiag.y , params.offdiag.z , params.diag.z
-    );
-    return params.radius - (softiron*(sample+params.offset)).length();
-}
-
 // calc the fitness given a set of parameters (offsets, diagonals, off diagonals)
-float CompassCalibrator::calc_mean_squared_residuals(const param_t& params) const
+float CompassCalibrator::calc_mean_squared_residuals(const FitSamples& samples, const param_t& params) const
 {
-    if (_sample_buffer == nullptr || _samples_collected == 0) {
+    if (samples.count == 0) {
         return 1.0e30f;
     }
+    const float radius = params.radius;
+    const float ox = params.offset.x, oy = params.offset.y, oz = params.offset.z;
+    const float dx = params.diag.x, dy = params.diag.y, dz = params.diag.z;
+    const float odx = params.offdiag.x, ody = params.offdiag.y, odz = params.offdiag.z;
     float sum = 0.0f;
-    for (uint16_t i=0; i < _samples_collected; i++) {
-        Vector3f sample = _sample_buffer[i].get();
-        float resid = calc_residual(sample, params);
-        sum += sq(resid);
+    for (uint16_t i=0; i < samples.count; i++) {
+        const float x = samples.x[i] + ox;
+        const float y = samples.y[i] + oy;
+        const float z = samples.z[i] + oz;
+        const float A = (dx  * x) + (odx * y) + (ody * z);
+        const float B = (odx * x) + (dy  * y) + (odz * z);
+        const float C = (ody * x) + (odz * y) + (dz  * z);
+        sum += sq(radius - sqrtf(A*A + B*B + C*C));
     }
-    sum /= _samples_collected;
+    sum /= samples.count;
     return sum;
 }
 
-// calculate initial offsets by simply taking the average values of the samples
-void CompassCalibrator::calc_initial_offset()
+// calculate the initial guesses of the first sphere fit
+void CompassCalibrator::calc_initial_starts()
 {
-    // Set initial offset to the average value of the samples
-    _params.offset.zero();
+    // average and bounding box of the samples
+    Vector3f mean;
+    Vector3f min_v = _sample_buffer[0].get();
+    Vector3f max_v = min_v;
     for (uint16_t k = 0; k < _samples_collected; k++) {
-        _params.offset -= _sample_buffer[k].get();
+        const Vector3f v = _sample_buffer[k].get();
+        mean += v;
+        min_v.x = MIN(min_v.x, v.x);
+        min_v.y = MIN(min_v.y, v.y);
+        min_v.z = MIN(min_v.z, v.z);
+        max_v.x = MAX(max_v.x, v.x);
+        max_v.y = MAX(max_v.y, v.y);
+        max_v.z = MAX(max_v.z, v.z);
+    }
+    mean /= _samples_collected;
+
+    // algebraic sphere fit, solving |s|^2 = 2 s.c + k in the least squares sense for the
+    // centre c, with the samples taken relative to their average to keep the sums small
+    float ATA[16] = { };
+    float ATb[4] = { };
+    for (uint16_t k = 0; k < _samples_collected; k++) {
+        const Vector3f v = _sample_buffer[k].get() - mean;
+        const float a[4] { 2*v.x, 2*v.y, 2*v.z, 1.0f };
+        const float b = v.length_squared();
+        for (uint8_t i = 0; i < 4; i++) {
+            for (uint8_t j = 0; j < 4; j++) {
+                ATA[i*4+j] += a[i] * a[j];
+            }
+            ATb[i] += a[i] * b;
+        }
+    }
+
+    for (uint8_t i = 0; i < COMPASS_CAL_NUM_STARTS; i++) {
+        _starts[i].params = _params;
+        _starts[i].lambda = 1.0f;
+    }
+
+    // the average of the samples, with the default radius
+    _starts[0].params.offset = -mean;
+
+    // the centre of the bounding box
+    const Vector3f half_size = (max_v - min_v) * 0.5f;
+    _starts[1].params.offset = -(min_v + max_v) * 0.5f;
+    _starts[1].params.radius = (half_size.x + half_size.y + half_size.z) / 3;
+
+    // the algebraic sphere fit, falling back to the average if it fails
+    _starts[2].params.offset = -mean;
+    if (inverse(ATA, ATA, 4)) {
+        float c[4] = { };
+        for (uint8_t i = 0; i < 4; i++) {
+            for (uint8_t j = 0; j < 4; j++) {
+                c[i] += ATA[i*4+j] * ATb[j];
+            }
+        }
+        const float radius_sq = c[3] + sq(c[0]) + sq(c[1]) + sq(c[2]);
+        if (radius_sq > 0) {
+            _starts[2].params.offset = -(mean + Vector3f(c[0], c[1], c[2]));
+            _starts[2].params.radius = sqrtf(radius_sq);
+        }
+    }
+
+    // each start only takes steps that improve on its own fitness
+    for (uint8_t i = 0; i < COMPASS_CAL_NUM_STARTS; i++) {
+        _starts[i].fitness = calc_mean_squared_residuals(*_fit_samples, _starts[i].params);
     }
-    _params.offset /= _samples_collected;
 }
 
-void CompassCalibrator::calc_sphere_jacob(const Vector3f& sample, const param_t& params, float* ret) const
+/*
+  sum of the products of two rows of jacobians. The four partial sums
+  let this be done with vector instructions without reordering the
+  additions
+ */
+static float dot_block(const float *a, const float *b)
 {
-    const Vector3f &offset = params.offset;
-    const Vector3f &diag = params.diag;
-    const Vector3f &offdiag = params.offdiag;
-    Matrix3f softiron(
-        diag.x    , offdiag.x , offdiag.y,
-        offdiag.x , diag.y    , offdiag.z,
-        offdiag.y , offdiag.z , diag.z
-    );
+    float sum[4] { };
+    for (uint8_t k = 0; k < COMPASS_CAL_FIT_BLOCK; k += 4) {
+        for (uint8_t l = 0; l < 4; l++) {
+            sum[l] += a[k+l] * b[k+l];
+        }
+    }
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
 
-    float A =  (diag.x    * (sample.x + offset.x)) + (offdiag.x * (sample.y + offset.y)) + (offdiag.y * (sample.z + offset.z));
-    float B =  (offdiag.x * (sample.x + offset.x)) + (diag.y    * (sample.y + offset.y)) + (offdiag.z * (sample.z + offset.z));
-    float C =  (offdiag.y * (sample.x + offset.x)) + (offdiag.z * (sample.y + offset.y)) + (diag.z    * (sample.z + offset.z));
-    float length = (softiron*(sample+offset)).length();
+void CompassCalibrator::calc_sphere_jacob(const FitSamples& samples, uint16_t first, uint16_t len, const param_t& params, float jacob[][COMPASS_CAL_FIT_BLOCK], float* resid) const
+{
+    // copies of the parameters so the compiler knows they don't change as the jacobians are written
+    const float radius = params.radius;
+    const float ox = params.offset.x, oy = params.offset.y, oz = params.offset.z;
+    const float dx = params.diag.x, dy = params.diag.y, dz = params.diag.z;
+    const float odx = params.offdiag.x, ody = params.offdiag.y, odz = params.offdiag.z;
+    const float *xs = &samples.x[first];
+    const float *ys = &samples.y[first];
+    const float *zs = &samples.z[first];
+
+    for (uint16_t k = 0; k < len; k++) {
+        const float x = xs[k] + ox;
+        const float y = ys[k] + oy;
+        const float z = zs[k] + oz;
+        const float A = (dx  * x) + (odx * y) + (ody * z);
+        const float B = (odx * x) + (dy  * y) + (odz * z);
+        const float C = (ody * x) + (odz * y) + (dz  * z);
+        const float length = sqrtf(A*A + B*B + C*C);
+
+        resid[k] = radius - length;
+        // 0: partial derivative (radius wrt fitness fn) fn operated on sample
+        jacob[0][k] = 1.0f;
+        // 1-3: partial derivative (offsets wrt fitness fn) fn operated on sample
+        jacob[1][k] = -1.0f * (((dx  * A) + (odx * B) + (ody * C))/length);
+        jacob[2][k] = -1.0f * (((odx * A) + (dy  * B) + (odz * C))/length);
+        jacob[3][k] = -1.0f * (((ody * A) + (odz * B) + (dz  * C))/length);
+    }
+}
 
-    // 0: partial derivative (radius wrt fitness fn) fn operated on sample
-    ret[0] = 1.0f;
-    // 1-3: partial derivative (offsets wrt fitness fn) fn operated on sample
-    ret[1] = -1.0f * (((diag.x    * A) + (offdiag.x * B) + (offdiag.y * C))/length);
-    ret[2] = -1.0f * (((offdiag.x * A) + (diag.y    * B) + (offdiag.z * C))/length);
-    ret[3] = -1.0f * (((offdiag.y * A) + (offdiag.z * B) + (diag.z    * C))/length);
+void CompassCalibrator::calc_ellipsoid_jacob(const FitSamples& samples, uint16_t first, uint16_t len, const param_t& params, float jacob[][COMPASS_CAL_FIT_BLOCK], float* resid) const
+{
+    // copies of the parameters so the compiler knows they don't change as the jacobians are written
+    const float radius = params.radius;
+    const float ox = params.offset.x, oy = params.offset.y, oz = params.offset.z;
+    const float dx = params.diag.x, dy = params.diag.y, dz = params.diag.z;
+    const float odx = params.offdiag.x, ody = params.offdiag.y, odz = params.offdiag.z;
+    const float *xs = &samples.x[first];
+    const float *ys = &samples.y[first];
+    const float *zs = &samples.z[first];
+
+    for (uint16_t k = 0; k < len; k++) {
+        const float x = xs[k] + ox;
+        const float y = ys[k] + oy;
+        const float z = zs[k] + oz;
+        const float A = (dx  * x) + (odx * y) + (ody * z);
+        const float B = (odx * x) + (dy  * y) + (odz * z);
+        const float C = (ody * x) + (odz * y) + (dz  * z);
+        const float length = sqrtf(A*A + B*B + C*C);
+
+        resid[k] = radius - length;
+        // 0-2: partial derivative (offset wrt fitness fn) fn operated on sample
+        jacob[0][k] = -1.0f * (((dx  * A) + (odx * B) + (ody * C))/length);
+        jacob[1][k] = -1.0f * (((odx * A) + (dy  * B) + (odz * C))/length);
+        jacob[2][k] = -1.0f * (((ody * A) + (odz * B) + (dz  * C))/length);
+        // 3-5: partial derivative (diag offset wrt fitness fn) fn operated on sample
+        jacob[3][k] = -1.0f * (x * A)/length;
+        jacob[4][k] = -1.0f * (y * B)/length;
+        jacob[5][k] = -1.0f * (z * C)/length;
+        // 6-8: partial derivative (off-diag offset wrt fitness fn) fn operated on sample
+        jacob[6][k] = -1.0f * ((y * A) + (x * B))/length;
+        jacob[7][k] = -1.0f * ((z * A) + (x * C))/length;
+        jacob[8][k] = -1.0f * ((z * B) + (y * C))/length;
+    }
 }
 
-// run sphere fit to calculate diagonals and offdiagonals
-void CompassCalibrator::run_sphere_fit()
+// sum J^T.J and J^T.r over all the samples for the sphere or ellipsoid fit
+void CompassCalibrator::calc_normal_equations(const FitSamples& samples, const param_t& params, bool ellipsoid, float* JTJ, float* JTFI) const
 {
-    if (_sample_buffer == nullptr) {
-        return;
+    const uint8_t n = ellipsoid ? COMPASS_CAL_NUM_ELLIPSOID_PARAMS : COMPASS_CAL_NUM_SPHERE_PARAMS;
+    float jacob[COMPASS_CAL_NUM_ELLIPSOID_PARAMS][COMPASS_CAL_FIT_BLOCK];
+    float resid[COMPASS_CAL_FIT_BLOCK];
+
+    memset(JTJ, 0, n*n*sizeof(JTJ[0]));
+    memset(JTFI, 0, n*sizeof(JTFI[0]));
+
+    for (uint16_t first = 0; first < samples.count; first += COMPASS_CAL_FIT_BLOCK) {
+        const uint16_t len = MIN(COMPASS_CAL_FIT_BLOCK, samples.count - first);
+        if (ellipsoid) {
+            calc_ellipsoid_jacob(samples, first, len, params, jacob, resid);
+        } else {
+            calc_sphere_jacob(samples, first, len, params, jacob, resid);
+        }
+        // pad a short last block with zeros, which add nothing to the sums
+        for (uint16_t k = len; k < COMPASS_CAL_FIT_BLOCK; k++) {
+            for (uint8_t i = 0; i < n; i++) {
+                jacob[i][k] = 0;
+            }
+            resid[k] = 0;
+        }
+
+        // JTJ is symmetric so only the upper triangle is summed
+        for (uint8_t i = 0; i < n; i++) {
+            for (uint8_t j = i; j < n; j++) {
+                JTJ[i*n+j] += dot_block(jacob[i], jacob[j]);
+            }
+            JTFI[i] += dot_block(jacob[i], resid);
+        }
+    }
+
+    for (uint8_t i = 1; i < n; i++) {
+        for (uint8_t j = 0; j < i; j++) {
+            JTJ[i*n+j] = JTJ[j*n+i];
+        }
     }
+}
 
+// run sphere fit to calculate diagonals and offdiagonals
+// returns true if the fitness improved
+bool CompassCalibrator::run_sphere_fit(const FitSamples& samples, param_t& params, float& fitness, float& lambda) const
+{
     const float lma_damping = 10.0f;
 
     // take backup of fitness and parameters so we can determine later if this fit has improved the calibration
-    float fitness = _fitness;
+    float new_fitness = fitness;
     float fit1, fit2;
     param_t fit1_params, fit2_params;
-    fit1_params = fit2_params = _params;
+    fit1_params = fit2_params = params;
 
-    float JTJ[COMPASS_CAL_NUM_SPHERE_PARAMS*COMPASS_CAL_NUM_SPHERE_PARAMS] = { };
-    float JTJ2[COMPASS_CAL_NUM_SPHERE_PARAMS*COMPASS_CAL_NUM_SPHERE_PARAMS] = { };
-    float JTFI[COMPASS_CAL_NUM_SPHERE_PARAMS] = { };
+    float JTJ[COMPASS_CAL_NUM_SPHERE_PARAMS*COMPASS_CAL_NUM_SPHERE_PARAMS];
+    float JTJ2[COMPASS_CAL_NUM_SPHERE_PARAMS*COMPASS_CAL_NUM_SPHERE_PARAMS];
+    float JTFI[COMPASS_CAL_NUM_SPHERE_PARAMS];
 
     // Gauss Newton Part common for all kind of extensions including LM
-    for (uint16_t k = 0; k<_samples_collected; k++) {
-        Vector3f sample = _sample_buffer[k].get();
-
-        float sphere_jacob[COMPASS_CAL_NUM_SPHERE_PARAMS];
-
-        calc_sphere_jacob(sample, fit1_params, sphere_jacob);
-
-        for (uint8_t i = 0;i < COMPASS_CAL_NUM_SPHERE_PARAMS; i++) {
-            // compute JTJ
-            for (uint8_t j = 0; j < COMPASS_CAL_NUM_SPHERE_PARAMS; j++) {
-                JTJ[i*COMPASS_CAL_NUM_SPHERE_PARAMS+j] += sphere_jacob[i] * sphere_jacob[j];
-                JTJ2[i*COMPASS_CAL_NUM_SPHERE_PARAMS+j] += sphere_jacob[i] * sphere_jacob[j];   //a backup JTJ for LM
-            }
-            // compute JTFI
-            JTFI[i] += sphere_jacob[i] * calc_residual(sample, fit1_params);
-        }
-    }
+    calc_normal_equations(samples, fit1_params, false, JTJ, JTFI);
+    memcpy(JTJ2, JTJ, sizeof(JTJ2));    //a backup JTJ for LM
 
     //------------------------Levenberg-Marquardt-part-starts-here---------------------------------//
     // refer: http://en.wikipedia.org/wiki/Levenberg%E2%80%93Marquardt_algorithm#Choice_of_damping_parameter
     for (uint8_t i = 0; i < COMPASS_CAL_NUM_SPHERE_PARAMS; i++) {
-        JTJ[i*COMPASS_CAL_NUM_SPHERE_PARAMS+i] += _sphere_lambda;
-        JTJ2[i*COMPASS_CAL_NUM_SPHERE_PARAMS+i] += _sphere_lambda/lma_damping;
+        JTJ[i*COMPASS_CAL_NUM_SPHERE_PARAMS+i] += lambda;
+        JTJ2[i*COMPASS_CAL_NUM_SPHERE_PARAMS+i] += lambda/lma_damping;
     }
 
     if (!inverse(JTJ, JTJ, 4)) {
-        return;
+        return false;
     }
 
     if (!inverse(JTJ2, JTJ2, 4)) {
-        return;
+        return false;
     }
 
     // extract radius, offset, diagonals and offdiagonal parameters
@@ -586,111 +905,72 @@ void CompassCalibrator::run_sphere_fit()
     }
 
     // calculate fitness of two possible sets of parameters
-    fit1 = calc_mean_squared_residuals(fit1_params);
-    fit2 = calc_mean_squared_residuals(fit2_params);
+    fit1 = calc_mean_squared_residuals(samples, fit1_params);
+    fit2 = calc_mean_squared_residuals(samples, fit2_params);
 
     // decide which of the two sets of parameters is best and store in fit1_params
-    if (fit1 > _fitness && fit2 > _fitness) {
+    if (fit1 > fitness && fit2 > fitness) {
         // if neither set of parameters provided better results, increase lambda
-        _sphere_lambda *= lma_damping;
-    } else if (fit2 < _fitness && fit2 < fit1) {
+        lambda *= lma_damping;
+    } else if (fit2 < fitness && fit2 < fit1) {
         // if fit2 was better we will use it. decrease lambda
-        _sphere_lambda /= lma_damping;
+        lambda /= lma_damping;
         fit1_params = fit2_params;
-        fitness = fit2;
-    } else if (fit1 < _fitness) {
-        fitness = fit1;
+        new_fitness = fit2;
+    } else if (fit1 < fitness) {
+        new_fitness = fit1;
     }
     //--------------------Levenberg-Marquardt-part-ends-here--------------------------------//
 
     // store new parameters and update fitness
-    if (!isnan(fitness) && fitness < _fitness) {
-        _fitness = fitness;
-        _params = fit1_params;
-        update_completion_mask();
-    }
-}
-
-void CompassCalibrator::calc_ellipsoid_jacob(const Vector3f& sample, const param_t& params, float* ret) const
-{
-    const Vector3f &offset = params.offset;
-    const Vector3f &diag = params.diag;
-    const Vector3f &offdiag = params.offdiag;
-    Matrix3f softiron(
-        diag.x    , offdiag.x , offdiag.y,
-        offdiag.x , diag.y    , offdiag.z,
-        offdiag.y , offdiag.z , diag.z
-    );
-
-    float A =  (diag.x    * (sample.x + offset.x)) + (offdiag.x * (sample.y + offset.y)) + (offdiag.y * (sample.z + offset.z));
-    float B =  (offdiag.x * (sample.x + offset.x)) + (diag.y    * (sample.y + offset.y)) + (offdiag.z * (sample.z + offset.z));
-    float C =  (offdiag.y * (sample.x + offset.x)) + (offdiag.z * (sample.y + offset.y)) + (diag.z    * (sample.z + offset.z));
-    float length = (softiron*(sample+offset)).length();
-
-    // 0-2: partial derivative (offset wrt fitness fn) fn operated on sample
-    ret[0] = -1.0f * (((diag.x    * A) + (offdiag.x * B) + (offdiag.y * C))/length);
-    ret[1] = -1.0f * (((offdiag.x * A) + (diag.y    * B) + (offdiag.z * C))/length);
-    ret[2] = -1.0f * (((offdiag.y * A) + (offdiag.z * B) + (diag.z    * C))/length);
-    // 3-5: partial derivative (diag offset wrt fitness fn) fn operated on sample
-    ret[3] = -1.0f * ((sample.x + offset.x) * A)/length;
-    ret[4] = -1.0f * ((sample.y + offset.y) * B)/length;
-    ret[5] = -1.0f * ((sample.z + offset.z) * C)/length;
-    // 6-8: partial derivative (off-diag offset wrt fitness fn) fn operated on sample
-    ret[6] = -1.0f * (((sample.y + offset.y) * A) + ((sample.x + offset.x) * B))/length;
-    ret[7] = -1.0f * (((sample.z + offset.z) * A) + ((sample.x + offset.x) * C))/length;
-    ret[8] = -1.0f * (((sample.z + offset.z) * B) + ((sample.y + offset.y) * C))/length;
+    if (!isnan(new_fitness) && new_fitness < fitness) {
+        fitness = new_fitness;
+        params = fit1_params;
+        return true;
+    }
+    return false;
 }
 
-void CompassCalibrator::run_ellipsoid_fit()
+void CompassCalibrator::run_sphere_fit()
 {
-    if (_sample_buffer == nullptr) {
-        return;
+    if (_fit_samples != nullptr && run_sphere_fit(*_fit_samples, _params, _fitness, _sphere_lambda)) {
+        fit_improved();
     }
+}
 
+// run ellipsoid fit to calculate diagonals and offdiagonals
+// returns true if the fitness improved
+bool CompassCalibrator::run_ellipsoid_fit(const FitSamples& samples, param_t& params, float& fitness, float& lambda) const
+{
     const float lma_damping = 10.0f;
 
     // take backup of fitness and parameters so we can determine later if this fit has improved the calibration
-    float fitness = _fitness;
+    float new_fitness = fitness;
     float fit1, fit2;
     param_t fit1_params, fit2_params;
-    fit1_params = fit2_params = _params;
+    fit1_params = fit2_params = params;
 
-    float JTJ[COMPASS_CAL_NUM_ELLIPSOID_PARAMS*COMPASS_CAL_NUM_ELLIPSOID_PARAMS] = { };
-    float JTJ2[COMPASS_CAL_NUM_ELLIPSOID_PARAMS*COMPASS_CAL_NUM_ELLIPSOID_PARAMS] = { };
-    float JTFI[COMPASS_CAL_NUM_ELLIPSOID_PARAMS] = { };
+    float JTJ[COMPASS_CAL_NUM_ELLIPSOID_PARAMS*COMPASS_CAL_NUM_ELLIPSOID_PARAMS];
+    float JTJ2[COMPASS_CAL_NUM_ELLIPSOID_PARAMS*COMPASS_CAL_NUM_ELLIPSOID_PARAMS];
+    float JTFI[COMPASS_CAL_NUM_ELLIPSOID_PARAMS];
 
     // Gauss Newton Part common for all kind of extensions including LM
-    for (uint16_t k = 0; k<_samples_collected; k++) {
-        Vector3f sample = _sample_buffer[k].get();
-
-        float ellipsoid_jacob[COMPASS_CAL_NUM_ELLIPSOID_PARAMS];
-
-        calc_ellipsoid_jacob(sample, fit1_params, ellipsoid_jacob);
-
-        for (uint8_t i = 0;i < COMPASS_CAL_NUM_ELLIPSOID_PARAMS; i++) {
-            // compute JTJ
-            for (uint8_t j = 0; j < COMPASS_CAL_NUM_ELLIPSOID_PARAMS; j++) {
-                JTJ [i*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+j] += ellipsoid_jacob[i] * ellipsoid_jacob[j];
-                JTJ2[i*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+j] += ellipsoid_jacob[i] * ellipsoid_jacob[j];
-            }
-            // compute JTFI
-            JTFI[i] += ellipsoid_jacob[i] * calc_residual(sample, fit1_params);
-        }
-    }
+    calc_normal_equations(samples, fit1_params, true, JTJ, JTFI);
+    memcpy(JTJ2, JTJ, sizeof(JTJ2));
 
     //------------------------Levenberg-Marquardt-part-starts-here---------------------------------//
     //refer: http://en.wikipedia.org/wiki/Levenberg%E2%80%93Marquardt_algorithm#Choice_of_damping_parameter
     for (uint8_t i = 0; i < COMPASS_CAL_NUM_ELLIPSOID_PARAMS; i++) {
-        JTJ[i*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+i] += _ellipsoid_lambda;
-        JTJ2[i*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+i] += _ellipsoid_lambda/lma_damping;
+        JTJ[i*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+i] += lambda;
+        JTJ2[i*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+i] += lambda/lma_damping;
     }
 
     if (!inverse(JTJ, JTJ, 9)) {
-        return;
+        return false;
     }
 
     if (!inverse(JTJ2, JTJ2, 9)) {
-        return;
+        return false;
     }
 
     // extract radius, offset, diagonals and offdiagonal parameters
@@ -702,28 +982,36 @@ void CompassCalibrator::run_ellipsoid_fit()
     }
 
     // calculate fitness of two possible sets of parameters
-    fit1 = calc_mean_squared_residuals(fit1_params);
-    fit2 = calc_mean_squared_residuals(fit2_params);
+    fit1 = calc_mean_squared_residuals(samples, fit1_params);
+    fit2 = calc_mean_squared_residuals(samples, fit2_params);
 
     // decide which of the two sets of parameters is best and store in fit1_params
-    if (fit1 > _fitness && fit2 > _fitness) {
+    if (fit1 > fitness && fit2 > fitness) {
         // if neither set of parameters provided better results, increase lambda
-        _ellipsoid_lambda *= lma_damping;
-    } else if (fit2 < _fitness && fit2 < fit1) {
+        lambda *= lma_damping;
+    } else if (fit2 < fitness && fit2 < fit1) {
         // if fit2 was better we will use it. decrease lambda
-        _ellipsoid_lambda /= lma_damping;
+        lambda /= lma_damping;
         fit1_params = fit2_params;
-        fitness = fit2;
-    } else if (fit1 < _fitness) {
-        fitness = fit1;
+        new_fitness = fit2;
+    } else if (fit1 < fitness) {
+        new_fitness = fit1;
     }
     //--------------------Levenberg-part-ends-here--------------------------------//
 
     // store new parameters and update fitness
-    if (fitness < _fitness) {
-        _fitness = fitness;
-        _params = fit1_params;
-        update_completion_mask();
+    if (new_fitness < fitness) {
+        fitness = new_fitness;
+        params = fit1_params;
+        return true;
+    }
+    return false;
+}
+
+void CompassCalibrator::run_ellipsoid_fit()
+{
+    if (_fit_samples != nullptr && run_ellipsoid_fit(*_fit_samples, _params, _fitness, _ellipsoid_lambda)) {
+        fit_improved();
     }
 }
 
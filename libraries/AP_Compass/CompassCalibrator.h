@@ -1,15 +1,28 @@
 #pragma once
 
+#include <AP_HAL/AP_HAL.h>
 #include <AP_Math/AP_Math.h>
 
 #define COMPASS_CAL_NUM_SPHERE_PARAMS       4
 #define COMPASS_CAL_NUM_ELLIPSOID_PARAMS    9
 #define COMPASS_CAL_NUM_SAMPLES             300     // number of samples required before fitting begins
+#define COMPASS_CAL_NUM_STARTS              3       // number of initial guesses the first sphere fit is run from
+#define COMPASS_CAL_FIT_BLOCK               16      // number of samples whose jacobians are calculated together
+
+/*
+  run the fit iterations on a thread of their own, working on all
+  compasses at once, rather than one iteration per update() call
+ */
+#ifndef COMPASS_CAL_THREAD
+#define COMPASS_CAL_THREAD (CONFIG_HAL_BOARD == HAL_BOARD_LINUX || CONFIG_HAL_BOARD == HAL_BOARD_SITL)
+#endif
 
 #define COMPASS_MIN_SCALE_FACTOR 0.85
 #define COMPASS_MAX_SCALE_FACTOR 1.3
 
 class CompassCalibrator {
+    friend class CompassCalibrator_Test;
+
 public:
     CompassCalibrator();
 
@@ -25,6 +38,13 @@ public:
 
     // update the state machine and calculate offsets, diagonals and offdiagonals
     void update(bool &failure);
+
+    // run the fit iterations from the calibration thread rather than update()
+    void set_fit_in_thread(bool fit_in_thread) { _fit_in_thread = fit_in_thread; }
+
+    // run one iteration of the fit, called from the calibration thread. The fit runs on a copy
+    // of the samples without holding the semaphore. returns false if there was none to run
+    bool update_fit();
     void new_sample(const Vector3f &sample);
 
     bool check_for_timeout();
@@ -66,6 +86,10 @@ public:
     typedef uint8_t completion_mask_t[10];
     const completion_mask_t& get_completion_mask() const { return _completion_mask; }
 
+    // get time spent running the fit iterations of the latest attempt, and the iteration the fitness stopped improving at
+    uint32_t get_fit_time_us() const { return _fit_time_us; }
+    uint16_t get_converged_iteration() const { return _converged_iteration; }
+
 private:
 
     // results
@@ -109,6 +133,30 @@ private:
         int16_t z;
     };
 
+    // the samples as separate arrays of each axis, which the fits can run over with vector instructions
+    struct FitSamples {
+        float x[COMPASS_CAL_NUM_SAMPLES];
+        float y[COMPASS_CAL_NUM_SAMPLES];
+        float z[COMPASS_CAL_NUM_SAMPLES];
+        uint16_t count;
+    };
+
+    // one of the initial guesses of the first sphere fit
+    struct start_t {
+        param_t params;
+        float fitness;
+        float lambda;
+    };
+
+    // the values an iteration of the fit reads and updates
+    struct fit_state_t {
+        param_t params;
+        float fitness;
+        float sphere_lambda;
+        float ellipsoid_lambda;
+        start_t starts[COMPASS_CAL_NUM_STARTS];
+    };
+
     // set status including any required initialisation
     bool set_status(Status status);
 
@@ -122,6 +170,12 @@ private:
     // clear sample buffer and reset offsets and scaling to their defaults
     void reset_state();
 
+    // free the sample buffers
+    void free_sample_buffers();
+
+    // copy the sample buffer into the arrays used by the fits
+    void load_fit_samples();
+
     // initialize fitness before starting a fit
     void initialize_fit();
 
@@ -131,24 +185,51 @@ private:
     // thins out samples between step one and step two
     void thin_samples();
 
-    // calc the fitness of a single sample vs a set of parameters (offsets, diagonals, off diagonals)
-    float calc_residual(const Vector3f& sample, const param_t& params) const;
+    // calc the fitness of the parameters (offsets, diagonals, off diagonals) vs the samples
+    // returns 1.0e30f if there are no samples
+    float calc_mean_squared_residuals(const FitSamples& samples, const param_t& params) const;
+
+    // calculate the initial guesses of the first sphere fit: the average of the samples, the centre of
+    // their bounding box and an algebraic sphere fit
+    void calc_initial_starts();
+
+    // check there is an iteration of the fit to run for the current step, preparing the initial
+    // guesses before the first. returns false if there is none to run
+    bool start_fit_iteration();
 
-    // calc the fitness of the parameters (offsets, diagonals, off diagonals) vs all the samples collected
-    // returns 1.0e30f if the sample buffer is empty
-    float calc_mean_squared_residuals(const param_t& params) const;
+    // run one iteration of the fit for the current step
+    // returns false if there was none to run
+    bool run_fit_iteration();
 
-    // calculate initial offsets by simply taking the average values of the samples
-    void calc_initial_offset();
+    // run one iteration of the fit for a step on a set of samples
+    // returns true if the fitness improved
+    bool run_fit_iteration(const FitSamples& samples, Status status, uint16_t fit_step, fit_state_t& state) const;
+
+    // copy the values an iteration reads, and store those it updated
+    void get_fit_state(fit_state_t& state) const;
+    void finish_fit_iteration(const fit_state_t& state, bool improved, uint32_t fit_time_us);
+
+    // calc the residuals and jacobians of a block of samples, with jacob[i][k] the derivative of the residual
+    // of sample first+k with respect to parameter i
+    void calc_sphere_jacob(const FitSamples& samples, uint16_t first, uint16_t len, const param_t& params, float jacob[][COMPASS_CAL_FIT_BLOCK], float* resid) const;
+    void calc_ellipsoid_jacob(const FitSamples& samples, uint16_t first, uint16_t len, const param_t& params, float jacob[][COMPASS_CAL_FIT_BLOCK], float* resid) const;
+
+    // sum J^T.J and J^T.r over all the samples for the sphere or ellipsoid fit
+    void calc_normal_equations(const FitSamples& samples, const param_t& params, bool ellipsoid, float* JTJ, float* JTFI) const;
 
     // run sphere fit to calculate diagonals and offdiagonals
-    void calc_sphere_jacob(const Vector3f& sample, const param_t& params, float* ret) const;
+    // returns true if the fitness improved
+    bool run_sphere_fit(const FitSamples& samples, param_t& params, float& fitness, float& lambda) const;
     void run_sphere_fit();
 
     // run ellipsoid fit to calculate diagonals and offdiagonals
-    void calc_ellipsoid_jacob(const Vector3f& sample, const param_t& params, float* ret) const;
+    // returns true if the fitness improved
+    bool run_ellipsoid_fit(const FitSamples& samples, param_t& params, float& fitness, float& lambda) const;
     void run_ellipsoid_fit();
 
+    // record an improvement of the fit
+    void fit_improved();
+
     // update the completion mask based on a single sample
     void update_completion_mask(const Vector3f& sample);
 
@@ -177,6 +258,7 @@ private:
     uint8_t _attempt;                       // number of attempts have been made to calibrate
     completion_mask_t _completion_mask;     // bitmask of directions in which we have samples
     CompassSample *_sample_buffer;          // buffer of sensor values
+    FitSamples *_fit_samples;               // copy of the sample buffer used by the fits
     uint16_t _samples_collected;            // number of samples in buffer
     uint16_t _samples_thinned;              // number of samples removed by the thin_samples() call (called before step 2 begins)
 
@@ -187,6 +269,14 @@ private:
     float _initial_fitness;                 // fitness before latest "fit" was attempted (used to determine if fit was an improvement)
     float _sphere_lambda;                   // sphere fit's lambda
     float _ellipsoid_lambda;                // ellipsoid fit's lambda
+    start_t _starts[COMPASS_CAL_NUM_STARTS]; // initial guesses of the first sphere fit
+    uint16_t _fit_iterations;               // number of fit iterations run in this attempt
+    uint16_t _converged_iteration;          // iteration of this attempt at which the fitness last improved
+    uint32_t _fit_time_us;                  // time spent running the fit iterations of this attempt
+    bool _fit_in_thread;                    // true if the calibration thread runs the fit iterations
+    uint32_t _fit_generation;               // incremented each time the fit is initialised, so the thread can tell its result is stale
+    FitSamples *_thread_samples;            // the calibration thread's copy of the samples, only used by that thread
+    HAL_Semaphore _sem;                     // protects the fit from the calibration thread
 
     // variables for orientation checking
     enum Rotation _orientation;             // latest detected orientation
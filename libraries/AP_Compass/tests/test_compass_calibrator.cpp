@@ -0,0 +1,216 @@
+#include <AP_gtest.h>
+
+#include <stdlib.h>
+#include <vector>
+
+#include <AP_Compass/CompassCalibrator.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+/*
+  run the fits of the compass calibrator on samples from known
+  ellipsoids, reaching into it to load the samples and move between
+  the steps without the AHRS, GPS and orientation checks
+ */
+
+// a soft iron ellipsoid: the calibration corrects a sample s to
+// softiron * (s + offset), which has length radius
+struct Ellipsoid {
+    float radius;
+    Vector3f offset;
+    Vector3f diag;
+    Vector3f offdiag;
+
+    Matrix3f softiron() const {
+        return Matrix3f {
+            diag.x,    offdiag.x, offdiag.y,
+            offdiag.x, diag.y,    offdiag.z,
+            offdiag.y, offdiag.z, diag.z
+        };
+    }
+};
+
+class CompassCalibrator_Test {
+public:
+    // start a calibration with the sample buffer filled
+    static void load(CompassCalibrator &cal, const std::vector<Vector3f> &samples) {
+        cal.start(false, 0, 1800, 0);
+        ASSERT_EQ(cal.get_status(), CompassCalibrator::Status::RUNNING_STEP_ONE);
+        ASSERT_EQ(samples.size(), COMPASS_CAL_NUM_SAMPLES);
+        for (uint16_t i=0; i<samples.size(); i++) {
+            cal._sample_buffer[i].set(samples[i]);
+        }
+        cal._samples_collected = samples.size();
+    }
+
+    // run the first iteration with every guess of the first sphere fit
+    // starting from the default parameters, as the fit did before it
+    // had several
+    static void single_start(CompassCalibrator &cal) {
+        ASSERT_TRUE(cal.start_fit_iteration());
+        for (uint8_t i=0; i<COMPASS_CAL_NUM_STARTS; i++) {
+            cal._starts[i].params = cal._params;
+            cal._starts[i].fitness = cal._fitness;
+            cal._starts[i].lambda = 1.0f;
+        }
+        CompassCalibrator::fit_state_t state;
+        cal.get_fit_state(state);
+        const bool improved = cal.run_fit_iteration(*cal._fit_samples, cal._status, cal._fit_step, state);
+        cal.finish_fit_iteration(state, improved, 0);
+    }
+
+    // run the fit iterations of the current step, either through the
+    // calibration thread's entry point or holding the semaphore
+    static uint16_t run_step(CompassCalibrator &cal, bool in_thread) {
+        uint16_t iterations = 0;
+        while (in_thread ? cal.update_fit() : cal.run_fit_iteration()) {
+            iterations++;
+        }
+        return iterations;
+    }
+
+    // move on to the second step, keeping all the samples
+    static void step_two(CompassCalibrator &cal) {
+        cal._status = CompassCalibrator::Status::RUNNING_STEP_TWO;
+        cal.initialize_fit();
+    }
+
+    static float fitness(const CompassCalibrator &cal) {
+        return cal._fitness;
+    }
+
+    static Vector3f offset(const CompassCalibrator &cal) {
+        return cal._params.offset;
+    }
+
+    static bool same_fit(const CompassCalibrator &a, const CompassCalibrator &b) {
+        return memcmp(&a._params, &b._params, sizeof(a._params)) == 0 &&
+            a._fitness == b._fitness &&
+            a._fit_step == b._fit_step &&
+            a._converged_iteration == b._converged_iteration;
+    }
+};
+
+static float rand_float(float min, float max)
+{
+    return min + (max - min) * (float(random()) / RAND_MAX);
+}
+
+static Ellipsoid random_ellipsoid()
+{
+    Ellipsoid e;
+    e.radius = rand_float(250, 600);
+    e.offset = Vector3f(rand_float(-1200, 1200), rand_float(-1200, 1200), rand_float(-1200, 1200));
+    e.diag = Vector3f(rand_float(0.85f, 1.15f), rand_float(0.85f, 1.15f), rand_float(0.85f, 1.15f));
+    e.offdiag = Vector3f(rand_float(-0.08f, 0.08f), rand_float(-0.08f, 0.08f), rand_float(-0.08f, 0.08f));
+    return e;
+}
+
+/*
+  samples on the ellipsoid with a little noise. Directions come from the
+  whole sphere, or with lopsided set from a cap covering most of it, as
+  when the vehicle is not turned fully over, which leaves their average
+  well away from the centre
+ */
+static std::vector<Vector3f> ellipsoid_samples(const Ellipsoid &e, bool lopsided)
+{
+    Matrix3f inv;
+    EXPECT_TRUE(e.softiron().inverse(inv));
+    std::vector<Vector3f> samples;
+    while (samples.size() < COMPASS_CAL_NUM_SAMPLES) {
+        Vector3f u(rand_float(-1, 1), rand_float(-1, 1), rand_float(-1, 1));
+        const float len = u.length();
+        if (len > 1 || len < 0.1f) {
+            continue;
+        }
+        u /= len;
+        if (lopsided && u.z < -0.2f) {
+            continue;
+        }
+        const Vector3f noise(rand_float(-1, 1), rand_float(-1, 1), rand_float(-1, 1));
+        samples.push_back(inv * (u * e.radius) - e.offset + noise);
+    }
+    return samples;
+}
+
+TEST(CompassCalibrator, MultiStartFit)
+{
+    srandom(23);
+    uint8_t multi_better = 0;
+    uint16_t single_iterations = 0;
+    uint16_t multi_iterations = 0;
+    const uint8_t num_ellipsoids = 40;
+    for (uint8_t n=0; n<num_ellipsoids; n++) {
+        const Ellipsoid e = random_ellipsoid();
+        const std::vector<Vector3f> samples = ellipsoid_samples(e, n % 2);
+
+        // allocated so that, like the vehicle's, they start zeroed
+        CompassCalibrator &single = *new CompassCalibrator();
+        CompassCalibrator_Test::load(single, samples);
+        CompassCalibrator_Test::single_start(single);
+        EXPECT_EQ(CompassCalibrator_Test::run_step(single, false), 9);
+
+        CompassCalibrator &multi = *new CompassCalibrator();
+        CompassCalibrator_Test::load(multi, samples);
+        EXPECT_EQ(CompassCalibrator_Test::run_step(multi, false), 10);
+
+        // the guesses all head for the same minimum, but the defaults
+        // are a long way from it when the offsets are large
+        const float single_fitness = CompassCalibrator_Test::fitness(single);
+        const float multi_fitness = CompassCalibrator_Test::fitness(multi);
+        EXPECT_LE(multi_fitness, single_fitness * 1.001f) << "ellipsoid " << unsigned(n);
+        if (multi_fitness < single_fitness * 0.5f) {
+            multi_better++;
+        }
+        single_iterations += single.get_converged_iteration();
+        multi_iterations += multi.get_converged_iteration();
+
+        // the second step finds the offsets from the sphere fit
+        CompassCalibrator_Test::step_two(multi);
+        EXPECT_EQ(CompassCalibrator_Test::run_step(multi, false), 35);
+        EXPECT_LT(sqrtf(CompassCalibrator_Test::fitness(multi)), 2.0f) << "ellipsoid " << unsigned(n);
+        EXPECT_LT((CompassCalibrator_Test::offset(multi) - e.offset).length(), 5.0f) << "ellipsoid " << unsigned(n);
+
+        single.stop();
+        multi.stop();
+        delete &single;
+        delete &multi;
+    }
+    // from the defaults the first step sometimes does not get there
+    // in its ten iterations, and generally takes longer
+    EXPECT_GT(multi_better, 0);
+    EXPECT_LT(multi_iterations, single_iterations * 3 / 4);
+}
+
+TEST(CompassCalibrator, ThreadFitMatchesLocked)
+{
+    srandom(24);
+    for (uint8_t n=0; n<10; n++) {
+        const std::vector<Vector3f> samples = ellipsoid_samples(random_ellipsoid(), n % 2);
+
+        // the calibration thread runs the fit on a copy of the samples
+        // and state, which must give the same result
+        CompassCalibrator &locked = *new CompassCalibrator();
+        CompassCalibrator &unlocked = *new CompassCalibrator();
+        unlocked.set_fit_in_thread(true);
+        CompassCalibrator_Test::load(locked, samples);
+        CompassCalibrator_Test::load(unlocked, samples);
+
+        EXPECT_EQ(CompassCalibrator_Test::run_step(locked, false), 10);
+        EXPECT_EQ(CompassCalibrator_Test::run_step(unlocked, true), 10);
+        EXPECT_TRUE(CompassCalibrator_Test::same_fit(locked, unlocked)) << "ellipsoid " << unsigned(n);
+
+        CompassCalibrator_Test::step_two(locked);
+        CompassCalibrator_Test::step_two(unlocked);
+        EXPECT_EQ(CompassCalibrator_Test::run_step(locked, false), 35);
+        EXPECT_EQ(CompassCalibrator_Test::run_step(unlocked, true), 35);
+        EXPECT_TRUE(CompassCalibrator_Test::same_fit(locked, unlocked)) << "ellipsoid " << unsigned(n);
+
+        locked.stop();
+        unlocked.stop();
+        delete &locked;
+        delete &unlocked;
+    }
+}
+
+AP_GTEST_MAIN()
@@ -127,6 +127,7 @@ bool AP_FlashStorage::init(void)
     }
 
     reserved_space = 0;
+    compact_pending = false;
     
     // ready to use
     return true;
@@ -216,6 +217,84 @@ bool AP_FlashStorage::write(uint16_t offset, uint16_t length)
     return true;
 }
 
+/*
+  write the first run of adjacent dirty blocks as one record. Callers
+  that write a line at a time otherwise spend a block header and two
+  flash writes on each block of a multi-block change
+ */
+bool AP_FlashStorage::write_dirty(BlockMask &dirty)
+{
+    const int16_t first = dirty.first_set();
+    if (first == -1) {
+        return true;
+    }
+    uint16_t n = 1;
+    while (n < max_write / block_size &&
+           first + n < num_blocks &&
+           dirty.get(first + n)) {
+        n++;
+    }
+    if (!write(first * block_size, n * block_size)) {
+        return false;
+    }
+    for (uint16_t i=0; i<n; i++) {
+        dirty.clear(first + i);
+    }
+    return true;
+}
+
+/*
+  copy mem_buffer into the current sector a few blocks at a time after
+  a switch of sectors. Once it is all there the full sector holds
+  nothing we need, and can be erased when that is allowed, leaving it
+  available for the next switch. Without this the full sector is only
+  freed by switch_full_sector(), which copies and erases everything in
+  one go from within write()
+ */
+bool AP_FlashStorage::compact(uint16_t max_blocks)
+{
+    if (write_error) {
+        // both sectors filled before the full one could be erased, so
+        // writes fail until it is. Do that here rather than waiting
+        // for the next init()
+        if (!flash_erase_ok()) {
+            return true;
+        }
+        return switch_full_sector();
+    }
+    if (!compact_pending) {
+        return true;
+    }
+
+    while (compact_block < num_blocks && max_blocks > 0) {
+        const uint16_t n = MIN(MIN(uint16_t(max_write / block_size), max_blocks),
+                               uint16_t(num_blocks - compact_block));
+        const uint16_t ofs = compact_block * block_size;
+        // move on before the write, as a write that fills the sector
+        // can switch sectors and start compaction again
+        compact_block += n;
+        max_blocks -= n;
+        if (!all_zero(ofs, n * block_size) && !write(ofs, n * block_size)) {
+            return false;
+        }
+    }
+    if (compact_block < num_blocks) {
+        return true;
+    }
+
+    if (!flash_erase_ok()) {
+        return true;
+    }
+    debug("erasing compacted sector %u\n", current_sector ^ 1);
+    if (!erase_sector(current_sector ^ 1, true)) {
+        return false;
+    }
+    // init() no longer needs room to write out the full sector
+    reserved_space = 0;
+    compact_pending = false;
+    return true;
+}
+
 /*
   load all data from a flash sector into mem_buffer
  */
@@ -296,6 +375,8 @@ bool AP_FlashStorage::erase_sector(uint8_t sector, bool mark_available)
 bool AP_FlashStorage::erase_all(void)
 {
     write_error = false;
+    reserved_space = 0;
+    compact_pending = false;
 
     current_sector = 0;
     write_offset = sizeof(struct sector_header);
@@ -395,6 +476,10 @@ bool AP_FlashStorage::switch_sectors(void)
     // we need to reserve some space in next sector to ensure we can successfully do a
     // full write out on init()
     reserved_space = reserve_size;
+
+    // the full sector can be erased once its data has been copied across
+    compact_pending = true;
+    compact_block = 0;
     
     write_offset = sizeof(header);
     return true;    
@@ -34,10 +34,15 @@
     128k flash sectors with 16k storage size.
 
   - assumes two flash sectors are available
+
+  - once a sector fills, writes move to the other sector and the live
+    data is copied across a few blocks at a time by compact(), so the
+    full sector can be erased without a long stall in write()
  */
 #pragma once
 
 #include <AP_HAL/AP_HAL.h>
+#include <AP_Common/Bitmask.h>
 
 #if defined(STM32F1)
 /*
@@ -92,6 +97,24 @@ public:
     // write some data to storage from mem_buffer
     bool write(uint16_t offset, uint16_t length);
 
+    // mask of blocks of mem_buffer waiting to be written, for callers
+    // that track dirty data in units of block_size
+    typedef Bitmask<num_blocks> BlockMask;
+
+    // write the first run of adjacent dirty blocks as a single record
+    // of up to max_write bytes and clear them in the mask
+    bool write_dirty(BlockMask &dirty);
+
+    // copy up to max_blocks blocks of mem_buffer into the current
+    // sector after a switch of sectors, and once all are copied erase
+    // the full sector if flash_erase_ok(). Also recovers from both
+    // sectors being full when erasing is allowed. Call regularly when
+    // idle
+    bool compact(uint16_t max_blocks);
+
+    // true while a full sector is waiting to be copied and erased
+    bool compacting(void) const { return compact_pending; }
+
     // fixed storage size
     static const uint16_t storage_size = block_size * num_blocks;
     
@@ -107,6 +130,8 @@ private:
     uint32_t write_offset;
     uint32_t reserved_space;
     bool write_error;
+    bool compact_pending;
+    uint16_t compact_block;     // next block to be copied by compact()
 
     // 24 bit signature
 #if AP_FLASHSTORAGE_MULTI_WRITE
@@ -0,0 +1,292 @@
+#include <AP_gbenchmark.h>
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <AP_HAL/AP_HAL.h>
+#include <AP_Math/AP_Math.h>
+#include <AP_FlashStorage/AP_FlashStorage.h>
+
+/*
+  replay a parameter-write trace through AP_FlashStorage the way the
+  ChibiOS storage backend drives it, one call per 1ms storage tick,
+  and report the distribution of time each tick spends in flash along
+  with the number of sector erases. Flash time is modelled with
+  roughly STM32F4 figures, as the point is where the stalls land
+  rather than the host's memcpy speed.
+
+  The trace is generated with a fixed seed to look like a vehicle's:
+  sessions of ground tuning, compass calibration and mission uploads
+  while disarmed, and periodic statistics saves and the odd in-flight
+  tune while armed.
+
+  arg 0: a line per tick through write(), as before write_dirty()
+  arg 1: write_dirty() batching adjacent lines into one record
+  arg 2: as 1, with compact() on idle ticks
+ */
+
+static const uint32_t bench_sector_size = 128U * 1024U;
+static const uint32_t flash_word_us = 16;           // program one 32 bit word
+static const uint32_t flash_erase_us = 1000000;     // erase one 128k sector
+static const uint8_t line_size = 8;
+
+struct TraceWrite {
+    uint32_t time_ms;
+    uint16_t offset;
+    uint8_t length;
+    bool armed;
+};
+
+// parameters are laid out as AP_Param does, a 4 byte header then the value
+struct BenchParam {
+    uint16_t offset;
+    uint8_t length;
+};
+
+static const std::vector<TraceWrite> &bench_trace()
+{
+    static std::vector<TraceWrite> trace;
+    if (!trace.empty()) {
+        return trace;
+    }
+    srandom(7);
+
+    std::vector<BenchParam> params;
+    uint16_t ofs = 4;
+    while (ofs < 6000) {
+        static const uint8_t sizes[] { 1, 2, 4, 4 };
+        const uint8_t len = sizes[random() % 4];
+        params.push_back({uint16_t(ofs + 4), len});
+        ofs += 4 + len;
+    }
+    const uint16_t mission_start = 8000;
+    const uint8_t mission_item_size = 15;
+
+    uint32_t t = 0;
+    auto save = [&](const BenchParam &p, bool armed) {
+        trace.push_back({t, p.offset, p.length, armed});
+    };
+
+    for (uint16_t session=0; session<150; session++) {
+        // on the ground: tuning a handful of parameters, each save a
+        // few seconds after the last
+        const uint16_t hot = random() % (params.size() - 40);
+        const uint16_t num_tune = 5 + random() % 60;
+        for (uint16_t i=0; i<num_tune; i++) {
+            t += 500 + random() % 5000;
+            save(params[hot + random() % 40], false);
+        }
+        if (random() % 3 == 0) {
+            // compass calibration saves its offsets, diagonals and
+            // off-diagonals in one go
+            t += 20000;
+            const uint16_t first = random() % (params.size() - 12);
+            for (uint8_t i=0; i<12; i++) {
+                save(params[first + i], false);
+            }
+        }
+        if (random() % 4 == 0) {
+            // mission upload, an item every 10ms
+            const uint16_t num_items = 20 + random() % 150;
+            for (uint16_t i=0; i<num_items; i++) {
+                t += 10;
+                trace.push_back({t, uint16_t(mission_start + i * mission_item_size), mission_item_size, false});
+            }
+        }
+
+        // flying: flight time statistics every 30s and the odd
+        // in-flight tune
+        const uint32_t flight_ms = 300000 + random() % 1200000;
+        const uint32_t end_ms = t + flight_ms;
+        while (t + 30000 < end_ms) {
+            t += 30000;
+            for (uint8_t i=0; i<3; i++) {
+                save(params[params.size() - 1 - i], true);
+            }
+            if (random() % 10 == 0) {
+                save(params[hot + random() % 40], true);
+            }
+        }
+        t = end_ms + 60000;
+    }
+    return trace;
+}
+
+class BenchFlash {
+public:
+    BenchFlash() {
+        flash[0] = new uint8_t[bench_sector_size];
+        flash[1] = new uint8_t[bench_sector_size];
+    }
+
+    ~BenchFlash() {
+        delete[] flash[0];
+        delete[] flash[1];
+    }
+
+    bool write(uint8_t sector, uint32_t offset, const uint8_t *data, uint16_t length) {
+        for (uint16_t i=0; i<length; i++) {
+            flash[sector][offset+i] &= data[i];
+        }
+        tick_us += ((length + 3) / 4) * flash_word_us;
+        writes++;
+        return true;
+    }
+
+    bool read(uint8_t sector, uint32_t offset, uint8_t *data, uint16_t length) {
+        memcpy(data, &flash[sector][offset], length);
+        return true;
+    }
+
+    bool erase(uint8_t sector) {
+        memset(flash[sector], 0xFF, bench_sector_size);
+        tick_us += flash_erase_us;
+        erases++;
+        return true;
+    }
+
+    bool erase_ok(void) {
+        return !armed;
+    }
+
+    uint8_t *flash[2];
+    uint32_t tick_us;
+    uint32_t writes;
+    uint32_t erases;
+    bool armed;
+};
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, float p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[MIN(size_t(sorted.size() * p), sorted.size() - 1)];
+}
+
+static void BM_FlashStorageTrace(benchmark::State& state)
+{
+    const int mode = state.range(0);
+    const std::vector<TraceWrite> &trace = bench_trace();
+    BenchFlash bf;
+    uint8_t mem_buffer[AP_FlashStorage::storage_size];
+    AP_FlashStorage storage{mem_buffer,
+            bench_sector_size,
+            FUNCTOR_BIND(&bf, &BenchFlash::write, bool, uint8_t, uint32_t, const uint8_t *, uint16_t),
+            FUNCTOR_BIND(&bf, &BenchFlash::read, bool, uint8_t, uint32_t, uint8_t *, uint16_t),
+            FUNCTOR_BIND(&bf, &BenchFlash::erase, bool, uint8_t),
+            FUNCTOR_BIND(&bf, &BenchFlash::erase_ok, bool)};
+    AP_FlashStorage::BlockMask dirty;
+    std::vector<uint32_t> write_stalls;
+    std::vector<uint32_t> idle_stalls;
+    uint32_t failed_ticks = 0;
+
+    // one storage tick. Returns false if there was nothing to write
+    auto tick = [&]() {
+        bf.tick_us = 0;
+        const int16_t line = dirty.first_set();
+        if (line == -1) {
+            if (mode == 2) {
+                storage.compact(8);
+            }
+            if (bf.tick_us != 0) {
+                idle_stalls.push_back(bf.tick_us);
+            }
+            return false;
+        }
+        bool ok;
+        if (mode == 0) {
+            ok = storage.write(line * line_size, line_size);
+            if (ok) {
+                dirty.clear(line);
+            }
+        } else {
+            ok = storage.write_dirty(dirty);
+        }
+        if (!ok) {
+            failed_ticks++;
+        }
+        if (bf.tick_us != 0) {
+            write_stalls.push_back(bf.tick_us);
+        }
+        return true;
+    };
+
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        bf.erase(0);
+        bf.erase(1);
+        bf.armed = false;
+        storage.init();
+        bf.writes = 0;
+        bf.erases = 0;
+        dirty.clearall();
+        write_stalls.clear();
+        idle_stalls.clear();
+        failed_ticks = 0;
+        state.ResumeTiming();
+
+        uint32_t now_ms = 0;
+        for (const TraceWrite &w : trace) {
+            // idle ticks until the write. Compaction needs a few
+            // hundred, so there is no point running more
+            const uint32_t idle = MIN(w.time_ms - now_ms, 500U);
+            for (uint32_t i=0; i<idle; i++) {
+                tick();
+            }
+            now_ms = w.time_ms;
+            bf.armed = w.armed;
+
+            for (uint8_t i=0; i<w.length; i++) {
+                mem_buffer[w.offset + i] = random();
+            }
+            for (uint16_t line=w.offset/line_size; line<=(w.offset+w.length-1)/line_size; line++) {
+                dirty.set(line);
+            }
+            // a burst of writes in the same millisecond is written
+            // from the following ticks
+            if (&w != &trace.back() && (&w)[1].time_ms == w.time_ms) {
+                continue;
+            }
+            while (tick()) {
+                now_ms++;
+                if (now_ms - w.time_ms > 1000) {
+                    // both sectors are full while armed, so the
+                    // writes wait for the next disarm
+                    break;
+                }
+            }
+        }
+        gbenchmark_escape(mem_buffer);
+    }
+
+    std::sort(write_stalls.begin(), write_stalls.end());
+    uint64_t total_us = 0;
+    for (uint32_t us : write_stalls) {
+        total_us += us;
+    }
+    for (uint32_t us : idle_stalls) {
+        total_us += us;
+    }
+    char label[200];
+    snprintf(label, sizeof(label),
+             "write ticks %u p50 %uus p99 %uus p99.9 %uus max %uus, idle max %uus, failed ticks %u, flash %ums in %u writes, erases %u",
+             unsigned(write_stalls.size()),
+             unsigned(percentile(write_stalls, 0.5)),
+             unsigned(percentile(write_stalls, 0.99)),
+             unsigned(percentile(write_stalls, 0.999)),
+             unsigned(write_stalls.empty() ? 0 : write_stalls.back()),
+             unsigned(idle_stalls.empty() ? 0 : *std::max_element(idle_stalls.begin(), idle_stalls.end())),
+             unsigned(failed_ticks),
+             unsigned(total_us / 1000),
+             unsigned(bf.writes),
+             unsigned(bf.erases));
+    state.SetLabel(label);
+}
+
+BENCHMARK(BM_FlashStorageTrace)->Arg(0)->Arg(1)->Arg(2);
+
+BENCHMARK_MAIN()
@@ -39,6 +39,9 @@ private:
     // write to storage and mem_mirror
     void write(uint16_t offset, const uint8_t *data, uint16_t length);
 
+    // write to storage through write_dirty() and mem_mirror
+    void write_batched(uint16_t offset, const uint8_t *data, uint16_t length);
+
     bool erase_ok;
 };
 
@@ -117,6 +120,24 @@ void FlashTest::write(uint16_t offset, const uint8_t *data, uint16_t length)
     }
 }
 
+void FlashTest::write_batched(uint16_t offset, const uint8_t *data, uint16_t length)
+{
+    memcpy(&mem_mirror[offset], data, length);
+    memcpy(&mem_buffer[offset], data, length);
+    AP_FlashStorage::BlockMask dirty;
+    for (uint16_t ofs=offset; ofs<offset+length; ofs++) {
+        dirty.set(ofs / 8);
+    }
+    while (!dirty.empty()) {
+        if (!storage.write_dirty(dirty)) {
+            if (erase_ok) {
+                printf("Failed to write at %u for %u\n", offset, length);
+            }
+            break;
+        }
+    }
+}
+
 /*
  * test flash storage
  */
@@ -147,7 +168,14 @@ void FlashTest::loop(void)
         }
 
         erase_ok = (i % 1000 == 0);
-        write(ofs, data, length);
+        if (i & 1) {
+            write_batched(ofs, data, length);
+        } else {
+            write(ofs, data, length);
+        }
+
+        // copy out of a full sector between writes
+        storage.compact(8);
 
         if (erase_ok) {
             if (memcmp(mem_buffer, mem_mirror, sizeof(mem_buffer)) != 0) {
@@ -72,9 +72,17 @@ AP_GPS_GSOF::read(void)
     }
 
     bool ret = false;
-    while (port->available() > 0) {
-        uint8_t temp = port->read();
-        ret |= parse(temp);
+    uint32_t numc = port->available();
+    while (numc > 0) {
+        uint8_t bytes[GPS_READ_CHUNK_SIZE];
+        const ssize_t n = port->read(bytes, MIN(numc, sizeof(bytes)));
+        if (n <= 0) {
+            break;
+        }
+        numc -= n;
+        for (ssize_t i = 0; i < n; i++) {
+            ret |= parse(bytes[i]);
+        }
     }
 
     return ret;
@@ -52,23 +52,29 @@ extern const AP_HAL::HAL& hal;
 
 bool AP_GPS_NMEA::read(void)
 {
-    int16_t numc;
     bool parsed = false;
 
-    numc = port->available();
-    while (numc--) {
-        char c = port->read();
+    uint32_t numc = port->available();
+    while (numc > 0) {
+        uint8_t bytes[GPS_READ_CHUNK_SIZE];
+        const ssize_t n = port->read(bytes, MIN(numc, sizeof(bytes)));
+        if (n <= 0) {
+            break;
+        }
+        numc -= n;
 #ifdef NMEA_LOG_PATH
         static FILE *logf = nullptr;
         if (logf == nullptr) {
             logf = fopen(NMEA_LOG_PATH, "wb");
         }
         if (logf != nullptr) {
-            ::fwrite(&c, 1, 1, logf);
+            ::fwrite(bytes, 1, n, logf);
         }
 #endif
-        if (_decode(c)) {
-            parsed = true;
+        for (ssize_t i = 0; i < n; i++) {
+            if (_decode(bytes[i])) {
+                parsed = true;
+            }
         }
     }
     return parsed;
@@ -66,9 +66,14 @@ AP_GPS_SBF::read(void)
 {
     bool ret = false;
     uint32_t available_bytes = port->available();
-    for (uint32_t i = 0; i < available_bytes; i++) {
-        uint8_t temp = port->read();
-        ret |= parse(temp);
+    while (available_bytes > 0) {
+        uint8_t bytes[GPS_READ_CHUNK_SIZE];
+        const ssize_t n = port->read(bytes, MIN(available_bytes, sizeof(bytes)));
+        if (n <= 0) {
+            break;
+        }
+        available_bytes -= n;
+        ret |= parse(bytes, n);
     }
 
     if (gps._auto_config != AP_GPS::GPS_AUTO_CONFIG_DISABLE) {
@@ -106,6 +111,48 @@ AP_GPS_SBF::read(void)
     return ret;
 }
 
+/*
+  run a chunk of received bytes through the parser. The search for the
+  preamble and the body of a block are handled a span at a time, the
+  rest a byte at a time
+ */
+bool
+AP_GPS_SBF::parse(const uint8_t *bytes, uint16_t len)
+{
+    bool ret = false;
+    uint16_t i = 0;
+
+    while (i < len) {
+        if (sbf_msg.sbf_state == sbf_msg_parser_t::PREAMBLE1) {
+            // skip to the next possible start of a block
+            const uint8_t *p = (const uint8_t *)memchr(&bytes[i], SBF_PREAMBLE1, len - i);
+            if (p == nullptr) {
+                break;
+            }
+            i = p - bytes;
+        } else if (sbf_msg.sbf_state == sbf_msg_parser_t::DATA) {
+            // gather as much of the block as this chunk holds. Like
+            // parse(uint8_t) this takes at least one byte
+            const int32_t remaining = MAX((int32_t)sbf_msg.length - 8 - sbf_msg.read, (int32_t)1);
+            const uint16_t n = MIN(remaining, (int32_t)(len - i));
+            if (sbf_msg.read < sizeof(sbf_msg.data)) {
+                memcpy(&sbf_msg.data.bytes[sbf_msg.read], &bytes[i],
+                       MIN((uint32_t)n, sizeof(sbf_msg.data) - sbf_msg.read));
+            }
+            sbf_msg.read += n;
+            i += n;
+            if (sbf_msg.read >= (sbf_msg.length - 8)) {
+                ret |= block_complete();
+            }
+            continue;
+        }
+
+        ret |= parse(bytes[i++]);
+    }
+
+    return ret;
+}
+
 bool
 AP_GPS_SBF::parse(uint8_t temp)
 {
@@ -171,23 +218,7 @@ AP_GPS_SBF::parse(uint8_t temp)
             }
             sbf_msg.read++;
             if (sbf_msg.read >= (sbf_msg.length - 8)) {
-                if (sbf_msg.read > sizeof(sbf_msg.data)) {
-                    // not interested in these large messages
-                    sbf_msg.sbf_state = sbf_msg_parser_t::PREAMBLE1;
-                    break;
-                }
-                uint16_t crc = crc16_ccitt((uint8_t*)&sbf_msg.blockid, 2, 0);
-                crc = crc16_ccitt((uint8_t*)&sbf_msg.length, 2, crc);
-                crc = crc16_ccitt((uint8_t*)&sbf_msg.data, sbf_msg.length - 8, crc);
-
-                sbf_msg.sbf_state = sbf_msg_parser_t::PREAMBLE1;
-
-                if (sbf_msg.crc == crc) {
-                    return process_message();
-                } else {
-                    Debug("crc fail\n");
-                    crc_error_counter++;
-                }
+                return block_complete();
             }
             break;
         case sbf_msg_parser_t::COMMAND_LINE:
@@ -233,6 +264,33 @@ AP_GPS_SBF::parse(uint8_t temp)
     return false;
 }
 
+/*
+  check the CRC of a block once all of it has been received and
+  process it
+ */
+bool
+AP_GPS_SBF::block_complete()
+{
+    sbf_msg.sbf_state = sbf_msg_parser_t::PREAMBLE1;
+
+    if (sbf_msg.read > sizeof(sbf_msg.data)) {
+        // not interested in these large messages
+        return false;
+    }
+
+    uint16_t crc = crc16_ccitt((uint8_t*)&sbf_msg.blockid, 2, 0);
+    crc = crc16_ccitt((uint8_t*)&sbf_msg.length, 2, crc);
+    crc = crc16_ccitt((uint8_t*)&sbf_msg.data, sbf_msg.length - 8, crc);
+
+    if (sbf_msg.crc == crc) {
+        return process_message();
+    }
+
+    Debug("crc fail\n");
+    crc_error_counter++;
+    return false;
+}
+
 bool
 AP_GPS_SBF::process_message(void)
 {
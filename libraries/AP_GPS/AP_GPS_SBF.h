@@ -53,6 +53,8 @@ public:
 private:
 
     bool parse(uint8_t temp);
+    bool parse(const uint8_t *bytes, uint16_t len);
+    bool block_complete();
     bool process_message();
 
     static const uint8_t SBF_PREAMBLE1 = '$';
@@ -97,9 +97,21 @@ void
 AP_GPS_SBP2::_sbp_process()
 {
     uint32_t nleft = port->available(); 
+    uint8_t bytes[GPS_READ_CHUNK_SIZE];
+    uint16_t nbytes = 0;
+    uint16_t pos = 0;
     while (nleft > 0) {
+        // read the port a chunk at a time
+        if (pos == nbytes) {
+            const ssize_t n = port->read(bytes, MIN(nleft, sizeof(bytes)));
+            if (n <= 0) {
+                break;
+            }
+            nbytes = n;
+            pos = 0;
+        }
         nleft--;
-        uint8_t temp = port->read();
+        uint8_t temp = bytes[pos++];
         uint16_t crc;
 
         //This switch reads one character at a time,
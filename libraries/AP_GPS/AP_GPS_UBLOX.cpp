@@ -374,8 +374,6 @@ AP_GPS_UBLOX::_request_port(void)
 bool
 AP_GPS_UBLOX::read(void)
 {
-    uint8_t data;
-    int16_t numc;
     bool parsed = false;
     uint32_t millis_now = AP_HAL::millis();
 
@@ -404,11 +402,71 @@ AP_GPS_UBLOX::read(void)
         }
     }
 
-    numc = port->available();
-    for (int16_t i = 0; i < numc; i++) {        // Process bytes received
+    // Process bytes received, a chunk at a time
+    uint32_t numc = port->available();
+    while (numc > 0) {
+        uint8_t bytes[GPS_READ_CHUNK_SIZE];
+        const ssize_t n = port->read(bytes, MIN(numc, sizeof(bytes)));
+        if (n <= 0) {
+            break;
+        }
+        numc -= n;
+        if (_parse_bytes(bytes, n)) {
+            parsed = true;
+        }
+    }
+    return parsed;
+}
+
+/*
+  add a block of bytes to the checksum, the same as doing
+  _ck_b += (_ck_a += data) for each byte but in a form the compiler
+  can vectorise
+ */
+void AP_GPS_UBLOX::_update_checksum_block(const uint8_t *data, uint16_t len)
+{
+    uint32_t sum = 0;
+    uint32_t weighted_sum = 0;
+    for (uint16_t i = 0; i < len; i++) {
+        sum += data[i];
+        weighted_sum += (uint32_t)(len - i) * data[i];
+    }
+    _ck_b += len * _ck_a + weighted_sum;
+    _ck_a += sum;
+}
+
+/*
+  run a chunk of received bytes through the message state machine.
+  The search for the preamble and the payload are handled a block at
+  a time, the header and checksum a byte at a time
+ */
+bool AP_GPS_UBLOX::_parse_bytes(const uint8_t *bytes, uint16_t len)
+{
+    bool parsed = false;
+    uint16_t i = 0;
+
+    while (i < len) {
+        if (_step == 0) {
+            // skip to the next possible start of a message
+            const uint8_t *p = (const uint8_t *)memchr(&bytes[i], PREAMBLE1, len - i);
+            if (p == nullptr) {
+                break;
+            }
+            i = p - bytes;
+        } else if (_step == 6) {
+            // gather as much of the payload as this chunk holds
+            const uint16_t n = MIN(_payload_length - _payload_counter, len - i);
+            _update_checksum_block(&bytes[i], n);
+            memcpy(&_buffer[_payload_counter], &bytes[i], n);
+            _payload_counter += n;
+            i += n;
+            if (_payload_counter == _payload_length) {
+                _step++;
+            }
+            continue;
+        }
 
-        // read the next byte
-        data = port->read();
+        const uint8_t data = bytes[i++];
 
 	reset:
         switch(_step) {
@@ -480,14 +538,7 @@ AP_GPS_UBLOX::read(void)
 
         // Receive message data
         //
-        case 6:
-            _ck_b += (_ck_a += data);                   // checksum byte
-            if (_payload_counter < sizeof(_buffer)) {
-                _buffer[_payload_counter] = data;
-            }
-            if (++_payload_counter == _payload_length)
-                _step++;
-            break;
+        // case 6, the payload, is handled before the switch
 
         // Checksum and message processing
         //
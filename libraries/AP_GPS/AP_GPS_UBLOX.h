@@ -635,6 +635,8 @@ private:
 
     // Buffer parse & GPS state update
     bool        _parse_gps();
+    bool        _parse_bytes(const uint8_t *bytes, uint16_t len);
+    void        _update_checksum_block(const uint8_t *data, uint16_t len);
 
     // used to update fix between status and position packets
     AP_GPS::GPS_Status next_fix;
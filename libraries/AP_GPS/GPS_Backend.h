@@ -22,6 +22,9 @@
 #include <AP_RTC/JitterCorrection.h>
 #include "AP_GPS.h"
 
+// number of bytes drivers read from the port at a time
+#define GPS_READ_CHUNK_SIZE 128
+
 class AP_GPS_Backend
 {
 public:
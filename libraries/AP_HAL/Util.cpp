@@ -37,6 +37,7 @@ public:
 
     uint32_t available() override { return 0; }
     int16_t read() override { return -1; }
+    using AP_HAL::BetterStream::read;
     uint32_t txspace() override { return 0; }
 };
 
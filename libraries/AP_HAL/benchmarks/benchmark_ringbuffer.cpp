@@ -0,0 +1,165 @@
+#include <AP_gbenchmark.h>
+
+#include <mutex>
+#include <string.h>
+#include <thread>
+
+#include <AP_HAL/utility/RingBuffer.h>
+
+/*
+  compare the copying write()/read() path, wrapped in a lock as most
+  callers do today, with the lock-free in-place reserve()/commit() and
+  peekiovec()/advance() path
+ */
+
+// the largest chunk size the benchmarks are run with
+#define MAX_CHUNK 1024
+
+static void BM_ByteBufferCopyLocked(benchmark::State& state)
+{
+    const uint32_t chunk = state.range(0);
+    ByteBuffer buf(16384);
+    std::mutex sem;
+    uint8_t src[MAX_CHUNK];
+    uint8_t dst[MAX_CHUNK];
+    memset(src, 0x5a, chunk);
+
+    while (state.KeepRunning()) {
+        {
+            std::lock_guard<std::mutex> lock(sem);
+            buf.write(src, chunk);
+        }
+        {
+            std::lock_guard<std::mutex> lock(sem);
+            buf.read(dst, chunk);
+        }
+        gbenchmark_escape(dst);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * chunk);
+}
+
+static void BM_ByteBufferZeroCopy(benchmark::State& state)
+{
+    const uint32_t chunk = state.range(0);
+    ByteBuffer buf(16384);
+    uint32_t sum = 0;
+
+    while (state.KeepRunning()) {
+        ByteBuffer::IoVec vec[2];
+        uint8_t n_vec = buf.reserve(vec, chunk);
+        uint32_t len = 0;
+        for (uint8_t i = 0; i < n_vec; i++) {
+            memset(vec[i].data, 0x5a, vec[i].len);
+            len += vec[i].len;
+        }
+        buf.commit(len);
+
+        n_vec = buf.peekiovec(vec, len);
+        for (uint8_t i = 0; i < n_vec; i++) {
+            sum += vec[i].data[0];
+        }
+        buf.advance(len);
+        gbenchmark_escape(&sum);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * chunk);
+}
+
+/*
+  one producer thread and one consumer thread moving 8MB through the
+  buffer. Both sides yield when they can't make progress so the
+  benchmark stays meaningful on machines with few cores
+ */
+static void BM_ByteBufferSPSCLocked(benchmark::State& state)
+{
+    const uint32_t chunk = state.range(0);
+    const uint64_t total = 8*1024*1024;
+
+    while (state.KeepRunning()) {
+        ByteBuffer buf(16384);
+        std::mutex sem;
+        std::thread producer([&]() {
+            uint8_t src[MAX_CHUNK];
+            memset(src, 0x5a, chunk);
+            uint64_t sent = 0;
+            while (sent < total) {
+                uint32_t n;
+                {
+                    std::lock_guard<std::mutex> lock(sem);
+                    n = buf.write(src, chunk);
+                }
+                if (n == 0) {
+                    std::this_thread::yield();
+                }
+                sent += n;
+            }
+        });
+        uint8_t dst[MAX_CHUNK];
+        uint64_t received = 0;
+        while (received < total) {
+            uint32_t n;
+            {
+                std::lock_guard<std::mutex> lock(sem);
+                n = buf.read(dst, chunk);
+            }
+            if (n == 0) {
+                std::this_thread::yield();
+            }
+            received += n;
+        }
+        producer.join();
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * total);
+}
+
+static void BM_ByteBufferSPSCLockFree(benchmark::State& state)
+{
+    const uint32_t chunk = state.range(0);
+    const uint64_t total = 8*1024*1024;
+
+    while (state.KeepRunning()) {
+        ByteBuffer buf(16384);
+        std::thread producer([&]() {
+            uint64_t sent = 0;
+            while (sent < total) {
+                ByteBuffer::IoVec vec[2];
+                const uint8_t n_vec = buf.reserve(vec, chunk);
+                uint32_t len = 0;
+                for (uint8_t i = 0; i < n_vec; i++) {
+                    memset(vec[i].data, 0x5a, vec[i].len);
+                    len += vec[i].len;
+                }
+                buf.commit(len);
+                if (len == 0) {
+                    std::this_thread::yield();
+                }
+                sent += len;
+            }
+        });
+        uint64_t received = 0;
+        uint32_t sum = 0;
+        while (received < total) {
+            ByteBuffer::IoVec vec[2];
+            const uint8_t n_vec = buf.peekiovec(vec, chunk);
+            uint32_t len = 0;
+            for (uint8_t i = 0; i < n_vec; i++) {
+                sum += vec[i].data[0];
+                len += vec[i].len;
+            }
+            buf.advance(len);
+            if (len == 0) {
+                std::this_thread::yield();
+            }
+            received += len;
+        }
+        gbenchmark_escape(&sum);
+        producer.join();
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * total);
+}
+
+BENCHMARK(BM_ByteBufferCopyLocked)->Arg(16)->Arg(128)->Arg(MAX_CHUNK);
+BENCHMARK(BM_ByteBufferZeroCopy)->Arg(16)->Arg(128)->Arg(MAX_CHUNK);
+BENCHMARK(BM_ByteBufferSPSCLocked)->Arg(128)->Arg(MAX_CHUNK)->UseRealTime();
+BENCHMARK(BM_ByteBufferSPSCLockFree)->Arg(128)->Arg(MAX_CHUNK)->UseRealTime();
+
+BENCHMARK_MAIN()
@@ -38,12 +38,13 @@ uint32_t ByteBuffer::available(void) const
 {
     /* use a copy on stack to avoid race conditions of @tail being updated by
      * the writer thread */
-    uint32_t _tail = tail;
+    const uint32_t _tail = tail.load(std::memory_order_acquire);
+    const uint32_t _head = head.load(std::memory_order_acquire);
 
-    if (head > _tail) {
-        return size - head + _tail;
+    if (_head > _tail) {
+        return size - _head + _tail;
     }
-    return _tail - head;
+    return _tail - _head;
 }
 
 void ByteBuffer::clear(void)
@@ -59,21 +60,22 @@ uint32_t ByteBuffer::space(void) const
 
     /* use a copy on stack to avoid race conditions of @head being updated by
      * the reader thread */
-    uint32_t _head = head;
+    const uint32_t _head = head.load(std::memory_order_acquire);
+    const uint32_t _tail = tail.load(std::memory_order_acquire);
     uint32_t ret = 0;
 
-    if (_head <= tail) {
+    if (_head <= _tail) {
         ret = size;
     }
 
-    ret += _head - tail - 1;
+    ret += _head - _tail - 1;
 
     return ret;
 }
 
 bool ByteBuffer::empty(void) const
 {
-    return head == tail;
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
 }
 
 uint32_t ByteBuffer::write(const uint8_t *data, uint32_t len)
@@ -101,11 +103,12 @@ bool ByteBuffer::update(const uint8_t *data, uint32_t len)
         return false;
     }
     // perform as two memcpy calls
-    uint32_t n = size - head;
+    const uint32_t _head = head.load(std::memory_order_relaxed);
+    uint32_t n = size - _head;
     if (n > len) {
         n = len;
     }
-    memcpy(&buf[head], data, n);
+    memcpy(&buf[_head], data, n);
     data += n;
     if (len > n) {
         memcpy(&buf[0], data, len-n);
@@ -118,7 +121,9 @@ bool ByteBuffer::advance(uint32_t n)
     if (n > available()) {
         return false;
     }
-    head = (head + n) % size;
+    // release so the writer sees we are done with the bytes before
+    // it reuses them
+    head.store((head.load(std::memory_order_relaxed) + n) % size, std::memory_order_release);
     return true;
 }
 
@@ -187,9 +192,10 @@ uint8_t ByteBuffer::reserve(ByteBuffer::IoVec iovec[2], uint32_t len)
         return 0;
     }
 
-    iovec[0].data = &buf[tail];
+    const uint32_t _tail = tail.load(std::memory_order_relaxed);
+    iovec[0].data = &buf[_tail];
 
-    n = size - tail;
+    n = size - _tail;
     if (len <= n) {
         iovec[0].len = len;
         return 1;
@@ -212,10 +218,25 @@ bool ByteBuffer::commit(uint32_t len)
         return false; //Someone broke the agreement
     }
 
-    tail = (tail + len) % size;
+    // release so the reader sees the committed bytes before the new tail
+    tail.store((tail.load(std::memory_order_relaxed) + len) % size, std::memory_order_release);
     return true;
 }
 
+/*
+ * Returns the pointer and size to a contiguous write in the buffer
+ */
+uint8_t *ByteBuffer::writeptr(uint32_t &space_bytes)
+{
+    const uint32_t _tail = tail.load(std::memory_order_relaxed);
+    const uint32_t _space = space();
+    const uint32_t contiguous = size - _tail;
+
+    space_bytes = (_space < contiguous) ? _space : contiguous;
+
+    return space_bytes ? &buf[_tail] : nullptr;
+}
+
 uint32_t ByteBuffer::read(uint8_t *data, uint32_t len)
 {
     uint32_t ret = peekbytes(data, len);
@@ -244,10 +265,11 @@ bool ByteBuffer::read_byte(uint8_t *data)
  */
 const uint8_t *ByteBuffer::readptr(uint32_t &available_bytes)
 {
-    uint32_t _tail = tail;
-    available_bytes = (head > _tail) ? size - head : _tail - head;
+    const uint32_t _tail = tail.load(std::memory_order_acquire);
+    const uint32_t _head = head.load(std::memory_order_relaxed);
+    available_bytes = (_head > _tail) ? size - _head : _tail - _head;
 
-    return available_bytes ? &buf[head] : nullptr;
+    return available_bytes ? &buf[_head] : nullptr;
 }
 
 int16_t ByteBuffer::peek(uint32_t ofs) const
@@ -255,5 +277,5 @@ int16_t ByteBuffer::peek(uint32_t ofs) const
     if (ofs >= available()) {
         return -1;
     }
-    return buf[(head+ofs)%size];
+    return buf[(head.load(std::memory_order_relaxed)+ofs)%size];
 }
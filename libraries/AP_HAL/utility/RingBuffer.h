@@ -5,6 +5,15 @@
 
 /*
  * Circular buffer of bytes.
+ *
+ * With a single producer and a single consumer the buffer is lock
+ * free: the producer only moves tail (write(), reserve()/commit(),
+ * writeptr()/commit()) and the consumer only moves head (read(),
+ * readptr()/advance(), peekiovec()/advance()). Each side publishes its
+ * index with release ordering and loads the other side's with acquire
+ * ordering, so the bytes behind an index are visible before the index
+ * itself. clear(), set_size() and update() still need the caller to
+ * exclude both sides.
  */
 class ByteBuffer {
 public:
@@ -83,6 +92,11 @@ public:
      */
     bool commit(uint32_t len);
 
+    // Returns the pointer and size of the contiguous free space at the
+    // write pointer, for producers that fill the buffer in place. Follow
+    // with 'commit()'.
+    uint8_t *writeptr(uint32_t &space_bytes);
+
 private:
     uint8_t *buf;
     uint32_t size;
@@ -210,6 +224,26 @@ public:
     bool advance(uint32_t n) {
         return buffer->advance(n * sizeof(T));
     }
+
+    /*
+      return a pointer to the first contiguous array of free objects
+      for in-place writes, followed by commit(). Return nullptr if
+      there is no space
+     */
+    T *writeptr(uint32_t &n) {
+        uint32_t space_bytes = 0;
+        T *ret = (T *)buffer->writeptr(space_bytes);
+        if (!ret || space_bytes < sizeof(T)) {
+            return nullptr;
+        }
+        n = space_bytes / sizeof(T);
+        return ret;
+    }
+
+    // make n objects written through writeptr() available to readers
+    bool commit(uint32_t n) {
+        return buffer->commit(n * sizeof(T));
+    }
     
     /* update the object at the front of the queue (the one that would
        be fetched by pop()) */
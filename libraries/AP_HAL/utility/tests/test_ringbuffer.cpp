@@ -0,0 +1,191 @@
+#include <AP_gtest.h>
+
+#include <string.h>
+#include <thread>
+
+#include <AP_HAL/utility/RingBuffer.h>
+
+TEST(ByteBufferTest, WriteRead)
+{
+    ByteBuffer buf(16);
+    const uint8_t data[] = { 1, 2, 3, 4, 5 };
+    uint8_t out[5] {};
+
+    EXPECT_TRUE(buf.empty());
+    EXPECT_EQ(15U, buf.space());
+    EXPECT_EQ(5U, buf.write(data, sizeof(data)));
+    EXPECT_EQ(5U, buf.available());
+    EXPECT_EQ(10U, buf.space());
+    EXPECT_EQ(5U, buf.read(out, sizeof(out)));
+    EXPECT_EQ(0, memcmp(data, out, sizeof(data)));
+    EXPECT_TRUE(buf.empty());
+}
+
+TEST(ByteBufferTest, Full)
+{
+    ByteBuffer buf(8);
+    const uint8_t data[10] {};
+
+    // one byte is always left free to distinguish full from empty
+    EXPECT_EQ(7U, buf.write(data, sizeof(data)));
+    EXPECT_EQ(0U, buf.space());
+    EXPECT_EQ(0U, buf.write(data, 1));
+}
+
+TEST(ByteBufferTest, ReserveCommitWraparound)
+{
+    ByteBuffer buf(8);
+    const uint8_t data[6] { 1, 2, 3, 4, 5, 6 };
+
+    // move head and tail to the middle of the buffer
+    EXPECT_EQ(6U, buf.write(data, sizeof(data)));
+    EXPECT_TRUE(buf.advance(6));
+
+    ByteBuffer::IoVec vec[2];
+    EXPECT_EQ(2, buf.reserve(vec, 5));
+    EXPECT_EQ(2U, vec[0].len);
+    EXPECT_EQ(3U, vec[1].len);
+    memcpy(vec[0].data, data, vec[0].len);
+    memcpy(vec[1].data, data + vec[0].len, vec[1].len);
+
+    // nothing is visible to the reader until commit
+    EXPECT_EQ(0U, buf.available());
+    EXPECT_TRUE(buf.commit(5));
+    EXPECT_EQ(5U, buf.available());
+
+    EXPECT_EQ(2, buf.peekiovec(vec, 5));
+    EXPECT_EQ(2U, vec[0].len);
+    EXPECT_EQ(3U, vec[1].len);
+    EXPECT_EQ(0, memcmp(vec[0].data, data, 2));
+    EXPECT_EQ(0, memcmp(vec[1].data, data + 2, 3));
+    EXPECT_TRUE(buf.advance(5));
+    EXPECT_TRUE(buf.empty());
+}
+
+TEST(ByteBufferTest, CommitTooMuch)
+{
+    ByteBuffer buf(8);
+    EXPECT_FALSE(buf.commit(8));
+    EXPECT_FALSE(buf.advance(1));
+}
+
+TEST(ByteBufferTest, WritePtr)
+{
+    ByteBuffer buf(8);
+    const uint8_t data[5] {};
+
+    uint32_t n;
+    uint8_t *p = buf.writeptr(n);
+    ASSERT_NE(nullptr, p);
+    EXPECT_EQ(7U, n);
+
+    // after wrapping the contiguous span stops at the end of the buffer
+    EXPECT_EQ(5U, buf.write(data, sizeof(data)));
+    EXPECT_TRUE(buf.advance(5));
+    p = buf.writeptr(n);
+    ASSERT_NE(nullptr, p);
+    EXPECT_EQ(3U, n);
+    memset(p, 0x55, n);
+    EXPECT_TRUE(buf.commit(n));
+
+    uint32_t avail;
+    const uint8_t *r = buf.readptr(avail);
+    ASSERT_NE(nullptr, r);
+    EXPECT_EQ(3U, avail);
+    EXPECT_EQ(0x55, r[2]);
+
+    p = buf.writeptr(n);
+    ASSERT_NE(nullptr, p);
+    EXPECT_EQ(4U, n);
+}
+
+TEST(ObjectBufferTest, WritePtrCommit)
+{
+    ObjectBuffer<uint32_t> buf(4);
+
+    uint32_t n;
+    uint32_t *p = buf.writeptr(n);
+    ASSERT_NE(nullptr, p);
+    EXPECT_EQ(4U, n);
+    for (uint32_t i=0; i<3; i++) {
+        p[i] = i + 100;
+    }
+    EXPECT_TRUE(buf.commit(3));
+    EXPECT_EQ(3U, buf.available());
+
+    uint32_t v;
+    EXPECT_TRUE(buf.pop(v));
+    EXPECT_EQ(100U, v);
+    EXPECT_TRUE(buf.pop(v));
+    EXPECT_EQ(101U, v);
+
+    // the free space now wraps; only the tail end is contiguous
+    p = buf.writeptr(n);
+    ASSERT_NE(nullptr, p);
+    EXPECT_EQ(2U, n);
+}
+
+/*
+  one thread writes a counting sequence in randomly sized reserve/commit
+  chunks while another consumes it with peekiovec/advance. Any ordering
+  bug shows up as a corrupted sequence.
+ */
+TEST(ByteBufferTest, SPSCStress)
+{
+    ByteBuffer buf(1021);
+    const uint32_t total = 256*1024;
+
+    std::thread producer([&buf, total]() {
+        uint32_t seq = 0;
+        uint32_t chunk = 1;
+        while (seq < total) {
+            ByteBuffer::IoVec vec[2];
+            chunk = (chunk * 7 + 3) % 300 + 1;
+            const uint32_t remaining = total - seq;
+            const uint8_t n_vec = buf.reserve(vec, chunk < remaining ? chunk : remaining);
+            uint32_t written = 0;
+            for (uint8_t i = 0; i < n_vec; i++) {
+                for (uint32_t j = 0; j < vec[i].len; j++) {
+                    vec[i].data[j] = uint8_t(seq + written + j);
+                }
+                written += vec[i].len;
+            }
+            if (written == 0) {
+                // full, let the consumer run
+                std::this_thread::yield();
+                continue;
+            }
+            buf.commit(written);
+            seq += written;
+        }
+    });
+
+    uint32_t seq = 0;
+    bool ok = true;
+    while (seq < total) {
+        ByteBuffer::IoVec vec[2];
+        const uint8_t n_vec = buf.peekiovec(vec, buf.available());
+        uint32_t consumed = 0;
+        for (uint8_t i = 0; i < n_vec; i++) {
+            for (uint32_t j = 0; j < vec[i].len; j++) {
+                if (vec[i].data[j] != uint8_t(seq + consumed + j)) {
+                    ok = false;
+                }
+            }
+            consumed += vec[i].len;
+        }
+        if (consumed == 0) {
+            // empty, let the producer run
+            std::this_thread::yield();
+            continue;
+        }
+        buf.advance(consumed);
+        seq += consumed;
+    }
+    producer.join();
+
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(total, seq);
+}
+
+AP_GTEST_MAIN()
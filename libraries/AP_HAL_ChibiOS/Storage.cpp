@@ -41,6 +41,11 @@ extern const AP_HAL::HAL& hal;
 
 #define STORAGE_FLASH_RETRIES 5
 
+#ifndef STORAGE_FLASH_COMPACT_BLOCKS
+// blocks copied out of a full flash sector on each idle tick
+#define STORAGE_FLASH_COMPACT_BLOCKS 8
+#endif
+
 void Storage::_storage_open(void)
 {
     if (_initialised) {
@@ -169,11 +174,13 @@ void Storage::_timer_tick(void)
     }
     if (_dirty_mask.empty()) {
         _last_empty_ms = AP_HAL::millis();
+        _flash_compact();
         return;
     }
 
-    // write out the first dirty line. We don't write more
-    // than one to keep the latency of this call to a minimum
+    // write out the first dirty line, or for flash the run of dirty
+    // lines starting there as one record. We don't write more to keep
+    // the latency of this call to a minimum
     uint16_t i;
     for (i=0; i<CH_STORAGE_NUM_LINES; i++) {
         if (_dirty_mask.get(i)) {
@@ -213,7 +220,7 @@ void Storage::_timer_tick(void)
 
 #ifdef STORAGE_FLASH_PAGE
     // save to storage backend
-    _flash_write(i);
+    _flash_write();
 #endif
 }
 
@@ -236,15 +243,31 @@ void Storage::_flash_load(void)
 }
 
 /*
-  write one storage line. This also updates _dirty_mask.
+  write the first run of dirty storage lines, up to the largest
+  record the flash storage writes. This also updates _dirty_mask.
 */
-void Storage::_flash_write(uint16_t line)
+void Storage::_flash_write(void)
 {
 #ifdef STORAGE_FLASH_PAGE
-    if (_flash.write(line*CH_STORAGE_LINE_SIZE, CH_STORAGE_LINE_SIZE)) {
-        // mark the line clean
-        _dirty_mask.clear(line);
+    // lines are the same size as flash storage blocks, so _dirty_mask
+    // is the flash storage's mask of dirty blocks
+    _flash.write_dirty(_dirty_mask);
+#endif
+}
+
+/*
+  copy some data out of a full flash sector while there is nothing to
+  write, so it can be erased without holding up a later write
+*/
+void Storage::_flash_compact(void)
+{
+#ifdef STORAGE_FLASH_PAGE
+#if HAL_WITH_RAMTRON
+    if (using_fram) {
+        return;
     }
+#endif
+    _flash.compact(STORAGE_FLASH_COMPACT_BLOCKS);
 #endif
 }
 
@@ -71,7 +71,8 @@ private:
 #endif
 
     void _flash_load(void);
-    void _flash_write(uint16_t line);
+    void _flash_write(void);
+    void _flash_compact(void);
 
 #if HAL_WITH_RAMTRON
     AP_RAMTRON fram;
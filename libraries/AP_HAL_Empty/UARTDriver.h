@@ -18,6 +18,7 @@ public:
     uint32_t available() override;
     uint32_t txspace() override;
     int16_t read() override;
+    using AP_HAL::BetterStream::read;
 
     /* Empty implementations of Print virtual methods */
     size_t write(uint8_t c) override;
@@ -14,10 +14,17 @@
  * You should have received a copy of the GNU General Public License along
  * with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <new>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <time.h>
-#include <vector>
+#include <unistd.h>
 
 #include <AP_HAL/AP_HAL.h>
 #include <AP_Math/AP_Math.h>
@@ -37,6 +44,9 @@ static const AP_HAL::HAL &hal = AP_HAL::get_HAL();
 
 Perf *Perf::_singleton;
 
+/* the slots of the calling thread */
+static thread_local Perf_Thread *_thread_slots;
+
 static inline uint64_t now_nsec()
 {
     struct timespec ts;
@@ -44,6 +54,55 @@ static inline uint64_t now_nsec()
     return ts.tv_nsec + (ts.tv_sec * AP_NSEC_PER_SEC);
 }
 
+/* single writer increment, no locked instruction needed */
+template <typename T>
+static inline void slot_add(std::atomic<T> &v, T n)
+{
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/*
+  histogram bin of an elapsed time. Values below 2^PERF_HIST_SUB_BITS
+  have a bin each, then each power of two is split into
+  2^PERF_HIST_SUB_BITS bins
+ */
+static inline uint16_t hist_bin(uint64_t v)
+{
+    const uint8_t sub = 1U << PERF_HIST_SUB_BITS;
+    if (v < sub) {
+        return v;
+    }
+    const uint8_t e = 63 - __builtin_clzll(v);
+    const uint16_t bin = sub + (e - PERF_HIST_SUB_BITS) * sub +
+        ((v >> (e - PERF_HIST_SUB_BITS)) & (sub - 1));
+    return MIN(bin, PERF_HIST_BINS - 1);
+}
+
+/* upper bound of the values in a histogram bin */
+static uint64_t hist_bin_max(uint16_t bin)
+{
+    const uint8_t sub = 1U << PERF_HIST_SUB_BITS;
+    if (bin < sub) {
+        return bin;
+    }
+    const uint8_t e = (bin - sub) / sub + PERF_HIST_SUB_BITS;
+    const uint64_t m = sub + (bin - sub) % sub;
+    return ((m + 1) << (e - PERF_HIST_SUB_BITS)) - 1;
+}
+
+uint64_t Perf_Stats::percentile(float p) const
+{
+    const uint64_t target = ceilf(count * p);
+    uint64_t sum = 0;
+    for (uint16_t i = 0; i < PERF_HIST_BINS; i++) {
+        sum += hist[i];
+        if (sum >= target && sum > 0) {
+            return MIN(hist_bin_max(i), max);
+        }
+    }
+    return max;
+}
+
 Perf *Perf::get_singleton()
 {
     if (!_singleton) {
@@ -61,58 +120,90 @@ void Perf::_debug_counters()
         return;
     }
 
-    pthread_rwlock_rdlock(&_perf_counters_lock);
-    unsigned int uc = _update_count;
-    auto v = _perf_counters;
-    pthread_rwlock_unlock(&_perf_counters_lock);
-
-    if (uc != _update_count) {
-        fprintf(stderr, "WARNING!! potentially wrong counters!!!");
-    }
-
-    for (auto &c : v) {
-        if (!c.count) {
-            fprintf(stderr, "%-30s\t"
-                    "(no events)\n", c.name);
-        } else if (c.type == Util::PC_ELAPSED) {
-            fprintf(stderr, "%-30s\t"
-                    "count: %" PRIu64 "\t"
-                    "min: %" PRIu64 "\t"
-                    "max: %" PRIu64 "\t"
-                    "avg: %.4f\t"
-                    "stddev: %.4f\n",
-                    c.name, c.count, c.min, c.max, c.avg, sqrt(c.m2));
-        } else {
-            fprintf(stderr, "%-30s\t"
-                    "count: %" PRIu64 "\n",
-                    c.name, c.count);
-        }
-    }
+    dump(STDERR_FILENO, false);
 
     _last_debug_msec = now;
 }
 
 Perf::Perf()
 {
-    if (pthread_rwlock_init(&_perf_counters_lock, nullptr) != 0) {
-        AP_HAL::panic("Perf: fail to initialize rw lock");
+    if (pthread_mutex_init(&_add_lock, nullptr) != 0) {
+        AP_HAL::panic("Perf: fail to initialize mutex");
     }
 
-    /* TODO: this number should come from vehicle code - just estimate the
-     * number of perf counters for now; if we grow more, it will just
-     * reallocate the memory pool */
-    _perf_counters.reserve(50);
-
 #ifdef DEBUG_PERF
     hal.scheduler->register_timer_process(FUNCTOR_BIND_MEMBER(&Perf::_debug_counters, void));
 #endif
+
+    /*
+      ARDUPILOT_PERF_SOCKET names a UNIX socket that sends a JSON dump
+      of the counters to each client that connects, for example with
+      "socat - UNIX-CONNECT:path". ARDUPILOT_PERF_DUMP names a file
+      rewritten every 5 seconds, as JSON if it ends in .json and as
+      text otherwise. In the logs directory it can be fetched with
+      MAVLink FTP
+     */
+    const char *sock_path = getenv("ARDUPILOT_PERF_SOCKET");
+    if (sock_path != nullptr) {
+        struct sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, sock_path, sizeof(addr.sun_path) - 1);
+        unlink(sock_path);
+        _sock_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (_sock_fd == -1 ||
+            bind(_sock_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+            listen(_sock_fd, 2) == -1) {
+            fprintf(stderr, "Perf: failed to open socket %s: %s\n", sock_path, strerror(errno));
+            if (_sock_fd != -1) {
+                close(_sock_fd);
+                _sock_fd = -1;
+            }
+        }
+    }
+    _dump_path = getenv("ARDUPILOT_PERF_DUMP");
+
+    if (_sock_fd != -1 || _dump_path != nullptr) {
+        hal.scheduler->register_io_process(FUNCTOR_BIND_MEMBER(&Perf::_io_update, void));
+    }
+}
+
+/*
+  find the calling thread's slot for a counter, allocating it on first use
+ */
+Perf_Slot *Perf::_get_slot(uintptr_t idx)
+{
+    Perf_Thread *t = _thread_slots;
+    if (t == nullptr) {
+        t = new Perf_Thread {};
+        if (t == nullptr) {
+            return nullptr;
+        }
+        // publish to the aggregating thread
+        t->next = _threads.load(std::memory_order_relaxed);
+        while (!_threads.compare_exchange_weak(t->next, t, std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+        }
+        _thread_slots = t;
+    }
+
+    Perf_Slot *slot = t->slots[idx].load(std::memory_order_relaxed);
+    if (slot == nullptr) {
+        void *mem;
+        if (posix_memalign(&mem, alignof(Perf_Slot), sizeof(Perf_Slot)) != 0) {
+            return nullptr;
+        }
+        slot = new (mem) Perf_Slot {};
+        slot->min.store(ULLONG_MAX, std::memory_order_relaxed);
+        t->slots[idx].store(slot, std::memory_order_release);
+    }
+    return slot;
 }
 
 void Perf::begin(Util::perf_counter_t pc)
 {
     uintptr_t idx = (uintptr_t)pc;
 
-    if (idx >= _perf_counters.size()) {
+    if (idx >= _num_counters.load(std::memory_order_acquire)) {
         return;
     }
 
@@ -124,24 +215,29 @@ void Perf::begin(Util::perf_counter_t pc)
         return;
     }
 
-    if (perf.start != 0) {
+    Perf_Slot *slot = _get_slot(idx);
+    if (slot == nullptr) {
+        return;
+    }
+
+    if (slot->start != 0) {
         hal.console->printf("perf_begin() called twice on perf_counter_t(%s)\n",
                             perf.name);
         return;
     }
 
-    _update_count++;
-
-    perf.start = now_nsec();
+    slot->start = now_nsec();
 
     perf.lttng.begin(perf.name);
+    _trace.begin(perf.name, slot->start);
 }
 
 void Perf::end(Util::perf_counter_t pc)
 {
+    const uint64_t now = now_nsec();
     uintptr_t idx = (uintptr_t)pc;
 
-    if (idx >= _perf_counters.size()) {
+    if (idx >= _num_counters.load(std::memory_order_acquire)) {
         return;
     }
 
@@ -153,44 +249,72 @@ void Perf::end(Util::perf_counter_t pc)
         return;
     }
 
-    if (perf.start == 0) {
+    Perf_Slot *slot = _get_slot(idx);
+    if (slot == nullptr) {
+        return;
+    }
+
+    if (slot->start == 0) {
         hal.console->printf("perf_begin() called before begin() on perf_counter_t(%s)\n",
                             perf.name);
         return;
     }
 
-    _update_count++;
+    const uint64_t elapsed = now - slot->start;
+    slot->start = 0;
+
+    _add_sample(slot, elapsed);
+
+    perf.lttng.end(perf.name);
+    _trace.end(perf.name, now);
+}
+
+/*
+  add an interval measured by the caller, for intervals that start in
+  one thread and end in another
+ */
+void Perf::add_elapsed(Util::perf_counter_t pc, uint64_t elapsed_nsec)
+{
+    uintptr_t idx = (uintptr_t)pc;
 
-    const uint64_t elapsed = now_nsec() - perf.start;
-    perf.count++;
-    perf.total += elapsed;
+    if (idx >= _num_counters.load(std::memory_order_acquire)) {
+        return;
+    }
 
-    if (perf.min > elapsed) {
-        perf.min = elapsed;
+    Perf_Counter &perf = _perf_counters[idx];
+    if (perf.type != Util::PC_ELAPSED) {
+        hal.console->printf("perf_add_elapsed() called on perf_counter_t(%s) that"
+                            " is not of PC_ELAPSED type.\n",
+                            perf.name);
+        return;
     }
 
-    if (perf.max < elapsed) {
-        perf.max = elapsed;
+    Perf_Slot *slot = _get_slot(idx);
+    if (slot == nullptr) {
+        return;
     }
 
-    /*
-     * Maintain avg and variance of interval in nanoseconds
-     * Knuth/Welford recursive avg and variance of update intervals (via Wikipedia)
-     * Same implementation of PX4.
-     */
-    const double delta_intvl = elapsed - perf.avg;
-    perf.avg += (delta_intvl / perf.count);
-    perf.m2 += (delta_intvl * (elapsed - perf.avg));
-    perf.start = 0;
+    _add_sample(slot, elapsed_nsec);
+}
 
-    perf.lttng.end(perf.name);
+void Perf::_add_sample(Perf_Slot *slot, uint64_t elapsed)
+{
+    slot_add(slot->count, (uint64_t)1);
+    slot_add(slot->total, elapsed);
+    if (elapsed < slot->min.load(std::memory_order_relaxed)) {
+        slot->min.store(elapsed, std::memory_order_relaxed);
+    }
+    if (elapsed > slot->max.load(std::memory_order_relaxed)) {
+        slot->max.store(elapsed, std::memory_order_relaxed);
+    }
+    slot_add(slot->hist[hist_bin(elapsed)], (uint32_t)1);
 }
 
 void Perf::count(Util::perf_counter_t pc)
 {
     uintptr_t idx = (uintptr_t)pc;
 
-    if (idx >= _perf_counters.size()) {
+    if (idx >= _num_counters.load(std::memory_order_acquire)) {
         return;
     }
 
@@ -202,10 +326,18 @@ void Perf::count(Util::perf_counter_t pc)
         return;
     }
 
-    _update_count++;
-    perf.count++;
+    Perf_Slot *slot = _get_slot(idx);
+    if (slot == nullptr) {
+        return;
+    }
+    const uint64_t n = slot->count.load(std::memory_order_relaxed) + 1;
+    slot->count.store(n, std::memory_order_relaxed);
 
-    perf.lttng.count(perf.name, perf.count);
+    // the count of this thread, as the total would need all of them
+    perf.lttng.count(perf.name, n);
+    if (_trace.enabled()) {
+        _trace.count(perf.name, now_nsec(), n);
+    }
 }
 
 Util::perf_counter_t Perf::add(Util::perf_counter_type type, const char *name)
@@ -218,10 +350,131 @@ Util::perf_counter_t Perf::add(Util::perf_counter_type type, const char *name)
         return (Util::perf_counter_t)(uintptr_t) -1;
     }
 
-    pthread_rwlock_wrlock(&_perf_counters_lock);
-    Util::perf_counter_t pc = (Util::perf_counter_t) _perf_counters.size();
-    _perf_counters.emplace_back(type, name);
-    pthread_rwlock_unlock(&_perf_counters_lock);
+    pthread_mutex_lock(&_add_lock);
+    const unsigned int idx = _num_counters.load(std::memory_order_relaxed);
+    if (idx >= PERF_MAX_COUNTERS) {
+        pthread_mutex_unlock(&_add_lock);
+        hal.console->printf("Perf: too many counters, %s not added\n", name);
+        return (Util::perf_counter_t)(uintptr_t) -1;
+    }
+    _perf_counters[idx].name = name;
+    _perf_counters[idx].type = type;
+    // the counter is set up before other threads can see it
+    _num_counters.store(idx + 1, std::memory_order_release);
+    pthread_mutex_unlock(&_add_lock);
+
+    return (Util::perf_counter_t)(uintptr_t) idx;
+}
+
+/*
+  sum a counter over the threads that have used it. This only reads
+  the slots, so it never delays the threads being measured
+ */
+bool Perf::get_stats(Util::perf_counter_t pc, Perf_Stats &stats) const
+{
+    uintptr_t idx = (uintptr_t)pc;
+
+    if (idx >= _num_counters.load(std::memory_order_acquire)) {
+        return false;
+    }
 
-    return pc;
+    memset(&stats, 0, sizeof(stats));
+    stats.min = ULLONG_MAX;
+    for (const Perf_Thread *t = _threads.load(std::memory_order_acquire); t != nullptr; t = t->next) {
+        const Perf_Slot *slot = t->slots[idx].load(std::memory_order_acquire);
+        if (slot == nullptr) {
+            continue;
+        }
+        stats.count += slot->count.load(std::memory_order_relaxed);
+        stats.total += slot->total.load(std::memory_order_relaxed);
+        stats.min = MIN(stats.min, slot->min.load(std::memory_order_relaxed));
+        stats.max = MAX(stats.max, slot->max.load(std::memory_order_relaxed));
+        for (uint16_t i = 0; i < PERF_HIST_BINS; i++) {
+            stats.hist[i] += slot->hist[i].load(std::memory_order_relaxed);
+        }
+    }
+    if (stats.count == 0) {
+        stats.min = 0;
+    }
+    return true;
+}
+
+void Perf::dump(int fd, bool json) const
+{
+    const unsigned int n = _num_counters.load(std::memory_order_acquire);
+
+    if (json) {
+        dprintf(fd, "{\"counters\":[");
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        const Perf_Counter &c = _perf_counters[i];
+        Perf_Stats s;
+        if (!get_stats((Util::perf_counter_t)(uintptr_t)i, s)) {
+            continue;
+        }
+        if (json) {
+            dprintf(fd, "%s\n{\"name\":\"%s\",\"count\":%" PRIu64, i == 0 ? "" : ",", c.name, s.count);
+            if (c.type == Util::PC_ELAPSED && s.count != 0) {
+                dprintf(fd, ",\"min\":%" PRIu64 ",\"max\":%" PRIu64 ",\"avg\":%" PRIu64
+                        ",\"p50\":%" PRIu64 ",\"p90\":%" PRIu64 ",\"p99\":%" PRIu64 ",\"p999\":%" PRIu64,
+                        s.min, s.max, s.total / s.count,
+                        s.percentile(0.5), s.percentile(0.9), s.percentile(0.99), s.percentile(0.999));
+            }
+            dprintf(fd, "}");
+        } else if (!s.count) {
+            dprintf(fd, "%-30s\t"
+                    "(no events)\n", c.name);
+        } else if (c.type == Util::PC_ELAPSED) {
+            dprintf(fd, "%-30s\t"
+                    "count: %" PRIu64 "\t"
+                    "min: %" PRIu64 "\t"
+                    "max: %" PRIu64 "\t"
+                    "avg: %" PRIu64 "\t"
+                    "p50: %" PRIu64 "\t"
+                    "p90: %" PRIu64 "\t"
+                    "p99: %" PRIu64 "\t"
+                    "p99.9: %" PRIu64 "\n",
+                    c.name, s.count, s.min, s.max, s.total / s.count,
+                    s.percentile(0.5), s.percentile(0.9), s.percentile(0.99), s.percentile(0.999));
+        } else {
+            dprintf(fd, "%-30s\t"
+                    "count: %" PRIu64 "\n",
+                    c.name, s.count);
+        }
+    }
+    if (json) {
+        dprintf(fd, "\n]}\n");
+    }
+}
+
+void Perf::_io_update()
+{
+    const uint64_t now = AP_HAL::millis64();
+    if (now - _last_io_msec < 100) {
+        return;
+    }
+    _last_io_msec = now;
+
+    if (_sock_fd != -1) {
+        int fd;
+        while ((fd = accept4(_sock_fd, nullptr, nullptr, SOCK_CLOEXEC)) != -1) {
+            dump(fd, true);
+            close(fd);
+        }
+    }
+
+    if (_dump_path != nullptr && now - _last_dump_msec >= 5000) {
+        _last_dump_msec = now;
+        // write to a temporary file and rename, so readers never see
+        // a partial dump
+        char tmp[PATH_MAX];
+        snprintf(tmp, sizeof(tmp), "%s.tmp", _dump_path);
+        int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd != -1) {
+            const size_t len = strlen(_dump_path);
+            dump(fd, len > 5 && strcmp(&_dump_path[len - 5], ".json") == 0);
+            close(fd);
+            rename(tmp, _dump_path);
+        }
+    }
 }
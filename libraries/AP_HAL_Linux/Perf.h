@@ -19,42 +19,78 @@
 #include <atomic>
 #include <limits.h>
 #include <pthread.h>
-#include <vector>
 
 #include "AP_HAL_Linux.h"
 #include "Perf_Lttng.h"
+#include "Perf_Trace.h"
 #include "Thread.h"
 #include "Util.h"
 
+/*
+  maximum number of perf counters. Counters are kept in a fixed table
+  so a handle stays valid without locking while counters are added
+ */
+#define PERF_MAX_COUNTERS 256
+
+/*
+  elapsed times are kept in a log-linear (HDR style) histogram of
+  nanoseconds, with 2^PERF_HIST_SUB_BITS linear bins per power of two,
+  so any percentile is known to within 25%. The last bin holds
+  everything over about 17 minutes
+ */
+#define PERF_HIST_SUB_BITS 2
+#define PERF_HIST_BINS 160
+
 namespace Linux {
 
+/*
+  a perf counter as added, shared by all threads
+ */
 class Perf_Counter {
     using perf_counter_type = AP_HAL::Util::perf_counter_type;
-    using perf_counter_t = AP_HAL::Util::perf_counter_t;
 
 public:
-    Perf_Counter(perf_counter_type type_, const char *name_)
-        : name{name_}
-        , type{type_}
-        , min{ULONG_MAX}
-    {
-    }
-
     const char *name;
     Perf_Lttng lttng;
-
     perf_counter_type type;
+};
 
-    uint64_t count;
+/*
+  the state of one counter in one thread. Only that thread writes it,
+  so updates are plain loads and stores; the atomics only make reads
+  from the thread aggregating the counters well defined. Each slot has
+  its own cache lines so threads never share a line being written
+ */
+struct alignas(64) Perf_Slot {
+    uint64_t start;                     /* owning thread only */
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> min;
+    std::atomic<uint64_t> max;
+    std::atomic<uint32_t> hist[PERF_HIST_BINS];
+};
 
+/*
+  the slots of one thread, allocated on first use of each counter
+ */
+struct Perf_Thread {
+    std::atomic<Perf_Slot *> slots[PERF_MAX_COUNTERS];
+    Perf_Thread *next;
+};
+
+/*
+  a counter summed over all threads
+ */
+struct Perf_Stats {
+    uint64_t count;
     /* Everything below is in nanoseconds */
-    uint64_t start;
     uint64_t total;
     uint64_t min;
     uint64_t max;
+    uint32_t hist[PERF_HIST_BINS];
 
-    double avg;
-    double m2;
+    /* value below which the given fraction of samples lie */
+    uint64_t percentile(float p) const;
 };
 
 class Perf {
@@ -72,24 +108,47 @@ public:
     void end(perf_counter_t pc);
     void count(perf_counter_t pc);
 
-    unsigned int get_update_count() { return _update_count; }
+    /* add an interval measured by the caller to a PC_ELAPSED counter */
+    void add_elapsed(perf_counter_t pc, uint64_t elapsed_nsec);
+
+    /* sum a counter over all threads, false if there is no such counter */
+    bool get_stats(perf_counter_t pc, Perf_Stats &stats) const;
+
+    /* write all counters to fd, as JSON or as a text table */
+    void dump(int fd, bool json) const;
 
 private:
     static Perf *_singleton;
 
     Perf();
 
+    Perf_Slot *_get_slot(uintptr_t idx);
+    void _add_sample(Perf_Slot *slot, uint64_t elapsed);
+
     void _debug_counters();
 
+    /* serve the socket and write the dump file, from the IO thread */
+    void _io_update();
+
     uint64_t _last_debug_msec;
 
-    std::vector<Perf_Counter> _perf_counters;
+    Perf_Counter _perf_counters[PERF_MAX_COUNTERS];
+    std::atomic<unsigned int> _num_counters {0};
 
     /* synchronize addition of new perf counters */
-    pthread_rwlock_t _perf_counters_lock;
+    pthread_mutex_t _add_lock;
+
+    /* every thread that has used a counter */
+    std::atomic<Perf_Thread *> _threads {nullptr};
+
+    /* optional Chrome trace output */
+    Perf_Trace _trace;
 
-    /* allow to check if memory pool has changed */
-    std::atomic<unsigned int> _update_count;
+    /* optional UNIX socket and dump file, see Perf() */
+    int _sock_fd = -1;
+    const char *_dump_path;
+    uint64_t _last_io_msec;
+    uint64_t _last_dump_msec;
 };
 
 }
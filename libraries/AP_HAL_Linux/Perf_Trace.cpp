@@ -0,0 +1,80 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <AP_HAL/AP_HAL.h>
+
+#include "Perf_Trace.h"
+
+using namespace Linux;
+
+#define PERF_TRACE_BUFSIZE 65536
+
+Perf_Trace::Perf_Trace()
+{
+    pthread_mutex_init(&_lock, nullptr);
+
+    const char *path = getenv("ARDUPILOT_PERF_TRACE");
+    if (path == nullptr) {
+        return;
+    }
+    _fp = fopen(path, "w");
+    if (_fp == nullptr) {
+        fprintf(stderr, "Perf: failed to open trace file %s\n", path);
+        return;
+    }
+    setvbuf(_fp, nullptr, _IOFBF, PERF_TRACE_BUFSIZE);
+
+    // the closing bracket is optional in the JSON array format, so
+    // the file is usable however we exit
+    fputs("[\n", _fp);
+}
+
+void Perf_Trace::write_event(const char *name, char phase, uint64_t t_nsec, const char *args)
+{
+    const long tid = syscall(SYS_gettid);
+
+    pthread_mutex_lock(&_lock);
+    fprintf(_fp, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%ld%s}",
+            _first ? "" : ",\n",
+            name, phase, t_nsec * 1.0e-3, (int)getpid(), tid, args);
+    _first = false;
+    pthread_mutex_unlock(&_lock);
+}
+
+void Perf_Trace::begin(const char *name, uint64_t t_nsec)
+{
+    if (_fp != nullptr) {
+        write_event(name, 'B', t_nsec, "");
+    }
+}
+
+void Perf_Trace::end(const char *name, uint64_t t_nsec)
+{
+    if (_fp != nullptr) {
+        write_event(name, 'E', t_nsec, "");
+    }
+}
+
+void Perf_Trace::count(const char *name, uint64_t t_nsec, uint64_t val)
+{
+    if (_fp != nullptr) {
+        char args[48];
+        snprintf(args, sizeof(args), ",\"args\":{\"count\":%llu}", (unsigned long long)val);
+        write_event(name, 'C', t_nsec, args);
+    }
+}
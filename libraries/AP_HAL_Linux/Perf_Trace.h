@@ -0,0 +1,49 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+
+#include "AP_HAL_Linux.h"
+
+namespace Linux {
+
+/*
+  write perf counter events as a Chrome trace (JSON array format), to
+  be loaded into chrome://tracing or Perfetto. Enabled by setting
+  ARDUPILOT_PERF_TRACE to the name of the file to write. For CTF use
+  LTTng through Perf_Lttng instead
+ */
+class Perf_Trace {
+public:
+    Perf_Trace();
+
+    bool enabled() const { return _fp != nullptr; }
+
+    void begin(const char *name, uint64_t t_nsec);
+    void end(const char *name, uint64_t t_nsec);
+    void count(const char *name, uint64_t t_nsec, uint64_t val);
+
+private:
+    void write_event(const char *name, char phase, uint64_t t_nsec, const char *args);
+
+    FILE *_fp;
+    bool _first = true;
+    pthread_mutex_t _lock;
+};
+
+}
@@ -90,6 +90,21 @@ bool Poller::register_pollable(Pollable *p, uint32_t events)
     return epoll_ctl(_epfd, EPOLL_CTL_ADD, p->get_fd(), &epev) == 0;
 }
 
+bool Poller::modify_pollable(Pollable *p, uint32_t events)
+{
+    events |= EPOLLWAKEUP;
+
+    if (_epfd < 0) {
+        return false;
+    }
+
+    struct epoll_event epev = { };
+    epev.events = events;
+    epev.data.ptr = static_cast<void *>(p);
+
+    return epoll_ctl(_epfd, EPOLL_CTL_MOD, p->get_fd(), &epev) == 0;
+}
+
 void Poller::unregister_pollable(const Pollable *p)
 {
     if (_epfd >= 0 && p->get_fd() >= 0) {
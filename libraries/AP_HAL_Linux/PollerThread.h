@@ -70,6 +70,20 @@ public:
                              uint32_t timeout_usec);
     bool adjust_timer(TimerPollable *p, uint32_t timeout_usec);
 
+    /*
+     * Serve the events of @p from this thread, see Poller. The caller
+     * keeps ownership of @p and must unregister it before destroying it.
+     */
+    bool register_pollable(Pollable *p, uint32_t events) {
+        return _poller.register_pollable(p, events);
+    }
+    bool modify_pollable(Pollable *p, uint32_t events) {
+        return _poller.modify_pollable(p, events);
+    }
+    void unregister_pollable(const Pollable *p) {
+        _poller.unregister_pollable(p);
+    }
+
     void mainloop();
 
     bool stop() override;
@@ -3,9 +3,11 @@
 #include <algorithm>
 #include <errno.h>
 #include <poll.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/sysinfo.h>
 #include <sys/time.h>
 #include <unistd.h>
 
@@ -99,6 +101,10 @@ void Scheduler::init()
 
     _main_ctx = pthread_self();
 
+    // the CPUs threads created later may use, even once the main
+    // thread is pinned
+    _have_startup_cpus = sched_getaffinity(0, sizeof(_startup_cpus), &_startup_cpus) == 0;
+
     init_realtime();
 
     /* set barrier to N + 1 threads: worker threads + main */
@@ -117,6 +123,14 @@ void Scheduler::init()
         t->thread->start(t->name, t->policy, t->prio);
     }
 
+#if HAL_LINUX_UART_EPOLL
+    // start writing bytes queued on idle ports from the poller thread,
+    // rather than from the thread queueing them
+    _uart_poller.add_timer(FUNCTOR_BIND_MEMBER(&Scheduler::_kick_uarts, void), nullptr, 1000);
+    _uart_poller.set_stack_size(1024 * 1024);
+    _uart_poller.start("ap-uart-io", SCHED_FIFO, APM_LINUX_UART_PRIORITY);
+#endif
+
 #if defined(DEBUG_STACK) && DEBUG_STACK
     register_timer_process(FUNCTOR_BIND_MEMBER(&Scheduler::_debug_stack, void));
 #endif
@@ -252,7 +266,8 @@ void Scheduler::_run_io(void)
 }
 
 /*
-  run timers for all UARTs
+  run timers for all UARTs. UARTs served by the UART poller thread only
+  do their housekeeping here
  */
 void Scheduler::_run_uarts()
 {
@@ -267,6 +282,22 @@ void Scheduler::_run_uarts()
     hal.uartH->_timer_tick();
 }
 
+/*
+  wait for the UARTs served by the UART poller thread to be writable
+  once bytes are queued. Called from the UART poller thread
+ */
+void Scheduler::_kick_uarts()
+{
+    UARTDriver::from(hal.uartA)->_event_kick_write();
+    UARTDriver::from(hal.uartB)->_event_kick_write();
+    UARTDriver::from(hal.uartC)->_event_kick_write();
+    UARTDriver::from(hal.uartD)->_event_kick_write();
+    UARTDriver::from(hal.uartE)->_event_kick_write();
+    UARTDriver::from(hal.uartF)->_event_kick_write();
+    UARTDriver::from(hal.uartG)->_event_kick_write();
+    UARTDriver::from(hal.uartH)->_event_kick_write();
+}
+
 void Scheduler::_rcin_task()
 {
     RCInput::from(hal.rcin)->_timer_tick();
@@ -336,11 +367,13 @@ void Scheduler::teardown()
     _io_thread.stop();
     _rcin_thread.stop();
     _uart_thread.stop();
+    _uart_poller.stop();
 
     _timer_thread.join();
     _io_thread.join();
     _rcin_thread.join();
     _uart_thread.join();
+    _uart_poller.join();
 }
 
 /*
@@ -393,3 +426,22 @@ bool Scheduler::thread_create(AP_HAL::MemberProc proc, const char *name, uint32_
 
     return true;
 }
+
+bool Scheduler::pin_worker_thread()
+{
+    const int ncpus = get_nprocs();
+    if (ncpus < 2) {
+        return false;
+    }
+    uint8_t cpu;
+    {
+        WITH_SEMAPHORE(_pin_semaphore);
+        // the first CPU is left to the main thread and the HAL threads
+        cpu = 1 + _num_pinned_workers % (ncpus-1);
+        _num_pinned_workers++;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+}
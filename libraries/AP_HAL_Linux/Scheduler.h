@@ -1,8 +1,10 @@
 #pragma once
 
 #include <pthread.h>
+#include <sched.h>
 
 #include "AP_HAL_Linux.h"
+#include "PollerThread.h"
 #include "Semaphores.h"
 #include "Thread.h"
 
@@ -47,10 +49,32 @@ public:
 
     void teardown();
 
+    /*
+      thread serving the UARTs that can wait for their file
+      descriptors to be ready, see UARTDriver
+     */
+    PollerThread &uart_poller() { return _uart_poller; }
+
     /*
       create a new thread
      */
     bool thread_create(AP_HAL::MemberProc, const char *name, uint32_t stack_size, priority_base base, int8_t priority) override;
+
+    /*
+      pin the calling worker thread to a CPU of its own. The CPUs
+      after the first are handed out in turn to the worker threads of
+      every library, so two only share a CPU when there are more
+      workers than CPUs. Returns false on a single CPU board
+     */
+    bool pin_worker_thread();
+
+    /*
+      the CPUs the process could use at startup, which every thread
+      started by the HAL may use, or nullptr if unknown
+     */
+    const cpu_set_t *get_startup_cpus() const {
+        return _have_startup_cpus ? &_startup_cpus : nullptr;
+    }
     
 private:
     class SchedulerThread : public PeriodicThread {
@@ -88,6 +112,7 @@ private:
     SchedulerThread _io_thread{FUNCTOR_BIND_MEMBER(&Scheduler::_io_task, void), *this};
     SchedulerThread _rcin_thread{FUNCTOR_BIND_MEMBER(&Scheduler::_rcin_task, void), *this};
     SchedulerThread _uart_thread{FUNCTOR_BIND_MEMBER(&Scheduler::_uart_task, void), *this};
+    PollerThread _uart_poller;
 
     void _timer_task();
     void _io_task();
@@ -96,12 +121,22 @@ private:
 
     void _run_io();
     void _run_uarts();
+    void _kick_uarts();
 
     uint64_t _stopped_clock_usec;
     uint64_t _last_stack_debug_msec;
     pthread_t _main_ctx;
 
     Semaphore _io_semaphore;
+
+    // number of worker threads pinned by pin_worker_thread()
+    uint8_t _num_pinned_workers;
+    Semaphore _pin_semaphore;
+
+    // CPUs at startup, so that no thread inherits the mask of a
+    // pinned thread starting it
+    cpu_set_t _startup_cpus;
+    bool _have_startup_cpus;
 };
 
 }
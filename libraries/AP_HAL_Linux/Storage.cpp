@@ -9,6 +9,7 @@
 #include <unistd.h>
 
 #include <AP_HAL/AP_HAL.h>
+#include <AP_Math/crc.h>
 #include <AP_Vehicle/AP_Vehicle_Type.h>
 
 using namespace Linux;
@@ -21,6 +22,9 @@ using namespace Linux;
 // name the storage file after the sketch so you can use the same board
 // card for ArduCopter and ArduPlane
 #define STORAGE_FILE SKETCHNAME ".stg"
+#define JOURNAL_FILE SKETCHNAME ".stj"
+
+#define JOURNAL_MAGIC 0x314c4e4a    // "JNL1"
 
 extern const AP_HAL::HAL& hal;
 
@@ -171,6 +175,11 @@ void Storage::init()
     }
 
     _fd = fd;
+
+#if HAL_LINUX_STORAGE_JOURNAL
+    _journal_open(dpath);
+#endif
+
     _initialised = true;
 }
 
@@ -192,6 +201,13 @@ void Storage::_mark_dirty(uint16_t loc, uint16_t length)
          line++) {
         _dirty_mask |= 1U << line;
     }
+#if HAL_LINUX_STORAGE_JOURNAL
+    const uint32_t now = AP_HAL::millis();
+    if (_first_dirty_ms == 0) {
+        _first_dirty_ms = now;
+    }
+    _last_dirty_ms = now;
+#endif
 }
 
 void Storage::read_block(void *dst, uint16_t loc, size_t n)
@@ -210,6 +226,9 @@ void Storage::write_block(uint16_t loc, const void *src, size_t n)
     }
     if (memcmp(src, &_buffer[loc], n) != 0) {
         init();
+#if HAL_LINUX_STORAGE_JOURNAL
+        WITH_SEMAPHORE(_sem);
+#endif
         memcpy(&_buffer[loc], src, n);
         _mark_dirty(loc, n);
     }
@@ -221,6 +240,13 @@ void Storage::_timer_tick(void)
         return;
     }
 
+#if HAL_LINUX_STORAGE_JOURNAL
+    if (_journal_fd != -1) {
+        _journal_tick();
+        return;
+    }
+#endif
+
     // write out the first dirty set of lines. We don't write more
     // than one to keep the latency of this call to a minimum
     uint8_t i, n;
@@ -266,3 +292,180 @@ void Storage::_timer_tick(void)
         }
     }
 }
+
+#if HAL_LINUX_STORAGE_JOURNAL
+/*
+  open the journal, creating it if needed, and apply any changes it
+  holds. If it can't be opened changes are written straight to the
+  storage file
+ */
+void Storage::_journal_open(const char *dpath)
+{
+    if (asprintf(&_journal_path, "%s/%s", dpath, JOURNAL_FILE) == -1) {
+        _journal_path = nullptr;
+        return;
+    }
+    _journal_fd = open(_journal_path, O_RDWR|O_CREAT|O_APPEND|O_CLOEXEC, 0666);
+    if (_journal_fd == -1) {
+        fprintf(stderr, "Failed to open storage journal %s (%m)\n", _journal_path);
+        return;
+    }
+
+    if (_journal_replay() && !_checkpoint()) {
+        _journal_close();
+    }
+}
+
+/*
+  apply the records of the journal to the buffer in order, stopping at
+  the first one that is incomplete or fails its CRC, which is where
+  power was lost during an append
+  returns true if the journal is not empty
+ */
+bool Storage::_journal_replay()
+{
+    struct journal_header hdr;
+    uint8_t *lines = &_journal_buffer[sizeof(hdr)];
+    off_t ofs = 0;
+
+    while (pread(_journal_fd, &hdr, sizeof(hdr), ofs) == sizeof(hdr)) {
+        const uint32_t len = __builtin_popcount(hdr.line_mask) * LINUX_STORAGE_LINE_SIZE;
+        if (hdr.magic != JOURNAL_MAGIC || hdr.line_mask == 0 ||
+            (uint64_t(hdr.line_mask) >> LINUX_STORAGE_NUM_LINES) != 0) {
+            break;
+        }
+        if (pread(_journal_fd, lines, len, ofs + sizeof(hdr)) != (ssize_t)len) {
+            break;
+        }
+        uint32_t crc = crc_crc32(0, (const uint8_t *)&hdr.line_mask, sizeof(hdr.line_mask));
+        crc = crc_crc32(crc, lines, len);
+        if (crc != hdr.crc) {
+            break;
+        }
+
+        const uint8_t *p = lines;
+        for (uint8_t i=0; i<LINUX_STORAGE_NUM_LINES; i++) {
+            if (hdr.line_mask & (1U<<i)) {
+                memcpy(&_buffer[i<<LINUX_STORAGE_LINE_SHIFT], p, LINUX_STORAGE_LINE_SIZE);
+                p += LINUX_STORAGE_LINE_SIZE;
+            }
+        }
+        ofs += sizeof(hdr) + len;
+    }
+
+    struct stat st;
+    return fstat(_journal_fd, &st) == 0 && st.st_size > 0;
+}
+
+/*
+  append the dirty lines to the journal once writes to storage have
+  paused, so a burst of changes goes in a single write
+ */
+void Storage::_journal_tick()
+{
+    if (_dirty_mask == 0) {
+        return;
+    }
+    const uint32_t now = AP_HAL::millis();
+    if (now - _last_dirty_ms < LINUX_STORAGE_COALESCE_MS &&
+        now - _first_dirty_ms < LINUX_STORAGE_MAX_DELAY_MS) {
+        return;
+    }
+
+    uint32_t line_mask;
+    {
+        // take a copy of the lines, so they can't change while being written
+        WITH_SEMAPHORE(_sem);
+        line_mask = _dirty_mask;
+        _dirty_mask = 0;
+        _first_dirty_ms = 0;
+        uint8_t *p = &_journal_buffer[sizeof(journal_header)];
+        for (uint8_t i=0; i<LINUX_STORAGE_NUM_LINES; i++) {
+            if (line_mask & (1U<<i)) {
+                memcpy(p, &_buffer[i<<LINUX_STORAGE_LINE_SHIFT], LINUX_STORAGE_LINE_SIZE);
+                p += LINUX_STORAGE_LINE_SIZE;
+            }
+        }
+    }
+
+    if (!_journal_append(line_mask)) {
+        // write what the journal would have held straight to the storage file
+        {
+            WITH_SEMAPHORE(_sem);
+            _dirty_mask |= line_mask;
+        }
+        _checkpoint();
+        _journal_close();
+        return;
+    }
+
+    if (_journal_size >= LINUX_STORAGE_JOURNAL_MAX && !_checkpoint()) {
+        _journal_close();
+    }
+}
+
+/*
+  append a record of the lines in line_mask, which have been copied to
+  _journal_buffer after the header
+ */
+bool Storage::_journal_append(uint32_t line_mask)
+{
+    struct journal_header &hdr = *(struct journal_header *)_journal_buffer;
+    const uint32_t len = __builtin_popcount(line_mask) * LINUX_STORAGE_LINE_SIZE;
+
+    hdr.magic = JOURNAL_MAGIC;
+    hdr.line_mask = line_mask;
+    hdr.crc = crc_crc32(0, (const uint8_t *)&hdr.line_mask, sizeof(hdr.line_mask));
+    hdr.crc = crc_crc32(hdr.crc, &_journal_buffer[sizeof(hdr)], len);
+
+    const ssize_t total = sizeof(hdr) + len;
+    if (write(_journal_fd, _journal_buffer, total) != total ||
+        fdatasync(_journal_fd) != 0) {
+        return false;
+    }
+    _journal_size += total;
+    return true;
+}
+
+/*
+  write the whole of storage back to the storage file and empty the
+  journal
+ */
+bool Storage::_checkpoint()
+{
+    {
+        WITH_SEMAPHORE(_sem);
+        memcpy(_journal_buffer, _buffer, sizeof(_buffer));
+    }
+
+    if (pwrite(_fd, _journal_buffer, sizeof(_buffer), 0) != sizeof(_buffer) ||
+        fsync(_fd) != 0) {
+        // as for a failed write of lines, give up on the storage
+        // file. The journal still holds the changes
+        close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    if (ftruncate(_journal_fd, 0) != 0 || fsync(_journal_fd) != 0) {
+        // the storage file is up to date, so remove the journal
+        // rather than have it replayed over later changes
+        if (_journal_path != nullptr) {
+            unlink(_journal_path);
+        }
+        return false;
+    }
+    _journal_size = 0;
+    return true;
+}
+
+/*
+  stop using the journal, writing changes straight to the storage
+  file from now on
+ */
+void Storage::_journal_close()
+{
+    close(_journal_fd);
+    _journal_fd = -1;
+}
+#endif // HAL_LINUX_STORAGE_JOURNAL
@@ -8,12 +8,27 @@
 #define LINUX_STORAGE_LINE_SIZE (1<<LINUX_STORAGE_LINE_SHIFT)
 #define LINUX_STORAGE_NUM_LINES (LINUX_STORAGE_SIZE/LINUX_STORAGE_LINE_SIZE)
 
+/*
+  write changes to an append-only journal next to the storage file
+  rather than to the storage file itself. The lines changed by a burst
+  of writes are appended together in one write, and the journal is
+  copied back to the storage file once it grows large. The journal is
+  replayed on boot, so a power cut leaves storage as it was after one
+  of the appends rather than half written
+ */
+#ifndef HAL_LINUX_STORAGE_JOURNAL
+#define HAL_LINUX_STORAGE_JOURNAL 1
+#endif
+#define LINUX_STORAGE_JOURNAL_MAX (4*LINUX_STORAGE_SIZE)   // journal size at which it is copied back to the storage file
+#define LINUX_STORAGE_COALESCE_MS 50                        // wait for writes to stop for this long before appending them
+#define LINUX_STORAGE_MAX_DELAY_MS 500                      // but don't hold back a change for longer than this
+
 namespace Linux {
 
 class Storage : public AP_HAL::Storage
 {
 public:
-    Storage() : _fd(-1),_dirty_mask(0) { }
+    Storage() : _fd(-1),_initialised(false),_dirty_mask(0) { }
 
     static Storage *from(AP_HAL::Storage *storage) {
         return static_cast<Storage*>(storage);
@@ -42,6 +57,29 @@ protected:
     volatile bool _initialised;
     volatile uint32_t _dirty_mask;
     uint8_t _buffer[LINUX_STORAGE_SIZE];
+
+#if HAL_LINUX_STORAGE_JOURNAL
+    struct PACKED journal_header {
+        uint32_t magic;
+        uint32_t line_mask;     // lines following the header, in order
+        uint32_t crc;           // crc32 of the line mask and the lines
+    };
+
+    void _journal_open(const char *dpath);
+    bool _journal_replay();
+    void _journal_tick();
+    bool _journal_append(uint32_t line_mask);
+    bool _checkpoint();
+    void _journal_close();
+
+    int _journal_fd = -1;
+    char *_journal_path = nullptr;
+    uint32_t _journal_size = 0;
+    uint32_t _first_dirty_ms = 0;   // time of the first change not yet written, or zero
+    uint32_t _last_dirty_ms;        // time of the latest change
+    HAL_Semaphore _sem;         // keeps writes out of the buffer while it is copied
+    uint8_t _journal_buffer[sizeof(journal_header) + LINUX_STORAGE_SIZE];
+#endif
 };
 
 }
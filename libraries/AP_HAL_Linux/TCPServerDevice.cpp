@@ -57,6 +57,19 @@ ssize_t TCPServerDevice::read(uint8_t *buf, uint16_t n)
     return ret;
 }
 
+/*
+  read from an established connection. Unlike read() this doesn't
+  close the connection on EOF, the caller stops waiting on the fd and
+  then polls with read() which does
+ */
+ssize_t TCPServerDevice::readv(const struct iovec *iov, int iovcnt)
+{
+    if (sock == nullptr) {
+        return -1;
+    }
+    return ::readv(sock->get_fd(), iov, iovcnt);
+}
+
 bool TCPServerDevice::open()
 {
     listener.reuseaddress();
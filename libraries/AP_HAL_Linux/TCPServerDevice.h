@@ -14,6 +14,8 @@ public:
     virtual void set_speed(uint32_t speed) override;
     virtual ssize_t write(const uint8_t *buf, uint16_t n) override;
     virtual ssize_t read(uint8_t *buf, uint16_t n) override;
+    virtual ssize_t readv(const struct iovec *iov, int iovcnt) override;
+    virtual int get_fd() const override { return sock != nullptr ? sock->get_fd() : -1; }
 
 private:
     SocketAPM listener{false};
@@ -189,6 +189,13 @@ bool Thread::start(const char *name, int policy, int prio)
         }
     }
 
+    // any CPU the process started with, rather than only those of a
+    // pinned thread starting this one
+    const cpu_set_t *cpus = Scheduler::from(hal.scheduler)->get_startup_cpus();
+    if (cpus != nullptr) {
+        pthread_attr_setaffinity_np(&attr, sizeof(*cpus), cpus);
+    }
+
     r = pthread_create(&_ctx, &attr, &Thread::_run_trampoline, this);
     if (r != 0) {
         AP_HAL::panic("Failed to create thread '%s': %s",
@@ -12,6 +12,8 @@ public:
     virtual bool close() override;
     virtual ssize_t write(const uint8_t *buf, uint16_t n) override;
     virtual ssize_t read(uint8_t *buf, uint16_t n) override;
+    virtual ssize_t readv(const struct iovec *iov, int iovcnt) override;
+    virtual int get_fd() const override { return _fd; }
     virtual void set_blocking(bool blocking) override;
     virtual void set_speed(uint32_t speed) override;
     virtual void set_flow_control(enum AP_HAL::UARTDriver::flow_control flow_control_setting) override;
@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -18,11 +19,14 @@
 #include <unistd.h>
 
 #include <AP_HAL/AP_HAL.h>
+#include <AP_Math/AP_Math.h>
 
 #include "ConsoleDevice.h"
+#include "Scheduler.h"
 #include "TCPServerDevice.h"
 #include "UARTDevice.h"
 #include "UDPDevice.h"
+#include "Util.h"
 
 #include <GCS_MAVLink/GCS.h>
 #include <AP_HAL/utility/packetise.h>
@@ -81,7 +85,13 @@ void UARTDriver::begin(uint32_t b, uint16_t rxS, uint16_t txS)
         _connected = _device->open();
         _device->set_blocking(false);
     }
-    _initialised = false;
+
+    {
+        WITH_SEMAPHORE(_event_sem);
+        _event_unregister();
+        _event_unsupported = false;
+        _initialised = false;
+    }
 
     while (_in_timer) hal.scheduler->delay(1);
 
@@ -211,7 +221,11 @@ AP_HAL::OwnPtr<SerialDevice> UARTDriver::_parseDevicePath(const char *arg)
  */
 void UARTDriver::end()
 {
-    _initialised = false;
+    {
+        WITH_SEMAPHORE(_event_sem);
+        _event_unregister();
+        _initialised = false;
+    }
     _connected = false;
 
     while (_in_timer) {
@@ -291,6 +305,15 @@ int16_t UARTDriver::read()
     return byte;
 }
 
+ssize_t UARTDriver::read(uint8_t *buffer, uint16_t count)
+{
+    if (!_initialised) {
+        return -1;
+    }
+
+    return _readbuf.read(buffer, count);
+}
+
 /* Linux implementations of Print virtual methods */
 size_t UARTDriver::write(uint8_t c)
 {
@@ -308,6 +331,9 @@ size_t UARTDriver::write(uint8_t c)
         }
         hal.scheduler->delay(1);
     }
+    if (_writebuf.available() == 0) {
+        _tx_queued_us = AP_HAL::micros();
+    }
     size_t ret = _writebuf.write(&c, 1);
     _write_mutex.give();
     return ret;
@@ -337,6 +363,9 @@ size_t UARTDriver::write(const uint8_t *buffer, size_t size)
         return ret;
     }
 
+    if (_writebuf.available() == 0) {
+        _tx_queued_us = AP_HAL::micros();
+    }
     size_t ret = _writebuf.write(buffer, size);
     _write_mutex.give();
     return ret;
@@ -393,6 +422,7 @@ bool UARTDriver::_write_pending_bytes(void)
             uint8_t tmpbuf[n];
             _writebuf.peekbytes(tmpbuf, n);
             ret = _write_fd(tmpbuf, n);
+            hal.util->perf_count(_perf_tx);
             if (ret > 0)
                 _writebuf.advance(ret);
         } else {
@@ -400,6 +430,7 @@ bool UARTDriver::_write_pending_bytes(void)
             const auto n_vec = _writebuf.peekiovec(vec, n);
             for (int i = 0; i < n_vec; i++) {
                 ret = _write_fd(vec[i].data, (uint16_t)vec[i].len);
+                hal.util->perf_count(_perf_tx);
                 if (ret < 0) {
                     break;
                 }
@@ -413,18 +444,43 @@ bool UARTDriver::_write_pending_bytes(void)
         }
     }
 
-    return _writebuf.available() != available_bytes;
+    const bool progress = _writebuf.available() != available_bytes;
+    if (progress && _tx_queued_us != 0) {
+        Perf::get_singleton()->add_elapsed(_perf_tx_latency,
+                                           (uint64_t)(AP_HAL::micros() - _tx_queued_us) * AP_NSEC_PER_USEC);
+        _tx_queued_us = 0;
+    }
+    return progress;
 }
 
 /*
   push any pending bytes to/from the serial port. This is called at
-  1kHz in the timer thread. Doing it this way reduces the system call
+  100Hz in the UART thread. Doing it this way reduces the system call
   overhead in the main task enormously.
+
+  Once the device has a file descriptor the port is served from the
+  UART poller thread instead, and this only retries stalled writes and
+  resumes reading once a full read buffer has room.
  */
 void UARTDriver::_timer_tick(void)
 {
     if (!_initialised) return;
 
+    _perf_init();
+
+    if (_event_driven) {
+        if ((_rx_paused && _readbuf.space() > 0) ||
+            (!_tx_armed && _writebuf.available() > 0)) {
+            WITH_SEMAPHORE(_event_sem);
+            if (_event_driven) {
+                _rx_paused = _readbuf.space() == 0;
+                _tx_armed = _writebuf.available() > 0;
+                _event_modify();
+            }
+        }
+        return;
+    }
+
     _in_timer = true;
 
     uint8_t num_send = 10;
@@ -439,24 +495,223 @@ void UARTDriver::_timer_tick(void)
     const auto n_vec = _readbuf.reserve(vec, _readbuf.space());
     for (int i = 0; i < n_vec; i++) {
         ret = _read_fd(vec[i].data, vec[i].len);
+        hal.util->perf_count(_perf_rx);
+        if (ret <= 0) {
+            hal.util->perf_count(_perf_rx_empty);
+        }
         if (ret < 0) {
             break;
         }
         _readbuf.commit((unsigned)ret);
 
-        // update receive timestamp
-        _receive_timestamp[_receive_timestamp_idx^1] = AP_HAL::micros64();
-        _receive_timestamp_idx ^= 1;
-        
+        _update_receive_timestamp();
+
         /* stop reading as we read less than we asked for */
         if ((unsigned)ret < vec[i].len) {
             break;
         }
     }
 
+    // the polling above opens and closes network connections, serve
+    // the device from the poller thread once it has a file descriptor
+    _event_register();
+
     _in_timer = false;
 }
 
+void UARTDriver::_update_receive_timestamp()
+{
+    _receive_timestamp[_receive_timestamp_idx^1] = AP_HAL::micros64();
+    _receive_timestamp_idx ^= 1;
+}
+
+/*
+  start serving the device from the UART poller thread, if it has a
+  file descriptor. Called from the UART thread
+ */
+bool UARTDriver::_event_register()
+{
+#if HAL_LINUX_UART_EPOLL
+    if (!_connected || _event_unsupported) {
+        return false;
+    }
+    const int fd = _device->get_fd();
+    if (fd < 0) {
+        return false;
+    }
+
+    WITH_SEMAPHORE(_event_sem);
+    if (!_initialised) {
+        return false;
+    }
+
+    _event_driven = true;
+    _rx_paused = false;
+    _tx_armed = _writebuf.available() > 0;
+
+    _event_pollable.set_fd(fd);
+    if (!Scheduler::from(hal.scheduler)->uart_poller().register_pollable(
+            &_event_pollable, EPOLLIN | (_tx_armed ? EPOLLOUT : 0))) {
+        // epoll doesn't support all files, keep polling this one
+        _event_pollable.set_fd(-1);
+        _event_driven = false;
+        _tx_armed = false;
+        _event_unsupported = true;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*
+  stop serving the device from the UART poller thread. Called with
+  _event_sem held, before the file descriptor is closed
+ */
+void UARTDriver::_event_unregister()
+{
+    if (!_event_driven) {
+        return;
+    }
+    Scheduler::from(hal.scheduler)->uart_poller().unregister_pollable(&_event_pollable);
+    _event_pollable.set_fd(-1);
+    _event_driven = false;
+    _tx_armed = false;
+}
+
+/*
+  update the events waited for. Called with _event_sem held
+ */
+bool UARTDriver::_event_modify()
+{
+    const uint32_t events = (_rx_paused ? 0 : EPOLLIN) | (_tx_armed ? EPOLLOUT : 0);
+    return Scheduler::from(hal.scheduler)->uart_poller().modify_pollable(&_event_pollable, events);
+}
+
+/*
+  the device has data to read, fill the free space of the read buffer
+  with a single readv()
+ */
+void UARTDriver::_event_read()
+{
+    WITH_SEMAPHORE(_event_sem);
+    if (!_event_driven) {
+        return;
+    }
+
+    ByteBuffer::IoVec vec[2];
+    const auto n_vec = _readbuf.reserve(vec, _readbuf.space());
+    if (n_vec == 0) {
+        // the UART thread resumes reading once there is room
+        _rx_paused = true;
+        _event_modify();
+        return;
+    }
+
+    struct iovec iov[2];
+    for (int i = 0; i < n_vec; i++) {
+        iov[i].iov_base = vec[i].data;
+        iov[i].iov_len = vec[i].len;
+    }
+
+    const ssize_t ret = _device->readv(iov, n_vec);
+    hal.util->perf_count(_perf_rx);
+    if (ret > 0) {
+        _readbuf.commit((unsigned)ret);
+        _update_receive_timestamp();
+        return;
+    }
+
+    hal.util->perf_count(_perf_rx_empty);
+    if ((ret == 0 && !_packetise) ||
+        (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        // end of stream or an error, let the UART thread poll the
+        // device, which closes a dropped connection
+        _event_unregister();
+    }
+}
+
+/*
+  the device can take more data, write out the write buffer
+ */
+void UARTDriver::_event_write()
+{
+    WITH_SEMAPHORE(_event_sem);
+    if (!_event_driven) {
+        return;
+    }
+
+    bool progress = false;
+    uint8_t num_send = 10;
+    while (num_send != 0 && _write_pending_bytes()) {
+        num_send--;
+        progress = true;
+    }
+
+    if (!progress) {
+        // the device won't take the data, such as a UDP port with no
+        // peer yet. The UART thread retries
+        _tx_armed = false;
+        _event_modify();
+        return;
+    }
+
+    if (_writebuf.available() == 0) {
+        // stop waiting to write, _event_kick_write() waits again once
+        // more is queued
+        _tx_armed = false;
+        _event_modify();
+    }
+}
+
+void UARTDriver::_event_hang_up()
+{
+    WITH_SEMAPHORE(_event_sem);
+    // let the UART thread poll the device, which closes a dropped
+    // connection
+    _event_unregister();
+}
+
+/*
+  wait for the device to be writable once bytes are queued on an idle
+  port. Called every millisecond from the UART poller thread, so that
+  write() makes no system call
+ */
+void UARTDriver::_event_kick_write()
+{
+    if (!_event_driven || _tx_armed || _writebuf.available() == 0) {
+        return;
+    }
+
+    WITH_SEMAPHORE(_event_sem);
+    if (_event_driven && !_tx_armed && _writebuf.available() > 0) {
+        _tx_armed = true;
+        _event_modify();
+    }
+}
+
+/*
+  add the per-port perf counters, named after the device
+ */
+void UARTDriver::_perf_init()
+{
+    if (_perf_added) {
+        return;
+    }
+    _perf_added = true;
+
+    const char *name = device_path != nullptr ? device_path : (_console ? "console" : "uart");
+    snprintf(_perf_names[0], sizeof(_perf_names[0]), "%s rx", name);
+    snprintf(_perf_names[1], sizeof(_perf_names[1]), "%s rx empty", name);
+    snprintf(_perf_names[2], sizeof(_perf_names[2]), "%s tx", name);
+    snprintf(_perf_names[3], sizeof(_perf_names[3]), "%s tx latency", name);
+    _perf_rx = hal.util->perf_alloc(AP_HAL::Util::PC_COUNT, _perf_names[0]);
+    _perf_rx_empty = hal.util->perf_alloc(AP_HAL::Util::PC_COUNT, _perf_names[1]);
+    _perf_tx = hal.util->perf_alloc(AP_HAL::Util::PC_COUNT, _perf_names[2]);
+    _perf_tx_latency = hal.util->perf_alloc(AP_HAL::Util::PC_ELAPSED, _perf_names[3]);
+}
+
 void UARTDriver::configure_parity(uint8_t v) {
     _device->set_parity(v);
 }
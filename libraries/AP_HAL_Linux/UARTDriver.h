@@ -1,12 +1,25 @@
 #pragma once
 
+#include <atomic>
+
 #include <AP_HAL/utility/OwnPtr.h>
 #include <AP_HAL/utility/RingBuffer.h>
 
 #include "AP_HAL_Linux.h"
+#include "Poller.h"
 #include "SerialDevice.h"
 #include "Semaphores.h"
 
+/*
+  serve UARTs whose device has a file descriptor from the scheduler's
+  UART poller thread, reading when data arrives and writing as soon as
+  data is queued, instead of polling them from the UART thread. Build
+  with HAL_LINUX_UART_EPOLL=0 to poll every UART
+ */
+#ifndef HAL_LINUX_UART_EPOLL
+#define HAL_LINUX_UART_EPOLL 1
+#endif
+
 namespace Linux {
 
 class UARTDriver : public AP_HAL::UARTDriver {
@@ -30,6 +43,7 @@ public:
     uint32_t available() override;
     uint32_t txspace() override;
     int16_t read() override;
+    ssize_t read(uint8_t *buffer, uint16_t count) override;
 
     /* Linux implementations of Print virtual methods */
     size_t write(uint8_t c) override;
@@ -39,6 +53,7 @@ public:
 
     bool _write_pending_bytes(void);
     virtual void _timer_tick(void) override;
+    void _event_kick_write();
 
     virtual enum flow_control get_flow_control(void) override
     {
@@ -68,6 +83,26 @@ public:
     uint64_t receive_time_constraint_us(uint16_t nbytes) override;
 
 private:
+    /*
+      forwards the events of the device's file descriptor, which the
+      device owns
+     */
+    class EventPollable : public Pollable {
+    public:
+        EventPollable(UARTDriver &uart) : _uart(uart) { }
+        ~EventPollable() { _fd = -1; }
+
+        void set_fd(int fd) { _fd = fd; }
+
+        void on_can_read() override { _uart._event_read(); }
+        void on_can_write() override { _uart._event_write(); }
+        void on_error() override { _uart._event_hang_up(); }
+        void on_hang_up() override { _uart._event_hang_up(); }
+
+    private:
+        UARTDriver &_uart;
+    };
+
     AP_HAL::OwnPtr<SerialDevice> _device;
     bool _nonblocking_writes;
     bool _console;
@@ -87,6 +122,33 @@ private:
     // timestamp for receiving data on the UART, avoiding a lock
     uint64_t _receive_timestamp[2];
     uint8_t _receive_timestamp_idx;
+    void _update_receive_timestamp();
+
+    // serving the device from the UART poller thread
+    bool _event_register();
+    void _event_unregister();
+    bool _event_modify();
+    void _event_read();
+    void _event_write();
+    void _event_hang_up();
+
+    EventPollable _event_pollable{*this};
+    Linux::Semaphore _event_sem;        // held while changing the registration and while serving events
+    std::atomic<bool> _event_driven{false};
+    std::atomic<bool> _tx_armed{false}; // waiting for the fd to be writable
+    volatile bool _rx_paused;           // read buffer full, not waiting for the fd to be readable
+    bool _event_unsupported;            // the fd can't be used with epoll
+
+    // per-port perf counters of the syscalls made and of the time from
+    // bytes being queued on an idle port until they are written
+    void _perf_init();
+    AP_HAL::Util::perf_counter_t _perf_rx;
+    AP_HAL::Util::perf_counter_t _perf_rx_empty;
+    AP_HAL::Util::perf_counter_t _perf_tx;
+    AP_HAL::Util::perf_counter_t _perf_tx_latency;
+    char _perf_names[4][48];
+    bool _perf_added;
+    volatile uint32_t _tx_queued_us;
 
 protected:
     const char *device_path;
@@ -45,6 +45,15 @@ ssize_t UDPDevice::read(uint8_t *buf, uint16_t n)
     return ret;
 }
 
+ssize_t UDPDevice::readv(const struct iovec *iov, int iovcnt)
+{
+    if (!_connected) {
+        // read() connects to the sender of the first packet
+        return SerialDevice::readv(iov, iovcnt);
+    }
+    return ::readv(socket.get_fd(), iov, iovcnt);
+}
+
 bool UDPDevice::open()
 {
     if (_input) {
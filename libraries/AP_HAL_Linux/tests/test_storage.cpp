@@ -0,0 +1,280 @@
+/*
+ * This file is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <AP_gtest.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include <AP_HAL/AP_HAL.h>
+#include <AP_HAL_Linux/Storage.h>
+#include <AP_HAL_Linux/Util.h>
+
+using namespace Linux;
+
+const AP_HAL::HAL &hal = AP_HAL::get_HAL();
+
+#if HAL_LINUX_STORAGE_JOURNAL
+
+typedef std::vector<uint8_t> bytes;
+
+/*
+  a Storage which loses power when deleted: its files are closed as
+  they are, without writing the journal back to the storage file
+ */
+class PowerCutStorage : public Storage {
+public:
+    ~PowerCutStorage() {
+        if (_fd != -1) {
+            close(_fd);
+        }
+        if (_journal_fd != -1) {
+            close(_journal_fd);
+        }
+        free(_journal_path);
+    }
+};
+
+/*
+  a storage directory of its own for each test. Each Storage object
+  opened on it is a boot, which ends with a power cut
+ */
+class LinuxStorageJournal : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char tmpl[] = "/tmp/ap_storage_XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+        Util::from(hal.util)->set_custom_storage_directory(dir.c_str());
+    }
+
+    void TearDown() override {
+        for (PowerCutStorage *storage : booted) {
+            delete storage;
+        }
+        booted.clear();
+        const std::string cmd = "rm -rf " + dir;
+        EXPECT_EQ(system(cmd.c_str()), 0);
+    }
+
+    Storage *boot() {
+        PowerCutStorage *storage = new PowerCutStorage();
+        booted.push_back(storage);
+        storage->init();
+        return storage;
+    }
+
+    // lose power, dropping any changes not yet written
+    void power_cut(Storage *storage) {
+        for (auto it = booted.begin(); it != booted.end(); it++) {
+            if (*it == storage) {
+                booted.erase(it);
+                delete static_cast<PowerCutStorage *>(storage);
+                return;
+            }
+        }
+        FAIL() << "storage was not booted";
+    }
+
+    // write changes and wait long enough for them to be appended together
+    void flush(Storage *storage) {
+        usleep((LINUX_STORAGE_COALESCE_MS + 20) * 1000);
+        storage->_timer_tick();
+    }
+
+    bytes contents(Storage *storage) {
+        bytes b(LINUX_STORAGE_SIZE);
+        storage->read_block(b.data(), 0, b.size());
+        return b;
+    }
+
+    std::string path(const char *suffix) {
+        DIR *d = opendir(dir.c_str());
+        std::string ret;
+        struct dirent *de;
+        while (d != nullptr && (de = readdir(d)) != nullptr) {
+            const size_t len = strlen(de->d_name);
+            if (len > 4 && strcmp(&de->d_name[len-4], suffix) == 0) {
+                ret = dir + "/" + de->d_name;
+            }
+        }
+        if (d != nullptr) {
+            closedir(d);
+        }
+        return ret;
+    }
+
+    bytes read_file(const std::string &fname) {
+        bytes b;
+        int fd = open(fname.c_str(), O_RDONLY);
+        uint8_t buf[4096];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            b.insert(b.end(), buf, buf+n);
+        }
+        close(fd);
+        return b;
+    }
+
+    void write_file(const std::string &fname, const bytes &b) {
+        int fd = open(fname.c_str(), O_WRONLY|O_TRUNC);
+        EXPECT_EQ(write(fd, b.data(), b.size()), (ssize_t)b.size());
+        close(fd);
+    }
+
+    // change a few bytes in each of the given lines
+    void change_lines(Storage *storage, const std::vector<uint8_t> &lines, uint8_t value) {
+        for (uint8_t line : lines) {
+            for (uint16_t ofs = 0; ofs < LINUX_STORAGE_LINE_SIZE; ofs += 100) {
+                const uint8_t v[3] { value, uint8_t(line), uint8_t(ofs) };
+                storage->write_block((line<<LINUX_STORAGE_LINE_SHIFT) + ofs, v, sizeof(v));
+            }
+        }
+    }
+
+    std::string dir;
+    std::vector<PowerCutStorage *> booted;
+};
+
+TEST_F(LinuxStorageJournal, survives_power_cut)
+{
+    Storage *storage = boot();
+    change_lines(storage, {0, 5, 31}, 1);
+    flush(storage);
+    const bytes expected = contents(storage);
+
+    // changes not yet appended are lost
+    change_lines(storage, {7}, 2);
+    power_cut(storage);
+
+    Storage *storage2 = boot();
+    EXPECT_EQ(contents(storage2), expected);
+    // the journal was written back to the storage file on boot
+    EXPECT_EQ(read_file(path(".stj")).size(), 0U);
+    EXPECT_EQ(read_file(path(".stg")), expected);
+}
+
+TEST_F(LinuxStorageJournal, coalesces_burst)
+{
+    Storage *storage = boot();
+
+    // a burst of parameter saves over a few lines
+    for (uint16_t i = 0; i < 200; i++) {
+        const uint32_t v = i;
+        storage->write_block(i*7, &v, sizeof(v));
+    }
+    // nothing is written until the writes pause
+    storage->_timer_tick();
+    EXPECT_EQ(read_file(path(".stj")).size(), 0U);
+
+    flush(storage);
+    const size_t lines = (199*7 + 4 + LINUX_STORAGE_LINE_SIZE - 1) / LINUX_STORAGE_LINE_SIZE;
+    EXPECT_EQ(read_file(path(".stj")).size(), 12 + lines*LINUX_STORAGE_LINE_SIZE);
+
+    const bytes expected = contents(storage);
+    power_cut(storage);
+    Storage *storage2 = boot();
+    EXPECT_EQ(contents(storage2), expected);
+}
+
+TEST_F(LinuxStorageJournal, truncated_journal)
+{
+    Storage *storage = boot();
+    std::vector<bytes> states { contents(storage) };
+    std::vector<size_t> ends { 0 };
+
+    change_lines(storage, {1, 2}, 1);
+    flush(storage);
+    states.push_back(contents(storage));
+    ends.push_back(read_file(path(".stj")).size());
+
+    change_lines(storage, {2, 3, 4}, 2);
+    flush(storage);
+    states.push_back(contents(storage));
+    ends.push_back(read_file(path(".stj")).size());
+
+    change_lines(storage, {1, 30}, 3);
+    flush(storage);
+    states.push_back(contents(storage));
+    ends.push_back(read_file(path(".stj")).size());
+
+    power_cut(storage);
+
+    const std::string stg = path(".stg");
+    const std::string stj = path(".stj");
+    const bytes stg_data = read_file(stg);
+    const bytes stj_data = read_file(stj);
+    ASSERT_EQ(stj_data.size(), ends.back());
+
+    // a power cut part way through any append leaves the state after
+    // the previous one
+    for (size_t len = 0; len <= stj_data.size(); len += 61) {
+        write_file(stg, stg_data);
+        write_file(stj, bytes(stj_data.begin(), stj_data.begin() + len));
+        uint8_t n = 0;
+        while (n+1 < ends.size() && ends[n+1] <= len) {
+            n++;
+        }
+        Storage *s = boot();
+        EXPECT_EQ(contents(s), states[n]) << "journal truncated to " << len;
+        power_cut(s);
+    }
+}
+
+TEST_F(LinuxStorageJournal, corrupt_record)
+{
+    Storage *storage = boot();
+    change_lines(storage, {1}, 1);
+    flush(storage);
+    const bytes expected = contents(storage);
+    const size_t first_end = read_file(path(".stj")).size();
+    change_lines(storage, {2}, 2);
+    flush(storage);
+    change_lines(storage, {3}, 3);
+    flush(storage);
+    power_cut(storage);
+
+    // damage the second record. Neither it nor the records after it can
+    // be trusted
+    bytes stj = read_file(path(".stj"));
+    stj[first_end + 100] ^= 0x55;
+    write_file(path(".stj"), stj);
+
+    Storage *storage2 = boot();
+    EXPECT_EQ(contents(storage2), expected);
+}
+
+TEST_F(LinuxStorageJournal, checkpoint)
+{
+    Storage *storage = boot();
+    for (uint8_t i = 0; i < 40; i++) {
+        change_lines(storage, {0, 1, 2, 3}, i);
+        flush(storage);
+        EXPECT_LT(read_file(path(".stj")).size(), (size_t)LINUX_STORAGE_JOURNAL_MAX);
+    }
+    const bytes expected = contents(storage);
+    power_cut(storage);
+
+    Storage *storage2 = boot();
+    EXPECT_EQ(contents(storage2), expected);
+}
+
+#endif // HAL_LINUX_STORAGE_JOURNAL
+
+AP_GTEST_MAIN()
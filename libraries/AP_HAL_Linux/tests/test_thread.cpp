@@ -17,6 +17,7 @@
 #include <AP_gtest.h>
 
 #include <pthread.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 
 #include <AP_HAL/AP_HAL.h>
@@ -91,6 +92,55 @@ TEST(LinuxThread, poller_thread)
     EXPECT_TRUE(thr.join());
 }
 
+class TestPollable : public Pollable {
+public:
+    TestPollable(int fd) : Pollable(fd) { }
+
+    volatile int n_read = 0;
+
+    void on_can_read() override {
+        uint8_t c;
+        if (read(_fd, &c, 1) == 1) {
+            n_read++;
+        }
+    }
+};
+
+TEST(LinuxThread, poller_thread_pollable)
+{
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+
+    PollerThread thr;
+    TestPollable p(fds[0]);
+    EXPECT_TRUE(thr.register_pollable(&p, EPOLLIN));
+    EXPECT_TRUE(thr.start(nullptr, 0, 0));
+
+    const uint8_t c = 0;
+    EXPECT_EQ(write(fds[1], &c, 1), 1);
+    while (p.n_read == 0) {
+        usleep(1000);
+    }
+    EXPECT_EQ(p.n_read, 1);
+
+    // no events while not waiting for input
+    EXPECT_TRUE(thr.modify_pollable(&p, 0));
+    EXPECT_EQ(write(fds[1], &c, 1), 1);
+    usleep(10000);
+    EXPECT_EQ(p.n_read, 1);
+
+    EXPECT_TRUE(thr.modify_pollable(&p, EPOLLIN));
+    while (p.n_read == 1) {
+        usleep(1000);
+    }
+    EXPECT_EQ(p.n_read, 2);
+
+    thr.unregister_pollable(&p);
+    close(fds[1]);
+    EXPECT_TRUE(thr.stop());
+    EXPECT_TRUE(thr.join());
+}
+
 class TestPeriodicThread1 : public PeriodicThread {
 public:
     TestPeriodicThread1() : PeriodicThread{FUNCTOR_BIND_MEMBER(&TestPeriodicThread1::_task, void)} { }
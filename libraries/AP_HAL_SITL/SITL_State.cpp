@@ -153,6 +153,8 @@ void SITL_State::_fdm_input_step(void)
 
     _fdm_input_local();
 
+    _snapshot_check();
+
     /* make sure we die if our parent dies */
     if (kill(_parent_pid, 0) != 0) {
         exit(1);
@@ -208,7 +210,7 @@ void SITL_State::wait_clock(uint64_t wait_time_usec)
         if (hal.scheduler->in_main_thread() ||
             Scheduler::from(hal.scheduler)->semaphore_wait_hack_required()) {
             _fdm_input_step();
-        } else {
+        } else if (!_scheduler->lockstep_wait(wait_time_usec)) {
             usleep(1000);
         }
     }
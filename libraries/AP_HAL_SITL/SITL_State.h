@@ -9,6 +9,7 @@
 #include "HAL_SITL_Class.h"
 #include "RCInput.h"
 
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -151,6 +152,17 @@ private:
 
     void wait_clock(uint64_t wait_time_usec);
 
+    // snapshot and restore of the whole vehicle, see SITL_snapshot.cpp
+    void _snapshot_check(void);
+    void _snapshot_take(void);
+    void _snapshot_restore(void);
+    static void _sig_snapshot(int signum);
+    void _gps_snapshot(void);
+    void _gps_restore(void);
+    uint64_t _snapshot_at_usec;
+    uint16_t _snapshot_count;
+    static volatile sig_atomic_t _snapshot_requested;
+
     // internal state
     enum vehicle_type _vehicle;
     uint16_t _framerate;
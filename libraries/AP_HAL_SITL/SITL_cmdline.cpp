@@ -93,6 +93,9 @@ void SITL_State::_usage(void)
            "\t--sim-port-in PORT       set port num for simulator in\n"
            "\t--sim-port-out PORT      set port num for simulator out\n"
            "\t--irlock-port PORT       set port num for irlock\n"
+           "\t--max-speed              run in lockstep as fast as possible (use with --wipe for repeatable runs)\n"
+           "\t--seed SEED              set random number seed\n"
+           "\t--snapshot-at SECONDS    snapshot the vehicle at this simulation time (also on SIGUSR1)\n"
         );
 }
 
@@ -159,12 +162,18 @@ void SITL_State::_set_signal_handlers(void) const
     sa_segv.sa_handler = _sig_segv;
     sigaction(SIGSEGV, &sa_segv, nullptr);
 
+    struct sigaction sa_snapshot = {};
+    sigemptyset(&sa_snapshot.sa_mask);
+    sa_snapshot.sa_handler = _sig_snapshot;
+    sigaction(SIGUSR1, &sa_snapshot, nullptr);
+
 }
 
 void SITL_State::_parse_command_line(int argc, char * const argv[])
 {
     int opt;
     float speedup = 1.0f;
+    bool max_speed = false;
     _instance = 0;
     _synthetic_clock_mode = false;
     // default to CMAC
@@ -210,6 +219,9 @@ void SITL_State::_parse_command_line(int argc, char * const argv[])
         CMDLINE_SIM_PORT_IN,
         CMDLINE_SIM_PORT_OUT,
         CMDLINE_IRLOCK_PORT,
+        CMDLINE_MAX_SPEED,
+        CMDLINE_SEED,
+        CMDLINE_SNAPSHOT_AT,
     };
 
     const struct GetOptLong::option options[] = {
@@ -245,6 +257,9 @@ void SITL_State::_parse_command_line(int argc, char * const argv[])
         {"sim-port-in",     true,   0, CMDLINE_SIM_PORT_IN},
         {"sim-port-out",    true,   0, CMDLINE_SIM_PORT_OUT},
         {"irlock-port",     true,   0, CMDLINE_IRLOCK_PORT},
+        {"max-speed",       false,  0, CMDLINE_MAX_SPEED},
+        {"seed",            true,   0, CMDLINE_SEED},
+        {"snapshot-at",     true,   0, CMDLINE_SNAPSHOT_AT},
         {0, false, 0, 0}
     };
 
@@ -363,6 +378,20 @@ void SITL_State::_parse_command_line(int argc, char * const argv[])
         case CMDLINE_IRLOCK_PORT:
             _irlock_port = atoi(gopt.optarg);
             break;
+        case CMDLINE_MAX_SPEED:
+            max_speed = true;
+            // threads must be stepped with the simulation from creation
+            _scheduler->set_lockstep(true);
+            break;
+        case CMDLINE_SEED: {
+            const unsigned seed = strtoul(gopt.optarg, nullptr, 0);
+            srandom(seed);
+            srand(seed);
+            break;
+        }
+        case CMDLINE_SNAPSHOT_AT:
+            _snapshot_at_usec = atof(gopt.optarg) * 1.0e6;
+            break;
         default:
             _usage();
             exit(1);
@@ -389,6 +418,7 @@ void SITL_State::_parse_command_line(int argc, char * const argv[])
             }
             sitl_model->set_interface_ports(simulator_address, simulator_port_in, simulator_port_out);
             sitl_model->set_speedup(speedup);
+            sitl_model->set_max_speed(max_speed);
             sitl_model->set_instance(_instance);
             sitl_model->set_autotest_dir(autotest_dir);
             sitl_model->set_config(config);
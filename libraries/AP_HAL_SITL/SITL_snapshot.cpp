@@ -0,0 +1,159 @@
+/*
+  snapshot and restore of a whole simulated vehicle
+
+  Taking a snapshot forks the process. The original process keeps
+  the snapshot and waits, while a child process carries on flying
+  from it. Sending SIGUSR1 to the original process kills the current
+  child and forks a new one from the same point, so many scenarios
+  can be flown from one takeoff. As fork() copies all memory this
+  covers the FDM, EKF, parameters, mission, scheduler and RNG state
+  without any of them needing to be serialised.
+
+  Each child runs in its own snapshotN directory with its own copy
+  of storage and starts a new log there. Network connections are
+  shared with the original process, so a GCS stays connected across
+  restores.
+ */
+
+#include <AP_HAL/AP_HAL.h>
+
+#if CONFIG_HAL_BOARD == HAL_BOARD_SITL
+
+#include "AP_HAL_SITL.h"
+#include "AP_HAL_SITL_Namespace.h"
+#include "HAL_SITL_Class.h"
+#include "Scheduler.h"
+#include "Storage.h"
+
+#include <AP_Logger/AP_Logger.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
+extern const AP_HAL::HAL& hal;
+
+using namespace HALSITL;
+
+volatile sig_atomic_t SITL_State::_snapshot_requested;
+
+void SITL_State::_sig_snapshot(int signum)
+{
+    _snapshot_requested = 1;
+}
+
+/*
+  called from the main thread after each FDM step, when lockstep
+  threads are all idle
+ */
+void SITL_State::_snapshot_check(void)
+{
+    if (!hal.scheduler->in_main_thread()) {
+        return;
+    }
+    if (_snapshot_at_usec != 0 && AP_HAL::micros64() >= _snapshot_at_usec) {
+        _snapshot_at_usec = 0;
+        _snapshot_requested = 1;
+    }
+    if (_snapshot_requested) {
+        _snapshot_requested = 0;
+        _snapshot_take();
+    }
+}
+
+/*
+  fork the process, returning in the child. The parent holds the
+  snapshot until it is told to exit
+ */
+void SITL_State::_snapshot_take(void)
+{
+    if (!_synthetic_clock_mode) {
+        ::fprintf(stderr, "SITL: snapshots need a synthetic clock\n");
+        return;
+    }
+    if (!_scheduler->lockstep()) {
+        ::fprintf(stderr, "SITL: snapshot without --max-speed, threads may not restore cleanly\n");
+    }
+
+    ::printf("SITL: snapshot at %.3fs in pid %d, send SIGUSR1 to restore\n",
+             AP_HAL::micros64() * 1.0e-6, (int)getpid());
+    // don't duplicate buffered output in the children
+    fflush(stdout);
+    fflush(stderr);
+    _gps_snapshot();
+
+    pid_t child = -1;
+    bool restore = true;
+    while (true) {
+        if (restore) {
+            restore = false;
+            _snapshot_count++;
+            child = fork();
+            if (child == 0) {
+                _snapshot_restore();
+                return;
+            }
+            if (child == -1) {
+                AP_HAL::panic("SITL: snapshot fork failed: %s", strerror(errno));
+            }
+        }
+
+        usleep(100000);
+
+        if (child > 0 && waitpid(child, nullptr, WNOHANG) == child) {
+            // the scenario finished; wait to be told to restore again
+            child = 0;
+        }
+        if (_snapshot_requested) {
+            _snapshot_requested = 0;
+            restore = true;
+        }
+        const bool parent_died = kill(_parent_pid, 0) != 0;
+        if ((restore || Scheduler::_should_exit || parent_died) && child > 0) {
+            kill(child, SIGKILL);
+            waitpid(child, nullptr, 0);
+            child = 0;
+        }
+        if (Scheduler::_should_exit || parent_died) {
+            exit(0);
+        }
+    }
+}
+
+/*
+  setup a child process to continue from the snapshot
+ */
+void SITL_State::_snapshot_restore(void)
+{
+#if defined(__linux__)
+    // don't outlive the process holding the snapshot
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+
+    char dir[20];
+    snprintf(dir, sizeof(dir), "snapshot%u", (unsigned)_snapshot_count);
+    if ((mkdir(dir, 0755) != 0 && errno != EEXIST) || chdir(dir) != 0) {
+        AP_HAL::panic("SITL: unable to use %s: %s", dir, strerror(errno));
+    }
+    _snapshot_count = 0;
+
+    static_cast<Storage *>(hal.storage)->reopen_files();
+    _gps_restore();
+    const uint8_t nthreads = _scheduler->restart_threads();
+
+    // the open log is shared with the parent; the next write starts
+    // a new one in this directory
+    AP::logger().StopLogging();
+
+    ::printf("SITL: restored snapshot in pid %d in %s with %u threads\n",
+             (int)getpid(), dir, (unsigned)nthreads);
+}
+
+#endif  // CONFIG_HAL_BOARD == HAL_BOARD_SITL
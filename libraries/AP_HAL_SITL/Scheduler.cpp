@@ -4,7 +4,9 @@
 #include "Scheduler.h"
 #include "UARTDriver.h"
 #include <sys/time.h>
+#include <errno.h>
 #include <fenv.h>
+#include <time.h>
 #include <AP_BoardConfig/AP_BoardConfig.h>
 #if defined (__clang__)
 #include <stdlib.h>
@@ -35,6 +37,13 @@ bool Scheduler::_in_semaphore_take_wait = false;
 Scheduler::thread_attr *Scheduler::threads;
 HAL_Semaphore Scheduler::_thread_sem;
 
+bool Scheduler::_lockstep;
+pthread_mutex_t Scheduler::_lockstep_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t Scheduler::_lockstep_cond = PTHREAD_COND_INITIALIZER;
+uint8_t Scheduler::_lockstep_running;
+bool Scheduler::_lockstep_timeout_reported;
+thread_local Scheduler::thread_attr *Scheduler::_current_thread;
+
 Scheduler::Scheduler(SITL_State *sitlState) :
     _sitlState(sitlState),
     _stopped_clock_usec(0)
@@ -248,6 +257,78 @@ void Scheduler::stop_clock(uint64_t time_usec)
         _last_io_run = time_usec;
         _run_io_procs();
     }
+    if (_lockstep) {
+        lockstep_run_threads();
+    }
+}
+
+/*
+  wait until all lockstep threads are blocked waiting for the
+  clock. A thread blocked on anything else (such as a semaphore held
+  by the main thread) would stall the simulation, so give up after a
+  second of wall clock time and let threads run freely from then on.
+  Called with _lockstep_mutex held
+ */
+static bool lockstep_wait_idle(pthread_cond_t *cond, pthread_mutex_t *mutex, const uint8_t &running)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 1;
+    while (running > 0) {
+        if (pthread_cond_timedwait(cond, mutex, &deadline) == ETIMEDOUT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+  release each lockstep thread whose wait has expired in turn, letting
+  it run until it waits again. Threads are released one at a time,
+  so that they never run concurrently, in the order of the thread
+  list, which is newest first. That order is fixed, so runs repeat
+ */
+void Scheduler::lockstep_run_threads(void)
+{
+    pthread_mutex_lock(&_lockstep_mutex);
+    bool released;
+    do {
+        if (!_lockstep_timeout_reported &&
+            !lockstep_wait_idle(&_lockstep_cond, &_lockstep_mutex, _lockstep_running)) {
+            _lockstep_timeout_reported = true;
+            ::fprintf(stderr, "SITL: lockstep thread did not yield, run is not repeatable\n");
+        }
+        // the list may have changed while we waited, so rescan it
+        released = false;
+        for (struct thread_attr *p=threads; p; p=p->next) {
+            if (p->lockstep_waiting && p->lockstep_wake_usec <= _stopped_clock_usec) {
+                p->lockstep_waiting = false;
+                _lockstep_running++;
+                pthread_cond_broadcast(&_lockstep_cond);
+                released = true;
+                break;
+            }
+        }
+    } while (released);
+    pthread_mutex_unlock(&_lockstep_mutex);
+}
+
+bool Scheduler::lockstep_wait(uint64_t wait_usec)
+{
+    struct thread_attr *a = _current_thread;
+    if (!_lockstep || a == nullptr) {
+        return false;
+    }
+    pthread_mutex_lock(&_lockstep_mutex);
+    a->lockstep_wake_usec = wait_usec;
+    a->lockstep_waiting = true;
+    _lockstep_running--;
+    pthread_cond_broadcast(&_lockstep_cond);
+    while (a->lockstep_waiting) {
+        pthread_cond_wait(&_lockstep_cond, &_lockstep_mutex);
+    }
+    pthread_mutex_unlock(&_lockstep_mutex);
+    return true;
 }
 
 /*
@@ -256,9 +337,14 @@ void Scheduler::stop_clock(uint64_t time_usec)
 void *Scheduler::thread_create_trampoline(void *ctx)
 {
     struct thread_attr *a = (struct thread_attr *)ctx;
+    _current_thread = a;
     a->f[0]();
     
     WITH_SEMAPHORE(_thread_sem);
+    if (_lockstep) {
+        pthread_mutex_lock(&_lockstep_mutex);
+        _lockstep_running--;
+    }
     if (threads == a) {
         threads = a->next;
     } else {
@@ -269,6 +355,10 @@ void *Scheduler::thread_create_trampoline(void *ctx)
             }
         }
     }
+    if (_lockstep) {
+        pthread_cond_broadcast(&_lockstep_cond);
+        pthread_mutex_unlock(&_lockstep_mutex);
+    }
     free(a->stack);
     free(a->f);
     delete a;
@@ -321,11 +411,24 @@ bool Scheduler::thread_create(AP_HAL::MemberProc proc, const char *name, uint32_
         AP_HAL::panic("Failed to set stack of size %u for thread %s", alloc_stack, name);
     }
 #endif
+    a->lockstep_waiting = false;
+    if (_lockstep) {
+        // hold the new thread off until it is counted as running
+        pthread_mutex_lock(&_lockstep_mutex);
+    }
     if (pthread_create(&thread, &a->attr, thread_create_trampoline, a) != 0) {
+        if (_lockstep) {
+            pthread_mutex_unlock(&_lockstep_mutex);
+        }
         goto failed;
     }
     a->next = threads;
     threads = a;
+    if (_lockstep) {
+        // it runs until it first waits for the clock
+        _lockstep_running++;
+        pthread_mutex_unlock(&_lockstep_mutex);
+    }
     return true;
 
 failed:
@@ -339,6 +442,38 @@ failed:
     return false;
 }
 
+/*
+  only the calling thread survives fork(), so a process forked from
+  a snapshot starts each thread again from its entry point, reusing
+  its old stack. In lockstep mode all threads were idle when the
+  snapshot was taken; otherwise a thread may have died holding a lock
+ */
+uint8_t Scheduler::restart_threads(void)
+{
+    WITH_SEMAPHORE(_thread_sem);
+
+    // waiters on these died with their threads
+    pthread_mutex_init(&_lockstep_mutex, nullptr);
+    pthread_cond_init(&_lockstep_cond, nullptr);
+    _lockstep_running = 0;
+
+    uint8_t count = 0;
+    pthread_mutex_lock(&_lockstep_mutex);
+    for (struct thread_attr *p=threads; p; p=p->next) {
+        pthread_t thread {};
+        p->lockstep_waiting = false;
+        if (pthread_create(&thread, &p->attr, thread_create_trampoline, p) != 0) {
+            AP_HAL::panic("Failed to restart thread %s", p->name);
+        }
+        count++;
+    }
+    if (_lockstep) {
+        _lockstep_running = count;
+    }
+    pthread_mutex_unlock(&_lockstep_mutex);
+    return count;
+}
+
 /*
   check for stack overflow
  */
@@ -8,6 +8,9 @@
 
 #define SITL_SCHEDULER_MAX_TIMER_PROCS 8
 
+// wall clock used for the RTC and GPS time in lockstep mode (2020-01-01)
+#define SITL_LOCKSTEP_EPOCH_SEC 1577836800ULL
+
 /* Scheduler implementation: */
 class HALSITL::Scheduler : public AP_HAL::Scheduler {
 public:
@@ -67,6 +70,23 @@ public:
     // a couple of helper functions to cope with SITL's time stepping
     bool semaphore_wait_hack_required();
 
+    /*
+      lockstep mode: threads created with thread_create() only run
+      while the main thread waits for them after each simulation
+      step, so their interleaving with the main thread no longer
+      depends on the host. Must be enabled before creating threads
+     */
+    void set_lockstep(bool enable) { _lockstep = enable; }
+    bool lockstep() const { return _lockstep; }
+
+    // block a lockstep thread until simulation time reaches
+    // wait_usec. Returns false if the caller isn't a lockstep thread
+    bool lockstep_wait(uint64_t wait_usec);
+
+    // recreate all threads in a process forked from a snapshot,
+    // returning the number of threads restarted
+    uint8_t restart_threads(void);
+
 private:
     SITL_State *_sitlState;
     uint8_t _nested_atomic_ctr;
@@ -89,6 +109,7 @@ private:
     void stop_clock(uint64_t time_usec) override;
 
     static void *thread_create_trampoline(void *ctx);
+    void lockstep_run_threads(void);
     static void check_thread_stacks(void);
     
     bool _initialized;
@@ -105,8 +126,19 @@ private:
         void *stack;
         const uint8_t *stack_min;
         const char *name;
+        // lockstep state, protected by _lockstep_mutex
+        uint64_t lockstep_wake_usec;
+        bool lockstep_waiting;
     };
     static struct thread_attr *threads;
+
+    static bool _lockstep;
+    static pthread_mutex_t _lockstep_mutex;
+    static pthread_cond_t _lockstep_cond;
+    // number of lockstep threads which have not yet blocked
+    static uint8_t _lockstep_running;
+    static bool _lockstep_timeout_reported;
+    static thread_local struct thread_attr *_current_thread;
     static const uint8_t stackfill = 0xEB;
 };
 #endif  // CONFIG_HAL_BOARD
@@ -281,8 +281,51 @@ bool Storage::_flash_erase_ok(void)
     // only allow erase while disarmed
     return !hal.util->get_soft_armed();
 }
+
+/*
+  copy flash.dat into the current directory and use the copy
+ */
+static void sitl_flash_reopen(void)
+{
+    if (flash_fd == -1) {
+        return;
+    }
+    uint8_t data[HAL_STORAGE_SIZE*2];
+    if (pread(flash_fd, data, sizeof(data), 0) != sizeof(data)) {
+        AP_HAL::panic("Failed to read flash.dat");
+    }
+    close(flash_fd);
+    flash_fd = open("flash.dat", O_RDWR|O_CREAT|O_TRUNC, 0644);
+    if (flash_fd == -1 ||
+        pwrite(flash_fd, data, sizeof(data), 0) != sizeof(data)) {
+        AP_HAL::panic("Failed to create flash.dat");
+    }
+}
 #endif // STORAGE_USE_FLASH
 
+void Storage::reopen_files(void)
+{
+    if (!_initialised) {
+        return;
+    }
+#if STORAGE_USE_POSIX
+    if (using_filesystem && log_fd != -1) {
+        close(log_fd);
+        log_fd = open(HAL_STORAGE_FILE, O_RDWR|O_CREAT|O_TRUNC, 0644);
+        if (log_fd == -1 ||
+            write(log_fd, _buffer, HAL_STORAGE_SIZE) != HAL_STORAGE_SIZE) {
+            hal.console->printf("reopen failed for " HAL_STORAGE_FILE "\n");
+            return;
+        }
+        // the whole buffer is now on disk
+        _dirty_mask.clearall();
+    }
+#endif
+#if STORAGE_USE_FLASH
+    sitl_flash_reopen();
+#endif
+}
+
 /*
   consider storage healthy if we have nothing to write sometime in the
   last 2 seconds
@@ -31,6 +31,11 @@ public:
     void _timer_tick(void) override;
     bool healthy(void) override;
 
+    // move storage to a new file in the current directory holding
+    // the current contents, so processes forked from a snapshot
+    // don't share storage
+    void reopen_files(void);
+
 private:
     volatile bool _initialised;
     void _storage_create(void);
@@ -173,6 +173,14 @@ int16_t UARTDriver::read(void)
     return c;
 }
 
+ssize_t UARTDriver::read(uint8_t *buffer, uint16_t count)
+{
+    if (available() == 0) {
+        return 0;
+    }
+    return _readbuffer.read(buffer, count);
+}
+
 void UARTDriver::flush(void)
 {
 }
@@ -1,12 +1,19 @@
 #include "Util.h"
+#include "Scheduler.h"
 #include <sys/time.h>
 
+extern const AP_HAL::HAL& hal;
+
 #ifdef WITH_SITL_TONEALARM
 HALSITL::ToneAlarm_SF HALSITL::Util::_toneAlarm;
 #endif
 
 uint64_t HALSITL::Util::get_hw_rtc() const
 {
+    if (Scheduler::from(hal.scheduler)->lockstep()) {
+        // don't let the host clock leak into repeatable runs
+        return SITL_LOCKSTEP_EPOCH_SEC * 1000000ULL + AP_HAL::micros64();
+    }
 #ifndef CLOCK_REALTIME
     struct timeval ts;
     gettimeofday(&ts, nullptr);
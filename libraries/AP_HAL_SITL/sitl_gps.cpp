@@ -41,6 +41,9 @@ static struct gps_state {
     /* pipe emulating UBLOX GPS serial stream */
     int gps_fd, client_fd;
     uint32_t last_update; // milliseconds
+    /* bytes in the pipe when a snapshot was taken */
+    uint8_t snapshot[8192];
+    uint16_t snapshot_len;
 } gps_state, gps2_state;
 
 /*
@@ -100,6 +103,55 @@ int SITL_State::gps2_pipe(void)
     return gps2_state.client_fd;
 }
 
+/*
+  save the bytes in a GPS pipe. The pipe is shared with processes
+  forked from a snapshot, so each gets a new pipe filled with these
+ */
+static void gps_pipe_snapshot(struct gps_state &s)
+{
+    s.snapshot_len = 0;
+    if (s.client_fd == 0) {
+        return;
+    }
+    ssize_t n;
+    while (s.snapshot_len < sizeof(s.snapshot) &&
+           (n = read(s.client_fd, &s.snapshot[s.snapshot_len], sizeof(s.snapshot) - s.snapshot_len)) > 0) {
+        s.snapshot_len += n;
+    }
+}
+
+static void gps_pipe_restore(struct gps_state &s)
+{
+    int fd[2];
+    if (s.client_fd == 0 || pipe(fd) != 0) {
+        return;
+    }
+    // keep the descriptor numbers the UART driver knows about
+    dup2(fd[0], s.client_fd);
+    dup2(fd[1], s.gps_fd);
+    close(fd[0]);
+    close(fd[1]);
+    fcntl(s.client_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(s.gps_fd, F_SETFD, FD_CLOEXEC);
+    HALSITL::UARTDriver::_set_nonblocking(s.gps_fd);
+    HALSITL::UARTDriver::_set_nonblocking(s.client_fd);
+    if (s.snapshot_len > 0) {
+        write(s.gps_fd, s.snapshot, s.snapshot_len);
+    }
+}
+
+void SITL_State::_gps_snapshot(void)
+{
+    gps_pipe_snapshot(gps_state);
+    gps_pipe_snapshot(gps2_state);
+}
+
+void SITL_State::_gps_restore(void)
+{
+    gps_pipe_restore(gps_state);
+    gps_pipe_restore(gps2_state);
+}
+
 /*
   write some bytes from the simulated GPS
  */
@@ -136,7 +188,12 @@ static void simulation_timeval(struct timeval *tv)
     static struct timeval first_tv;
     if (first_usec == 0) {
         first_usec = now;
-        gettimeofday(&first_tv, nullptr);
+        if (HALSITL::Scheduler::from(hal.scheduler)->lockstep()) {
+            first_tv.tv_sec = SITL_LOCKSTEP_EPOCH_SEC;
+            first_tv.tv_usec = 0;
+        } else {
+            gettimeofday(&first_tv, nullptr);
+        }
     }
     *tv = first_tv;
     tv->tv_sec += now / 1000000ULL;
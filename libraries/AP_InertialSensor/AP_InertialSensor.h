@@ -17,6 +17,23 @@
 
 #define DEFAULT_IMU_LOG_BAT_MASK 0
 
+/*
+  run the gyro low pass, notch and harmonic notch filters of each IMU
+  as one vectorised cascade. Only worth it where there is SSE or NEON
+ */
+#ifndef HAL_INS_GYRO_FILTER_BANK
+#define HAL_INS_GYRO_FILTER_BANK (CONFIG_HAL_BOARD == HAL_BOARD_LINUX)
+#endif
+
+/*
+  allow FIFO backends to hand over a whole FIFO read at once, rotated
+  and corrected as a block. The unpacked samples are kept on the stack
+  of the bus thread, so this is only enabled where stacks are large
+ */
+#ifndef HAL_INS_BLOCK_INGEST
+#define HAL_INS_BLOCK_INGEST (CONFIG_HAL_BOARD == HAL_BOARD_LINUX)
+#endif
+
 #include <stdint.h>
 
 #include <AP_AccelCal/AP_AccelCal.h>
@@ -26,6 +43,7 @@
 #include <Filter/LowPassFilter.h>
 #include <Filter/NotchFilter.h>
 #include <Filter/HarmonicNotchFilter.h>
+#include <Filter/BiquadFilterBank.h>
 
 class AP_InertialSensor_Backend;
 class AuxiliaryBus;
@@ -433,6 +451,13 @@ private:
     // the current center frequency for the notch
     float _calculated_harmonic_notch_freq_hz;
 
+#if HAL_INS_GYRO_FILTER_BANK
+    // the gyro filters above as one cascade per instance: low pass,
+    // notch then the harmonic notches. The filter objects above
+    // still hold the coefficients
+    BiquadFilterBank<INS_MAX_INSTANCES, 2+HNF_MAX_FILTERS> _gyro_filter_bank;
+#endif
+
     // Most recent gyro reading
     Vector3f _gyro[INS_MAX_INSTANCES];
     Vector3f _delta_angle[INS_MAX_INSTANCES];
@@ -189,6 +189,28 @@ void AP_InertialSensor_Backend::_notify_new_gyro_raw_sample(uint8_t instance,
         hal.opticalflow->push_gyro(gyro.x, gyro.y, dt);
     }
     
+    {
+        WITH_SEMAPHORE(_sem);
+        uint64_t now = AP_HAL::micros64();
+
+        // zero accumulator if sensor was unhealthy for 0.1s
+        _accumulate_gyro_sample(instance, gyro, dt, now - last_sample_us > 100000U);
+    }
+
+    if (!_imu.batchsampler.doing_post_filter_logging()) {
+        log_gyro_raw(instance, sample_us, gyro);
+    }
+    else {
+        log_gyro_raw(instance, sample_us, _imu._gyro_filtered[instance]);
+    }
+}
+
+/*
+  integrate a gyro sample into the delta angle and run it through the
+  filters. Called with _sem held
+ */
+void AP_InertialSensor_Backend::_accumulate_gyro_sample(uint8_t instance, const Vector3f &gyro, float dt, bool reset)
+{
     // compute delta angle
     Vector3f delta_angle = (gyro + _imu._last_raw_gyro[instance]) * 0.5f * dt;
 
@@ -202,60 +224,55 @@ void AP_InertialSensor_Backend::_notify_new_gyro_raw_sample(uint8_t instance,
     delta_coning = delta_coning % delta_angle;
     delta_coning *= 0.5f;
 
-    {
-        WITH_SEMAPHORE(_sem);
-        uint64_t now = AP_HAL::micros64();
-
-        if (now - last_sample_us > 100000U) {
-            // zero accumulator if sensor was unhealthy for 0.1s
-            _imu._delta_angle_acc[instance].zero();
-            _imu._delta_angle_acc_dt[instance] = 0;
-            dt = 0;
-            delta_angle.zero();
-        }
-
-        // integrate delta angle accumulator
-        // the angles and coning corrections are accumulated separately in the
-        // referenced paper, but in simulation little difference was found between
-        // integrating together and integrating separately (see examples/coning.py)
-        _imu._delta_angle_acc[instance] += delta_angle + delta_coning;
-        _imu._delta_angle_acc_dt[instance] += dt;
-
-        // save previous delta angle for coning correction
-        _imu._last_delta_angle[instance] = delta_angle;
-        _imu._last_raw_gyro[instance] = gyro;
+    if (reset) {
+        _imu._delta_angle_acc[instance].zero();
+        _imu._delta_angle_acc_dt[instance] = 0;
+        dt = 0;
+        delta_angle.zero();
+    }
 
-        // apply the low pass filter
-        Vector3f gyro_filtered = _imu._gyro_filter[instance].apply(gyro);
+    // integrate delta angle accumulator
+    // the angles and coning corrections are accumulated separately in the
+    // referenced paper, but in simulation little difference was found between
+    // integrating together and integrating separately (see examples/coning.py)
+    _imu._delta_angle_acc[instance] += delta_angle + delta_coning;
+    _imu._delta_angle_acc_dt[instance] += dt;
 
-        // apply the notch filter
-        if (_gyro_notch_enabled()) {
-            gyro_filtered = _imu._gyro_notch_filter[instance].apply(gyro_filtered);
-        }
+    // save previous delta angle for coning correction
+    _imu._last_delta_angle[instance] = delta_angle;
+    _imu._last_raw_gyro[instance] = gyro;
 
-        // apply the harmonic notch filter
-        if (gyro_harmonic_notch_enabled()) {
-            gyro_filtered = _imu._gyro_harmonic_notch_filter[instance].apply(gyro_filtered);
-        }
+#if HAL_INS_GYRO_FILTER_BANK
+    // apply the low pass, notch and harmonic notch filters
+    Vector3f gyro_filtered = _imu._gyro_filter_bank.apply(instance, gyro);
+#else
+    // apply the low pass filter
+    Vector3f gyro_filtered = _imu._gyro_filter[instance].apply(gyro);
 
-        // if the filtering failed in any way then reset the filters and keep the old value
-        if (gyro_filtered.is_nan() || gyro_filtered.is_inf()) {
-            _imu._gyro_filter[instance].reset();
-            _imu._gyro_notch_filter[instance].reset();
-            _imu._gyro_harmonic_notch_filter[instance].reset();
-        } else {
-            _imu._gyro_filtered[instance] = gyro_filtered;
-        }
-
-        _imu._new_gyro_data[instance] = true;
+    // apply the notch filter
+    if (_gyro_notch_enabled()) {
+        gyro_filtered = _imu._gyro_notch_filter[instance].apply(gyro_filtered);
     }
 
-    if (!_imu.batchsampler.doing_post_filter_logging()) {
-        log_gyro_raw(instance, sample_us, gyro);
+    // apply the harmonic notch filter
+    if (gyro_harmonic_notch_enabled()) {
+        gyro_filtered = _imu._gyro_harmonic_notch_filter[instance].apply(gyro_filtered);
     }
-    else {
-        log_gyro_raw(instance, sample_us, _imu._gyro_filtered[instance]);
+#endif
+
+    // if the filtering failed in any way then reset the filters and keep the old value
+    if (gyro_filtered.is_nan() || gyro_filtered.is_inf()) {
+        _imu._gyro_filter[instance].reset();
+        _imu._gyro_notch_filter[instance].reset();
+        _imu._gyro_harmonic_notch_filter[instance].reset();
+#if HAL_INS_GYRO_FILTER_BANK
+        _imu._gyro_filter_bank.reset(instance);
+#endif
+    } else {
+        _imu._gyro_filtered[instance] = gyro_filtered;
     }
+
+    _imu._new_gyro_data[instance] = true;
 }
 
 void AP_InertialSensor_Backend::log_gyro_raw(uint8_t instance, const uint64_t sample_us, const Vector3f &gyro)
@@ -367,25 +384,8 @@ void AP_InertialSensor_Backend::_notify_new_accel_raw_sample(uint8_t instance,
 
         uint64_t now = AP_HAL::micros64();
 
-        if (now - last_sample_us > 100000U) {
-            // zero accumulator if sensor was unhealthy for 0.1s
-            _imu._delta_velocity_acc[instance].zero();
-            _imu._delta_velocity_acc_dt[instance] = 0;
-            dt = 0;
-        }
-        
-        // delta velocity
-        _imu._delta_velocity_acc[instance] += accel * dt;
-        _imu._delta_velocity_acc_dt[instance] += dt;
-
-        _imu._accel_filtered[instance] = _imu._accel_filter[instance].apply(accel);
-        if (_imu._accel_filtered[instance].is_nan() || _imu._accel_filtered[instance].is_inf()) {
-            _imu._accel_filter[instance].reset();
-        }
-
-        _imu.set_accel_peak_hold(instance, _imu._accel_filtered[instance]);
-
-        _imu._new_accel_data[instance] = true;
+        // zero accumulator if sensor was unhealthy for 0.1s
+        _accumulate_accel_sample(instance, accel, dt, now - last_sample_us > 100000U);
     }
 
     if (!_imu.batchsampler.doing_post_filter_logging()) {
@@ -395,6 +395,32 @@ void AP_InertialSensor_Backend::_notify_new_accel_raw_sample(uint8_t instance,
     }
 }
 
+/*
+  integrate an accel sample into the delta velocity and run it through
+  the filter. Called with _sem held
+ */
+void AP_InertialSensor_Backend::_accumulate_accel_sample(uint8_t instance, const Vector3f &accel, float dt, bool reset)
+{
+    if (reset) {
+        _imu._delta_velocity_acc[instance].zero();
+        _imu._delta_velocity_acc_dt[instance] = 0;
+        dt = 0;
+    }
+
+    // delta velocity
+    _imu._delta_velocity_acc[instance] += accel * dt;
+    _imu._delta_velocity_acc_dt[instance] += dt;
+
+    _imu._accel_filtered[instance] = _imu._accel_filter[instance].apply(accel);
+    if (_imu._accel_filtered[instance].is_nan() || _imu._accel_filtered[instance].is_inf()) {
+        _imu._accel_filter[instance].reset();
+    }
+
+    _imu.set_accel_peak_hold(instance, _imu._accel_filtered[instance]);
+
+    _imu._new_accel_data[instance] = true;
+}
+
 void AP_InertialSensor_Backend::_notify_new_accel_sensor_rate_sample(uint8_t instance, const Vector3f &accel)
 {
     if (!_imu.batchsampler.doing_sensor_rate_logging()) {
@@ -412,6 +438,199 @@ void AP_InertialSensor_Backend::_notify_new_gyro_sensor_rate_sample(uint8_t inst
     _imu.batchsampler.sample(instance, AP_InertialSensor::IMU_SENSOR_TYPE_GYRO, AP_HAL::micros64(), gyro);
 }
 
+#if HAL_INS_BLOCK_INGEST
+/*
+  rotate and correct a block of accel samples. The sensor rotation,
+  offsets, scaling and board rotation are combined into one matrix
+  and offset, so each sample costs a single matrix multiply
+ */
+void AP_InertialSensor_Backend::_rotate_and_correct_accel_block(uint8_t instance, Vector3f *accel, uint8_t n)
+{
+    Matrix3f sensor_rot;
+    sensor_rot.from_rotation(_imu._accel_orientation[instance]);
+
+    Matrix3f board_rot;
+    if (_imu._board_orientation == ROTATION_CUSTOM && _imu._custom_rotation) {
+        board_rot = *_imu._custom_rotation;
+    } else {
+        board_rot.from_rotation(_imu._board_orientation);
+    }
+
+    const Vector3f &accel_scale = _imu._accel_scale[instance].get();
+    const Matrix3f scale(Vector3f(accel_scale.x, 0, 0),
+                         Vector3f(0, accel_scale.y, 0),
+                         Vector3f(0, 0, accel_scale.z));
+    const Matrix3f board_scale = board_rot * scale;
+    const Matrix3f m = board_scale * sensor_rot;
+    const Vector3f offset = board_scale * _imu._accel_offset[instance].get();
+
+    for (uint8_t i=0; i<n; i++) {
+        accel[i] = m * accel[i] - offset;
+    }
+}
+
+/*
+  rotate and correct a block of gyro samples
+ */
+void AP_InertialSensor_Backend::_rotate_and_correct_gyro_block(uint8_t instance, Vector3f *gyro, uint8_t n)
+{
+    Matrix3f sensor_rot;
+    sensor_rot.from_rotation(_imu._gyro_orientation[instance]);
+
+    Matrix3f board_rot;
+    if (_imu._board_orientation == ROTATION_CUSTOM && _imu._custom_rotation) {
+        board_rot = *_imu._custom_rotation;
+    } else {
+        board_rot.from_rotation(_imu._board_orientation);
+    }
+
+    const Matrix3f m = board_rot * sensor_rot;
+    const Vector3f offset = board_rot * _imu._gyro_offset[instance].get();
+
+    for (uint8_t i=0; i<n; i++) {
+        gyro[i] = m * gyro[i] - offset;
+    }
+}
+
+/*
+  notify a block of gyro samples from a FIFO read
+ */
+void AP_InertialSensor_Backend::_notify_new_gyro_raw_samples(uint8_t instance, const Vector3f *gyro, uint8_t n)
+{
+    if (((1U<<instance) & _imu.imu_kill_mask) || n == 0) {
+        return;
+    }
+
+    for (uint8_t i=0; i<n; i++) {
+        _update_sensor_rate(_imu._sample_gyro_count[instance], _imu._sample_gyro_start_us[instance],
+                            _imu._gyro_raw_sample_rates[instance]);
+    }
+
+    // don't accept below 100Hz
+    if (_imu._gyro_raw_sample_rates[instance] < 100) {
+        return;
+    }
+
+    // FIFO samples are evenly spaced at the sensor rate
+    const float dt = 1.0f / _imu._gyro_raw_sample_rates[instance];
+    const uint64_t last_sample_us = _imu._gyro_last_sample_us[instance];
+    _imu._gyro_last_sample_us[instance] = AP_HAL::micros64();
+
+    for (uint8_t i=0; i<n; i++) {
+#if AP_MODULE_SUPPORTED
+        // call gyro_sample hook if any
+        AP_Module::call_hook_gyro_sample(instance, dt, gyro[i]);
+#endif
+
+        // push gyros if optical flow present
+        if (hal.opticalflow) {
+            hal.opticalflow->push_gyro(gyro[i].x, gyro[i].y, dt);
+        }
+    }
+
+    const bool post_filter = _imu.batchsampler.doing_post_filter_logging();
+    {
+        WITH_SEMAPHORE(_sem);
+        uint64_t now = AP_HAL::micros64();
+
+        // zero accumulator if sensor was unhealthy for 0.1s
+        const bool reset = now - last_sample_us > 100000U;
+        for (uint8_t i=0; i<n; i++) {
+            _accumulate_gyro_sample(instance, gyro[i], dt, reset && i == 0);
+            if (post_filter) {
+                log_gyro_raw(instance, 0, _imu._gyro_filtered[instance]);
+            }
+        }
+    }
+
+    if (!post_filter) {
+        for (uint8_t i=0; i<n; i++) {
+            log_gyro_raw(instance, 0, gyro[i]);
+        }
+    }
+}
+
+/*
+  notify a block of accel samples from a FIFO read
+ */
+void AP_InertialSensor_Backend::_notify_new_accel_raw_samples(uint8_t instance, const Vector3f *accel, uint8_t n, uint32_t fsync_mask)
+{
+    if (((1U<<instance) & _imu.imu_kill_mask) || n == 0) {
+        return;
+    }
+
+    for (uint8_t i=0; i<n; i++) {
+        _update_sensor_rate(_imu._sample_accel_count[instance], _imu._sample_accel_start_us[instance],
+                            _imu._accel_raw_sample_rates[instance]);
+    }
+
+    // don't accept below 100Hz
+    if (_imu._accel_raw_sample_rates[instance] < 100) {
+        return;
+    }
+
+    // FIFO samples are evenly spaced at the sensor rate
+    const float dt = 1.0f / _imu._accel_raw_sample_rates[instance];
+    const uint64_t last_sample_us = _imu._accel_last_sample_us[instance];
+    _imu._accel_last_sample_us[instance] = AP_HAL::micros64();
+
+    for (uint8_t i=0; i<n; i++) {
+#if AP_MODULE_SUPPORTED
+        // call accel_sample hook if any
+        AP_Module::call_hook_accel_sample(instance, dt, accel[i], (fsync_mask & (1U<<i)) != 0);
+#endif
+        _imu.calc_vibration_and_clipping(instance, accel[i], dt);
+    }
+
+    const bool post_filter = _imu.batchsampler.doing_post_filter_logging();
+    {
+        WITH_SEMAPHORE(_sem);
+        uint64_t now = AP_HAL::micros64();
+
+        // zero accumulator if sensor was unhealthy for 0.1s
+        const bool reset = now - last_sample_us > 100000U;
+        for (uint8_t i=0; i<n; i++) {
+            _accumulate_accel_sample(instance, accel[i], dt, reset && i == 0);
+            if (post_filter) {
+                log_accel_raw(instance, 0, _imu._accel_filtered[instance]);
+            }
+        }
+    }
+
+    if (!post_filter) {
+        for (uint8_t i=0; i<n; i++) {
+            log_accel_raw(instance, 0, accel[i]);
+        }
+    }
+}
+
+/*
+  sensor rate samples from one FIFO read, all logged with the time of
+  the read as the single sample functions do
+ */
+void AP_InertialSensor_Backend::_notify_new_accel_sensor_rate_samples(uint8_t instance, const Vector3f *accel, uint8_t n)
+{
+    if (!_imu.batchsampler.doing_sensor_rate_logging()) {
+        return;
+    }
+    const uint64_t now = AP_HAL::micros64();
+    for (uint8_t i=0; i<n; i++) {
+        _imu.batchsampler.sample(instance, AP_InertialSensor::IMU_SENSOR_TYPE_ACCEL, now, accel[i]);
+    }
+}
+
+void AP_InertialSensor_Backend::_notify_new_gyro_sensor_rate_samples(uint8_t instance, const Vector3f *gyro, uint8_t n)
+{
+    if (!_imu.batchsampler.doing_sensor_rate_logging()) {
+        return;
+    }
+    const uint64_t now = AP_HAL::micros64();
+    for (uint8_t i=0; i<n; i++) {
+        _imu.batchsampler.sample(instance, AP_InertialSensor::IMU_SENSOR_TYPE_GYRO, now, gyro[i]);
+    }
+}
+#endif // HAL_INS_BLOCK_INGEST
+
 void AP_InertialSensor_Backend::log_accel_raw(uint8_t instance, const uint64_t sample_us, const Vector3f &accel)
 {
     AP_Logger *logger = AP_Logger::get_singleton();
@@ -538,7 +757,42 @@ void AP_InertialSensor_Backend::update_gyro(uint8_t instance)
         _last_notch_bandwidth_hz = _gyro_notch_bandwidth_hz();
         _last_notch_attenuation_dB = _gyro_notch_attenuation_dB();
     }
+
+#if HAL_INS_GYRO_FILTER_BANK
+    update_gyro_filter_bank(instance);
+#endif
+}
+
+#if HAL_INS_GYRO_FILTER_BANK
+/*
+  copy the coefficients of the gyro filters into the filter bank. This
+  is cheap enough to do on every update, which also picks up the notch
+  filters being enabled or disabled
+ */
+void AP_InertialSensor_Backend::update_gyro_filter_bank(uint8_t instance)
+{
+    BiquadCoeffs c;
+
+    _imu._gyro_filter[instance].get_coefficients(c);
+    _imu._gyro_filter_bank.set_stage(instance, 0, c);
+
+    if (_gyro_notch_enabled()) {
+        _imu._gyro_notch_filter[instance].get_coefficients(c);
+    } else {
+        c.set_passthrough();
+    }
+    _imu._gyro_filter_bank.set_stage(instance, 1, c);
+
+    for (uint8_t i=0; i<HNF_MAX_FILTERS; i++) {
+        if (gyro_harmonic_notch_enabled()) {
+            _imu._gyro_harmonic_notch_filter[instance].get_coefficients(i, c);
+        } else {
+            c.set_passthrough();
+        }
+        _imu._gyro_filter_bank.set_stage(instance, 2+i, c);
+    }
 }
+#endif // HAL_INS_GYRO_FILTER_BANK
 
 /*
   common accel update function for all backends
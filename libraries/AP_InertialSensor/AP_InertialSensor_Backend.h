@@ -145,6 +145,21 @@ protected:
     // sensors, and should be set to zero for FIFO based sensors
     void _notify_new_accel_raw_sample(uint8_t instance, const Vector3f &accel, uint64_t sample_us=0, bool fsync_set=false);
 
+#if HAL_INS_BLOCK_INGEST
+    // rotate and correct a block of samples, as for
+    // _rotate_and_correct_accel() and _rotate_and_correct_gyro()
+    void _rotate_and_correct_accel_block(uint8_t instance, Vector3f *accel, uint8_t n);
+    void _rotate_and_correct_gyro_block(uint8_t instance, Vector3f *gyro, uint8_t n);
+
+    // notify a block of consecutive FIFO samples, equivalent to
+    // calling _notify_new_accel_raw_sample() and
+    // _notify_new_gyro_raw_sample() for each sample with a zero
+    // sample_us, but taking the semaphore once per block. Bit i of
+    // fsync_mask is the fsync flag of sample i
+    void _notify_new_accel_raw_samples(uint8_t instance, const Vector3f *accel, uint8_t n, uint32_t fsync_mask=0);
+    void _notify_new_gyro_raw_samples(uint8_t instance, const Vector3f *gyro, uint8_t n);
+#endif
+
     // set the amount of oversamping a accel is doing
     void _set_accel_oversampling(uint8_t instance, uint8_t n);
 
@@ -260,6 +275,11 @@ protected:
     // common gyro update function for all backends
     void update_gyro(uint8_t instance);
 
+#if HAL_INS_GYRO_FILTER_BANK
+    // copy the gyro filter coefficients into the filter bank
+    void update_gyro_filter_bank(uint8_t instance);
+#endif
+
     // common accel update function for all backends
     void update_accel(uint8_t instance);
 
@@ -298,6 +318,10 @@ protected:
     // at the 'sensor rate'
     void _notify_new_accel_sensor_rate_sample(uint8_t instance, const Vector3f &accel);
     void _notify_new_gyro_sensor_rate_sample(uint8_t instance, const Vector3f &gyro);
+#if HAL_INS_BLOCK_INGEST
+    void _notify_new_accel_sensor_rate_samples(uint8_t instance, const Vector3f *accel, uint8_t n);
+    void _notify_new_gyro_sensor_rate_samples(uint8_t instance, const Vector3f *gyro, uint8_t n);
+#endif
 
     /*
       notify of a FIFO reset so we don't use bad data to update observed sensor rate
@@ -315,4 +339,8 @@ private:
     void log_accel_raw(uint8_t instance, const uint64_t sample_us, const Vector3f &accel);
     void log_gyro_raw(uint8_t instance, const uint64_t sample_us, const Vector3f &gryo);
 
+    // integrate and filter one sample, called with _sem held
+    void _accumulate_gyro_sample(uint8_t instance, const Vector3f &gyro, float dt, bool reset);
+    void _accumulate_accel_sample(uint8_t instance, const Vector3f &accel, float dt, bool reset);
+
 };
@@ -54,7 +54,18 @@ extern const AP_HAL::HAL& hal;
 #include "AP_InertialSensor_Invensense_registers.h"
 
 #define MPU_SAMPLE_SIZE 14
+
+/*
+  with block ingest a normal burst of up to 24 fast sampling samples
+  is read with a single transfer
+ */
+#ifndef MPU_FIFO_BUFFER_LEN
+#if HAL_INS_BLOCK_INGEST
+#define MPU_FIFO_BUFFER_LEN 32
+#else
 #define MPU_FIFO_BUFFER_LEN 16
+#endif
+#endif
 
 #define int16_val(v, idx) ((int16_t)(((uint16_t)v[2*idx] << 8) | v[2*idx+1]))
 #define uint16_val(v, idx)(((uint16_t)v[2*idx] << 8) | v[2*idx+1])
@@ -412,6 +423,58 @@ void AP_InertialSensor_Invensense::_poll_data()
 
 bool AP_InertialSensor_Invensense::_accumulate(uint8_t *samples, uint8_t n_samples)
 {
+#if HAL_INS_BLOCK_INGEST
+    /*
+      unpack the samples up to any FIFO corruption, then rotate,
+      correct and notify them as a block
+     */
+    Vector3f accel[MPU_FIFO_BUFFER_LEN];
+    Vector3f gyro[MPU_FIFO_BUFFER_LEN];
+    float temp[MPU_FIFO_BUFFER_LEN];
+    uint32_t fsync_mask = 0;
+    uint8_t n = 0;
+    bool ret = true;
+
+    for (; n < n_samples; n++) {
+        const uint8_t *data = samples + MPU_SAMPLE_SIZE * n;
+
+        int16_t t2 = int16_val(data, 3);
+        if (!_check_raw_temp(t2)) {
+            debug("temp reset IMU[%u] %d %d", _accel_instance, _raw_temp, t2);
+            ret = false;
+            break;
+        }
+        temp[n] = t2 * temp_sensitivity + temp_zero;
+
+#if INVENSENSE_EXT_SYNC_ENABLE
+        if (int16_val(data, 2) & 1U) {
+            fsync_mask |= 1U << n;
+        }
+#endif
+
+        accel[n] = Vector3f(int16_val(data, 1),
+                            int16_val(data, 0),
+                            -int16_val(data, 2)) * _accel_scale;
+        gyro[n] = Vector3f(int16_val(data, 5),
+                           int16_val(data, 4),
+                           -int16_val(data, 6)) * _gyro_scale;
+    }
+
+    _rotate_and_correct_accel_block(_accel_instance, accel, n);
+    _rotate_and_correct_gyro_block(_gyro_instance, gyro, n);
+
+    _notify_new_accel_raw_samples(_accel_instance, accel, n, fsync_mask);
+    _notify_new_gyro_raw_samples(_gyro_instance, gyro, n);
+
+    for (uint8_t i = 0; i < n; i++) {
+        _temp_filtered = _temp_filter.apply(temp[i]);
+    }
+
+    if (!ret) {
+        _fifo_reset();
+    }
+    return ret;
+#else
     for (uint8_t i = 0; i < n_samples; i++) {
         const uint8_t *data = samples + MPU_SAMPLE_SIZE * i;
         Vector3f accel, gyro;
@@ -448,6 +511,7 @@ bool AP_InertialSensor_Invensense::_accumulate(uint8_t *samples, uint8_t n_sampl
         _temp_filtered = _temp_filter.apply(temp);
     }
     return true;
+#endif // HAL_INS_BLOCK_INGEST
 }
 
 /*
@@ -464,6 +528,13 @@ bool AP_InertialSensor_Invensense::_accumulate_sensor_rate_sampling(uint8_t *sam
     const int32_t unscaled_clip_limit = _clip_limit / _accel_scale;
     bool clipped = false;
     bool ret = true;
+#if HAL_INS_BLOCK_INGEST
+    // sensor rate samples, logged together at the end
+    Vector3f accel_sr[MPU_FIFO_BUFFER_LEN];
+    Vector3f gyro_sr[MPU_FIFO_BUFFER_LEN];
+    uint8_t n_accel_sr = 0;
+    uint8_t n_gyro_sr = 0;
+#endif
     
     for (uint8_t i = 0; i < n_samples; i++) {
         const uint8_t *data = samples + MPU_SAMPLE_SIZE * i;
@@ -490,7 +561,11 @@ bool AP_InertialSensor_Invensense::_accumulate_sensor_rate_sampling(uint8_t *sam
             }
             _accum.accel += _accum.accel_filter.apply(a);
             Vector3f a2 = a * _accel_scale;
+#if HAL_INS_BLOCK_INGEST
+            accel_sr[n_accel_sr++] = a2;
+#else
             _notify_new_accel_sensor_rate_sample(_accel_instance, a2);
+#endif
         }
 
         Vector3f g(int16_val(data, 5),
@@ -498,7 +573,11 @@ bool AP_InertialSensor_Invensense::_accumulate_sensor_rate_sampling(uint8_t *sam
                    -int16_val(data, 6));
 
         Vector3f g2 = g * _gyro_scale;
+#if HAL_INS_BLOCK_INGEST
+        gyro_sr[n_gyro_sr++] = g2;
+#else
         _notify_new_gyro_sensor_rate_sample(_gyro_instance, g2);
+#endif
 
         _accum.gyro += _accum.gyro_filter.apply(g);
         _accum.count++;
@@ -520,6 +599,11 @@ bool AP_InertialSensor_Invensense::_accumulate_sensor_rate_sampling(uint8_t *sam
         }
     }
 
+#if HAL_INS_BLOCK_INGEST
+    _notify_new_accel_sensor_rate_samples(_accel_instance, accel_sr, n_accel_sr);
+    _notify_new_gyro_sensor_rate_samples(_gyro_instance, gyro_sr, n_gyro_sr);
+#endif
+
     if (clipped) {
         increment_clip_count(_accel_instance);
     }
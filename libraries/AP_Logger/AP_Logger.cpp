@@ -92,6 +92,21 @@ const AP_Param::GroupInfo AP_Logger::var_info[] = {
     // @User: Standard
     // @Units: s
     AP_GROUPINFO("_FILE_TIMEOUT",  6, AP_Logger, _params.file_timeout,     HAL_LOGGING_FILE_TIMEOUT),
+
+    // @Param: _FILE_OPTS
+    // @DisplayName: AP_Logger File Backend options
+    // @Description: Options for the File backend on Linux and SITL boards. A dedicated writer thread drains the log buffer with writev() instead of sharing the IO thread. Direct IO (O_DIRECT) and preallocation are only used with the dedicated writer thread. Compressed logs must be read with Replay or converted with Tools/scripts/log_decompress.py. Takes effect on reboot.
+    // @Bitmask: 0:Dedicated writer thread,1:Direct IO,2:Preallocate log file,3:Compress log
+    // @User: Advanced
+    AP_GROUPINFO("_FILE_OPTS",  7, AP_Logger, _params.file_options,     0),
+
+    // @Param: _FILE_SYNC
+    // @DisplayName: Data written between log file syncs
+    // @Description: The File backend syncs the log file to storage after this much data has been written. Zero syncs after every write on boards which do so by default.
+    // @User: Advanced
+    // @Units: kB
+    // @Range: 0 32767
+    AP_GROUPINFO("_FILE_SYNC",  8, AP_Logger, _params.file_sync_kb,     0),
     
     AP_GROUPEND
 };
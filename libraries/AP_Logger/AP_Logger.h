@@ -337,6 +337,8 @@ public:
         AP_Int8 log_replay;
         AP_Int8 mav_bufsize; // in kilobytes
         AP_Int16 file_timeout; // in seconds
+        AP_Int8 file_options;
+        AP_Int16 file_sync_kb; // in kilobytes
     } _params;
 
     const struct LogStructure *structure(uint16_t num) const;
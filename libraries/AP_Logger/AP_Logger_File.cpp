@@ -24,6 +24,15 @@
 #include <GCS_MAVLink/GCS.h>
 #include <stdio.h>
 
+#if HAL_LOGGER_FILE_WRITER_THREAD_ENABLED
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
 
 extern const AP_HAL::HAL& hal;
 
@@ -34,6 +43,15 @@ extern const AP_HAL::HAL& hal;
 #define HAL_LOGGER_WRITE_CHUNK_SIZE 4096
 #endif
 
+// O_DIRECT transfers must be aligned to the logical block size
+#define LOGGER_DIRECT_IO_ALIGN 4096U
+
+// log files are preallocated in steps of this size
+#define LOGGER_PREALLOCATE_SIZE (16*1024*1024UL)
+
+// a single write or sync taking longer than this counts as a stall
+#define LOGGER_STALL_US 20000U
+
 /*
   constructor
  */
@@ -49,7 +67,9 @@ AP_Logger_File::AP_Logger_File(AP_Logger &front,
     _perf_write(hal.util->perf_alloc(AP_HAL::Util::PC_ELAPSED, "DF_write")),
     _perf_fsync(hal.util->perf_alloc(AP_HAL::Util::PC_ELAPSED, "DF_fsync")),
     _perf_errors(hal.util->perf_alloc(AP_HAL::Util::PC_COUNT, "DF_errors")),
-    _perf_overruns(hal.util->perf_alloc(AP_HAL::Util::PC_COUNT, "DF_overruns"))
+    _perf_overruns(hal.util->perf_alloc(AP_HAL::Util::PC_COUNT, "DF_overruns")),
+    _perf_stalls(hal.util->perf_alloc(AP_HAL::Util::PC_COUNT, "DF_stalls")),
+    _perf_compress(hal.util->perf_alloc(AP_HAL::Util::PC_ELAPSED, "DF_compress"))
 {
     df_stats_clear();
 }
@@ -100,7 +120,44 @@ void AP_Logger_File::Init()
 
     hal.console->printf("AP_Logger_File: buffer size=%u\n", (unsigned)bufsize);
 
+#if HAL_LOGGER_COMPRESSION_ENABLED
+    if (option_is_set(FileOption::COMPRESS)) {
+        _compressor = new LogCompressor();
+        if (_compressor == nullptr || !_compressor->init()) {
+            hal.console->printf("Out of memory for log compression\n");
+            delete _compressor;
+            _compressor = nullptr;
+        }
+    }
+#endif
+
     _initialised = true;
+
+#if HAL_LOGGER_FILE_WRITER_THREAD_ENABLED && !APM_BUILD_TYPE(APM_BUILD_Replay)
+    if (option_is_set(FileOption::WRITER_THREAD)) {
+        if (option_is_set(FileOption::DIRECT_IO)) {
+            // the bounce buffer must hold a full buffer's worth of blocks
+            _direct_buf_size = (bufsize + LOGGER_DIRECT_IO_ALIGN - 1) & ~(LOGGER_DIRECT_IO_ALIGN - 1);
+            void *p = nullptr;
+            if (posix_memalign(&p, LOGGER_DIRECT_IO_ALIGN, _direct_buf_size) == 0) {
+                _direct_buf = (uint8_t *)p;
+            } else {
+                hal.console->printf("AP_Logger_File: no memory for direct IO\n");
+            }
+        }
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX
+        pthread_mutex_init(&_writer_mtx, nullptr);
+        pthread_cond_init(&_writer_cond, nullptr);
+#endif
+        if (hal.scheduler->thread_create(FUNCTOR_BIND_MEMBER(&AP_Logger_File::_writer_thread, void),
+                                         "log_writer", 4096, AP_HAL::Scheduler::PRIORITY_IO, 0)) {
+            _writer_thread_running = true;
+            return;
+        }
+        hal.console->printf("AP_Logger_File: failed to start writer thread\n");
+    }
+#endif
+
     hal.scheduler->register_io_process(FUNCTOR_BIND_MEMBER(&AP_Logger_File::_io_timer, void));
 }
 
@@ -159,6 +216,16 @@ void AP_Logger_File::periodic_1Hz()
 void AP_Logger_File::periodic_fullrate()
 {
     AP_Logger_Backend::push_log_blocks();
+
+#if HAL_LOGGER_COMPRESSION_ENABLED
+    // don't let a partial block wait indefinitely when logging slowly
+    if (_compressor != nullptr && _compressor->pending() > 0 &&
+        AP_HAL::millis() - _compress_pending_ms > 100 &&
+        semaphore.take_nonblocking()) {
+        _compress_flush();
+        semaphore.give();
+    }
+#endif
 }
 
 uint32_t AP_Logger_File::bufferspace_available()
@@ -514,6 +581,20 @@ bool AP_Logger_File::_WritePrioritisedBlock(const void *pBuffer, uint16_t size,
         }
     }
 
+#if HAL_LOGGER_COMPRESSION_ENABLED
+    if (_compressor != nullptr) {
+        if (!_compress_message(pBuffer, size)) {
+            hal.util->perf_count(_perf_overruns);
+            _dropped++;
+            semaphore.give();
+            return false;
+        }
+        df_stats_gather(size);
+        semaphore.give();
+        return true;
+    }
+#endif
+
     // if no room for entire message - drop it:
     if (space < size) {
         hal.util->perf_count(_perf_overruns);
@@ -522,12 +603,63 @@ bool AP_Logger_File::_WritePrioritisedBlock(const void *pBuffer, uint16_t size,
         return false;
     }
 
+    const uint32_t available_before = _writebuf.available();
     _writebuf.write((uint8_t*)pBuffer, size);
+#if HAL_LOGGER_FILE_WRITER_THREAD_ENABLED
+    _writer_wake_if_due(available_before);
+#endif
     df_stats_gather(size);
     semaphore.give();
     return true;
 }
 
+#if HAL_LOGGER_COMPRESSION_ENABLED
+/*
+  add a message to the compressor, first moving the pending block to
+  the write buffer if it is full. Called with semaphore held
+ */
+bool AP_Logger_File::_compress_message(const void *pBuffer, uint16_t size)
+{
+    if (_compressor->pending() == 0) {
+        _compress_pending_ms = AP_HAL::millis();
+    }
+    if (_compressor->add((const uint8_t *)pBuffer, size)) {
+        return true;
+    }
+    if (!_compress_flush()) {
+        // no room in the write buffer for the full block
+        return false;
+    }
+    _compress_pending_ms = AP_HAL::millis();
+    return _compressor->add((const uint8_t *)pBuffer, size);
+}
+
+/*
+  compress the pending block into the write buffer. Called with
+  semaphore held
+ */
+bool AP_Logger_File::_compress_flush(void)
+{
+    if (_compressor->pending() == 0) {
+        return true;
+    }
+    if (_writebuf.space() < LogCompressor::max_frame_size()) {
+        return false;
+    }
+    hal.util->perf_begin(_perf_compress);
+    const uint8_t *frame;
+    const uint32_t len = _compressor->flush(frame);
+    hal.util->perf_end(_perf_compress);
+    const uint32_t available_before = _writebuf.available();
+    _writebuf.write(frame, len);
+#if HAL_LOGGER_FILE_WRITER_THREAD_ENABLED
+    _writer_wake_if_due(available_before);
+#endif
+    stats.compressed_bytes += len;
+    return true;
+}
+#endif
+
 /*
   find the highest log number
  */
@@ -780,6 +912,32 @@ void AP_Logger_File::stop_logging(void)
 {
     // best-case effort to avoid annoying the IO thread
     const bool have_sem = write_fd_semaphore.take(hal.util->get_soft_armed()?1:20);
+#if HAL_LOGGER_FILE_WRITER_THREAD_ENABLED
+    if (_write_fd != -1 && have_sem && _closing_fd == -1) {
+        /*
+          hand the file over to the thread writing the log to write
+          out what is still buffered for it and close it, rather than
+          writing it out here, as this is often the main thread
+          arming. A partial compressed block goes into the buffer
+          first if there is room for it
+         */
+#if HAL_LOGGER_COMPRESSION_ENABLED
+        if (_compressor != nullptr && semaphore.take(1)) {
+            _compress_flush();
+            semaphore.give();
+        }
+#endif
+        // the tail held back as less than a direct IO block goes out
+        // with a normal write
+        _direct_io_disable();
+        _closing_fd = _write_fd;
+        _closing_bytes = _writebuf.available();
+        _write_fd = -1;
+        write_fd_semaphore.give();
+        _writer_wake();
+        return;
+    }
+#endif
     if (_write_fd != -1) {
         int fd = _write_fd;
         _write_fd = -1;
@@ -870,7 +1028,31 @@ uint16_t AP_Logger_File::start_new_log(void)
     }
     _last_write_ms = AP_HAL::millis();
     _write_offset = 0;
+    _bytes_since_sync = 0;
+#if HAL_LOGGER_FILE_WRITER_THREAD_ENABLED
+    if (_closing_fd != -1) {
+        // the data of this file follows what is left for a file
+        // still being closed. Anything between them is from a file
+        // closed at once while that one was being finished
+        _discard_bytes = _writebuf.available() - _closing_bytes;
+    } else {
+        _writebuf.clear();
+    }
+#else
     _writebuf.clear();
+#endif
+#if HAL_LOGGER_COMPRESSION_ENABLED
+    if (_compressor != nullptr) {
+        // the header must be the first thing in the file
+        _compressor->reset();
+        struct log_compress_file_header hdr;
+        LogCompressor::file_header(hdr);
+        _writebuf.write((const uint8_t *)&hdr, sizeof(hdr));
+    }
+#endif
+#if HAL_LOGGER_FILE_WRITER_THREAD_ENABLED
+    _configure_write_fd();
+#endif
     write_fd_semaphore.give();
 
     // now update lastlog.txt with the new log number
@@ -906,6 +1088,26 @@ void AP_Logger_File::flush(void)
 #if APM_BUILD_TYPE(APM_BUILD_Replay) || APM_BUILD_TYPE(APM_BUILD_UNKNOWN)
 {
     uint32_t tnow = AP_HAL::millis();
+#if HAL_LOGGER_COMPRESSION_ENABLED
+    if (_compressor != nullptr && semaphore.take(1)) {
+        _compress_flush();
+        semaphore.give();
+    }
+#endif
+#if HAL_LOGGER_FILE_WRITER_THREAD_ENABLED
+    if (_writer_thread_running) {
+        // the writer thread drains the buffer; stop it holding back a
+        // partial direct IO block and wait for it
+        if (write_fd_semaphore.take(1)) {
+            _direct_io_disable();
+            write_fd_semaphore.give();
+        }
+        _writer_wake();
+        while (_write_fd != -1 && _initialised && !_open_error && _writebuf.available()) {
+            hal.scheduler->delay_microseconds(1000);
+        }
+    }
+#endif
     while (_write_fd != -1 && _initialised && !_open_error && _writebuf.available()) {
         // convince the IO timer that it really is OK to write out
         // less than _writebuf_chunk bytes:
@@ -930,10 +1132,119 @@ void AP_Logger_File::flush(void)
 #endif // APM_BUILD_TYPE(APM_BUILD_Replay) || APM_BUILD_TYPE(APM_BUILD_UNKNOWN)
 #endif
 
+/*
+  check for enough free space to keep logging, stopping logging if
+  there isn't. Returns false if logging was stopped
+ */
+bool AP_Logger_File::_check_free_space(uint32_t tnow)
+{
+    if (tnow - _free_space_last_check_time > _free_space_check_interval) {
+        _free_space_last_check_time = tnow;
+        last_io_operation = "disk_space_avail";
+        if (disk_space_avail() < _free_space_min_avail && disk_space() > 0) {
+            hal.console->printf("Out of space for logging\n");
+            stop_logging();
+            _open_error = true; // prevent logging starting again
+            last_io_operation = "";
+            return false;
+        }
+        last_io_operation = "";
+    }
+    return true;
+}
+
+/*
+  sync the file once LOG_FILE_SYNC kilobytes have been written since
+  the last sync, or after every write if it is zero
+ */
+void AP_Logger_File::_sync_if_due(uint32_t nwritten)
+{
+    _bytes_since_sync += nwritten;
+    const uint32_t sync_bytes = uint32_t(MAX(_front._params.file_sync_kb.get(), 0)) * 1024U;
+    if (sync_bytes == 0) {
+        /*
+          the best strategy for minimizing corruption on microSD cards
+          seems to be to write in 4k chunks and fsync the file on each
+          chunk, ensuring the directory entry is updated after each
+          write.
+         */
+#if CONFIG_HAL_BOARD == HAL_BOARD_SITL || CONFIG_HAL_BOARD_SUBTYPE == HAL_BOARD_SUBTYPE_LINUX_NONE
+        return;
+#endif
+    } else if (_bytes_since_sync < sync_bytes) {
+        return;
+    }
+    _bytes_since_sync = 0;
+
+    last_io_operation = "fsync";
+    hal.util->perf_begin(_perf_fsync);
+    const uint32_t t0 = AP_HAL::micros();
+#if HAL_LOGGER_FILE_WRITER_THREAD_ENABLED && defined(__linux__)
+    if (_writer_thread_running) {
+        // file metadata other than the size is not needed for the log
+        ::fdatasync(_write_fd);
+    } else
+#endif
+    {
+        AP::FS().fsync(_write_fd);
+    }
+    if (AP_HAL::micros() - t0 > LOGGER_STALL_US) {
+        hal.util->perf_count(_perf_stalls);
+    }
+    hal.util->perf_end(_perf_fsync);
+    last_io_operation = "";
+}
+
+/*
+  handle the result of a write to the log file. Called with
+  write_fd_semaphore held
+ */
+void AP_Logger_File::_write_complete(uint32_t tnow, ssize_t nwritten)
+{
+    if (nwritten <= 0) {
+        if ((tnow - _last_write_ms)/1000U > unsigned(_front._params.file_timeout)) {
+            // if we can't write for LOG_FILE_TIMEOUT seconds we give up and close
+            // the file. This allows us to cope with temporary write
+            // failures caused by directory listing
+            hal.util->perf_count(_perf_errors);
+            last_io_operation = "close";
+            AP::FS().close(_write_fd);
+            last_io_operation = "";
+            _write_fd = -1;
+            _initialised = false;
+            printf("Failed to write to File: %s\n", strerror(errno));
+        }
+        _last_write_failed = true;
+        return;
+    }
+
+    _last_write_failed = false;
+    _last_write_ms = tnow;
+    _write_offset += nwritten;
+    _writebuf.advance(nwritten);
+
+    _sync_if_due(nwritten);
+
+#if CONFIG_HAL_BOARD == HAL_BOARD_CHIBIOS
+    // ChibiOS does not update mtime on writes, so if we opened
+    // without knowing the time we should update it later
+    if (_need_rtc_update) {
+        uint64_t utc_usec;
+        if (AP::rtc().get_utc_usec(utc_usec)) {
+            AP::FS().set_mtime(_write_filename, utc_usec/(1000U*1000U));
+            _need_rtc_update = false;
+        }
+    }
+#endif
+}
+
 void AP_Logger_File::_io_timer(void)
 {
     uint32_t tnow = AP_HAL::millis();
     _io_timer_heartbeat = tnow;
+#if HAL_LOGGER_FILE_WRITER_THREAD_ENABLED
+    _finish_closing();
+#endif
     if (_write_fd == -1 || !_initialised || _open_error) {
         return;
     }
@@ -948,17 +1259,8 @@ void AP_Logger_File::_io_timer(void)
         // least once per 2 seconds if data is available
         return;
     }
-    if (tnow - _free_space_last_check_time > _free_space_check_interval) {
-        _free_space_last_check_time = tnow;
-        last_io_operation = "disk_space_avail";
-        if (disk_space_avail() < _free_space_min_avail && disk_space() > 0) {
-            hal.console->printf("Out of space for logging\n");
-            stop_logging();
-            _open_error = true; // prevent logging starting again
-            last_io_operation = "";
-            return;
-        }
-        last_io_operation = "";
+    if (!_check_free_space(tnow)) {
+        return;
     }
 
     hal.util->perf_begin(_perf_write);
@@ -969,9 +1271,31 @@ void AP_Logger_File::_io_timer(void)
         nbytes = _writebuf_chunk;
     }
 
+    last_io_operation = "write";
+    if (!write_fd_semaphore.take(1)) {
+        return;
+    }
+#if HAL_LOGGER_FILE_WRITER_THREAD_ENABLED
+    // the buffer starts with the tail of a file still being closed
+    if (_closing_fd != -1) {
+        write_fd_semaphore.give();
+        return;
+    }
+#endif
+    if (_write_fd == -1) {
+        write_fd_semaphore.give();
+        return;
+    }
+
+    // look at the buffer with the semaphore held, as stop_logging()
+    // may have written it out in the meantime
     uint32_t size;
     const uint8_t *head = _writebuf.readptr(size);
     nbytes = MIN(nbytes, size);
+    if (nbytes == 0) {
+        write_fd_semaphore.give();
+        return;
+    }
 
     // try to align writes on a 512 byte boundary to avoid filesystem reads
     if ((nbytes + _write_offset) % 512 != 0) {
@@ -980,64 +1304,283 @@ void AP_Logger_File::_io_timer(void)
             nbytes -= ofs;
         }
     }
+    ssize_t nwritten = AP::FS().write(_write_fd, head, nbytes);
+    last_io_operation = "";
+    _write_complete(tnow, nwritten);
 
-    last_io_operation = "write";
-    if (!write_fd_semaphore.take(1)) {
+    write_fd_semaphore.give();
+    hal.util->perf_end(_perf_write);
+}
+
+#if HAL_LOGGER_FILE_WRITER_THREAD_ENABLED
+/*
+  dedicated writer thread. Unlike the IO timer this doesn't have to
+  share a thread with other IO callbacks, so it writes whatever is
+  available as soon as there is enough of it
+ */
+void AP_Logger_File::_writer_thread(void)
+{
+    while (true) {
+        _finish_closing();
+        if (_writer_write_pending()) {
+            continue;
+        }
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX
+        // sleep until there is a chunk to write or a file to close,
+        // or the data waiting is due to be written anyway
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 100 * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&_writer_mtx);
+        while (!_writer_woken) {
+            if (pthread_cond_timedwait(&_writer_cond, &_writer_mtx, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+        _writer_woken = false;
+        pthread_mutex_unlock(&_writer_mtx);
+#else
+        // SITL lockstep threads may only wait on the scheduler
+        hal.scheduler->delay_microseconds(1000);
+#endif
+    }
+}
+
+/*
+  wake the writer thread
+ */
+void AP_Logger_File::_writer_wake(void)
+{
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX
+    if (!_writer_thread_running) {
         return;
     }
-    if (_write_fd == -1) {
-        write_fd_semaphore.give();
+    pthread_mutex_lock(&_writer_mtx);
+    _writer_woken = true;
+    pthread_cond_signal(&_writer_cond);
+    pthread_mutex_unlock(&_writer_mtx);
+#endif
+}
+
+/*
+  wake the writer thread when a write fills the buffer past a chunk,
+  so it is woken once for each chunk rather than for every message
+ */
+void AP_Logger_File::_writer_wake_if_due(uint32_t available_before)
+{
+    if (available_before < _writebuf_chunk &&
+        _writebuf.available() >= _writebuf_chunk) {
+        _writer_wake();
+    }
+}
+
+/*
+  write out the data left in the buffer for a file handed over by
+  stop_logging() and close it. Only this thread writes to the file
+  once it is handed over, so write_fd_semaphore is only held while
+  looking at the buffer, leaving start_new_log() free to open the
+  next file meanwhile
+ */
+void AP_Logger_File::_finish_closing(void)
+{
+    if (_closing_fd == -1 || !write_fd_semaphore.take(1)) {
         return;
     }
-    ssize_t nwritten = AP::FS().write(_write_fd, head, nbytes);
+    while (_closing_bytes > 0) {
+        ByteBuffer::IoVec vec[2];
+        const uint8_t n_vec = _writebuf.peekiovec(vec, _closing_bytes);
+        const int fd = _closing_fd;
+        write_fd_semaphore.give();
+
+        struct iovec iov[2];
+        for (uint8_t i = 0; i < n_vec; i++) {
+            iov[i].iov_base = vec[i].data;
+            iov[i].iov_len = vec[i].len;
+        }
+        last_io_operation = "write";
+        const ssize_t nwritten = ::writev(fd, iov, n_vec);
+        last_io_operation = "";
+
+        write_fd_semaphore.take_blocking();
+        if (nwritten <= 0) {
+            // give up on the rest of the file
+            _writebuf.advance(_closing_bytes);
+            _closing_bytes = 0;
+            break;
+        }
+        _writebuf.advance(nwritten);
+        _closing_bytes -= nwritten;
+    }
+    _writebuf.advance(_discard_bytes);
+    _discard_bytes = 0;
+    last_io_operation = "close";
+    AP::FS().close(_closing_fd);
     last_io_operation = "";
-    if (nwritten <= 0) {
-        if ((tnow - _last_write_ms)/1000U > unsigned(_front._params.file_timeout)) {
-            // if we can't write for LOG_FILE_TIMEOUT seconds we give up and close
-            // the file. This allows us to cope with temporary write
-            // failures caused by directory listing
-            hal.util->perf_count(_perf_errors);
-            last_io_operation = "close";
-            AP::FS().close(_write_fd);
-            last_io_operation = "";
-            _write_fd = -1;
-            _initialised = false;
-            printf("Failed to write to File: %s\n", strerror(errno));
+    _closing_fd = -1;
+    write_fd_semaphore.give();
+}
+
+/*
+  write out pending data with writev() over both spans of the ring
+  buffer, or through the aligned bounce buffer when using direct IO.
+  Returns true if data was written
+ */
+bool AP_Logger_File::_writer_write_pending(void)
+{
+    uint32_t tnow = AP_HAL::millis();
+    _io_timer_heartbeat = tnow;
+    if (_write_fd == -1 || !_initialised || _open_error) {
+        return false;
+    }
+
+    uint32_t nbytes = _writebuf.available();
+    if (nbytes == 0) {
+        return false;
+    }
+    if (nbytes < _writebuf_chunk &&
+        tnow - _last_write_time < 100UL) {
+        // give the buffer a chance to fill so writes stay large
+        return false;
+    }
+    if (!_check_free_space(tnow)) {
+        return false;
+    }
+
+    if (!write_fd_semaphore.take(1)) {
+        return false;
+    }
+    if (_write_fd == -1 || _closing_fd != -1) {
+        write_fd_semaphore.give();
+        return false;
+    }
+
+    if (_direct_io_active) {
+        // only whole blocks can be written with O_DIRECT; the remainder
+        // stays in the buffer until more data arrives
+        nbytes -= nbytes % LOGGER_DIRECT_IO_ALIGN;
+        if (nbytes == 0) {
+            write_fd_semaphore.give();
+            return false;
+        }
+    } else if ((nbytes + _write_offset) % 512 != 0) {
+        // try to align writes on a 512 byte boundary to avoid filesystem reads
+        uint32_t ofs = (nbytes + _write_offset) % 512;
+        if (ofs < nbytes) {
+            nbytes -= ofs;
+        }
+    }
+
+    _last_write_time = tnow;
+    _preallocate(nbytes);
+
+    ByteBuffer::IoVec vec[2];
+    const uint8_t n_vec = _writebuf.peekiovec(vec, nbytes);
+
+    last_io_operation = "write";
+    hal.util->perf_begin(_perf_write);
+    const uint32_t t0 = AP_HAL::micros();
+    ssize_t nwritten;
+    if (_direct_io_active) {
+        uint32_t ofs = 0;
+        for (uint8_t i = 0; i < n_vec; i++) {
+            memcpy(&_direct_buf[ofs], vec[i].data, vec[i].len);
+            ofs += vec[i].len;
+        }
+        nwritten = ::write(_write_fd, _direct_buf, ofs);
+        if (nwritten > 0 && nwritten % LOGGER_DIRECT_IO_ALIGN != 0) {
+            // a short write leaves the file offset unaligned
+            _direct_io_disable();
         }
-        _last_write_failed = true;
     } else {
-        _last_write_failed = false;
-        _last_write_ms = tnow;
-        _write_offset += nwritten;
-        _writebuf.advance(nwritten);
-        /*
-          the best strategy for minimizing corruption on microSD cards
-          seems to be to write in 4k chunks and fsync the file on each
-          chunk, ensuring the directory entry is updated after each
-          write.
-         */
-#if CONFIG_HAL_BOARD != HAL_BOARD_SITL && CONFIG_HAL_BOARD_SUBTYPE != HAL_BOARD_SUBTYPE_LINUX_NONE
-        last_io_operation = "fsync";
-        AP::FS().fsync(_write_fd);
-        last_io_operation = "";
-#endif
+        struct iovec iov[2];
+        for (uint8_t i = 0; i < n_vec; i++) {
+            iov[i].iov_base = vec[i].data;
+            iov[i].iov_len = vec[i].len;
+        }
+        nwritten = ::writev(_write_fd, iov, n_vec);
+    }
+    if (AP_HAL::micros() - t0 > LOGGER_STALL_US) {
+        hal.util->perf_count(_perf_stalls);
+    }
+    hal.util->perf_end(_perf_write);
+    last_io_operation = "";
 
-#if CONFIG_HAL_BOARD == HAL_BOARD_CHIBIOS
-        // ChibiOS does not update mtime on writes, so if we opened
-        // without knowing the time we should update it later
-        if (_need_rtc_update) {
-            uint64_t utc_usec;
-            if (AP::rtc().get_utc_usec(utc_usec)) {
-                AP::FS().set_mtime(_write_filename, utc_usec/(1000U*1000U));
-                _need_rtc_update = false;
-            }
+    _write_complete(tnow, nwritten);
+
+    write_fd_semaphore.give();
+    return nwritten > 0;
+}
+
+/*
+  set up direct IO and preallocation on a newly opened log
+  file. Called with write_fd_semaphore held
+ */
+void AP_Logger_File::_configure_write_fd(void)
+{
+    _preallocated = 0;
+    _direct_io_active = false;
+    if (!_writer_thread_running) {
+        return;
+    }
+#if defined(__linux__)
+    if (_direct_buf != nullptr) {
+        const int flags = fcntl(_write_fd, F_GETFL);
+        if (flags != -1 && fcntl(_write_fd, F_SETFL, flags | O_DIRECT) == 0) {
+            _direct_io_active = true;
+        } else {
+            // e.g. tmpfs does not support O_DIRECT
+            hal.console->printf("AP_Logger_File: direct IO not supported\n");
         }
+    }
 #endif
+    _preallocate(0);
+}
+
+/*
+  go back to buffered writes for the rest of the current file. Called
+  with write_fd_semaphore held
+ */
+void AP_Logger_File::_direct_io_disable(void)
+{
+    if (!_direct_io_active) {
+        return;
     }
+    _direct_io_active = false;
+#if defined(__linux__)
+    const int flags = fcntl(_write_fd, F_GETFL);
+    if (flags != -1) {
+        fcntl(_write_fd, F_SETFL, flags & ~O_DIRECT);
+    }
+#endif
+}
 
-    write_fd_semaphore.give();
-    hal.util->perf_end(_perf_write);
+/*
+  make sure space for the next nbytes is allocated, extending the
+  allocation in large steps to keep the file contiguous. The file
+  size is not changed so readers only see written data
+ */
+void AP_Logger_File::_preallocate(uint32_t nbytes)
+{
+#if defined(__linux__)
+    if (!option_is_set(FileOption::PREALLOCATE) || !_writer_thread_running) {
+        return;
+    }
+    if (_write_offset + nbytes <= _preallocated) {
+        return;
+    }
+    last_io_operation = "fallocate";
+    const uint64_t new_size = _preallocated + LOGGER_PREALLOCATE_SIZE;
+    if (::fallocate(_write_fd, FALLOC_FL_KEEP_SIZE, _preallocated, LOGGER_PREALLOCATE_SIZE) == 0) {
+        _preallocated = new_size;
+    }
+    last_io_operation = "";
+#endif
 }
+#endif // HAL_LOGGER_FILE_WRITER_THREAD_ENABLED
 
 // this sensor is enabled if we should be logging at the moment
 bool AP_Logger_File::logging_enabled() const
@@ -1098,6 +1641,7 @@ void AP_Logger_File::Write_AP_Logger_Stats_File(const struct df_stats &_stats)
         buf_space_min   : _stats.buf_space_min,
         buf_space_max   : _stats.buf_space_max,
         buf_space_avg   : (_stats.blocks) ? (_stats.buf_space_sigma / _stats.blocks) : 0,
+        compressed_bytes : _stats.compressed_bytes,
 
     };
     WriteBlock(&pkt, sizeof(pkt));
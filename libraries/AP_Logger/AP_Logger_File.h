@@ -13,6 +13,22 @@
 #include <AP_HAL/utility/RingBuffer.h>
 #include "AP_Logger_Backend.h"
 
+#ifndef HAL_LOGGER_FILE_WRITER_THREAD_ENABLED
+#define HAL_LOGGER_FILE_WRITER_THREAD_ENABLED (CONFIG_HAL_BOARD == HAL_BOARD_SITL || CONFIG_HAL_BOARD == HAL_BOARD_LINUX)
+#endif
+
+#if HAL_LOGGER_FILE_WRITER_THREAD_ENABLED && CONFIG_HAL_BOARD == HAL_BOARD_LINUX
+#include <pthread.h>
+#endif
+
+#ifndef HAL_LOGGER_COMPRESSION_ENABLED
+#define HAL_LOGGER_COMPRESSION_ENABLED (CONFIG_HAL_BOARD == HAL_BOARD_SITL || CONFIG_HAL_BOARD == HAL_BOARD_LINUX)
+#endif
+
+#if HAL_LOGGER_COMPRESSION_ENABLED
+#include "LogCompress.h"
+#endif
+
 class AP_Logger_File : public AP_Logger_Backend
 {
 public:
@@ -124,6 +140,69 @@ private:
     void stop_logging(void) override;
 
     void _io_timer(void);
+    bool _check_free_space(uint32_t tnow);
+    void _write_complete(uint32_t tnow, ssize_t nwritten);
+    void _sync_if_due(uint32_t nwritten);
+
+    // bytes written since the file was last synced
+    uint32_t _bytes_since_sync;
+
+    // LOG_FILE_OPTS bits
+    enum class FileOption : uint8_t {
+        WRITER_THREAD = (1U<<0),
+        DIRECT_IO     = (1U<<1),
+        PREALLOCATE   = (1U<<2),
+        COMPRESS      = (1U<<3),
+    };
+    bool option_is_set(FileOption option) const {
+        return (uint8_t(_front._params.file_options.get()) & uint8_t(option)) != 0;
+    }
+
+#if HAL_LOGGER_FILE_WRITER_THREAD_ENABLED
+    // dedicated writer thread, used in place of the IO timer callback
+    bool _writer_thread_running = false;
+    void _writer_thread(void);
+    bool _writer_write_pending(void);
+
+    // aligned bounce buffer for O_DIRECT writes, nullptr when direct
+    // IO is not in use on the current file
+    uint8_t *_direct_buf = nullptr;
+    uint32_t _direct_buf_size;
+    bool _direct_io_active = false;
+    void _configure_write_fd(void);
+    void _direct_io_disable(void);
+
+    // bytes preallocated at the start of the current file
+    uint64_t _preallocated;
+    void _preallocate(uint32_t nbytes);
+
+    // a stopped file handed over by stop_logging() to the thread
+    // writing the log, which writes out the first _closing_bytes of
+    // the buffer to it and closes it, then drops the next
+    // _discard_bytes. Protected by write_fd_semaphore
+    int _closing_fd = -1;
+    uint32_t _closing_bytes;
+    uint32_t _discard_bytes;
+    void _finish_closing(void);
+
+#if CONFIG_HAL_BOARD == HAL_BOARD_LINUX
+    // the writer thread sleeps until woken with a chunk to write or
+    // a file to close
+    pthread_mutex_t _writer_mtx;
+    pthread_cond_t _writer_cond;
+    bool _writer_woken;
+#endif
+    void _writer_wake(void);
+    void _writer_wake_if_due(uint32_t available_before);
+#endif
+
+#if HAL_LOGGER_COMPRESSION_ENABLED
+    // delta+LZ encoder, nullptr unless LOG_FILE_OPTS asks for it
+    LogCompressor *_compressor = nullptr;
+    uint32_t _compress_pending_ms;
+    bool _compress_message(const void *pBuffer, uint16_t size);
+    bool _compress_flush(void);
+#endif
 
     uint32_t critical_message_reserved_space() const {
         // possibly make this a proportional to buffer size?
@@ -166,6 +245,8 @@ private:
     AP_HAL::Util::perf_counter_t  _perf_fsync;
     AP_HAL::Util::perf_counter_t  _perf_errors;
     AP_HAL::Util::perf_counter_t  _perf_overruns;
+    AP_HAL::Util::perf_counter_t  _perf_stalls;
+    AP_HAL::Util::perf_counter_t  _perf_compress;
 
     const char *last_io_operation = "";
 
@@ -175,6 +256,7 @@ private:
         uint32_t buf_space_min;
         uint32_t buf_space_max;
         uint32_t buf_space_sigma;
+        uint32_t compressed_bytes;
     };
     struct df_stats stats;
 
@@ -0,0 +1,393 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+  log compression, see LogCompress.h for the format
+ */
+
+#include "LogCompress.h"
+#include "LogStructure.h"
+
+#include <AP_Math/AP_Math.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_COMPRESS_MAX_MSG_LEN 255U
+
+#define LZ_HASH_BITS      12
+#define LZ_HASH_SIZE      (1U<<LZ_HASH_BITS)
+#define LZ_MIN_MATCH      4U
+// as for LZ4, the last bytes of a block are always literals
+#define LZ_LAST_LITERALS  5U
+#define LZ_MIN_LENGTH     (LZ_MIN_MATCH + LZ_LAST_LITERALS + 4U)
+
+static_assert(LOG_COMPRESS_BLOCK_SIZE <= UINT16_MAX, "block offsets must fit in hash table");
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+// write the 255-run extension of a literal or match length
+static inline uint8_t *lz_write_length(uint8_t *op, uint32_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+LogCompressor::~LogCompressor()
+{
+    free(prev);
+    free(block);
+    free(frame_buf);
+    free(hash_table);
+}
+
+bool LogCompressor::init(void)
+{
+    prev = (uint8_t *)malloc(256 * LOG_COMPRESS_MAX_MSG_LEN);
+    block = (uint8_t *)malloc(LOG_COMPRESS_BLOCK_SIZE);
+    frame_buf = (uint8_t *)malloc(max_frame_size());
+    hash_table = (uint16_t *)malloc(LZ_HASH_SIZE * sizeof(uint16_t));
+    if (prev == nullptr || block == nullptr || frame_buf == nullptr || hash_table == nullptr) {
+        return false;
+    }
+    reset();
+    return true;
+}
+
+void LogCompressor::reset(void)
+{
+    memset(prev_len, 0, sizeof(prev_len));
+    block_len = 0;
+    total_raw = 0;
+    total_compressed = 0;
+}
+
+void LogCompressor::file_header(struct log_compress_file_header &hdr)
+{
+    memcpy(hdr.magic, LOG_COMPRESS_MAGIC, sizeof(hdr.magic));
+    hdr.version = LOG_COMPRESS_VERSION;
+    hdr.block_size = LOG_COMPRESS_BLOCK_SIZE;
+}
+
+bool LogCompressor::add(const uint8_t *msg, uint16_t len)
+{
+    if (len < 3 || len > LOG_COMPRESS_MAX_MSG_LEN) {
+        // not a message; this can't be represented in the stream
+        return true;
+    }
+    if (block_len + len > LOG_COMPRESS_BLOCK_SIZE) {
+        return false;
+    }
+    uint8_t *out = &block[block_len];
+    const uint8_t type = msg[2];
+    uint8_t *p = &prev[type * LOG_COMPRESS_MAX_MSG_LEN];
+
+    memcpy(out, msg, 3);
+    if (type != LOG_FORMAT_MSG && prev_len[type] == len) {
+        for (uint16_t i=3; i<len; i++) {
+            out[i] = msg[i] - p[i];
+        }
+    } else {
+        // formats are never delta encoded as they are all different
+        memcpy(&out[3], &msg[3], len-3);
+    }
+    memcpy(p, msg, len);
+    prev_len[type] = len;
+    if (type == LOG_FORMAT_MSG && len >= sizeof(struct log_Format)) {
+        // a (re)definition of a type starts its deltas again. The
+        // decoder does the same, as it only knows a message's length
+        // from its format
+        struct log_Format f;
+        memcpy(&f, msg, sizeof(f));
+        prev_len[f.type] = 0;
+    }
+
+    block_len += len;
+    total_raw += len;
+    return true;
+}
+
+/*
+  compress a block using the LZ4 block format: a sequence of tokens
+  giving a literal run and a back reference to an earlier match,
+  with the last token having only literals
+ */
+uint32_t LogCompressor::lz_compress(const uint8_t *src, uint32_t len, uint8_t *dst)
+{
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *const end = src + len;
+    uint8_t *op = dst;
+
+    if (len >= LZ_MIN_LENGTH) {
+        const uint8_t *const match_limit = end - LZ_LAST_LITERALS;
+        memset(hash_table, 0, LZ_HASH_SIZE * sizeof(uint16_t));
+
+        while (ip + LZ_MIN_MATCH <= match_limit) {
+            const uint32_t seq = read32(ip);
+            const uint32_t h = lz_hash(seq);
+            const uint8_t *ref = src + hash_table[h];
+            hash_table[h] = ip - src;
+            if (ref >= ip || read32(ref) != seq) {
+                ip++;
+                continue;
+            }
+
+            // extend the match forwards
+            const uint8_t *mp = ip + LZ_MIN_MATCH;
+            const uint8_t *rp = ref + LZ_MIN_MATCH;
+            while (mp < match_limit && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+
+            const uint32_t lit_len = ip - anchor;
+            const uint32_t match_len = (mp - ip) - LZ_MIN_MATCH;
+            const uint16_t offset = ip - ref;
+
+            uint8_t *token = op++;
+            *token = (MIN(lit_len, 15U) << 4) | MIN(match_len, 15U);
+            if (lit_len >= 15) {
+                op = lz_write_length(op, lit_len - 15);
+            }
+            memcpy(op, anchor, lit_len);
+            op += lit_len;
+            *op++ = offset & 0xFF;
+            *op++ = offset >> 8;
+            if (match_len >= 15) {
+                op = lz_write_length(op, match_len - 15);
+            }
+
+            ip = mp;
+            anchor = ip;
+        }
+    }
+
+    // remaining literals
+    const uint32_t lit_len = end - anchor;
+    *op++ = MIN(lit_len, 15U) << 4;
+    if (lit_len >= 15) {
+        op = lz_write_length(op, lit_len - 15);
+    }
+    memcpy(op, anchor, lit_len);
+    op += lit_len;
+
+    return op - dst;
+}
+
+uint32_t LogCompressor::flush(const uint8_t *&frame)
+{
+    if (block_len == 0) {
+        return 0;
+    }
+    struct log_compress_frame_header hdr;
+    hdr.sync = LOG_COMPRESS_FRAME_SYNC;
+    hdr.raw_len = block_len;
+
+    uint8_t *data = &frame_buf[sizeof(hdr)];
+    const uint32_t data_len = lz_compress(block, block_len, data);
+    if (data_len >= block_len) {
+        // incompressible, store it as is
+        memcpy(data, block, block_len);
+        hdr.data_len = block_len;
+    } else {
+        hdr.data_len = data_len;
+    }
+    memcpy(frame_buf, &hdr, sizeof(hdr));
+    block_len = 0;
+
+    const uint32_t frame_len = sizeof(hdr) + hdr.data_len;
+    total_compressed += frame_len;
+    frame = frame_buf;
+    return frame_len;
+}
+
+bool LogDecompressor::is_compressed(const uint8_t *data, uint64_t len)
+{
+    return len >= sizeof(struct log_compress_file_header) &&
+        memcmp(data, LOG_COMPRESS_MAGIC, 4) == 0;
+}
+
+bool LogDecompressor::lz_decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len)
+{
+    const uint8_t *ip = src;
+    const uint8_t *const iend = src + src_len;
+    uint8_t *op = dst;
+    uint8_t *const oend = dst + dst_len;
+
+    while (ip < iend) {
+        const uint8_t token = *ip++;
+
+        uint32_t lit_len = token >> 4;
+        if (lit_len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) {
+                    return false;
+                }
+                b = *ip++;
+                lit_len += b;
+            } while (b == 255);
+        }
+        if (lit_len > uint32_t(iend - ip) || lit_len > uint32_t(oend - op)) {
+            return false;
+        }
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+        if (ip == iend) {
+            // last sequence has no match
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return false;
+        }
+        const uint16_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - dst) {
+            return false;
+        }
+        uint32_t match_len = token & 0x0F;
+        if (match_len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) {
+                    return false;
+                }
+                b = *ip++;
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += LZ_MIN_MATCH;
+        if (match_len > uint32_t(oend - op)) {
+            return false;
+        }
+        // matches may overlap the output so copy bytewise
+        const uint8_t *mp = op - offset;
+        while (match_len--) {
+            *op++ = *mp++;
+        }
+    }
+    return op == oend;
+}
+
+bool LogDecompressor::decompress(const uint8_t *data, uint64_t len, uint8_t *&out, uint64_t &out_len)
+{
+    out = nullptr;
+    out_len = 0;
+    if (!is_compressed(data, len)) {
+        return false;
+    }
+    struct log_compress_file_header fhdr;
+    memcpy(&fhdr, data, sizeof(fhdr));
+    if (fhdr.version != LOG_COMPRESS_VERSION) {
+        return false;
+    }
+
+    // size the output from the frame headers
+    uint64_t total = 0;
+    uint64_t ofs = sizeof(fhdr);
+    while (ofs + sizeof(struct log_compress_frame_header) <= len) {
+        struct log_compress_frame_header hdr;
+        memcpy(&hdr, &data[ofs], sizeof(hdr));
+        if (hdr.sync != LOG_COMPRESS_FRAME_SYNC ||
+            ofs + sizeof(hdr) + hdr.data_len > len) {
+            break;
+        }
+        total += hdr.raw_len;
+        ofs += sizeof(hdr) + hdr.data_len;
+    }
+    const uint64_t data_end = ofs;
+
+    out = (uint8_t *)malloc(total > 0 ? total : 1);
+    uint8_t *prev = (uint8_t *)calloc(256, LOG_COMPRESS_MAX_MSG_LEN);
+    if (out == nullptr || prev == nullptr) {
+        free(out);
+        free(prev);
+        out = nullptr;
+        return false;
+    }
+    bool have_prev[256] {};
+    uint8_t msg_len[256] {};
+    msg_len[LOG_FORMAT_MSG] = sizeof(struct log_Format);
+
+    bool frame_ok = true;
+    ofs = sizeof(fhdr);
+    while (ofs < data_end) {
+        struct log_compress_frame_header hdr;
+        memcpy(&hdr, &data[ofs], sizeof(hdr));
+        ofs += sizeof(hdr);
+        uint8_t *block = &out[out_len];
+        if (hdr.data_len == hdr.raw_len) {
+            memcpy(block, &data[ofs], hdr.raw_len);
+        } else if (!lz_decompress(&data[ofs], hdr.data_len, block, hdr.raw_len)) {
+            break;
+        }
+        ofs += hdr.data_len;
+
+        // undo the delta encoding; frames always hold whole messages
+        uint32_t bofs = 0;
+        while (bofs < hdr.raw_len) {
+            uint8_t *msg = &block[bofs];
+            if (hdr.raw_len - bofs < 3 || msg[0] != HEAD_BYTE1 || msg[1] != HEAD_BYTE2) {
+                frame_ok = false;
+                break;
+            }
+            const uint8_t type = msg[2];
+            const uint8_t mlen = msg_len[type];
+            if (mlen < 3 || bofs + mlen > hdr.raw_len) {
+                frame_ok = false;
+                break;
+            }
+            uint8_t *p = &prev[type * LOG_COMPRESS_MAX_MSG_LEN];
+            if (type != LOG_FORMAT_MSG && have_prev[type]) {
+                for (uint16_t i=3; i<mlen; i++) {
+                    msg[i] += p[i];
+                }
+            }
+            memcpy(p, msg, mlen);
+            have_prev[type] = true;
+            if (type == LOG_FORMAT_MSG) {
+                struct log_Format f;
+                memcpy(&f, msg, sizeof(f));
+                msg_len[f.type] = f.length;
+                have_prev[f.type] = false;
+            }
+            bofs += mlen;
+        }
+        if (!frame_ok) {
+            // keep the frames decoded so far, as for a partial frame
+            break;
+        }
+        out_len += hdr.raw_len;
+    }
+
+    free(prev);
+    return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+/*
+  streaming compression for log files
+
+  Each message is first delta encoded against the previous message of
+  the same type: every byte after the message header is replaced by
+  its difference from the same byte of the last message of that type,
+  so fields which haven't changed become runs of zeroes.  The delta
+  stream is cut into blocks on message boundaries and each block is
+  compressed with a small LZ77 codec using the LZ4 block format.
+
+  A compressed log starts with a log_compress_file_header followed by
+  frames, each a log_compress_frame_header and its data.  Decoding a
+  frame needs the delta state from all previous frames, and message
+  lengths are taken from the FMT messages in the stream, so every
+  message written must be exactly as long as its format says.
+ */
+
+#include <AP_Common/AP_Common.h>
+#include <stdint.h>
+
+#define LOG_COMPRESS_MAGIC        "APLZ"
+#define LOG_COMPRESS_VERSION      1
+#define LOG_COMPRESS_FRAME_SYNC   0x5A4C
+#define LOG_COMPRESS_BLOCK_SIZE   8192U // maximum uncompressed bytes per frame
+
+// worst case size of a compressed block of n bytes
+#define LOG_COMPRESS_BOUND(n) ((n) + (n)/255 + 16)
+
+struct PACKED log_compress_file_header {
+    char magic[4];
+    uint16_t version;
+    uint16_t block_size;
+};
+
+struct PACKED log_compress_frame_header {
+    uint16_t sync;
+    uint16_t raw_len;   // bytes after decompression
+    uint16_t data_len;  // bytes following the header; raw_len if stored uncompressed
+};
+
+class LogCompressor {
+public:
+    ~LogCompressor();
+
+    // allocate working buffers, returns false if out of memory
+    bool init(void);
+
+    // forget all state ready for a new file
+    void reset(void);
+
+    // fill in the header which must start the file
+    static void file_header(struct log_compress_file_header &hdr);
+
+    // largest frame that flush() can produce
+    static constexpr uint32_t max_frame_size() {
+        return sizeof(struct log_compress_frame_header) + LOG_COMPRESS_BOUND(LOG_COMPRESS_BLOCK_SIZE);
+    }
+
+    // add a complete message to the pending block. Returns false if
+    // there is no room, in which case flush() must be called first
+    bool add(const uint8_t *msg, uint16_t len);
+
+    // bytes waiting in the pending block
+    uint16_t pending(void) const { return block_len; }
+
+    // compress the pending block into a frame, returning its length.
+    // The frame is valid until the next call to flush()
+    uint32_t flush(const uint8_t *&frame);
+
+    // totals since reset()
+    uint64_t raw_bytes(void) const { return total_raw; }
+    uint64_t compressed_bytes(void) const { return total_compressed; }
+
+private:
+    // previous message of each type, used for delta encoding
+    uint8_t *prev = nullptr;
+    uint8_t prev_len[256] {};
+
+    uint8_t *block = nullptr;
+    uint16_t block_len = 0;
+
+    uint8_t *frame_buf = nullptr;
+    uint16_t *hash_table = nullptr;
+
+    uint64_t total_raw = 0;
+    uint64_t total_compressed = 0;
+
+    uint32_t lz_compress(const uint8_t *src, uint32_t len, uint8_t *dst);
+};
+
+class LogDecompressor {
+public:
+    // return true if data is the start of a compressed log
+    static bool is_compressed(const uint8_t *data, uint64_t len);
+
+    /*
+      decompress a whole compressed log into a buffer allocated with
+      malloc(). A trailing partial frame (e.g. from a power loss
+      while logging) is ignored, and decoding stops at the first
+      corrupt frame, keeping the frames before it. Returns false if
+      the data is not a compressed log or out of memory
+     */
+    static bool decompress(const uint8_t *data, uint64_t len, uint8_t *&out, uint64_t &out_len);
+
+    // decompress one LZ block, returns false on corrupt data
+    static bool lz_decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len);
+};
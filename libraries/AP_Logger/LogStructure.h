@@ -183,6 +183,7 @@ struct PACKED log_DSF {
     uint32_t buf_space_min;
     uint32_t buf_space_max;
     uint32_t buf_space_avg;
+    uint32_t compressed_bytes;
 };
 
 struct PACKED log_Event {
@@ -1164,6 +1165,32 @@ struct PACKED log_Performance {
     uint32_t extra_loop_us;
 };
 
+struct PACKED log_PerfTask {
+    LOG_PACKET_HEADER;
+    uint64_t time_us;
+    uint8_t rank;
+    uint8_t task;
+    char name[16];
+    uint16_t max_time;
+    uint16_t avg_time;
+    uint16_t budget;
+    uint16_t num_overruns;
+    uint16_t num_slips;
+    uint16_t max_delay;
+    uint16_t num_runs;
+    uint16_t p95_time;
+};
+
+struct PACKED log_PerfThread {
+    LOG_PACKET_HEADER;
+    uint64_t time_us;
+    uint8_t core;
+    uint8_t util;
+    uint32_t num_runs;
+    uint32_t num_steals;
+    float drop_rate;
+};
+
 struct PACKED log_SRTL {
     LOG_PACKET_HEADER;
     uint64_t time_us;
@@ -1415,6 +1442,10 @@ struct PACKED log_Arm_Disarm {
       "PRX", "QBfffffffffff", "TimeUS,Health,D0,D45,D90,D135,D180,D225,D270,D315,DUp,CAn,CDis", "s-mmmmmmmmmhm", "F-00000000000" }, \
     { LOG_PERFORMANCE_MSG, sizeof(log_Performance),                     \
       "PM",  "QHHIIHIIIIII", "TimeUS,NLon,NLoop,MaxT,Mem,Load,IntE,IntEC,SPIC,I2CC,I2CI,ExUS", "s---b%-----s", "F---0A-----F" }, \
+    { LOG_PERF_TASK_MSG, sizeof(log_PerfTask), \
+      "PMT", "QBBNHHHHHHHH", "TimeUS,Rank,Task,Name,MaxT,AvgT,Bgt,NOvr,NSlp,MaxD,NRun,P95T", "s---sss--s-s", "F---FFF--F-F" }, \
+    { LOG_PERF_THREAD_MSG, sizeof(log_PerfThread), \
+      "PMTH", "QBBIIf", "TimeUS,Core,Util,NRun,NStl,DropR", "s-%---", "F-0---" }, \
     { LOG_SRTL_MSG, sizeof(log_SRTL), \
       "SRTL", "QBHHBfff", "TimeUS,Active,NumPts,MaxPts,Action,N,E,D", "s----mmm", "F----000" }, \
     { LOG_OA_BENDYRULER_MSG, sizeof(log_OABendyRuler), \
@@ -1587,7 +1618,7 @@ struct PACKED log_Arm_Disarm {
     { LOG_ORGN_MSG, sizeof(log_ORGN), \
       "ORGN","QBLLe","TimeUS,Type,Lat,Lng,Alt", "s-DUm", "F-GGB" },   \
     { LOG_DF_FILE_STATS, sizeof(log_DSF), \
-      "DSF", "QIHIIII", "TimeUS,Dp,Blk,Bytes,FMn,FMx,FAv", "s--b---", "F--0---" }, \
+      "DSF", "QIHIIIII", "TimeUS,Dp,Blk,Bytes,FMn,FMx,FAv,CBy", "s--b---b", "F--0---0" }, \
     { LOG_RPM_MSG, sizeof(log_RPM), \
       "RPM",  "Qff", "TimeUS,rpm1,rpm2", "sqq", "F00" }, \
     { LOG_GIMBAL1_MSG, sizeof(log_Gimbal1), \
@@ -1768,10 +1799,6 @@ enum LogMessages : uint8_t {
     LOG_MULT_MSG,
 
     LOG_MSG_SBPHEALTH,
-    LOG_MSG_SBPLLH,
-    LOG_MSG_SBPBASELINE,
-    LOG_MSG_SBPTRACKING1,
-    LOG_MSG_SBPTRACKING2,
     LOG_MSG_SBPRAWH,
     LOG_MSG_SBPRAWM,
     LOG_MSG_SBPEVENT,
@@ -1792,6 +1819,8 @@ enum LogMessages : uint8_t {
     LOG_ISBD_MSG,
     LOG_ASP2_MSG,
     LOG_PERFORMANCE_MSG,
+    LOG_PERF_TASK_MSG,
+    LOG_PERF_THREAD_MSG,
     LOG_OPTFLOW_MSG,
     LOG_EVENT_MSG,
     LOG_WHEELENCODER_MSG,
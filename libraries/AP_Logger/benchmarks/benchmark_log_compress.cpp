@@ -0,0 +1,166 @@
+#include <AP_gbenchmark.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <AP_Logger/LogCompress.h>
+#include <AP_Logger/LogStructure.h>
+
+/*
+  compression throughput and ratio on a synthetic log shaped like a
+  typical high rate log: IMU samples quantised as a real sensor
+  would give them, interleaved with slowly changing RCOU messages
+ */
+
+struct PACKED log_BenchIMU {
+    LOG_PACKET_HEADER;
+    uint64_t time_us;
+    float gyro_x, gyro_y, gyro_z;
+    float accel_x, accel_y, accel_z;
+    uint32_t gyro_error, accel_error;
+    float temperature;
+    uint8_t gyro_health, accel_health;
+    uint16_t gyro_rate, accel_rate;
+};
+
+struct PACKED log_BenchRCOU {
+    LOG_PACKET_HEADER;
+    uint64_t time_us;
+    uint16_t chan[14];
+};
+
+static void append(std::vector<uint8_t> &log, const void *msg, uint16_t len)
+{
+    const uint8_t *p = (const uint8_t *)msg;
+    log.insert(log.end(), p, p + len);
+}
+
+static void append_fmt(std::vector<uint8_t> &log, uint8_t type, uint8_t length, const char *name)
+{
+    struct log_Format fmt {};
+    fmt.head1 = HEAD_BYTE1;
+    fmt.head2 = HEAD_BYTE2;
+    fmt.msgid = LOG_FORMAT_MSG;
+    fmt.type = type;
+    fmt.length = length;
+    memcpy(fmt.name, name, 4);
+    append(log, &fmt, sizeof(fmt));
+}
+
+static const std::vector<uint8_t> &bench_log()
+{
+    static std::vector<uint8_t> log;
+    if (!log.empty()) {
+        return log;
+    }
+    append_fmt(log, 200, sizeof(log_BenchIMU), "IMU");
+    append_fmt(log, 201, sizeof(log_BenchRCOU), "RCOU");
+    srandom(42);
+    for (uint32_t i=0; i<40000; i++) {
+        const uint64_t t = 1000000ULL + i * 2500ULL;
+        struct log_BenchIMU imu {};
+        imu.head1 = HEAD_BYTE1;
+        imu.head2 = HEAD_BYTE2;
+        imu.msgid = 200;
+        imu.time_us = t;
+        imu.gyro_x = (random() % 5 - 2) * 0.00106f;
+        imu.gyro_y = (random() % 5 - 2) * 0.00106f;
+        imu.gyro_z = (random() % 3 - 1) * 0.00106f;
+        imu.accel_x = (random() % 9 - 4) * 0.0048f;
+        imu.accel_y = (random() % 9 - 4) * 0.0048f;
+        imu.accel_z = -9.80665f + (random() % 9 - 4) * 0.0048f;
+        imu.temperature = 45.0f + (i / 4000) * 0.0625f;
+        imu.gyro_health = 1;
+        imu.accel_health = 1;
+        imu.gyro_rate = 400;
+        imu.accel_rate = 400;
+        append(log, &imu, sizeof(imu));
+        if (i % 8 == 0) {
+            struct log_BenchRCOU rcou {};
+            rcou.head1 = HEAD_BYTE1;
+            rcou.head2 = HEAD_BYTE2;
+            rcou.msgid = 201;
+            rcou.time_us = t;
+            for (uint8_t c=0; c<4; c++) {
+                rcou.chan[c] = 1500 + random() % 20;
+            }
+            append(log, &rcou, sizeof(rcou));
+        }
+    }
+    return log;
+}
+
+static uint16_t msg_len(uint8_t type)
+{
+    switch (type) {
+    case LOG_FORMAT_MSG:
+        return sizeof(struct log_Format);
+    case 200:
+        return sizeof(struct log_BenchIMU);
+    default:
+        return sizeof(struct log_BenchRCOU);
+    }
+}
+
+static std::vector<uint8_t> compress(LogCompressor &compressor, const std::vector<uint8_t> &log)
+{
+    std::vector<uint8_t> out;
+    struct log_compress_file_header fhdr;
+    LogCompressor::file_header(fhdr);
+    append(out, &fhdr, sizeof(fhdr));
+    compressor.reset();
+    const uint8_t *frame = nullptr;
+    for (size_t ofs = 0; ofs < log.size(); ) {
+        const uint16_t len = msg_len(log[ofs+2]);
+        if (!compressor.add(&log[ofs], len)) {
+            append(out, frame, compressor.flush(frame));
+            compressor.add(&log[ofs], len);
+        }
+        ofs += len;
+    }
+    append(out, frame, compressor.flush(frame));
+    return out;
+}
+
+static void BM_LogCompress(benchmark::State& state)
+{
+    const std::vector<uint8_t> &log = bench_log();
+    LogCompressor compressor;
+    compressor.init();
+    size_t compressed_len = 0;
+
+    while (state.KeepRunning()) {
+        std::vector<uint8_t> out = compress(compressor, log);
+        compressed_len = out.size();
+        gbenchmark_escape(out.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * log.size());
+
+    char label[32];
+    snprintf(label, sizeof(label), "ratio %.2f", double(log.size()) / compressed_len);
+    state.SetLabel(label);
+}
+
+static void BM_LogDecompress(benchmark::State& state)
+{
+    const std::vector<uint8_t> &log = bench_log();
+    LogCompressor compressor;
+    compressor.init();
+    const std::vector<uint8_t> compressed = compress(compressor, log);
+
+    while (state.KeepRunning()) {
+        uint8_t *out;
+        uint64_t out_len;
+        LogDecompressor::decompress(compressed.data(), compressed.size(), out, out_len);
+        gbenchmark_escape(out);
+        free(out);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * log.size());
+}
+
+BENCHMARK(BM_LogCompress);
+BENCHMARK(BM_LogDecompress);
+
+BENCHMARK_MAIN()
@@ -0,0 +1,317 @@
+#include <AP_gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include <AP_Logger/LogCompress.h>
+#include <AP_Logger/LogStructure.h>
+
+#define TEST_MSG_TYPE 200
+
+struct PACKED log_Test {
+    LOG_PACKET_HEADER;
+    uint64_t time_us;
+    float x, y, z;
+    uint32_t count;
+};
+
+static void append(std::vector<uint8_t> &log, const void *msg, uint16_t len)
+{
+    const uint8_t *p = (const uint8_t *)msg;
+    log.insert(log.end(), p, p + len);
+}
+
+// define the test message with the given length; shorter lengths drop
+// trailing fields
+static void append_format(std::vector<uint8_t> &log, uint8_t length)
+{
+    struct log_Format fmt {};
+    fmt.head1 = HEAD_BYTE1;
+    fmt.head2 = HEAD_BYTE2;
+    fmt.msgid = LOG_FORMAT_MSG;
+    fmt.type = TEST_MSG_TYPE;
+    fmt.length = length;
+    memcpy(fmt.name, "TEST", 4);
+    strncpy(fmt.format, "QfffI", sizeof(fmt.format));
+    strncpy(fmt.labels, "TimeUS,X,Y,Z,C", sizeof(fmt.labels));
+    append(log, &fmt, sizeof(fmt));
+}
+
+// append slowly changing samples of the test message
+static void append_samples(std::vector<uint8_t> &log, uint32_t count, bool noisy, uint8_t length = sizeof(struct log_Test))
+{
+    for (uint32_t i=0; i<count; i++) {
+        struct log_Test pkt {};
+        pkt.head1 = HEAD_BYTE1;
+        pkt.head2 = HEAD_BYTE2;
+        pkt.msgid = TEST_MSG_TYPE;
+        pkt.time_us = 1000000ULL + i * 2500ULL;
+        pkt.x = noisy ? float(random()) : 0.1f;
+        pkt.y = 0.2f;
+        pkt.z = -9.8f;
+        pkt.count = i;
+        append(log, &pkt, length);
+    }
+}
+
+// build a log with a format message followed by slowly changing samples
+static std::vector<uint8_t> make_log(uint32_t count, bool noisy)
+{
+    std::vector<uint8_t> log;
+    append_format(log, sizeof(struct log_Test));
+    srandom(1);
+    append_samples(log, count, noisy);
+    return log;
+}
+
+// compress a log one message at a time as the File backend does
+static std::vector<uint8_t> compress_log(const std::vector<uint8_t> &log)
+{
+    LogCompressor compressor;
+    EXPECT_TRUE(compressor.init());
+
+    std::vector<uint8_t> out;
+    struct log_compress_file_header fhdr;
+    LogCompressor::file_header(fhdr);
+    append(out, &fhdr, sizeof(fhdr));
+
+    // message lengths come from the formats, as they do when logging
+    uint8_t msg_len[256] {};
+    msg_len[LOG_FORMAT_MSG] = sizeof(struct log_Format);
+
+    size_t ofs = 0;
+    while (ofs < log.size()) {
+        const uint16_t len = msg_len[log[ofs+2]];
+        if (log[ofs+2] == LOG_FORMAT_MSG) {
+            struct log_Format f;
+            memcpy(&f, &log[ofs], sizeof(f));
+            msg_len[f.type] = f.length;
+        }
+        if (!compressor.add(&log[ofs], len)) {
+            const uint8_t *frame = nullptr;
+            const uint32_t frame_len = compressor.flush(frame);
+            EXPECT_LE(frame_len, LogCompressor::max_frame_size());
+            append(out, frame, frame_len);
+            EXPECT_TRUE(compressor.add(&log[ofs], len));
+        }
+        ofs += len;
+    }
+    const uint8_t *frame = nullptr;
+    const uint32_t frame_len = compressor.flush(frame);
+    append(out, frame, frame_len);
+    EXPECT_EQ(log.size(), compressor.raw_bytes());
+    return out;
+}
+
+TEST(LogCompressTest, RoundTrip)
+{
+    const std::vector<uint8_t> log = make_log(20000, false);
+    const std::vector<uint8_t> compressed = compress_log(log);
+
+    EXPECT_TRUE(LogDecompressor::is_compressed(compressed.data(), compressed.size()));
+    EXPECT_FALSE(LogDecompressor::is_compressed(log.data(), log.size()));
+    // slowly changing data should compress well
+    EXPECT_LT(compressed.size() * 5, log.size());
+
+    uint8_t *out;
+    uint64_t out_len;
+    ASSERT_TRUE(LogDecompressor::decompress(compressed.data(), compressed.size(), out, out_len));
+    ASSERT_EQ(log.size(), out_len);
+    EXPECT_EQ(0, memcmp(log.data(), out, out_len));
+    free(out);
+}
+
+TEST(LogCompressTest, Incompressible)
+{
+    const std::vector<uint8_t> log = make_log(5000, true);
+    const std::vector<uint8_t> compressed = compress_log(log);
+
+    uint8_t *out;
+    uint64_t out_len;
+    ASSERT_TRUE(LogDecompressor::decompress(compressed.data(), compressed.size(), out, out_len));
+    ASSERT_EQ(log.size(), out_len);
+    EXPECT_EQ(0, memcmp(log.data(), out, out_len));
+    free(out);
+}
+
+// a type redefined with a different length part way through the log,
+// as happens when a log is continued by newer firmware, and then back
+// again, with an identical redefinition in between
+static std::vector<uint8_t> make_redefined_log(void)
+{
+    std::vector<uint8_t> log;
+    srandom(2);
+    append_format(log, sizeof(struct log_Test));
+    append_samples(log, 100, false);
+    append_format(log, sizeof(struct log_Test) - 4);
+    append_samples(log, 100, true, sizeof(struct log_Test) - 4);
+    append_format(log, sizeof(struct log_Test) - 4);
+    append_samples(log, 1, false, sizeof(struct log_Test) - 4);
+    append_format(log, sizeof(struct log_Test));
+    append_samples(log, 100, false);
+    return log;
+}
+
+/*
+  damage the data of the frame with the given index so that it can't
+  be decompressed, returning the length of the log held by the frames
+  before it
+ */
+static uint64_t corrupt_frame(std::vector<uint8_t> &compressed, uint16_t index)
+{
+    uint64_t good_len = 0;
+    size_t ofs = sizeof(struct log_compress_file_header);
+    for (uint16_t i=0; i<index; i++) {
+        struct log_compress_frame_header hdr;
+        memcpy(&hdr, &compressed[ofs], sizeof(hdr));
+        good_len += hdr.raw_len;
+        ofs += sizeof(hdr) + hdr.data_len;
+    }
+    struct log_compress_frame_header hdr;
+    memcpy(&hdr, &compressed[ofs], sizeof(hdr));
+    EXPECT_NE(hdr.data_len, hdr.raw_len);
+    // a literal run longer than the frame
+    memset(&compressed[ofs + sizeof(hdr)], 0xFF, hdr.data_len);
+    return good_len;
+}
+
+/*
+  convert a compressed log with Tools/scripts/log_decompress.py, found
+  from the path of this file. Returns false if the script or python
+  can't be found
+ */
+static bool python_decompress(const std::vector<uint8_t> &compressed, std::vector<uint8_t> &plain)
+{
+    std::string script = __FILE__;
+    const size_t pos = script.rfind("libraries/AP_Logger/tests/");
+    if (pos == std::string::npos) {
+        return false;
+    }
+    script = script.substr(0, pos) + "Tools/scripts/log_decompress.py";
+    if (access(script.c_str(), R_OK) != 0 ||
+        system("python3 --version > /dev/null 2>&1") != 0) {
+        ::printf("log_decompress.py or python3 not found, skipping\n");
+        return false;
+    }
+
+    char dir[] = "/tmp/log_compress_XXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+        return false;
+    }
+    const std::string in_file = std::string(dir) + "/in.BIN";
+    const std::string out_file = std::string(dir) + "/out.BIN";
+    FILE *f = fopen(in_file.c_str(), "wb");
+    EXPECT_NE(f, nullptr);
+    EXPECT_EQ(fwrite(compressed.data(), 1, compressed.size(), f), compressed.size());
+    fclose(f);
+
+    const std::string cmd = "python3 " + script + " --output " + out_file + " " + in_file + " > /dev/null";
+    EXPECT_EQ(system(cmd.c_str()), 0);
+    plain.clear();
+    f = fopen(out_file.c_str(), "rb");
+    EXPECT_NE(f, nullptr);
+    if (f != nullptr) {
+        uint8_t buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+            plain.insert(plain.end(), buf, buf + n);
+        }
+        fclose(f);
+    }
+    const std::string rm = std::string("rm -rf ") + dir;
+    EXPECT_EQ(system(rm.c_str()), 0);
+    return true;
+}
+
+TEST(LogCompressTest, FormatLengthChange)
+{
+    const std::vector<uint8_t> log = make_redefined_log();
+    const std::vector<uint8_t> compressed = compress_log(log);
+
+    uint8_t *out;
+    uint64_t out_len;
+    ASSERT_TRUE(LogDecompressor::decompress(compressed.data(), compressed.size(), out, out_len));
+    ASSERT_EQ(log.size(), out_len);
+    EXPECT_EQ(0, memcmp(log.data(), out, out_len));
+    free(out);
+}
+
+TEST(LogCompressTest, Truncated)
+{
+    const std::vector<uint8_t> log = make_log(20000, false);
+    std::vector<uint8_t> compressed = compress_log(log);
+    compressed.resize(compressed.size() - 10);
+
+    // the partial last frame is dropped, everything before it is kept
+    uint8_t *out;
+    uint64_t out_len;
+    ASSERT_TRUE(LogDecompressor::decompress(compressed.data(), compressed.size(), out, out_len));
+    EXPECT_GT(out_len, 0U);
+    EXPECT_LT(out_len, log.size());
+    EXPECT_EQ(0, memcmp(log.data(), out, out_len));
+    free(out);
+}
+
+TEST(LogCompressTest, Corrupt)
+{
+    const std::vector<uint8_t> log = make_log(20000, false);
+    std::vector<uint8_t> compressed = compress_log(log);
+    const uint64_t good_len = corrupt_frame(compressed, 3);
+
+    // the frames before the damaged one are kept
+    uint8_t *out;
+    uint64_t out_len;
+    ASSERT_TRUE(LogDecompressor::decompress(compressed.data(), compressed.size(), out, out_len));
+    EXPECT_GT(good_len, 0U);
+    ASSERT_EQ(good_len, out_len);
+    EXPECT_EQ(0, memcmp(log.data(), out, out_len));
+    free(out);
+
+    // not a compressed log at all
+    EXPECT_FALSE(LogDecompressor::decompress(log.data(), log.size(), out, out_len));
+    EXPECT_EQ(nullptr, out);
+}
+
+TEST(LogCompressTest, PythonMatches)
+{
+    // the python converter gives the same log as LogDecompressor, both
+    // for redefined types and a damaged frame
+    std::vector<uint8_t> compressed[2] {
+        compress_log(make_redefined_log()),
+        compress_log(make_log(20000, false)),
+    };
+    corrupt_frame(compressed[1], 3);
+
+    for (const std::vector<uint8_t> &c : compressed) {
+        uint8_t *out;
+        uint64_t out_len;
+        ASSERT_TRUE(LogDecompressor::decompress(c.data(), c.size(), out, out_len));
+        std::vector<uint8_t> plain;
+        if (python_decompress(c, plain)) {
+            ASSERT_EQ(plain.size(), out_len);
+            EXPECT_EQ(0, memcmp(plain.data(), out, out_len));
+        }
+        free(out);
+    }
+}
+
+TEST(LogCompressTest, LZBadInput)
+{
+    uint8_t dst[16];
+    // match offset before the start of the output
+    const uint8_t bad_offset[] = { 0x10, 'a', 0x05, 0x00 };
+    EXPECT_FALSE(LogDecompressor::lz_decompress(bad_offset, sizeof(bad_offset), dst, sizeof(dst)));
+    // literal run longer than the input
+    const uint8_t bad_literals[] = { 0xF0, 0x20, 'a' };
+    EXPECT_FALSE(LogDecompressor::lz_decompress(bad_literals, sizeof(bad_literals), dst, sizeof(dst)));
+    // output size mismatch
+    const uint8_t short_output[] = { 0x20, 'a', 'b' };
+    EXPECT_FALSE(LogDecompressor::lz_decompress(short_output, sizeof(short_output), dst, sizeof(dst)));
+    EXPECT_TRUE(LogDecompressor::lz_decompress(short_output, sizeof(short_output), dst, 2));
+}
+
+AP_GTEST_MAIN()
@@ -19,6 +19,7 @@
 #include <stdint.h>
 #include <AP_Math/AP_Math.h>
 #include <AP_Math/vectorN.h>
+#include "AP_Nav_Common.h"
 
 /*
   this declares a common parent class for AP_NavEKF2 and
@@ -42,10 +43,10 @@ public:
 #endif
 
 protected:
-    static Matrix24 KH;                   // intermediate result used for covariance updates
-    static Matrix24 KHP;                  // intermediate result used for covariance updates
-    static Matrix24 nextP;                // Predicted covariance matrix before addition of process noise to diagonals
-    static Vector28 Kfusion;              // intermediate fusion vector
+    static NAVEKF_SCRATCH Matrix24 KH;      // intermediate result used for covariance updates
+    static NAVEKF_SCRATCH Matrix24 KHP;     // intermediate result used for covariance updates
+    static NAVEKF_SCRATCH Matrix24 nextP;   // Predicted covariance matrix before addition of process noise to diagonals
+    static NAVEKF_SCRATCH Vector28 Kfusion; // intermediate fusion vector
 
     // fill all the common scratch variables with NaN on SITL
     void fill_scratch_variables(void);
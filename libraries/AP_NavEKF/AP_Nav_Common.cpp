@@ -2,6 +2,7 @@
 
 #include <AP_HAL/AP_HAL.h>
 #include <AP_Logger/AP_Logger.h>
+#include <AP_Math/AP_Math.h>
 
 /*
   write an EKF timing message
@@ -10,8 +11,8 @@ void Log_EKF_Timing(const char *name, uint64_t time_us, const struct ekf_timing
 {
     AP::logger().Write(
         name,
-        "TimeUS,Cnt,IMUMin,IMUMax,EKFMin,EKFMax,AngMin,AngMax,VMin,VMax",
-        "QIffffffff",
+        "TimeUS,Cnt,IMUMin,IMUMax,EKFMin,EKFMax,AngMin,AngMax,VMin,VMax,UpdAvg,UpdMax",
+        "QIffffffffff",
         time_us,
         timing.count,
         (double)timing.dtIMUavg_min,
@@ -21,5 +22,18 @@ void Log_EKF_Timing(const char *name, uint64_t time_us, const struct ekf_timing
         (double)timing.delAngDT_min,
         (double)timing.delAngDT_max,
         (double)timing.delVelDT_min,
-        (double)timing.delVelDT_max);
+        (double)timing.delVelDT_max,
+        (double)timing.updateTime_avg,
+        (double)timing.updateTime_max);
+}
+
+/*
+  add the run time of a core UpdateFilter() call started at start_us
+ */
+void EKF_Timing_Update(struct ekf_timing &timing, uint32_t start_us)
+{
+    const float dt_us = AP_HAL::micros() - start_us;
+    timing.updateCount++;
+    timing.updateTime_avg += (dt_us - timing.updateTime_avg) / timing.updateCount;
+    timing.updateTime_max = MAX(timing.updateTime_max, dt_us);
 }
@@ -17,6 +17,22 @@
 #pragma once
 
 #include <stdint.h>
+#include <AP_HAL/AP_HAL_Boards.h>
+
+/*
+  EKF3 can update its cores in parallel threads on Linux boards (see
+  EK3_THREADS). Each thread then needs its own copy of the scratch
+  space, at the cost of a thread pointer relative address
+ */
+#ifndef HAL_NAVEKF3_PARALLEL_CORES
+#define HAL_NAVEKF3_PARALLEL_CORES (CONFIG_HAL_BOARD == HAL_BOARD_LINUX)
+#endif
+
+#if HAL_NAVEKF3_PARALLEL_CORES
+#define NAVEKF_SCRATCH thread_local
+#else
+#define NAVEKF_SCRATCH
+#endif
 
 union nav_filter_status {
     struct {
@@ -74,5 +90,9 @@ struct ekf_timing {
     float delAngDT_min;
     float delVelDT_max;
     float delVelDT_min;
+    uint32_t updateCount;
+    float updateTime_avg;  // average core UpdateFilter() run time in microseconds
+    float updateTime_max;  // maximum core UpdateFilter() run time in microseconds
 };
 void Log_EKF_Timing(const char *name, uint64_t time_us, const struct ekf_timing &timing);
+void EKF_Timing_Update(struct ekf_timing &timing, uint32_t start_us);
@@ -547,6 +547,7 @@ void NavEKF2_core::UpdateFilter(bool predict)
     timing_start_us = AP_HAL::micros();
 #endif
     hal.util->perf_begin(_perf_UpdateFilter);
+    const uint32_t update_start_us = AP_HAL::micros();
 
     fill_scratch_variables();
 
@@ -595,6 +596,7 @@ void NavEKF2_core::UpdateFilter(bool predict)
     calcOutputStates();
 
     // stop the timer used for load measurement
+    EKF_Timing_Update(timing, update_start_us);
     hal.util->perf_end(_perf_UpdateFilter);
 #if ENABLE_EKF_TIMING
     static uint32_t total_us;
@@ -604,6 +604,16 @@ const AP_Param::GroupInfo NavEKF3::var_info[] = {
     // @Units: mGauss
     AP_GROUPINFO("MAG_EF_LIM", 56, NavEKF3, _mag_ef_limit, 50),
 
+#if HAL_NAVEKF3_PARALLEL_CORES
+    // @Param: THREADS
+    // @DisplayName: EKF core update threads
+    // @Description: Number of extra threads used to update the EKF cores in parallel with the main thread on Linux boards with more than one CPU. Each thread is pinned to its own CPU other than the first, shared out with the scheduler worker threads, and runs at a higher priority than those. Zero updates all cores in turn in the main thread.
+    // @User: Advanced
+    // @Range: 0 6
+    // @RebootRequired: True
+    AP_GROUPINFO("THREADS", 57, NavEKF3, _threads, 0),
+#endif
+
     AP_GROUPEND
 };
 
@@ -703,6 +713,10 @@ bool NavEKF3::InitialiseFilter(void)
         for (uint8_t i = 0; i < num_cores; i++) {
             new (&core[i]) NavEKF3_core(this);
         }
+
+#if HAL_NAVEKF3_PARALLEL_CORES
+        start_parallel_workers();
+#endif
     }
 
     // Set up any cores that have been created
@@ -755,6 +769,12 @@ void NavEKF3::UpdateFilter(void)
 
     const AP_InertialSensor &ins = AP::ins();
 
+#if HAL_NAVEKF3_PARALLEL_CORES
+    const bool parallel_update = parallel.num_workers > 0;
+#else
+    const bool parallel_update = false;
+#endif
+
     bool statePredictEnabled[num_cores];
     for (uint8_t i=0; i<num_cores; i++) {
         // if we have not overrun by more than 3 IMU frames, and we
@@ -767,8 +787,17 @@ void NavEKF3::UpdateFilter(void)
         } else {
             statePredictEnabled[i] = true;
         }
-        core[i].UpdateFilter(statePredictEnabled[i]);
+        if (!parallel_update) {
+            core[i].UpdateFilter(statePredictEnabled[i]);
+        }
+    }
+
+#if HAL_NAVEKF3_PARALLEL_CORES
+    if (parallel_update) {
+        // all cores are finished before we look at their outputs
+        update_cores_parallel(statePredictEnabled);
     }
+#endif
 
     // If the current core selected has a bad error score or is unhealthy, switch to a healthy core with the lowest fault score
     // Don't start running the check until the primary core has started returned healthy for at least 10 seconds to avoid switching
@@ -825,6 +854,25 @@ void NavEKF3::UpdateFilter(void)
     check_log_write();
 }
 
+/*
+  keep the origin in the frontend so it stays in sync between lanes.
+  When cores are updated in parallel the origin is only shared once
+  they have all finished, so each core sees the same common origin
+  however the threads are scheduled
+ */
+void NavEKF3::setCommonOrigin(uint8_t core_index, const Location &loc)
+{
+#if HAL_NAVEKF3_PARALLEL_CORES
+    if (parallel.active) {
+        parallel.origin[core_index] = loc;
+        parallel.origin_set[core_index] = true;
+        return;
+    }
+#endif
+    common_EKF_origin = loc;
+    common_origin_valid = true;
+}
+
 /*
   check if switching lanes will reduce the normalised
   innovations. This is called when the vehicle code is about to
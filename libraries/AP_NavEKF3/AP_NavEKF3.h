@@ -28,6 +28,10 @@
 #include <AP_RangeFinder/AP_RangeFinder.h>
 #include <AP_Logger/LogStructure.h>
 
+#if HAL_NAVEKF3_PARALLEL_CORES
+#include <pthread.h>
+#endif
+
 class NavEKF3_core;
 class AP_AHRS;
 
@@ -450,6 +454,9 @@ private:
     AP_Int8  _flowUse;              // Controls if the optical flow data is fused into the main navigation estimator and/or the terrain estimator.
     AP_Float _hrt_filt_freq;        // frequency of output observer height rate complementary filter in Hz
     AP_Int16 _mag_ef_limit;         // limit on difference between WMM tables and learned earth field.
+#if HAL_NAVEKF3_PARALLEL_CORES
+    AP_Int8  _threads;              // number of worker threads updating cores in parallel with the main thread
+#endif
 
 // Possible values for _flowUse
 #define FLOW_USE_NONE    0
@@ -529,6 +536,44 @@ private:
     // origin set by one of the cores
     struct Location common_EKF_origin;
     bool common_origin_valid;
+
+    // called by a core when it sets its origin
+    void setCommonOrigin(uint8_t core_index, const Location &loc);
+
+#if HAL_NAVEKF3_PARALLEL_CORES
+    /*
+      worker threads updating cores in parallel with the main
+      thread. Core i is updated by worker i % (num_workers+1), where
+      worker 0 is the main thread
+     */
+    struct {
+        uint8_t num_workers;        // number of running worker threads
+        uint8_t started;            // number of worker threads that have taken an index
+        uint32_t generation;        // incremented to start each update
+        uint8_t remaining;          // workers yet to finish this update
+        bool active;                // true while cores are being updated in parallel
+        bool predict[7];            // statePredictEnabled for each core this update
+        // origins set by each core this update, applied after all
+        // cores finish so the common origin doesn't change under them
+        bool origin_set[7];
+        struct Location origin[7];
+        pthread_mutex_t mtx;
+        pthread_cond_t start_cond;
+        pthread_cond_t done_cond;
+    } parallel;
+
+    // start the worker threads selected by EK3_THREADS
+    void start_parallel_workers(void);
+
+    // worker thread main loop
+    void parallel_worker(void);
+
+    // update the cores belonging to one worker
+    void update_worker_cores(uint8_t worker);
+
+    // update all cores in parallel, returning when all are done
+    void update_cores_parallel(const bool *statePredictEnabled);
+#endif
     
     // update the yaw reset data to capture changes due to a lane switch
     // new_primary - index of the ekf instance that we are about to switch to as the primary
@@ -151,38 +151,9 @@ void NavEKF3_core::FuseAirspeed()
             stateStruct.quat.normalize();
 
             // correct the covariance P = (I - K*H)*P
-            // take advantage of the empty columns in KH to reduce the
-            // number of operations
-            for (unsigned i = 0; i<=stateIndexLim; i++) {
-                for (unsigned j = 0; j<=3; j++) {
-                    KH[i][j] = 0.0f;
-                }
-                for (unsigned j = 4; j<=6; j++) {
-                    KH[i][j] = Kfusion[i] * H_TAS[j];
-                }
-                for (unsigned j = 7; j<=21; j++) {
-                    KH[i][j] = 0.0f;
-                }
-                for (unsigned j = 22; j<=23; j++) {
-                    KH[i][j] = Kfusion[i] * H_TAS[j];
-                }
-            }
-            for (unsigned j = 0; j<=stateIndexLim; j++) {
-                for (unsigned i = 0; i<=stateIndexLim; i++) {
-                    ftype res = 0;
-                    res += KH[i][4] * P[4][j];
-                    res += KH[i][5] * P[5][j];
-                    res += KH[i][6] * P[6][j];
-                    res += KH[i][22] * P[22][j];
-                    res += KH[i][23] * P[23][j];
-                    KHP[i][j] = res;
-                }
-            }
-            for (unsigned i = 0; i<=stateIndexLim; i++) {
-                for (unsigned j = 0; j<=stateIndexLim; j++) {
-                    P[i][j] = P[i][j] - KHP[i][j];
-                }
-            }
+            // taking advantage of the empty columns in H
+            static const uint8_t Hidx[] = {4, 5, 6, 22, 23};
+            CovarianceFusionUpdate(&H_TAS[0], Hidx, ARRAY_SIZE(Hidx), false);
         }
     }
 
@@ -419,39 +390,9 @@ void NavEKF3_core::FuseSideslip()
         stateStruct.quat.normalize();
 
         // correct the covariance P = (I - K*H)*P
-        // take advantage of the empty columns in KH to reduce the
-        // number of operations
-        for (unsigned i = 0; i<=stateIndexLim; i++) {
-            for (unsigned j = 0; j<=6; j++) {
-                KH[i][j] = Kfusion[i] * H_BETA[j];
-            }
-            for (unsigned j = 7; j<=21; j++) {
-                KH[i][j] = 0.0f;
-            }
-            for (unsigned j = 22; j<=23; j++) {
-                KH[i][j] = Kfusion[i] * H_BETA[j];
-            }
-        }
-        for (unsigned j = 0; j<=stateIndexLim; j++) {
-            for (unsigned i = 0; i<=stateIndexLim; i++) {
-                ftype res = 0;
-                res += KH[i][0] * P[0][j];
-                res += KH[i][1] * P[1][j];
-                res += KH[i][2] * P[2][j];
-                res += KH[i][3] * P[3][j];
-                res += KH[i][4] * P[4][j];
-                res += KH[i][5] * P[5][j];
-                res += KH[i][6] * P[6][j];
-                res += KH[i][22] * P[22][j];
-                res += KH[i][23] * P[23][j];
-                KHP[i][j] = res;
-            }
-        }
-        for (unsigned i = 0; i<=stateIndexLim; i++) {
-            for (unsigned j = 0; j<=stateIndexLim; j++) {
-                P[i][j] = P[i][j] - KHP[i][j];
-            }
-        }
+        // taking advantage of the empty columns in H
+        static const uint8_t Hidx[] = {0, 1, 2, 3, 4, 5, 6, 22, 23};
+        CovarianceFusionUpdate(&H_BETA[0], Hidx, ARRAY_SIZE(Hidx), false);
     }
 
     // force the covariance matrix to be symmetrical and limit the variances to prevent ill-conditioning.
@@ -493,8 +493,7 @@ void NavEKF3_core::setOrigin(const Location &loc)
     gcs().send_text(MAV_SEVERITY_INFO, "EKF3 IMU%u origin set",(unsigned)imu_index);
 
     // put origin in frontend as well to ensure it stays in sync between lanes
-    frontend->common_EKF_origin = EKF_origin;
-    frontend->common_origin_valid = true;
+    frontend->setCommonOrigin(core_index, EKF_origin);
 }
 
 // record a yaw reset event
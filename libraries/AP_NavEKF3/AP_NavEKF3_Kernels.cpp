@@ -0,0 +1,108 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+  covariance update kernels for EKF3, see AP_NavEKF3_Kernels.h
+ */
+
+#include "AP_NavEKF3_Kernels.h"
+
+/*
+  thin wrappers over the vector instructions. P is allocated as part
+  of the EKF core so its alignment isn't known; unaligned loads cost
+  nothing extra on aligned data on the targets we care about
+ */
+#if EK3_SIMD_KERNELS && defined(__AVX__)
+#include <immintrin.h>
+#define EK3_VWIDTH 8
+typedef __m256 vfloat;
+static inline vfloat vload(const float *p) { return _mm256_loadu_ps(p); }
+static inline void vstore(float *p, vfloat v) { _mm256_storeu_ps(p, v); }
+static inline vfloat vdup(float f) { return _mm256_set1_ps(f); }
+static inline vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+static inline vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+static inline vfloat vsub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+#elif EK3_SIMD_KERNELS && defined(__SSE2__)
+#include <emmintrin.h>
+#define EK3_VWIDTH 4
+typedef __m128 vfloat;
+static inline vfloat vload(const float *p) { return _mm_loadu_ps(p); }
+static inline void vstore(float *p, vfloat v) { _mm_storeu_ps(p, v); }
+static inline vfloat vdup(float f) { return _mm_set1_ps(f); }
+static inline vfloat vmul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+static inline vfloat vadd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+static inline vfloat vsub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+#elif EK3_SIMD_KERNELS && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define EK3_VWIDTH 4
+typedef float32x4_t vfloat;
+static inline vfloat vload(const float *p) { return vld1q_f32(p); }
+static inline void vstore(float *p, vfloat v) { vst1q_f32(p, v); }
+static inline vfloat vdup(float f) { return vdupq_n_f32(f); }
+static inline vfloat vmul(vfloat a, vfloat b) { return vmulq_f32(a, b); }
+static inline vfloat vadd(vfloat a, vfloat b) { return vaddq_f32(a, b); }
+static inline vfloat vsub(vfloat a, vfloat b) { return vsubq_f32(a, b); }
+#else
+#define EK3_VWIDTH 1
+#endif
+
+void EKF3_sparse_HP(const float *P, const float *H, const uint8_t *Hidx, uint8_t nidx, uint8_t n, float *HP)
+{
+    uint8_t j = 0;
+#if EK3_VWIDTH > 1
+    for (; j + EK3_VWIDTH <= n; j += EK3_VWIDTH) {
+        vfloat sum = vdup(0);
+        for (uint8_t k = 0; k < nidx; k++) {
+            const uint8_t s = Hidx[k];
+            sum = vadd(sum, vmul(vdup(H[s]), vload(&P[s*EK3_COV_DIM + j])));
+        }
+        vstore(&HP[j], sum);
+    }
+#endif
+    for (; j < n; j++) {
+        float sum = 0;
+        for (uint8_t k = 0; k < nidx; k++) {
+            const uint8_t s = Hidx[k];
+            sum += H[s] * P[s*EK3_COV_DIM + j];
+        }
+        HP[j] = sum;
+    }
+}
+
+bool EKF3_variances_ok(const float *P, const float *K, const float *HP, uint8_t n)
+{
+    for (uint8_t i = 0; i < n; i++) {
+        if (K[i] * HP[i] > P[i*EK3_COV_DIM + i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void EKF3_rank1_update(float *P, const float *K, const float *HP, uint8_t n)
+{
+    for (uint8_t i = 0; i < n; i++) {
+        float *row = &P[i*EK3_COV_DIM];
+        uint8_t j = 0;
+#if EK3_VWIDTH > 1
+        const vfloat k = vdup(K[i]);
+        for (; j + EK3_VWIDTH <= n; j += EK3_VWIDTH) {
+            vstore(&row[j], vsub(vload(&row[j]), vmul(k, vload(&HP[j]))));
+        }
+#endif
+        for (; j < n; j++) {
+            row[j] -= K[i] * HP[j];
+        }
+    }
+}
@@ -0,0 +1,38 @@
+/*
+  covariance update kernels for EKF3
+
+  The fusion steps in EKF3 all apply P = P - K*H*P for a single
+  measurement, where H has only a few non-zero elements. As K*H is
+  rank one this is computed as K*(H*P), first forming the row vector
+  HP = H*P and then subtracting K*HP' from P. Both steps work along
+  rows of P, so are vectorised with SSE/AVX on x86 and NEON on ARM.
+
+  P is the 24x24 row-major covariance matrix. As a row is a whole
+  number of 4 and 8 float vectors no padding is needed. Only the
+  first n rows and columns are used, allowing for the states that
+  are inhibited by stateIndexLim.
+
+  Build with EK3_SIMD_KERNELS=0 to use plain scalar loops.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#ifndef EK3_SIMD_KERNELS
+#if defined(__SSE2__) || defined(__ARM_NEON)
+#define EK3_SIMD_KERNELS 1
+#else
+#define EK3_SIMD_KERNELS 0
+#endif
+#endif
+
+#define EK3_COV_DIM 24
+
+// HP = H*P, where H is zero except at the nidx state indexes in Hidx
+void EKF3_sparse_HP(const float *P, const float *H, const uint8_t *Hidx, uint8_t nidx, uint8_t n, float *HP);
+
+// return false if subtracting K*HP' would make any variance in P negative
+bool EKF3_variances_ok(const float *P, const float *K, const float *HP, uint8_t n);
+
+// P = P - K*HP'
+void EKF3_rank1_update(float *P, const float *K, const float *HP, uint8_t n);
@@ -0,0 +1,150 @@
+/*
+  parallel update of EKF3 cores on Linux boards
+
+  Each core only reads sensor data and the frontend parameters and
+  writes its own state, so the cores can be updated at the same time
+  on different CPUs. The main thread updates its share of the cores
+  while the worker threads update theirs, then waits for all of them
+  before core selection and the AHRS use the outputs. Cores are
+  assigned to threads statically and the common origin is only
+  shared between updates, so the result doesn't depend on how the
+  threads are scheduled.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <AP_HAL/AP_HAL.h>
+
+#include "AP_NavEKF3.h"
+
+#if HAL_NAVEKF3_PARALLEL_CORES
+
+#include "AP_NavEKF3_core.h"
+#include <AP_HAL_Linux/Scheduler.h>
+#include <GCS_MAVLink/GCS.h>
+
+extern const AP_HAL::HAL& hal;
+
+/*
+  start the worker threads. Called once the cores are allocated
+ */
+void NavEKF3::start_parallel_workers(void)
+{
+    // no point in more threads than cores, with the main thread
+    // taking the first core
+    const uint8_t nthreads = MIN(uint8_t(constrain_int16(_threads, 0, 6)), num_cores-1);
+    if (nthreads == 0) {
+        return;
+    }
+
+    pthread_mutex_init(&parallel.mtx, nullptr);
+    pthread_cond_init(&parallel.start_cond, nullptr);
+    pthread_cond_init(&parallel.done_cond, nullptr);
+
+    // the main thread waits for the workers in the fast loop, so run
+    // them one above the scheduler workers they may share a CPU with
+    for (uint8_t i=0; i<nthreads; i++) {
+        if (!hal.scheduler->thread_create(FUNCTOR_BIND_MEMBER(&NavEKF3::parallel_worker, void),
+                                          "EK3",
+                                          8192, AP_HAL::Scheduler::PRIORITY_MAIN, 1)) {
+            break;
+        }
+        parallel.num_workers++;
+    }
+    if (parallel.num_workers < nthreads) {
+        gcs().send_text(MAV_SEVERITY_WARNING, "NavEKF3: started %u of %u threads",
+                        (unsigned)parallel.num_workers, (unsigned)nthreads);
+    }
+}
+
+/*
+  update the cores belonging to a worker, where worker 0 is the main
+  thread
+ */
+void NavEKF3::update_worker_cores(uint8_t worker)
+{
+    for (uint8_t i=worker; i<num_cores; i += parallel.num_workers+1) {
+        core[i].UpdateFilter(parallel.predict[i]);
+    }
+}
+
+/*
+  worker thread main loop
+ */
+void NavEKF3::parallel_worker(void)
+{
+    pthread_mutex_lock(&parallel.mtx);
+    const uint8_t worker = ++parallel.started;
+    pthread_mutex_unlock(&parallel.mtx);
+
+    // the main thread waits for every worker on each update, so a
+    // worker that starts late still has the first update to do
+    uint32_t generation = 0;
+
+    // keep each worker on its own CPU, shared out with the scheduler
+    // worker threads
+    Linux::Scheduler::from(hal.scheduler)->pin_worker_thread();
+
+    while (true) {
+        pthread_mutex_lock(&parallel.mtx);
+        while (parallel.generation == generation) {
+            pthread_cond_wait(&parallel.start_cond, &parallel.mtx);
+        }
+        generation = parallel.generation;
+        pthread_mutex_unlock(&parallel.mtx);
+
+        update_worker_cores(worker);
+
+        pthread_mutex_lock(&parallel.mtx);
+        if (--parallel.remaining == 0) {
+            pthread_cond_signal(&parallel.done_cond);
+        }
+        pthread_mutex_unlock(&parallel.mtx);
+    }
+}
+
+/*
+  update all cores, returning when they have all finished
+ */
+void NavEKF3::update_cores_parallel(const bool *statePredictEnabled)
+{
+    memcpy(parallel.predict, statePredictEnabled, num_cores);
+    memset(parallel.origin_set, 0, sizeof(parallel.origin_set));
+    parallel.active = true;
+
+    pthread_mutex_lock(&parallel.mtx);
+    parallel.remaining = parallel.num_workers;
+    parallel.generation++;
+    pthread_cond_broadcast(&parallel.start_cond);
+    pthread_mutex_unlock(&parallel.mtx);
+
+    update_worker_cores(0);
+
+    pthread_mutex_lock(&parallel.mtx);
+    while (parallel.remaining != 0) {
+        pthread_cond_wait(&parallel.done_cond, &parallel.mtx);
+    }
+    pthread_mutex_unlock(&parallel.mtx);
+
+    parallel.active = false;
+
+    // share origins in core order, so the last one wins as it does
+    // when the cores are updated in turn
+    for (uint8_t i=0; i<num_cores; i++) {
+        if (parallel.origin_set[i]) {
+            setCommonOrigin(i, parallel.origin[i]);
+        }
+    }
+}
+
+#endif // HAL_NAVEKF3_PARALLEL_CORES
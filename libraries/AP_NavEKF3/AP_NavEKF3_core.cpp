@@ -2,6 +2,7 @@
 
 #include "AP_NavEKF3.h"
 #include "AP_NavEKF3_core.h"
+#include "AP_NavEKF3_Kernels.h"
 #include <AP_AHRS/AP_AHRS.h>
 #include <AP_Vehicle/AP_Vehicle.h>
 #include <GCS_MAVLink/GCS.h>
@@ -585,6 +586,7 @@ void NavEKF3_core::UpdateFilter(bool predict)
     void *istate = hal.scheduler->disable_interrupts_save();
 #endif
     hal.util->perf_begin(_perf_UpdateFilter);
+    const uint32_t update_start_us = AP_HAL::micros();
 
     fill_scratch_variables();
 
@@ -633,6 +635,7 @@ void NavEKF3_core::UpdateFilter(bool predict)
     calcOutputStates();
 
     // stop the timer used for load measurement
+    EKF_Timing_Update(timing, update_start_us);
     hal.util->perf_end(_perf_UpdateFilter);
 #if EK3_DISABLE_INTERRUPTS
     hal.scheduler->restore_interrupts(istate);
@@ -1477,6 +1480,33 @@ void NavEKF3_core::ForceSymmetry()
     }
 }
 
+// update the covariance matrix after fusing a measurement, P = (I - K*H)*P
+// K*H has rank one so K*H*P is formed as K*(H*P), see AP_NavEKF3_Kernels.h
+bool NavEKF3_core::CovarianceFusionUpdate(const ftype *H, const uint8_t *Hidx, uint8_t nidx, bool checkVariances)
+{
+    const uint8_t n = stateIndexLim + 1;
+    ftype HP[24];
+    EKF3_sparse_HP(&P[0][0], H, Hidx, nidx, n, HP);
+    if (checkVariances && !EKF3_variances_ok(&P[0][0], &Kfusion[0], HP, n)) {
+        return false;
+    }
+    EKF3_rank1_update(&P[0][0], &Kfusion[0], HP, n);
+    return true;
+}
+
+bool NavEKF3_core::CovarianceFusionUpdate(uint8_t stateIndex)
+{
+    // H*P is just the observed row, copied as P is updated in place
+    const uint8_t n = stateIndexLim + 1;
+    ftype HP[24];
+    memcpy(HP, &P[stateIndex][0], n * sizeof(ftype));
+    if (!EKF3_variances_ok(&P[0][0], &Kfusion[0], HP, n)) {
+        return false;
+    }
+    EKF3_rank1_update(&P[0][0], &Kfusion[0], HP, n);
+    return true;
+}
+
 // constrain variances (diagonal terms) in the state covariance matrix to  prevent ill-conditioning
 // if states are inactive, zero the corresponding off-diagonals
 void NavEKF3_core::ConstrainVariances()
@@ -551,6 +551,14 @@ private:
     // force symmetry on the state covariance matrix
     void ForceSymmetry();
 
+    // apply P = P - K*H*P using Kfusion for K, where H is zero except
+    // at the nidx states in Hidx. Returns false and leaves P unchanged
+    // if checkVariances is set and this would make a variance negative
+    bool CovarianceFusionUpdate(const ftype *H, const uint8_t *Hidx, uint8_t nidx, bool checkVariances=true);
+
+    // as above for a direct observation of the state at stateIndex
+    bool CovarianceFusionUpdate(uint8_t stateIndex);
+
     // constrain variances (diagonal terms) in the state covariance matrix
     void ConstrainVariances();
 
@@ -0,0 +1,109 @@
+#include <AP_gbenchmark.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <AP_Common/AP_Common.h>
+#include <AP_NavEKF3/AP_NavEKF3_Kernels.h>
+
+/*
+  cost of the covariance update for one magnetometer axis, the
+  fusion with the most non-zero Jacobian elements, comparing the
+  kernels against forming K*H and K*H*P as EKF3 used to
+ */
+
+#define N EK3_COV_DIM
+
+static const uint8_t Hidx[] = {0, 1, 2, 3, 16, 17, 18, 19, 20, 21};
+
+static float P[N][N];
+static float H[N];
+static float K[N];
+static float KH[N][N];
+static float KHP[N][N];
+
+static void setup_fusion(void)
+{
+    srandom(1);
+    for (uint8_t i=0; i<N; i++) {
+        for (uint8_t j=0; j<N; j++) {
+            P[i][j] = (i == j) ? 1.0f : 0.01f * (float(random()) / RAND_MAX);
+        }
+    }
+    memset(H, 0, sizeof(H));
+    for (uint8_t k=0; k<ARRAY_SIZE(Hidx); k++) {
+        H[Hidx[k]] = float(random()) / RAND_MAX;
+    }
+    for (uint8_t i=0; i<N; i++) {
+        // small enough that repeated updates stay finite
+        K[i] = 1.0e-6f * (float(random()) / RAND_MAX);
+    }
+}
+
+static void BM_FusionUpdateKHP(benchmark::State& state)
+{
+    setup_fusion();
+    while (state.KeepRunning()) {
+        for (uint8_t i=0; i<N; i++) {
+            for (uint8_t j=0; j<N; j++) {
+                KH[i][j] = K[i] * H[j];
+            }
+        }
+        for (uint8_t j=0; j<N; j++) {
+            for (uint8_t i=0; i<N; i++) {
+                float res = 0;
+                for (uint8_t k=0; k<ARRAY_SIZE(Hidx); k++) {
+                    res += KH[i][Hidx[k]] * P[Hidx[k]][j];
+                }
+                KHP[i][j] = res;
+            }
+        }
+        bool healthy = true;
+        for (uint8_t i=0; i<N; i++) {
+            if (KHP[i][i] > P[i][i]) {
+                healthy = false;
+            }
+        }
+        if (healthy) {
+            for (uint8_t i=0; i<N; i++) {
+                for (uint8_t j=0; j<N; j++) {
+                    P[i][j] -= KHP[i][j];
+                }
+            }
+        }
+        gbenchmark_escape(P);
+    }
+}
+
+static void BM_FusionUpdateKernels(benchmark::State& state)
+{
+    setup_fusion();
+    float HP[N];
+    while (state.KeepRunning()) {
+        EKF3_sparse_HP(&P[0][0], H, Hidx, ARRAY_SIZE(Hidx), N, HP);
+        if (EKF3_variances_ok(&P[0][0], K, HP, N)) {
+            EKF3_rank1_update(&P[0][0], K, HP, N);
+        }
+        gbenchmark_escape(P);
+    }
+}
+
+static void BM_FusionUpdateDirect(benchmark::State& state)
+{
+    // direct observation of a single state, as for GPS velocity and position
+    setup_fusion();
+    float HP[N];
+    while (state.KeepRunning()) {
+        memcpy(HP, &P[7][0], sizeof(HP));
+        if (EKF3_variances_ok(&P[0][0], K, HP, N)) {
+            EKF3_rank1_update(&P[0][0], K, HP, N);
+        }
+        gbenchmark_escape(P);
+    }
+}
+
+BENCHMARK(BM_FusionUpdateKHP);
+BENCHMARK(BM_FusionUpdateKernels);
+BENCHMARK(BM_FusionUpdateDirect);
+
+BENCHMARK_MAIN()
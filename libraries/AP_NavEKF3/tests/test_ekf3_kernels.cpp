@@ -0,0 +1,143 @@
+#include <AP_gtest.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <AP_Common/AP_Common.h>
+#include <AP_NavEKF3/AP_NavEKF3_Kernels.h>
+
+#define N EK3_COV_DIM
+
+// the magnetometer fusion Jacobian has the most non-zero elements
+static const uint8_t Hidx[] = {0, 1, 2, 3, 16, 17, 18, 19, 20, 21};
+
+static float rand_float(float scale)
+{
+    return scale * (float(random()) / RAND_MAX - 0.5f);
+}
+
+// build a symmetric positive definite covariance matrix
+static void make_P(float P[N][N])
+{
+    float A[N][N];
+    for (uint8_t i=0; i<N; i++) {
+        for (uint8_t j=0; j<N; j++) {
+            A[i][j] = rand_float(0.2f);
+        }
+    }
+    for (uint8_t i=0; i<N; i++) {
+        for (uint8_t j=0; j<N; j++) {
+            float sum = (i == j) ? 1.0f : 0.0f;
+            for (uint8_t k=0; k<N; k++) {
+                sum += A[i][k] * A[j][k];
+            }
+            P[i][j] = sum;
+        }
+    }
+}
+
+// the fusion as it was written before the kernels, forming K*H first
+static void reference_update(float P[N][N], const float *K, const float *H, uint8_t n)
+{
+    static float KH[N][N];
+    static float KHP[N][N];
+    for (uint8_t i=0; i<n; i++) {
+        for (uint8_t j=0; j<N; j++) {
+            KH[i][j] = K[i] * H[j];
+        }
+    }
+    for (uint8_t i=0; i<n; i++) {
+        for (uint8_t j=0; j<n; j++) {
+            float res = 0;
+            for (uint8_t k=0; k<ARRAY_SIZE(Hidx); k++) {
+                res += KH[i][Hidx[k]] * P[Hidx[k]][j];
+            }
+            KHP[i][j] = res;
+        }
+    }
+    for (uint8_t i=0; i<n; i++) {
+        for (uint8_t j=0; j<n; j++) {
+            P[i][j] -= KHP[i][j];
+        }
+    }
+}
+
+// form H and the matching Kalman gain K = P*H'/(H*P*H' + R)
+static void make_fusion(const float P[N][N], float *H, float *K)
+{
+    memset(H, 0, N*sizeof(float));
+    for (uint8_t k=0; k<ARRAY_SIZE(Hidx); k++) {
+        H[Hidx[k]] = rand_float(2.0f);
+    }
+    float PHt[N];
+    float S = 0.1f;
+    for (uint8_t i=0; i<N; i++) {
+        PHt[i] = 0;
+        for (uint8_t j=0; j<N; j++) {
+            PHt[i] += P[i][j] * H[j];
+        }
+        S += H[i] * PHt[i];
+    }
+    for (uint8_t i=0; i<N; i++) {
+        K[i] = PHt[i] / S;
+    }
+}
+
+static void check_against_reference(uint8_t n)
+{
+    srandom(n);
+    for (uint8_t iter=0; iter<20; iter++) {
+        float P[N][N], Pref[N][N];
+        float H[N], K[N], HP[N];
+        make_P(P);
+        make_fusion(P, H, K);
+        memcpy(Pref, P, sizeof(P));
+
+        EKF3_sparse_HP(&P[0][0], H, Hidx, ARRAY_SIZE(Hidx), n, HP);
+        EXPECT_TRUE(EKF3_variances_ok(&P[0][0], K, HP, n));
+        EKF3_rank1_update(&P[0][0], K, HP, n);
+        reference_update(Pref, K, H, n);
+
+        for (uint8_t i=0; i<N; i++) {
+            for (uint8_t j=0; j<N; j++) {
+                if (i < n && j < n) {
+                    EXPECT_NEAR(Pref[i][j], P[i][j], 1.0e-5f * (1 + fabsf(Pref[i][j])));
+                } else {
+                    // outside the active states nothing is touched
+                    EXPECT_EQ(Pref[i][j], P[i][j]);
+                }
+            }
+        }
+    }
+}
+
+TEST(EKF3KernelsTest, MatchesReference)
+{
+    check_against_reference(24);
+}
+
+TEST(EKF3KernelsTest, InhibitedStates)
+{
+    // stateIndexLim can stop at 9, 12, 15, 21 or 23
+    check_against_reference(10);
+    check_against_reference(13);
+    check_against_reference(16);
+    check_against_reference(22);
+}
+
+TEST(EKF3KernelsTest, NegativeVariance)
+{
+    float P[N][N] {};
+    float K[N] {}, HP[N] {};
+    for (uint8_t i=0; i<N; i++) {
+        P[i][i] = 1.0f;
+    }
+    K[5] = 2.0f;
+    HP[5] = 1.0f;
+    EXPECT_FALSE(EKF3_variances_ok(&P[0][0], K, HP, N));
+    // the state is inhibited so doesn't count
+    EXPECT_TRUE(EKF3_variances_ok(&P[0][0], K, HP, 5));
+}
+
+AP_GTEST_MAIN()
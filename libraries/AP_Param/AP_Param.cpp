@@ -24,6 +24,7 @@
 #include "AP_Param.h"
 
 #include <cmath>
+#include <stdlib.h>
 #include <string.h>
 
 #include <AP_Common/AP_Common.h>
@@ -112,6 +113,20 @@ void AP_Param::eeprom_write_check(const void *ptr, uint16_t ofs, uint8_t size)
 
 bool AP_Param::_hide_disabled_groups = true;
 
+#if AP_PARAM_INDEX_ENABLED
+struct AP_Param::index_entry *AP_Param::_index;
+uint16_t *AP_Param::_index_by_name;
+uint16_t *AP_Param::_index_by_ptr;
+struct AP_Param::index_scalar *AP_Param::_index_scalar;
+uint16_t AP_Param::_index_count;
+uint16_t AP_Param::_index_scalar_count;
+uint16_t AP_Param::_index_size;
+bool AP_Param::_index_valid;
+HAL_Semaphore AP_Param::_index_sem;
+uint16_t AP_Param::_key_vindex[_sentinal_key+1];
+bool AP_Param::_key_index_ready;
+#endif
+
 // write a sentinal value at the given offset
 void AP_Param::write_sentinal(uint16_t ofs)
 {
@@ -327,6 +342,19 @@ bool AP_Param::setup(void)
         erase_all();
     }
 
+#if AP_PARAM_INDEX_ENABLED
+    // storage keys are unique, so each can only match one variable
+    for (uint16_t k=0; k<ARRAY_SIZE(_key_vindex); k++) {
+        _key_vindex[k] = 0xFFFF;
+    }
+    for (uint16_t i=0; i<_num_vars; i++) {
+        if (_var_info[i].key < ARRAY_SIZE(_key_vindex)) {
+            _key_vindex[_var_info[i].key] = i;
+        }
+    }
+    _key_index_ready = true;
+#endif
+
     return true;
 }
 
@@ -435,8 +463,21 @@ const struct AP_Param::Info *AP_Param::find_by_header_group(struct Param_header
 // return the Info structure and a pointer to the variables storage
 const struct AP_Param::Info *AP_Param::find_by_header(struct Param_header phdr, void **ptr)
 {
+    uint16_t start = 0;
+    uint16_t end = _num_vars;
+#if AP_PARAM_INDEX_ENABLED
+    if (_key_index_ready) {
+        // only the variable with this key can match
+        start = _key_vindex[get_key(phdr)];
+        if (start >= _num_vars) {
+            return nullptr;
+        }
+        end = start + 1;
+    }
+#endif
+
     // loop over all named variables
-    for (uint16_t i=0; i<_num_vars; i++) {
+    for (uint16_t i=start; i<end; i++) {
         uint8_t type = _var_info[i].type;
         uint16_t key = _var_info[i].key;
         if (key != get_key(phdr)) {
@@ -539,6 +580,27 @@ const struct AP_Param::Info *AP_Param::find_var_info(uint32_t *
                                                      const struct GroupInfo *   &group_ret,
                                                      struct GroupNesting        &group_nesting,
                                                      uint8_t *                  idx) const
+{
+#if AP_PARAM_INDEX_ENABLED
+    ParamToken token {};
+    uint16_t vindex;
+    if (index_find_vindex(vindex)) {
+        token.key = vindex;
+        const struct AP_Param::Info *info = find_var_info_token(token, group_element, group_ret, group_nesting, idx);
+        if (info != nullptr) {
+            return info;
+        }
+        group_nesting.level = 0;
+    }
+#endif
+    return find_var_info_unindexed(group_element, group_ret, group_nesting, idx);
+}
+
+// find the info structure for a variable, searching the whole tree
+const struct AP_Param::Info *AP_Param::find_var_info_unindexed(uint32_t *                 group_element,
+                                                               const struct GroupInfo *   &group_ret,
+                                                               struct GroupNesting        &group_nesting,
+                                                               uint8_t *                  idx) const
 {
     group_ret = nullptr;
     
@@ -839,6 +901,31 @@ AP_Param::find_group(const char *name, uint16_t vindex, ptrdiff_t group_offset,
 //
 AP_Param *
 AP_Param::find(const char *name, enum ap_var_type *ptype, uint16_t *flags)
+{
+    AP_Param *ap = nullptr;
+#if AP_PARAM_INDEX_ENABLED
+    ap = index_find(name, ptype);
+#endif
+    if (ap == nullptr) {
+        ap = find_unindexed(name, ptype);
+    }
+    if (ap != nullptr && flags != nullptr) {
+        uint32_t group_element = 0;
+        const struct GroupInfo *ginfo;
+        struct GroupNesting group_nesting {};
+        uint8_t idx;
+        ap->find_var_info(&group_element, ginfo, group_nesting, &idx);
+        if (ginfo != nullptr) {
+            *flags = ginfo->flags;
+        }
+    }
+    return ap;
+}
+
+// Find a variable by name, searching the whole tree
+//
+AP_Param *
+AP_Param::find_unindexed(const char *name, enum ap_var_type *ptype)
 {
     for (uint16_t i=0; i<_num_vars; i++) {
         uint8_t type = _var_info[i].type;
@@ -853,16 +940,6 @@ AP_Param::find(const char *name, enum ap_var_type *ptype, uint16_t *flags)
             }
             AP_Param *ap = find_group(name + len, i, 0, group_info, ptype);
             if (ap != nullptr) {
-                if (flags != nullptr) {
-                    uint32_t group_element = 0;
-                    const struct GroupInfo *ginfo;
-                    struct GroupNesting group_nesting {};
-                    uint8_t idx;
-                    ap->find_var_info(&group_element, ginfo, group_nesting, &idx);
-                    if (ginfo != nullptr) {
-                        *flags = ginfo->flags;
-                    }
-                }
                 return ap;
             }
             // we continue looking as we want to allow top level
@@ -880,11 +957,27 @@ AP_Param::find(const char *name, enum ap_var_type *ptype, uint16_t *flags)
     return nullptr;
 }
 
-// Find a variable by index. Note that this is quite slow.
+// Find a variable by index. Note that this is quite slow without the index.
 //
 AP_Param *
 AP_Param::find_by_index(uint16_t idx, enum ap_var_type *ptype, ParamToken *token)
 {
+#if AP_PARAM_INDEX_ENABLED
+    {
+        WITH_SEMAPHORE(_index_sem);
+        if (index_update()) {
+            if (idx >= _index_scalar_count) {
+                return nullptr;
+            }
+            const struct index_entry &e = _index[_index_scalar[idx].pos];
+            *token = _index_scalar[idx].token;
+            if (ptype != nullptr) {
+                *ptype = e.type;
+            }
+            return e.ap;
+        }
+    }
+#endif
     AP_Param *ap;
     uint16_t count=0;
     for (ap=AP_Param::first(token, ptype);
@@ -980,6 +1073,173 @@ AP_Param::find_object(const char *name)
     return nullptr;
 }
 
+#if AP_PARAM_INDEX_ENABLED
+/*
+  FNV-1a hash of a parameter name
+ */
+uint32_t AP_Param::name_hash(const char *name)
+{
+    uint32_t hash = 2166136261U;
+    for (uint8_t i=0; i<AP_MAX_NAME_SIZE && name[i]; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619U;
+    }
+    return hash;
+}
+
+int AP_Param::index_compare_name(const void *a, const void *b)
+{
+    const uint32_t h1 = _index[*(const uint16_t *)a].name_hash;
+    const uint32_t h2 = _index[*(const uint16_t *)b].name_hash;
+    return h1 < h2 ? -1 : (h1 > h2 ? 1 : 0);
+}
+
+int AP_Param::index_compare_ptr(const void *a, const void *b)
+{
+    const ptrdiff_t p1 = (ptrdiff_t)_index[*(const uint16_t *)a].ap;
+    const ptrdiff_t p2 = (ptrdiff_t)_index[*(const uint16_t *)b].ap;
+    return p1 < p2 ? -1 : (p1 > p2 ? 1 : 0);
+}
+
+/*
+  rebuild the lookup index if it has been invalidated. Must be called
+  with _index_sem held. Returns false if the index can't be used
+ */
+bool AP_Param::index_update(void)
+{
+    if (_index_valid) {
+        return true;
+    }
+
+    ParamToken token;
+    enum ap_var_type type;
+    AP_Param *ap;
+    uint16_t count = 0;
+    for (ap = first(&token, &type); ap != nullptr; ap = next(&token, &type)) {
+        count++;
+    }
+
+    if (count > _index_size) {
+        delete[] _index;
+        delete[] _index_by_name;
+        delete[] _index_by_ptr;
+        delete[] _index_scalar;
+        // leave room for dynamic objects that turn up later
+        _index_size = count + count/8;
+        _index = new index_entry[_index_size];
+        _index_by_name = new uint16_t[_index_size];
+        _index_by_ptr = new uint16_t[_index_size];
+        _index_scalar = new index_scalar[_index_size];
+        if (_index == nullptr || _index_by_name == nullptr ||
+            _index_by_ptr == nullptr || _index_scalar == nullptr) {
+            _index_size = 0;
+            return false;
+        }
+    }
+
+    _index_count = 0;
+    for (ap = first(&token, &type);
+         ap != nullptr && _index_count < count;
+         ap = next(&token, &type)) {
+        struct index_entry &e = _index[_index_count];
+        ap->copy_name_token(token, e.name, sizeof(e.name), type != AP_PARAM_VECTOR3F);
+        e.name[AP_MAX_NAME_SIZE] = 0;
+        e.name_hash = name_hash(e.name);
+        e.token = token;
+        e.ap = ap;
+        e.type = type;
+        _index_by_name[_index_count] = _index_count;
+        _index_by_ptr[_index_count] = _index_count;
+        _index_count++;
+    }
+
+    // next_scalar() returns a subset of next() in the same order,
+    // though the token it returns for a disabled enable parameter
+    // points at the end of the hidden subtree
+    _index_scalar_count = 0;
+    uint16_t pos = 0;
+    for (ap = first(&token, &type); ap != nullptr; ap = next_scalar(&token, &type)) {
+        while (pos < _index_count &&
+               (_index[pos].ap != ap || _index[pos].type == AP_PARAM_VECTOR3F)) {
+            pos++;
+        }
+        if (pos == _index_count) {
+            break;
+        }
+        _index_scalar[_index_scalar_count].token = token;
+        _index_scalar[_index_scalar_count].pos = pos;
+        _index_scalar_count++;
+    }
+
+    qsort(_index_by_name, _index_count, sizeof(_index_by_name[0]), index_compare_name);
+    qsort(_index_by_ptr, _index_count, sizeof(_index_by_ptr[0]), index_compare_ptr);
+
+    _index_valid = true;
+    return true;
+}
+
+/*
+  find a variable by name using the index
+ */
+AP_Param *AP_Param::index_find(const char *name, enum ap_var_type *ptype)
+{
+    WITH_SEMAPHORE(_index_sem);
+    if (!index_update()) {
+        return nullptr;
+    }
+    const uint32_t hash = name_hash(name);
+    uint16_t lo = 0, hi = _index_count;
+    while (lo < hi) {
+        const uint16_t mid = (lo + hi) / 2;
+        if (_index[_index_by_name[mid]].name_hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (; lo < _index_count; lo++) {
+        const struct index_entry &e = _index[_index_by_name[lo]];
+        if (e.name_hash != hash) {
+            break;
+        }
+        if (e.token.idx != 0 && _var_info[e.token.key].type != AP_PARAM_GROUP) {
+            // the tree only finds the elements of vectors in groups
+            continue;
+        }
+        // hashes may collide
+        if (strncmp(name, e.name, AP_MAX_NAME_SIZE) == 0) {
+            *ptype = e.type;
+            return e.ap;
+        }
+    }
+    return nullptr;
+}
+
+/*
+  find the _var_info index of this variable using the index
+ */
+bool AP_Param::index_find_vindex(uint16_t &vindex) const
+{
+    WITH_SEMAPHORE(_index_sem);
+    if (!index_update()) {
+        return false;
+    }
+    uint16_t lo = 0, hi = _index_count;
+    while (lo < hi) {
+        const uint16_t mid = (lo + hi) / 2;
+        if ((ptrdiff_t)_index[_index_by_ptr[mid]].ap < (ptrdiff_t)this) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == _index_count || _index[_index_by_ptr[lo]].ap != this) {
+        return false;
+    }
+    vindex = _index[_index_by_ptr[lo]].token.key;
+    return true;
+}
+#endif // AP_PARAM_INDEX_ENABLED
+
 // notify GCS of current value of parameter
 void AP_Param::notify() const {
     uint32_t group_element = 0;
@@ -1046,7 +1306,7 @@ void AP_Param::save_sync(bool force_save)
 
     if (phdr.type == AP_PARAM_INT8 && ginfo != nullptr && (ginfo->flags & AP_PARAM_FLAG_ENABLE)) {
         // clear cached parameter count
-        _parameter_count = 0;
+        invalidate_count();
     }
     
     char name[AP_MAX_NAME_SIZE+1];
@@ -1313,6 +1573,10 @@ void AP_Param::set_value(enum ap_var_type type, void *ptr, float value)
 // in the objects constructor
 void AP_Param::setup_object_defaults(const void *object_pointer, const struct GroupInfo *group_info)
 {
+#if AP_PARAM_INDEX_ENABLED
+    // this may be a new dynamically allocated object
+    _index_valid = false;
+#endif
     ptrdiff_t base = (ptrdiff_t)object_pointer;
     uint8_t type;
     for (uint8_t i=0;
@@ -1388,6 +1652,8 @@ bool AP_Param::load_all()
         if (is_sentinal(phdr)) {
             // we've reached the sentinal
             sentinal_offset = ofs;
+            // enable parameters may have changed
+            invalidate_count();
             return true;
         }
 
@@ -1448,7 +1714,7 @@ void AP_Param::load_object_from_eeprom(const void *object_pointer, const struct
     uint16_t key;
 
     // reset cached param counter as we may be loading a dynamic var_info
-    _parameter_count = 0;
+    invalidate_count();
     
     if (!find_key_by_pointer(object_pointer, key)) {
         hal.console->printf("ERROR: Unable to find param pointer\n");
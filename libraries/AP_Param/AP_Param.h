@@ -42,6 +42,14 @@
 #define AP_PARAM_MAX_EMBEDDED_PARAM 8192
 #endif
 
+/*
+  enable the parameter lookup index. This trades some RAM for fast
+  lookup of parameters by name, index, pointer and storage key
+ */
+#ifndef AP_PARAM_INDEX_ENABLED
+#define AP_PARAM_INDEX_ENABLED (CONFIG_HAL_BOARD == HAL_BOARD_SITL || CONFIG_HAL_BOARD == HAL_BOARD_LINUX)
+#endif
+
 /*
   flags for variables in var_info and group tables
  */
@@ -140,6 +148,8 @@ enum ap_var_type {
 ///
 class AP_Param
 {
+    friend class AP_Param_Test;
+
 public:
     // the Info and GroupInfo structures are passed by the main
     // program in setup() to give information on how variables are
@@ -440,14 +450,26 @@ public:
     // count of parameters in tree
     static uint16_t count_parameters(void);
 
-    static void set_hide_disabled_groups(bool value) { _hide_disabled_groups = value; }
+    static void set_hide_disabled_groups(bool value) {
+        invalidate_count();
+        _hide_disabled_groups = value;
+    }
 
     // set frame type flags. Used to unhide frame specific parameters
     static void set_frame_type_flags(uint16_t flags_to_set) {
-        _parameter_count = 0;
+        invalidate_count();
         _frame_type_flags |= flags_to_set;
     }
 
+    // forget the cached parameter count and lookup index. Called
+    // when the set of visible parameters may have changed
+    static void invalidate_count(void) {
+        _parameter_count = 0;
+#if AP_PARAM_INDEX_ENABLED
+        _index_valid = false;
+#endif
+    }
+
     // check if a given frame type should be included
     static bool check_frame_type(uint16_t flags);
 
@@ -555,6 +577,11 @@ private:
                                     const struct GroupInfo *  &group_ret,
                                     struct GroupNesting       &group_nesting,
                                     uint8_t *                 idx) const;
+    const struct Info *         find_var_info_unindexed(
+                                    uint32_t *                group_element,
+                                    const struct GroupInfo *  &group_ret,
+                                    struct GroupNesting       &group_nesting,
+                                    uint8_t *                 idx) const;
     const struct Info *			find_var_info_token(const ParamToken &token,
                                                     uint32_t *                 group_element,
                                                     const struct GroupInfo *  &group_ret,
@@ -574,6 +601,7 @@ private:
                                     char *buffer,
                                     size_t buffer_size,
                                     uint8_t idx) const;
+    static AP_Param *           find_unindexed(const char *name, enum ap_var_type *ptype);
     static AP_Param *           find_group(
                                     const char *name,
                                     uint16_t vindex,
@@ -649,6 +677,47 @@ private:
 
     static bool _hide_disabled_groups;
 
+#if AP_PARAM_INDEX_ENABLED
+    /*
+      lookup index over all parameters, built on first use and
+      rebuilt after invalidate_count(). Objects holding parameters
+      are never freed, and new ones call setup_object_defaults(), so
+      entries stay valid until the index is rebuilt. Names that
+      aren't in the index are still looked for in the tree
+     */
+    struct index_entry {
+        uint32_t name_hash;
+        ParamToken token;
+        AP_Param *ap;
+        enum ap_var_type type;
+        char name[AP_MAX_NAME_SIZE+1];
+    };
+    struct index_scalar {
+        ParamToken token;                   // as returned by next_scalar()
+        uint16_t pos;
+    };
+    static struct index_entry *_index;      // entries in next() order
+    static uint16_t *_index_by_name;        // _index positions sorted by name_hash
+    static uint16_t *_index_by_ptr;         // _index positions sorted by ap
+    static struct index_scalar *_index_scalar; // in next_scalar() order
+    static uint16_t _index_count;
+    static uint16_t _index_scalar_count;
+    static uint16_t _index_size;            // number of entries allocated
+    static bool _index_valid;
+    static HAL_Semaphore _index_sem;
+
+    // _var_info index for each storage key, built by setup()
+    static uint16_t _key_vindex[_sentinal_key+1];
+    static bool _key_index_ready;
+
+    static uint32_t name_hash(const char *name);
+    static int index_compare_name(const void *a, const void *b);
+    static int index_compare_ptr(const void *a, const void *b);
+    static bool index_update(void);
+    static AP_Param *index_find(const char *name, enum ap_var_type *ptype);
+    bool index_find_vindex(uint16_t &vindex) const;
+#endif
+
     // support for background saving of parameters. We pack it to reduce memory for the
     // queue
     struct PACKED param_save {
@@ -0,0 +1,144 @@
+#include <AP_gbenchmark.h>
+
+#include <AP_HAL/AP_HAL.h>
+#include <AP_Math/AP_Math.h>
+#include <AP_Param/AP_Param.h>
+
+/*
+  cost of fetching the whole parameter list as a GCS does with
+  PARAM_REQUEST_LIST, of finding each parameter by name and of
+  load_all(), for a tree of roughly the size of a vehicle's. Build
+  with AP_PARAM_INDEX_ENABLED=0 to compare against the tree walk
+ */
+
+const AP_HAL::HAL &hal = AP_HAL::get_HAL();
+
+class BenchInner {
+public:
+    static const struct AP_Param::GroupInfo var_info[];
+    AP_Float a, b;
+    AP_Int8 c;
+    BenchInner() { AP_Param::setup_object_defaults(this, var_info); }
+};
+
+const AP_Param::GroupInfo BenchInner::var_info[] = {
+    AP_GROUPINFO("A", 1, BenchInner, a, 1.5f),
+    AP_GROUPINFO("B", 2, BenchInner, b, 2.5f),
+    AP_GROUPINFO("C", 3, BenchInner, c, 3),
+    AP_GROUPEND
+};
+
+class BenchGroup {
+public:
+    static const struct AP_Param::GroupInfo var_info[];
+    AP_Int8 enable;
+    AP_Float p[30];
+    AP_Vector3f v;
+    BenchInner inner;
+    BenchGroup() { AP_Param::setup_object_defaults(this, var_info); }
+};
+
+#define P(i) AP_GROUPINFO("P" #i, i+1, BenchGroup, p[i], i)
+const AP_Param::GroupInfo BenchGroup::var_info[] = {
+    AP_GROUPINFO_FLAGS("ENABLE", 0, BenchGroup, enable, 1, AP_PARAM_FLAG_ENABLE),
+    P(0),  P(1),  P(2),  P(3),  P(4),  P(5),  P(6),  P(7),  P(8),  P(9),
+    P(10), P(11), P(12), P(13), P(14), P(15), P(16), P(17), P(18), P(19),
+    P(20), P(21), P(22), P(23), P(24), P(25), P(26), P(27), P(28), P(29),
+    AP_GROUPINFO("V", 40, BenchGroup, v, 0),
+    AP_SUBGROUPINFO(inner, "IN_", 41, BenchGroup, BenchInner),
+    AP_GROUPEND
+};
+#undef P
+
+static AP_Int16 format_version;
+static BenchGroup groups[26];
+
+#define G(i, name) { AP_PARAM_GROUP, name, i+1, &groups[i], {group_info : BenchGroup::var_info} }
+static const AP_Param::Info var_info[] = {
+    { AP_PARAM_INT16, "FORMAT_VERSION", 0, &format_version, {def_value : 0} },
+    G(0, "GA_"),  G(1, "GB_"),  G(2, "GC_"),  G(3, "GD_"),  G(4, "GE_"),
+    G(5, "GF_"),  G(6, "GG_"),  G(7, "GH_"),  G(8, "GI_"),  G(9, "GJ_"),
+    G(10, "GK_"), G(11, "GL_"), G(12, "GM_"), G(13, "GN_"), G(14, "GO_"),
+    G(15, "GP_"), G(16, "GQ_"), G(17, "GR_"), G(18, "GS_"), G(19, "GT_"),
+    G(20, "GU_"), G(21, "GV_"), G(22, "GW_"), G(23, "GX_"), G(24, "GY_"),
+    G(25, "GZ_"),
+    AP_VAREND
+};
+#undef G
+
+static AP_Param param_loader(var_info);
+
+static uint16_t num_params;
+static char names[1200][AP_MAX_NAME_SIZE+1];
+
+static void setup_params(void)
+{
+    static bool done;
+    if (done) {
+        return;
+    }
+    done = true;
+
+    hal.storage->init();
+    AP_Param::setup();
+
+    // a few saved values in each group, for load_all() to find
+    for (uint8_t i=0; i<ARRAY_SIZE(groups); i++) {
+        groups[i].p[i].set(100+i);
+        groups[i].p[i].save_sync(true);
+        groups[i].inner.b.set(200+i);
+        groups[i].inner.b.save_sync(true);
+        groups[i].v.set(Vector3f(i, i, i));
+        groups[i].v.save_sync(true);
+    }
+
+    AP_Param::ParamToken token;
+    enum ap_var_type type;
+    for (AP_Param *ap = AP_Param::first(&token, &type);
+         ap && num_params < ARRAY_SIZE(names);
+         ap = AP_Param::next_scalar(&token, &type)) {
+        ap->copy_name_token(token, names[num_params], sizeof(names[0]), true);
+        num_params++;
+    }
+}
+
+static void BM_ParamFetchByIndex(benchmark::State& state)
+{
+    setup_params();
+    while (state.KeepRunning()) {
+        for (uint16_t i=0; i<num_params; i++) {
+            AP_Param::ParamToken token;
+            enum ap_var_type type;
+            AP_Param *ap = AP_Param::find_by_index(i, &type, &token);
+            char name[AP_MAX_NAME_SIZE+1];
+            ap->copy_name_token(token, name, sizeof(name), true);
+            gbenchmark_escape(name);
+        }
+    }
+}
+
+static void BM_ParamFindByName(benchmark::State& state)
+{
+    setup_params();
+    while (state.KeepRunning()) {
+        for (uint16_t i=0; i<num_params; i++) {
+            enum ap_var_type type;
+            AP_Param *ap = AP_Param::find(names[i], &type);
+            gbenchmark_escape(ap);
+        }
+    }
+}
+
+static void BM_ParamLoadAll(benchmark::State& state)
+{
+    setup_params();
+    while (state.KeepRunning()) {
+        AP_Param::load_all();
+    }
+}
+
+BENCHMARK(BM_ParamFetchByIndex);
+BENCHMARK(BM_ParamFindByName);
+BENCHMARK(BM_ParamLoadAll);
+
+BENCHMARK_MAIN()
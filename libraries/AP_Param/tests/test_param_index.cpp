@@ -0,0 +1,332 @@
+#include <AP_gtest.h>
+
+#include <ctype.h>
+#include <string.h>
+
+#include <AP_HAL/AP_HAL.h>
+#include <AP_Math/AP_Math.h>
+#include <AP_Param/AP_Param.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+/*
+  a small parameter tree with subgroups, a group behind a pointer,
+  vectors, frame specific parameters and groups with an enable
+  parameter, to check the lookups done through the index against a
+  walk of the tree
+ */
+class ParamTestInner {
+public:
+    static const struct AP_Param::GroupInfo var_info[];
+    AP_Float a;
+    AP_Int16 b;
+    AP_Vector3f v;
+    ParamTestInner() { AP_Param::setup_object_defaults(this, var_info); }
+};
+
+const AP_Param::GroupInfo ParamTestInner::var_info[] = {
+    AP_GROUPINFO("A", 1, ParamTestInner, a, 1.5f),
+    AP_GROUPINFO("B", 2, ParamTestInner, b, 2),
+    AP_GROUPINFO("V", 3, ParamTestInner, v, 0),
+    AP_GROUPEND
+};
+
+class ParamTestGroup {
+public:
+    static const struct AP_Param::GroupInfo var_info[];
+    AP_Int8 enable;
+    AP_Float p;
+    AP_Int32 copter;
+    AP_Float plane;
+    ParamTestInner inner;
+    ParamTestInner *dynamic;
+    ParamTestGroup() { AP_Param::setup_object_defaults(this, var_info); }
+};
+
+const AP_Param::GroupInfo ParamTestGroup::var_info[] = {
+    AP_GROUPINFO_FLAGS("ENABLE", 0, ParamTestGroup, enable, 1, AP_PARAM_FLAG_ENABLE),
+    AP_GROUPINFO("P", 1, ParamTestGroup, p, 0.5f),
+    AP_GROUPINFO_FRAME("COPTER", 2, ParamTestGroup, copter, 7, AP_PARAM_FRAME_COPTER),
+    AP_GROUPINFO_FRAME("PLANE", 3, ParamTestGroup, plane, 8, AP_PARAM_FRAME_PLANE),
+    AP_SUBGROUPINFO(inner, "IN_", 4, ParamTestGroup, ParamTestInner),
+    AP_SUBGROUPPTR(dynamic, "DY_", 5, ParamTestGroup, ParamTestInner),
+    AP_GROUPEND
+};
+
+static AP_Int16 format_version;
+static AP_Float top_float;
+static AP_Vector3f top_vector;
+static AP_Float top_prefixed;
+static ParamTestGroup group_a;
+static ParamTestGroup group_b;
+
+static const AP_Param::Info var_info[] = {
+    { AP_PARAM_INT16, "FORMAT_VERSION", 0, &format_version, {def_value : 0} },
+    { AP_PARAM_FLOAT, "TOP_F", 1, &top_float, {def_value : 1.0f} },
+    { AP_PARAM_VECTOR3F, "TOP_V", 2, &top_vector, {def_value : 0} },
+    { AP_PARAM_GROUP, "GA_", 3, &group_a, {group_info : ParamTestGroup::var_info} },
+    { AP_PARAM_GROUP, "GB_", 4, &group_b, {group_info : ParamTestGroup::var_info} },
+    // shares its prefix with the group before it
+    { AP_PARAM_FLOAT, "GA_X", 5, &top_prefixed, {def_value : 3.0f} },
+    AP_VAREND
+};
+
+static AP_Param param_loader(var_info);
+
+/*
+  reach into AP_Param for the tree walks the index replaces
+ */
+class AP_Param_Test {
+public:
+    static void setup() {
+        static bool done;
+        if (done) {
+            return;
+        }
+        done = true;
+        hal.storage->init();
+        ASSERT_TRUE(AP_Param::setup());
+    }
+
+    // restore the visibility of parameters changed by a test
+    static void reset() {
+        AP_Param::set_hide_disabled_groups(true);
+        AP_Param::_frame_type_flags = 0;
+        AP_Param::invalidate_count();
+        group_a.enable.set(1);
+        group_b.enable.set(1);
+    }
+
+    static AP_Param *find_unindexed(const char *name, enum ap_var_type *ptype) {
+        return AP_Param::find_unindexed(name, ptype);
+    }
+
+    // find_by_index() as it was before the index
+    static AP_Param *find_by_index_unindexed(uint16_t idx, enum ap_var_type *ptype, AP_Param::ParamToken *token) {
+        AP_Param *ap;
+        uint16_t count = 0;
+        for (ap = AP_Param::first(token, ptype);
+             ap && count < idx;
+             ap = AP_Param::next_scalar(token, ptype)) {
+            count++;
+        }
+        return ap;
+    }
+
+    // true if find_by_index() returns the parameter
+    static bool listed(const AP_Param *ap) {
+        AP_Param::ParamToken token;
+        enum ap_var_type type;
+        for (uint16_t i=0; i<1000; i++) {
+            const AP_Param *found = AP_Param::find_by_index(i, &type, &token);
+            if (found == nullptr) {
+                break;
+            }
+            if (found == ap) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void check_var_info(const AP_Param *ap) {
+        uint32_t group_element = 0, group_element2 = 0;
+        const AP_Param::GroupInfo *ginfo, *ginfo2;
+        AP_Param::GroupNesting nesting {}, nesting2 {};
+        uint8_t idx = 0, idx2 = 0;
+        const AP_Param::Info *info = ap->find_var_info(&group_element, ginfo, nesting, &idx);
+        const AP_Param::Info *info2 = ap->find_var_info_unindexed(&group_element2, ginfo2, nesting2, &idx2);
+        ASSERT_NE(info2, nullptr);
+        EXPECT_EQ(info, info2);
+        EXPECT_EQ(group_element, group_element2);
+        EXPECT_EQ(ginfo, ginfo2);
+        EXPECT_EQ(idx, idx2);
+        ASSERT_EQ(nesting.level, nesting2.level);
+        for (uint8_t i=0; i<nesting.level; i++) {
+            EXPECT_EQ(nesting.group_ret[i], nesting2.group_ret[i]);
+        }
+    }
+
+    // look up a parameter by the header it is saved with, with and
+    // without the per-key index
+    static void check_by_header(const AP_Param *ap, enum ap_var_type type) {
+        uint32_t group_element = 0;
+        const AP_Param::GroupInfo *ginfo;
+        AP_Param::GroupNesting nesting {};
+        uint8_t idx = 0;
+        const AP_Param::Info *info = ap->find_var_info_unindexed(&group_element, ginfo, nesting, &idx);
+        ASSERT_NE(info, nullptr);
+
+        AP_Param::Param_header phdr {};
+        phdr.type = type;
+        AP_Param::set_key(phdr, info->key);
+        phdr.group_element = group_element;
+
+        void *ptr = nullptr, *ptr2 = nullptr;
+        const AP_Param::Info *found = AP_Param::find_by_header(phdr, &ptr);
+        AP_Param::_key_index_ready = false;
+        const AP_Param::Info *found2 = AP_Param::find_by_header(phdr, &ptr2);
+        AP_Param::_key_index_ready = true;
+        EXPECT_EQ(found, info);
+        EXPECT_EQ(found, found2);
+        EXPECT_EQ(ptr, ptr2);
+        EXPECT_EQ(ptr, (const void *)ap);
+
+        // the wrong type or an unused key matches nothing either way
+        phdr.type = type == AP_PARAM_FLOAT ? AP_PARAM_INT32 : AP_PARAM_FLOAT;
+        EXPECT_EQ(AP_Param::find_by_header(phdr, &ptr), nullptr);
+        AP_Param::set_key(phdr, 200);
+        EXPECT_EQ(AP_Param::find_by_header(phdr, &ptr), nullptr);
+        AP_Param::_key_index_ready = false;
+        EXPECT_EQ(AP_Param::find_by_header(phdr, &ptr), nullptr);
+        AP_Param::_key_index_ready = true;
+    }
+
+    // check every lookup for every parameter currently in the tree
+    static void check_all() {
+        AP_Param::ParamToken token;
+        enum ap_var_type type;
+        uint16_t count = 0;
+        for (AP_Param *ap = AP_Param::first(&token, &type);
+             ap != nullptr;
+             ap = AP_Param::next(&token, &type)) {
+            char name[AP_MAX_NAME_SIZE+1];
+            ap->copy_name_token(token, name, sizeof(name), type != AP_PARAM_VECTOR3F);
+            SCOPED_TRACE(name);
+
+            enum ap_var_type type1, type2;
+            uint16_t flags = 0;
+            AP_Param *found = AP_Param::find(name, &type1, &flags);
+            EXPECT_EQ(found, find_unindexed(name, &type2));
+            if (token.idx != 0 && var_info[token.key].type != AP_PARAM_GROUP) {
+                // nor does the tree find the elements of a top level vector
+                EXPECT_EQ(found, nullptr);
+                count++;
+                continue;
+            }
+            EXPECT_EQ(found, ap);
+            EXPECT_EQ(type1, type2);
+            EXPECT_EQ(type1, type);
+
+            uint32_t group_element;
+            const AP_Param::GroupInfo *ginfo;
+            AP_Param::GroupNesting nesting {};
+            uint8_t idx;
+            ap->find_var_info_unindexed(&group_element, ginfo, nesting, &idx);
+            EXPECT_EQ(flags, ginfo != nullptr ? ginfo->flags : 0);
+
+            // names the index doesn't hold are still found in the tree
+            char lower[AP_MAX_NAME_SIZE+1];
+            for (uint8_t i=0; i<sizeof(lower); i++) {
+                lower[i] = tolower(name[i]);
+            }
+            EXPECT_EQ(AP_Param::find(lower, &type1), find_unindexed(lower, &type2));
+
+            check_var_info(ap);
+            if (token.idx == 0) {
+                check_by_header(ap, type);
+            }
+            count++;
+        }
+        EXPECT_GT(count, 0);
+
+        enum ap_var_type type1;
+        EXPECT_EQ(AP_Param::find("GA_NONE", &type1), nullptr);
+        EXPECT_EQ(AP_Param::find("", &type1), nullptr);
+
+        // find_by_index() in next_scalar() order, ending at the count
+        for (uint16_t i=0; ; i++) {
+            AP_Param::ParamToken token1 {}, token2 {};
+            enum ap_var_type type2;
+            AP_Param *ap1 = AP_Param::find_by_index(i, &type1, &token1);
+            AP_Param *ap2 = find_by_index_unindexed(i, &type2, &token2);
+            EXPECT_EQ(ap1, ap2) << "index " << i;
+            if (ap1 == nullptr || ap2 == nullptr) {
+                EXPECT_EQ(i, AP_Param::count_parameters());
+                break;
+            }
+            EXPECT_EQ(type1, type2) << "index " << i;
+            EXPECT_EQ(token1.key, token2.key) << "index " << i;
+            EXPECT_EQ(token1.group_element, token2.group_element) << "index " << i;
+            EXPECT_EQ(token1.idx, token2.idx) << "index " << i;
+        }
+    }
+};
+
+TEST(AP_Param, IndexMatchesTreeWalk)
+{
+    AP_Param_Test::setup();
+    AP_Param_Test::reset();
+    AP_Param_Test::check_all();
+}
+
+TEST(AP_Param, IndexHidesDisabledGroups)
+{
+    AP_Param_Test::setup();
+    AP_Param_Test::reset();
+
+    AP_Param_Test::check_all();
+    const uint16_t count = AP_Param::count_parameters();
+    EXPECT_TRUE(AP_Param_Test::listed(&group_a.p));
+
+    // saving an enable parameter changes what next_scalar() returns
+    group_a.enable.set(0);
+    group_a.enable.save_sync();
+    AP_Param_Test::check_all();
+    EXPECT_LT(AP_Param::count_parameters(), count);
+    EXPECT_TRUE(AP_Param_Test::listed(&group_a.enable));
+    EXPECT_FALSE(AP_Param_Test::listed(&group_a.p));
+    EXPECT_TRUE(AP_Param_Test::listed(&group_b.p));
+
+    AP_Param::set_hide_disabled_groups(false);
+    AP_Param_Test::check_all();
+    EXPECT_EQ(AP_Param::count_parameters(), count);
+
+    AP_Param::set_hide_disabled_groups(true);
+    group_a.enable.set(1);
+    group_a.enable.save_sync();
+    AP_Param_Test::check_all();
+    EXPECT_EQ(AP_Param::count_parameters(), count);
+    EXPECT_TRUE(AP_Param_Test::listed(&group_a.p));
+
+    AP_Param_Test::reset();
+}
+
+TEST(AP_Param, IndexFrameTypeFlags)
+{
+    AP_Param_Test::setup();
+    AP_Param_Test::reset();
+
+    AP_Param_Test::check_all();
+    const uint16_t count = AP_Param::count_parameters();
+    EXPECT_FALSE(AP_Param_Test::listed(&group_a.copter));
+
+    AP_Param::set_frame_type_flags(AP_PARAM_FRAME_COPTER);
+    AP_Param_Test::check_all();
+    EXPECT_EQ(AP_Param::count_parameters(), count + 2);
+    EXPECT_TRUE(AP_Param_Test::listed(&group_a.copter));
+    EXPECT_TRUE(AP_Param_Test::listed(&group_b.copter));
+    EXPECT_FALSE(AP_Param_Test::listed(&group_a.plane));
+
+    AP_Param_Test::reset();
+}
+
+TEST(AP_Param, IndexDynamicGroup)
+{
+    AP_Param_Test::setup();
+    AP_Param_Test::reset();
+
+    enum ap_var_type type;
+    EXPECT_EQ(AP_Param::find("GB_DY_A", &type), nullptr);
+
+    // a group that appears once the index has been built
+    group_b.dynamic = new ParamTestInner();
+    ASSERT_NE(group_b.dynamic, nullptr);
+    EXPECT_EQ(AP_Param::find("GB_DY_A", &type), &group_b.dynamic->a);
+    EXPECT_EQ((void *)AP_Param::find("GB_DY_V_Z", &type), (void *)&group_b.dynamic->v.get().z);
+    AP_Param_Test::check_all();
+
+    AP_Param_Test::reset();
+}
+
+AP_GTEST_MAIN()
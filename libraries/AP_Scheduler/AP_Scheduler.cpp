@@ -57,6 +57,23 @@ const AP_Param::GroupInfo AP_Scheduler::var_info[] = {
     // @User: Advanced
     AP_GROUPINFO("LOOP_RATE",  1, AP_Scheduler, _loop_rate_hz, SCHEDULER_DEFAULT_LOOP_RATE),
 
+    // @Param: OPTIONS
+    // @DisplayName: Scheduler options
+    // @Description: Scheduler options bitmask. When task profiling is enabled the scheduler keeps a runtime histogram, overrun and slip counts and the start delay of each task, and logs the worst tasks each second in the PMT message
+    // @Bitmask: 0:Task profiling
+    // @User: Advanced
+    AP_GROUPINFO("OPTIONS",  2, AP_Scheduler, _options, 0),
+
+#if HAL_SCHEDULER_THREADS
+    // @Param: THREADS
+    // @DisplayName: Scheduler worker threads
+    // @Description: Number of worker threads that run the tasks marked with a thread group in the vehicle task table, on Linux boards with more than one CPU. The main loop stays on the first CPU and each worker thread is pinned to its own. Zero runs all tasks on the main thread.
+    // @Range: 0 4
+    // @RebootRequired: True
+    // @User: Advanced
+    AP_GROUPINFO("THREADS",  3, AP_Scheduler, _threads, 0),
+#endif
+
     AP_GROUPEND
 };
 
@@ -106,6 +123,10 @@ void AP_Scheduler::init(const AP_Scheduler::Task *tasks, uint8_t num_tasks, uint
     perf_info.reset();
 
     _log_performance_bit = log_performance_bit;
+
+#if HAL_SCHEDULER_THREADS
+    start_threads();
+#endif
 }
 
 // one tick has passed
@@ -135,6 +156,14 @@ void AP_Scheduler::run(uint32_t time_available)
     uint32_t run_started_usec = AP_HAL::micros();
     uint32_t now = run_started_usec;
 
+    if ((_options & OPTION_TASK_PROFILING) && !perf_info.task_info_allocated()) {
+        perf_info.allocate_task_info(_num_tasks);
+    }
+
+#if HAL_SCHEDULER_THREADS
+    run_threaded_tasks();
+#endif
+
     if (_debug > 1 && _perf_counters == nullptr) {
         _perf_counters = new AP_HAL::Util::perf_counter_t[_num_tasks];
         if (_perf_counters != nullptr) {
@@ -145,6 +174,9 @@ void AP_Scheduler::run(uint32_t time_available)
     }
     
     for (uint8_t i=0; i<_num_tasks; i++) {
+        if (task_is_threaded(i)) {
+            continue;
+        }
         uint32_t dt = _tick_counter - _last_run[i];
         uint32_t interval_ticks = _loop_rate_hz / _tasks[i].rate_hz;
         if (interval_ticks < 1) {
@@ -165,6 +197,7 @@ void AP_Scheduler::run(uint32_t time_available)
                   (unsigned)dt,
                   (unsigned)interval_ticks,
                   (unsigned)_task_time_allowed);
+            perf_info.update_task_slip(i);
         }
 
         if (dt >= interval_ticks*max_task_slowdown) {
@@ -176,6 +209,7 @@ void AP_Scheduler::run(uint32_t time_available)
         if (_task_time_allowed > time_available) {
             // not enough time to run this task.  Continue loop -
             // maybe another task will fit into time remaining
+            _tasks_dropped++;
             continue;
         }
 
@@ -197,11 +231,22 @@ void AP_Scheduler::run(uint32_t time_available)
         // record the tick counter when we ran. This drives
         // when we next run the event
         _last_run[i] = _tick_counter;
+        _main_task_runs++;
 
         // work out how long the event actually took
         now = AP_HAL::micros();
         uint32_t time_taken = now - _task_time_started;
 
+        if (perf_info.task_info_allocated()) {
+            // the task was due interval_ticks after its last run, at
+            // the start of this run() if that is this tick
+            const uint32_t start_delay_us = (dt - interval_ticks) * get_loop_period_us() +
+                (_task_time_started - run_started_usec);
+            perf_info.update_task_info(i, MIN(time_taken, UINT16_MAX),
+                                       MIN(start_delay_us, UINT16_MAX),
+                                       time_taken > _task_time_allowed);
+        }
+
         if (time_taken > _task_time_allowed) {
             // the event overran!
             debug(3, "Scheduler overrun task[%u-%s] (%u/%u)\n",
@@ -212,6 +257,14 @@ void AP_Scheduler::run(uint32_t time_available)
         }
         if (time_taken >= time_available) {
             time_available = 0;
+            // the rest of the due tasks are dropped
+            for (uint8_t j=i+1; j<_num_tasks; j++) {
+                uint32_t interval_ticks = _loop_rate_hz / _tasks[j].rate_hz;
+                if (!task_is_threaded(j) &&
+                    (uint16_t)(_tick_counter - _last_run[j]) >= MAX(interval_ticks, 1U)) {
+                    _tasks_dropped++;
+                }
+            }
             break;
         }
         time_available -= time_taken;
@@ -339,15 +392,38 @@ void AP_Scheduler::loop()
 
 void AP_Scheduler::update_logging()
 {
+#if HAL_SCHEDULER_THREADS
+    // the workers update the task statistics
+    if (threads.num_workers > 0) {
+        pthread_mutex_lock(&threads.mtx);
+    }
+#endif
     if (debug_flags()) {
         perf_info.update_logging();
     }
     if (_log_performance_bit != (uint32_t)-1 &&
         AP::logger().should_log(_log_performance_bit)) {
         Log_Write_Performance();
+        Log_Write_Task_Performance();
+        Log_Write_Thread_Performance();
     }
     perf_info.set_loop_rate(get_loop_rate_hz());
     perf_info.reset();
+
+    _main_task_runs = 0;
+    _tasks_dropped = 0;
+    _last_logging_us = AP_HAL::micros();
+#if HAL_SCHEDULER_THREADS
+    if (threads.num_workers > 0) {
+        for (uint8_t i=0; i<threads.num_workers; i++) {
+            threads.worker[i].busy_us = 0;
+            threads.worker[i].runs = 0;
+            threads.worker[i].steals = 0;
+            threads.worker[i].drops = 0;
+        }
+        pthread_mutex_unlock(&threads.mtx);
+    }
+#endif
 }
 
 // Write a performance monitoring packet
@@ -372,6 +448,71 @@ void AP_Scheduler::Log_Write_Performance()
     AP::logger().WriteCriticalBlock(&pkt, sizeof(pkt));
 }
 
+// Write the statistics of the worst tasks since the last reset
+void AP_Scheduler::Log_Write_Task_Performance()
+{
+    uint8_t worst[3];
+    const uint8_t n = perf_info.get_worst_tasks(worst, ARRAY_SIZE(worst));
+    const uint64_t now = AP_HAL::micros64();
+    for (uint8_t i=0; i<n; i++) {
+        const uint8_t t = worst[i];
+        const AP::PerfInfo::TaskInfo *ti = perf_info.get_task_info(t);
+        struct log_PerfTask pkt = {
+            LOG_PACKET_HEADER_INIT(LOG_PERF_TASK_MSG),
+            time_us      : now,
+            rank         : i,
+            task         : t,
+            name         : {},
+            max_time     : ti->max_time_us,
+            avg_time     : (uint16_t)(ti->elapsed_time_us / ti->tick_count),
+            budget       : _tasks[t].max_time_micros,
+            num_overruns : ti->overrun_count,
+            num_slips    : ti->slip_count,
+            max_delay    : ti->max_start_delay_us,
+            num_runs     : ti->tick_count,
+            p95_time     : perf_info.get_task_time_percentile(t, 95),
+        };
+        strncpy(pkt.name, _tasks[t].name, sizeof(pkt.name));
+        AP::logger().WriteBlock(&pkt, sizeof(pkt));
+    }
+}
+
+// Write the utilisation of the main thread and the worker threads
+// since the last update_logging()
+void AP_Scheduler::Log_Write_Thread_Performance()
+{
+    const uint32_t now_us = AP_HAL::micros();
+    const float interval_s = (now_us - _last_logging_us) * 1.0e-6f;
+    if (_last_logging_us == 0 || interval_s <= 0) {
+        return;
+    }
+    const uint64_t time_us = AP_HAL::micros64();
+    const float drop_rate = _tasks_dropped / interval_s;
+
+    struct log_PerfThread pkt = {
+        LOG_PACKET_HEADER_INIT(LOG_PERF_THREAD_MSG),
+        time_us      : time_us,
+        core         : 0,
+        util         : (uint8_t)constrain_float(load_average() * 100, 0, 100),
+        num_runs     : _main_task_runs,
+        num_steals   : 0,
+        drop_rate    : drop_rate,
+    };
+    AP::logger().WriteBlock(&pkt, sizeof(pkt));
+
+#if HAL_SCHEDULER_THREADS
+    for (uint8_t i=0; i<threads.num_workers; i++) {
+        const auto &w = threads.worker[i];
+        pkt.core = i+1;
+        pkt.util = (uint8_t)constrain_float(w.busy_us * 1.0e-4f / interval_s, 0, 100);
+        pkt.num_runs = w.runs;
+        pkt.num_steals = w.steals;
+        pkt.drop_rate = w.drops / interval_s;
+        AP::logger().WriteBlock(&pkt, sizeof(pkt));
+    }
+#endif
+}
+
 namespace AP {
 
 AP_Scheduler &scheduler()
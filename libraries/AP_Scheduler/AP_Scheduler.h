@@ -25,6 +25,21 @@
 #include <AP_Math/AP_Math.h>
 #include "PerfInfo.h"       // loop perf monitoring
 
+/*
+  allow tasks marked with a thread group to run on worker threads
+ */
+#ifndef HAL_SCHEDULER_THREADS
+#define HAL_SCHEDULER_THREADS (CONFIG_HAL_BOARD == HAL_BOARD_LINUX)
+#endif
+
+#if HAL_SCHEDULER_THREADS
+#include <pthread.h>
+#endif
+
+// maximum number of worker threads and of thread groups
+#define AP_SCHEDULER_MAX_WORKERS 4
+#define AP_SCHEDULER_MAX_THREAD_GROUPS 8
+
 #define AP_SCHEDULER_NAME_INITIALIZER(_name) .name = #_name,
 
 /*
@@ -37,6 +52,20 @@
     .max_time_micros = _max_time_micros\
 }
 
+/*
+  a task that may run on a worker thread when SCHED_THREADS is set.
+  Tasks with the same thread group run one after the other in table
+  order, so tasks that share state should share a group. The task
+  must not touch state used by the main thread without locking
+ */
+#define SCHED_TASK_CLASS_THREAD(classname, classptr, func, _rate_hz, _max_time_micros, _thread_group) { \
+    .function = FUNCTOR_BIND(classptr, &classname::func, void),\
+    AP_SCHEDULER_NAME_INITIALIZER(func)\
+    .rate_hz = _rate_hz,\
+    .max_time_micros = _max_time_micros,\
+    .thread_group = _thread_group\
+}
+
 /*
   A task scheduler for APM main loops
 
@@ -72,6 +101,9 @@ public:
         const char *name;
         float rate_hz;
         uint16_t max_time_micros;
+        // zero for tasks that must run on the main thread, otherwise
+        // the group of tasks this one may run with on a worker thread
+        uint8_t thread_group;
     };
 
     // initialise scheduler
@@ -87,6 +119,13 @@ public:
     // write out PERF message to logger
     void Log_Write_Performance();
 
+    // write out PMT messages for the worst tasks to logger
+    void Log_Write_Task_Performance();
+
+    // write out PMTH messages with the utilisation of the main
+    // thread and of each worker thread
+    void Log_Write_Thread_Performance();
+
     // call when one tick has passed
     void tick(void);
 
@@ -160,6 +199,18 @@ private:
     // overall scheduling rate in Hz
     AP_Int16 _loop_rate_hz;
 
+    enum {
+        OPTION_TASK_PROFILING = (1U<<0),
+    };
+
+    // scheduler options bitmask
+    AP_Int8 _options;
+
+#if HAL_SCHEDULER_THREADS
+    // number of worker threads for tasks with a thread group
+    AP_Int8 _threads;
+#endif
+
     // loop rate in Hz as set at startup
     AP_Int16 _active_loop_rate_hz;
     
@@ -218,6 +269,64 @@ private:
     // extra time available for each loop - used to dynamically adjust
     // the loop rate in case we are well over budget
     uint32_t extra_loop_us;
+
+    // tasks run on the main thread and its tasks that were due but
+    // dropped, since the last update_logging()
+    uint32_t _main_task_runs;
+    uint32_t _tasks_dropped;
+    uint32_t _last_logging_us;
+
+#if HAL_SCHEDULER_THREADS
+    /*
+      worker threads for tasks with a thread group. The main thread
+      queues each group with due tasks on the worker the group belongs
+      to, and a worker with nothing queued steals from the other
+      workers. A group runs its tasks in table order on one worker,
+      and isn't queued again until it has finished
+     */
+    struct {
+        uint8_t num_workers;        // number of running worker threads
+        uint8_t started;            // number of worker threads that have taken an index
+        uint8_t busy_groups;        // bitmask of groups queued or running
+        bool *pending;              // tasks due to run in queued groups
+        struct {
+            // ring of queued groups, taken from the head by the
+            // worker and from the tail by thieves
+            uint8_t queue[AP_SCHEDULER_MAX_THREAD_GROUPS];
+            uint8_t head;
+            uint8_t count;
+            uint32_t busy_us;       // time spent running tasks
+            uint32_t runs;          // tasks run
+            uint32_t steals;        // groups taken from another worker
+            uint32_t drops;         // due tasks of our groups dropped as the group was busy
+        } worker[AP_SCHEDULER_MAX_WORKERS];
+        pthread_mutex_t mtx;
+        pthread_cond_t cond;
+    } threads;
+
+    // start the worker threads selected by SCHED_THREADS
+    void start_threads(void);
+
+    // queue the due tasks with a thread group
+    void run_threaded_tasks(void);
+
+    // worker thread main loop
+    void thread_worker(void);
+
+    // run the pending tasks of a group on a worker
+    void run_thread_group(uint8_t worker, uint8_t group);
+#endif
+
+    // true if a task is to be run by a worker thread
+    bool task_is_threaded(uint8_t i) const {
+#if HAL_SCHEDULER_THREADS
+        return threads.num_workers > 0 &&
+            _tasks[i].thread_group != 0 &&
+            _tasks[i].thread_group <= AP_SCHEDULER_MAX_THREAD_GROUPS;
+#else
+        return false;
+#endif
+    }
 };
 
 namespace AP {
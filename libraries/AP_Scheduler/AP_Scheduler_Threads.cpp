@@ -0,0 +1,222 @@
+/*
+  worker threads for scheduler tasks on Linux boards
+
+  Tasks with a thread group in the task table may run on worker
+  threads instead of the main thread, so they no longer compete with
+  the fast loop and the other tasks for the time left in each
+  loop. The main thread stays on the first CPU and each worker is
+  pinned to its own CPU, shared out with the worker threads of other
+  libraries by the HAL.
+
+  Tasks in a group run one after the other in table order on one
+  worker, which is how a task that depends on another says so: put
+  them in the same group. A group with a task still running isn't
+  queued again, so a task that is due while its group is busy is
+  dropped for that tick and tried again on the next.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "AP_Scheduler.h"
+
+#if HAL_SCHEDULER_THREADS
+
+#include <AP_HAL/AP_HAL.h>
+#include <AP_HAL_Linux/Scheduler.h>
+#include <GCS_MAVLink/GCS.h>
+
+#include <sched.h>
+#include <sys/sysinfo.h>
+
+extern const AP_HAL::HAL& hal;
+
+/*
+  start the worker threads. Called from init()
+ */
+void AP_Scheduler::start_threads(void)
+{
+    const int ncpus = get_nprocs();
+    const uint8_t nthreads = MIN(constrain_int16(_threads, 0, AP_SCHEDULER_MAX_WORKERS), MAX(ncpus-1, 0));
+    if (nthreads == 0) {
+        return;
+    }
+
+    threads.pending = new bool[_num_tasks];
+    if (threads.pending == nullptr) {
+        return;
+    }
+    memset(threads.pending, 0, sizeof(bool) * _num_tasks);
+
+    pthread_mutex_init(&threads.mtx, nullptr);
+    pthread_cond_init(&threads.cond, nullptr);
+
+    uint8_t started = 0;
+    for (uint8_t i=0; i<nthreads; i++) {
+        if (!hal.scheduler->thread_create(FUNCTOR_BIND_MEMBER(&AP_Scheduler::thread_worker, void),
+                                          "SCHED",
+                                          16384, AP_HAL::Scheduler::PRIORITY_MAIN, 0)) {
+            break;
+        }
+        started++;
+    }
+
+    // only queue work once all the workers exist, so no group is
+    // queued on a worker that failed to start
+    pthread_mutex_lock(&threads.mtx);
+    threads.num_workers = started;
+    pthread_mutex_unlock(&threads.mtx);
+
+    if (started < nthreads) {
+        gcs().send_text(MAV_SEVERITY_WARNING, "Scheduler: started %u of %u threads",
+                        (unsigned)started, (unsigned)nthreads);
+    }
+
+    // keep the main thread, and so the fast loop, on the first
+    // CPU. Threads it creates from now on still get every CPU from
+    // the HAL
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(0, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+/*
+  queue the groups with tasks that are due. Called by the main thread
+  at the start of run()
+ */
+void AP_Scheduler::run_threaded_tasks(void)
+{
+    if (threads.num_workers == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&threads.mtx);
+
+    uint8_t queue_groups = 0;
+    for (uint8_t i=0; i<_num_tasks; i++) {
+        if (!task_is_threaded(i)) {
+            continue;
+        }
+        const uint32_t dt = _tick_counter - _last_run[i];
+        uint32_t interval_ticks = _loop_rate_hz / _tasks[i].rate_hz;
+        if (interval_ticks < 1) {
+            interval_ticks = 1;
+        }
+        if (dt < interval_ticks) {
+            continue;
+        }
+        const uint8_t group_bit = 1U << (_tasks[i].thread_group - 1);
+        if (threads.busy_groups & group_bit) {
+            // still running from an earlier tick. The drop counts
+            // against the group's home worker
+            threads.worker[(_tasks[i].thread_group - 1) % threads.num_workers].drops++;
+            continue;
+        }
+        if (dt >= interval_ticks*2) {
+            perf_info.update_task_slip(i);
+        }
+        threads.pending[i] = true;
+        queue_groups |= group_bit;
+        _last_run[i] = _tick_counter;
+    }
+
+    for (uint8_t g=0; g<AP_SCHEDULER_MAX_THREAD_GROUPS; g++) {
+        if (!(queue_groups & (1U<<g))) {
+            continue;
+        }
+        // each group has a home worker, so a group usually runs on the
+        // same CPU
+        auto &w = threads.worker[g % threads.num_workers];
+        w.queue[(w.head + w.count) % AP_SCHEDULER_MAX_THREAD_GROUPS] = g;
+        w.count++;
+    }
+    threads.busy_groups |= queue_groups;
+
+    if (queue_groups != 0) {
+        pthread_cond_broadcast(&threads.cond);
+    }
+    pthread_mutex_unlock(&threads.mtx);
+}
+
+/*
+  run the pending tasks of a group
+ */
+void AP_Scheduler::run_thread_group(uint8_t worker, uint8_t group)
+{
+    for (uint8_t i=0; i<_num_tasks; i++) {
+        // pending is only set by the main thread while the group is
+        // not busy, so it is ours until we mark the group idle
+        if (!threads.pending[i] || _tasks[i].thread_group != group+1) {
+            continue;
+        }
+        threads.pending[i] = false;
+
+        const uint32_t start_us = AP_HAL::micros();
+        _tasks[i].function();
+        const uint32_t time_taken = AP_HAL::micros() - start_us;
+
+        pthread_mutex_lock(&threads.mtx);
+        threads.worker[worker].busy_us += time_taken;
+        threads.worker[worker].runs++;
+        perf_info.update_task_info(i, MIN(time_taken, UINT16_MAX), 0,
+                                   time_taken > _tasks[i].max_time_micros);
+        pthread_mutex_unlock(&threads.mtx);
+    }
+}
+
+/*
+  worker thread main loop
+ */
+void AP_Scheduler::thread_worker(void)
+{
+    pthread_mutex_lock(&threads.mtx);
+    const uint8_t worker = threads.started++;
+    pthread_mutex_unlock(&threads.mtx);
+
+    Linux::Scheduler::from(hal.scheduler)->pin_worker_thread();
+
+    pthread_mutex_lock(&threads.mtx);
+    while (true) {
+        // take our own work first, oldest first
+        auto &own = threads.worker[worker];
+        int16_t group = -1;
+        if (own.count > 0) {
+            group = own.queue[own.head];
+            own.head = (own.head + 1) % AP_SCHEDULER_MAX_THREAD_GROUPS;
+            own.count--;
+        } else {
+            // steal the newest group from another worker
+            for (uint8_t i=1; i<threads.num_workers; i++) {
+                auto &victim = threads.worker[(worker + i) % threads.num_workers];
+                if (victim.count > 0) {
+                    victim.count--;
+                    group = victim.queue[(victim.head + victim.count) % AP_SCHEDULER_MAX_THREAD_GROUPS];
+                    own.steals++;
+                    break;
+                }
+            }
+        }
+        if (group < 0) {
+            pthread_cond_wait(&threads.cond, &threads.mtx);
+            continue;
+        }
+        pthread_mutex_unlock(&threads.mtx);
+
+        run_thread_group(worker, group);
+
+        pthread_mutex_lock(&threads.mtx);
+        threads.busy_groups &= ~(1U << group);
+    }
+}
+
+#endif // HAL_SCHEDULER_THREADS
@@ -21,6 +21,9 @@ void AP::PerfInfo::reset()
     long_running = 0;
     sigma_time = 0;
     sigmasquared_time = 0;
+    if (_task_info != nullptr) {
+        memset(_task_info, 0, sizeof(TaskInfo) * _num_tasks);
+    }
 }
 
 // ignore_loop - ignore this loop from performance measurements (used to reduce false positive when arming)
@@ -125,6 +128,128 @@ void AP::PerfInfo::update_logging()
                     (unsigned long)AP::scheduler().get_extra_loop_us());
 }
 
+// allocate_task_info - allocate the per-task statistics
+bool AP::PerfInfo::allocate_task_info(uint8_t num_tasks)
+{
+    if (_task_info != nullptr) {
+        return true;
+    }
+    _task_info = new TaskInfo[num_tasks];
+    if (_task_info == nullptr) {
+        return false;
+    }
+    memset(_task_info, 0, sizeof(TaskInfo) * num_tasks);
+    _num_tasks = num_tasks;
+    return true;
+}
+
+// update_task_info - record one run of a task
+void AP::PerfInfo::update_task_info(uint8_t task_index, uint16_t task_time_us, uint16_t start_delay_us, bool overrun)
+{
+    if (_task_info == nullptr || task_index >= _num_tasks) {
+        return;
+    }
+    TaskInfo &ti = _task_info[task_index];
+    if (ti.tick_count == 0 || task_time_us < ti.min_time_us) {
+        ti.min_time_us = task_time_us;
+    }
+    ti.max_time_us = MAX(ti.max_time_us, task_time_us);
+    ti.max_start_delay_us = MAX(ti.max_start_delay_us, start_delay_us);
+    ti.elapsed_time_us += task_time_us;
+    if (ti.tick_count < UINT16_MAX) {
+        ti.tick_count++;
+    }
+    if (overrun && ti.overrun_count < UINT16_MAX) {
+        ti.overrun_count++;
+    }
+
+    // log2 bins, starting at 32us
+    uint8_t bin = 0;
+    for (uint16_t t = task_time_us >> 5; t != 0 && bin < PERF_TASK_HIST_BINS-1; t >>= 1) {
+        bin++;
+    }
+    if (ti.hist[bin] < UINT16_MAX) {
+        ti.hist[bin]++;
+    }
+}
+
+// update_task_slip - record that a task missed a whole run
+void AP::PerfInfo::update_task_slip(uint8_t task_index)
+{
+    if (_task_info == nullptr || task_index >= _num_tasks) {
+        return;
+    }
+    TaskInfo &ti = _task_info[task_index];
+    if (ti.slip_count < UINT16_MAX) {
+        ti.slip_count++;
+    }
+}
+
+// get_task_info - return the statistics of a task, or nullptr if not allocated
+const AP::PerfInfo::TaskInfo *AP::PerfInfo::get_task_info(uint8_t task_index) const
+{
+    if (_task_info == nullptr || task_index >= _num_tasks) {
+        return nullptr;
+    }
+    return &_task_info[task_index];
+}
+
+// get_task_time_percentile - estimate a percentile of a task's run time
+uint16_t AP::PerfInfo::get_task_time_percentile(uint8_t task_index, uint8_t percent) const
+{
+    const TaskInfo *ti = get_task_info(task_index);
+    if (ti == nullptr) {
+        return 0;
+    }
+    uint32_t total = 0;
+    for (uint8_t b=0; b<PERF_TASK_HIST_BINS; b++) {
+        total += ti->hist[b];
+    }
+    const uint32_t target = (total * percent + 99) / 100;
+    uint32_t count = 0;
+    for (uint8_t b=0; b<PERF_TASK_HIST_BINS-1; b++) {
+        count += ti->hist[b];
+        if (count >= target) {
+            return MIN(uint16_t(32U << b), ti->max_time_us);
+        }
+    }
+    // the last bin has no upper edge
+    return ti->max_time_us;
+}
+
+// get_worst_tasks - find the tasks with the most overruns, then the longest runs
+uint8_t AP::PerfInfo::get_worst_tasks(uint8_t *idx, uint8_t n) const
+{
+    if (_task_info == nullptr) {
+        return 0;
+    }
+    uint8_t count = 0;
+    for (uint8_t i=0; i<_num_tasks; i++) {
+        const TaskInfo &ti = _task_info[i];
+        if (ti.tick_count == 0) {
+            continue;
+        }
+        // insertion into the sorted list of the worst so far
+        uint8_t pos = count;
+        while (pos > 0) {
+            const TaskInfo &other = _task_info[idx[pos-1]];
+            if (ti.overrun_count < other.overrun_count ||
+                (ti.overrun_count == other.overrun_count && ti.max_time_us <= other.max_time_us)) {
+                break;
+            }
+            if (pos < n) {
+                idx[pos] = idx[pos-1];
+            }
+            pos--;
+        }
+        if (pos < n) {
+            idx[pos] = i;
+            count = MIN(count+1, n);
+        }
+    }
+    return count;
+}
+
 void AP::PerfInfo::set_loop_rate(uint16_t rate_hz)
 {
     // allow a 20% overrun before we consider a loop "slow":
@@ -2,6 +2,10 @@
 
 #include <stdint.h>
 
+// number of log2 bins in the task runtime histograms. Bin 0 counts
+// runs under 32us and the last bin runs of 2048us or more
+#define PERF_TASK_HIST_BINS 8
+
 namespace AP {
 
 class PerfInfo {
@@ -26,6 +30,41 @@ public:
 
     void update_logging();
 
+    /*
+      per-task statistics, kept since the last reset()
+     */
+    struct TaskInfo {
+        uint16_t min_time_us;
+        uint16_t max_time_us;
+        uint32_t elapsed_time_us;
+        uint16_t tick_count;
+        uint16_t overrun_count;
+        uint16_t slip_count;
+        uint16_t max_start_delay_us;
+        uint16_t hist[PERF_TASK_HIST_BINS];
+    };
+
+    // allocate the per-task statistics, returning false on failure
+    bool allocate_task_info(uint8_t num_tasks);
+    bool task_info_allocated() const { return _task_info != nullptr; }
+
+    // record a run of a task. start_delay_us is how late the task
+    // started compared to when it was due
+    void update_task_info(uint8_t task_index, uint16_t task_time_us, uint16_t start_delay_us, bool overrun);
+
+    // record that a task missed a whole run
+    void update_task_slip(uint8_t task_index);
+
+    const TaskInfo *get_task_info(uint8_t task_index) const;
+
+    // estimate a percentile of a task's run time from its histogram,
+    // as the upper edge of the bin it falls in
+    uint16_t get_task_time_percentile(uint8_t task_index, uint8_t percent) const;
+
+    // fill idx with the indexes of up to n tasks with the most
+    // overruns, then the longest runs. Returns the number found
+    uint8_t get_worst_tasks(uint8_t *idx, uint8_t n) const;
+
 private:
     uint16_t loop_rate_hz;
     uint16_t overtime_threshold_micros;
@@ -39,6 +78,8 @@ private:
     float filtered_loop_time;
     bool ignore_loop;
 
+    TaskInfo *_task_info;
+    uint8_t _num_tasks;
 };
 
 };
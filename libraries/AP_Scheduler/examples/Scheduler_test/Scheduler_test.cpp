@@ -43,8 +43,9 @@ static SchedTest schedtest;
  */
 const AP_Scheduler::Task SchedTest::scheduler_tasks[] = {
     SCHED_TASK(ins_update,             50,   1000),
-    SCHED_TASK(one_hz_print,            1,   1000),
-    SCHED_TASK(five_second_call,      0.2,   1800),
+    // these only print, so may run on a worker thread with SCHED_THREADS
+    SCHED_TASK_CLASS_THREAD(SchedTest, &schedtest, one_hz_print,      1,   1000, 1),
+    SCHED_TASK_CLASS_THREAD(SchedTest, &schedtest, five_second_call, 0.2,  1800, 1),
 };
 
 
@@ -31,7 +31,7 @@ const AP_Param::GroupInfo AP_SmartRTL::var_info[] = {
     // @Param: POINTS
     // @DisplayName: SmartRTL maximum number of points on path
     // @Description: SmartRTL maximum number of points on path. Set to 0 to disable SmartRTL.  100 points consumes about 3k of memory.
-    // @Range: 0 500
+    // @Range: 0 1000
     // @User: Advanced
     // @RebootRequired: True
     AP_GROUPINFO("POINTS", 1, AP_SmartRTL, _points_max, SMARTRTL_POINTS_DEFAULT),
@@ -57,9 +57,20 @@ const AP_Param::GroupInfo AP_SmartRTL::var_info[] = {
 *    (p2,p3) will get very close (they touch), but there would be nothing to
 *    trim between them.
 *
+*    To avoid comparing every pair of segments, segments are placed in a
+*    spatial hash keyed by the cell holding their first point, so a segment is
+*    only compared with segments starting in nearby cells and with the few
+*    segments that are longer than a cell.
+*
 *    2. Simplification uses the Ramer-Douglas-Peucker algorithm. See Wikipedia
 *    for a more complete description.
 *
+*    In addition, as each point is added it replaces the last point on the path
+*    if the last point, and the points it replaced earlier, are all close to the
+*    line from the second last point to the new point.  This removes most of
+*    the points on straight legs before they take up space in the path, while
+*    the background simplification handles the rest.
+*
 *    The simplification and pruning algorithms run in the background and do not
 *    alter the path in memory.  Two definitions, SMARTRTL_SIMPLIFY_TIME_US and
 *    SMARTRTL_PRUNING_LOOP_TIME_US are used to limit how long each algorithm will
@@ -100,7 +111,12 @@ void AP_SmartRTL::init()
     }
 
     // allocate arrays
+#if SMARTRTL_COMPACT_POINTS
+    _compact_resolution = SMARTRTL_COMPACT_RESOLUTION;
+    _path = (compact_point*)calloc(_points_max, sizeof(compact_point));
+#else
     _path = (Vector3f*)calloc(_points_max, sizeof(Vector3f));
+#endif
 
     _prune.loops_max = _points_max * SMARTRTL_PRUNING_LOOP_BUFFER_LEN_MULT;
     _prune.loops = (prune_loop_t*)calloc(_prune.loops_max, sizeof(prune_loop_t));
@@ -108,13 +124,25 @@ void AP_SmartRTL::init()
     _simplify.stack_max = _points_max * SMARTRTL_SIMPLIFY_STACK_LEN_MULT;
     _simplify.stack = (simplify_start_finish_t*)calloc(_simplify.stack_max, sizeof(simplify_start_finish_t));
 
+    // spatial hash used to find loops with two to four points per bucket
+    _prune.hash_num_buckets = 16;
+    while (_prune.hash_num_buckets * 4 <= _points_max) {
+        _prune.hash_num_buckets *= 2;
+    }
+    _prune.hash_next = (uint16_t*)calloc(_points_max, sizeof(uint16_t));
+    _prune.hash_buckets = (uint16_t*)calloc(_prune.hash_num_buckets, sizeof(uint16_t));
+
     // check if memory allocation failed
-    if (_path == nullptr || _prune.loops == nullptr || _simplify.stack == nullptr) {
+    if (_path == nullptr || _prune.loops == nullptr || _simplify.stack == nullptr ||
+        _prune.hash_next == nullptr || _prune.hash_buckets == nullptr) {
         log_action(SRTL_DEACTIVATED_INIT_FAILED);
         gcs().send_text(MAV_SEVERITY_WARNING, "SmartRTL deactivated: init failed");
         free(_path);
         free(_prune.loops);
         free(_simplify.stack);
+        free(_prune.hash_next);
+        free(_prune.hash_buckets);
+        _path = nullptr;
         return;
     }
 
@@ -154,11 +182,14 @@ bool AP_SmartRTL::pop_point(Vector3f& point)
     }
 
     // return last point and remove from path
-    point = _path[--_path_points_count];
+    point = path_point(--_path_points_count);
 
     // record count of last point popped
     _path_points_completed_limit = _path_points_count;
 
+    // the new last point has already been seen by the background cleanup so must not be moved
+    stream_close();
+
     _path_sem.give();
     return true;
 }
@@ -179,6 +210,7 @@ void AP_SmartRTL::set_home(bool position_ok, const Vector3f& current_pos)
 
     // clear path
     _path_points_count = 0;
+    stream_close();
 
     // reset simplification and pruning.  These functions access members that should normally only
     // be touched by the background thread but it will not be running because active should be false
@@ -255,6 +287,12 @@ bool AP_SmartRTL::request_thorough_cleanup(ThoroughCleanupType clean_type)
 
     // request thorough cleanup
     if (_thorough_clean_request_ms == 0) {
+        // stop the last point from moving so that the cleanup includes it
+        if (!_path_sem.take_nonblocking()) {
+            return false;
+        }
+        stream_close();
+        _path_sem.give();
         _thorough_clean_request_ms = AP_HAL::millis();
         if (clean_type != THOROUGH_CLEAN_DEFAULT) {
             _thorough_clean_type = clean_type;
@@ -292,13 +330,19 @@ bool AP_SmartRTL::add_point(const Vector3f& point)
 
     // check if we have traveled far enough
     if (_path_points_count > 0) {
-        const Vector3f& last_pos = _path[_path_points_count-1];
+        const Vector3f last_pos = path_point(_path_points_count-1);
         if (last_pos.distance_squared(point) < sq(_accuracy.get())) {
             _path_sem.give();
             return true;
         }
     }
 
+    // move the last point to the new point if the last point is no longer needed
+    if (try_stream_simplify(point)) {
+        _path_sem.give();
+        return true;
+    }
+
     // check we have space in the path
     if (_path_points_count >= _path_points_max) {
         _path_sem.give();
@@ -307,13 +351,60 @@ bool AP_SmartRTL::add_point(const Vector3f& point)
     }
 
     // add point to path
-    _path[_path_points_count++] = point;
+    if (!set_path_point(_path_points_count, point)) {
+        _path_sem.give();
+        deactivate(SRTL_DEACTIVATED_OUT_OF_RANGE, "too far from origin");
+        return false;
+    }
+    _path_points_count++;
     log_action(SRTL_POINT_ADD, point);
 
+    // the new point may be moved by later points unless it is home
+    _stream.tail_open = (_path_points_count > 1);
+    _stream.count = 0;
+
     _path_sem.give();
     return true;
 }
 
+// move the last point on the path to the point being added if the last point, and the points it replaced
+// earlier, are all within SMARTRTL_SIMPLIFY_EPSILON of the line from the second last point to the new point
+// returns true if the last point was moved.  should be called while holding _path_sem
+bool AP_SmartRTL::try_stream_simplify(const Vector3f& point)
+{
+    if (!_stream.tail_open || (_stream.count >= SMARTRTL_STREAM_WINDOW) || (_path_points_count < 2)) {
+        return false;
+    }
+
+    const Vector3f anchor = path_point(_path_points_count-2);
+    const Vector3f tail = path_point(_path_points_count-1);
+    if (tail.distance_to_segment(anchor, point) > SMARTRTL_SIMPLIFY_EPSILON) {
+        return false;
+    }
+    for (uint8_t i = 0; i < _stream.count; i++) {
+        if (_stream.window[i].distance_to_segment(anchor, point) > SMARTRTL_SIMPLIFY_EPSILON) {
+            return false;
+        }
+    }
+
+    // replace last point, remembering it so the next point's line is checked against it too
+    if (!set_path_point(_path_points_count-1, point)) {
+        return false;
+    }
+    _stream.window[_stream.count++] = tail;
+    log_action(SRTL_POINT_SIMPLIFY, tail);
+    log_action(SRTL_POINT_ADD, point);
+    return true;
+}
+
+// prevent the last point on the path from being moved by add_point.  should be called while holding _path_sem
+// unless the background cleanup is not running
+void AP_SmartRTL::stream_close()
+{
+    _stream.tail_open = false;
+    _stream.count = 0;
+}
+
 // run background cleanup - should be run regularly from the IO thread
 void AP_SmartRTL::run_background_cleanup()
 {
@@ -326,7 +417,8 @@ void AP_SmartRTL::run_background_cleanup()
         return;
     }
     // local copy of _path_points_count and _path_points_completed_limit
-    const uint16_t path_points_count = _path_points_count;
+    // the last point is left out while it may still be moved by add_point
+    const uint16_t path_points_count = _stream.tail_open ? _path_points_count - 1 : _path_points_count;
     const uint16_t path_points_completed_limit = _path_points_completed_limit;
     _path_points_completed_limit = SMARTRTL_POINTS_MAX;
     _path_sem.give();
@@ -485,6 +577,8 @@ void AP_SmartRTL::detect_simplifications()
         const simplify_start_finish_t tmp = _simplify.stack[--_simplify.stack_count];
         const uint16_t start_index = tmp.start;
         const uint16_t end_index = tmp.finish;
+        const Vector3f start_point = path_point(start_index);
+        const Vector3f end_point = path_point(end_index);
 
         // find the point between start and end points that is farthest from the start-end line segment
         float max_dist = 0.0f;
@@ -492,7 +586,7 @@ void AP_SmartRTL::detect_simplifications()
         for (uint16_t i = start_index + 1; i < end_index; i++) {
             // only check points that have not already been flagged for simplification
             if (_simplify.bitmask.get(i)) {
-                const float dist = _path[i].distance_to_segment(_path[start_index], _path[end_index]);
+                const float dist = path_point(i).distance_to_segment(start_point, end_point);
                 if (dist > max_dist) {
                     farthest_point_index = i;
                     max_dist = dist;
@@ -526,6 +620,7 @@ void AP_SmartRTL::detect_simplifications()
 *   This method runs for the allotted time, and detects loops in a path. Any detected loops are added to _prune.loops,
 *   this function does not alter the path in memory. It works by comparing the line segment between any two sequential points
 *   to the line segment between any other two sequential points. If they get close enough, anything between them could be pruned.
+*   The segments are first added to a spatial hash so that each segment is only compared with the segments near it.
 *
 *   reset_pruning should have been called at least once before this function is called to setup the indexes (_prune.i, etc)
 */
@@ -543,35 +638,129 @@ void AP_SmartRTL::detect_loops()
     // run for defined amount of time
     while (AP_HAL::micros() - start_time_us < SMARTRTL_PRUNING_LOOP_TIME_US) {
 
-        // advance inner loop
-        _prune.j++;
-        if (_prune.j > _prune.i - 2) {
-            // set inner loop back to first point
-            _prune.j = 1;
-            // reduce outer loop
-            _prune.i--;
-            // complete when outer loop has run out of new points to check
-            if (_prune.i < 4 || _prune.i < _prune.path_points_completed) {
-                _prune.complete = true;
-                _prune.path_points_completed = _prune.path_points_count;
-                return;
-            }
+        // add all segments to the spatial hash before searching for loops
+        if (_prune.hash_count < _prune.path_points_count - 1) {
+            prune_hash_insert(++_prune.hash_count);
+            continue;
         }
 
-        // find the closest distance between two line segments and the mid-point
-        dist_point dp = segment_segment_dist(_path[_prune.i], _path[_prune.i-1], _path[_prune.j-1], _path[_prune.j]);
-        if (dp.distance < SMARTRTL_PRUNING_DELTA) {
+        // find the earliest segment which comes close to the segment ending at point i
+        uint16_t loop_start;
+        dist_point dp;
+        if (prune_hash_find_loop(_prune.i, loop_start, dp)) {
             // if there is a loop here, add to loop array
-            if (!add_loop(_prune.j, _prune.i-1, dp.midpoint)) {
+            if (!add_loop(loop_start, _prune.i-1, dp.midpoint)) {
                 // if the buffer is full, stop trying to prune
                 _prune.complete = true;
+                return;
             }
-            // set inner loop forward to trigger outer loop move to next segment
-            _prune.j = _prune.i;
+        }
+
+        // reduce outer loop
+        _prune.i--;
+        // complete when outer loop has run out of new points to check
+        if (_prune.i < 4 || _prune.i < _prune.path_points_completed) {
+            _prune.complete = true;
+            _prune.path_points_completed = _prune.path_points_count;
+            return;
         }
     }
 }
 
+// add segment (the segment ending at point "index") to the spatial hash used by detect_loops
+// segments are keyed by the cell holding their first point.  Segments longer than a cell are kept in a separate list
+void AP_SmartRTL::prune_hash_insert(uint16_t index)
+{
+    const Vector3f start = path_point(index-1);
+    const Vector3f end = path_point(index);
+    if (sq(end.x - start.x) + sq(end.y - start.y) > sq(_prune.hash_cell_size)) {
+        _prune.hash_next[index] = _prune.hash_long;
+        _prune.hash_long = index;
+        return;
+    }
+    int32_t cell_x, cell_y;
+    prune_hash_cell(start, cell_x, cell_y);
+    const uint16_t bucket = prune_hash_bucket(cell_x, cell_y);
+    _prune.hash_next[index] = _prune.hash_buckets[bucket];
+    _prune.hash_buckets[bucket] = index;
+}
+
+// find the earliest segment (ending at a point below "index" - 1) which comes within SMARTRTL_PRUNING_DELTA of
+// the segment ending at point "index".  returns false if there is no such segment
+bool AP_SmartRTL::prune_hash_find_loop(uint16_t index, uint16_t &loop_start, dist_point &dp) const
+{
+    const Vector3f p1 = path_point(index);
+    const Vector3f p2 = path_point(index-1);
+    const uint16_t last_segment = index - 2;
+    uint16_t found = 0;     // segment indexes start from 1 so zero means not found
+
+    // keep the earliest segment within SMARTRTL_PRUNING_DELTA of the segment being checked
+    auto check_segment = [&](uint16_t seg) {
+        if ((seg > last_segment) || ((found != 0) && (seg >= found))) {
+            return;
+        }
+        const dist_point seg_dp = segment_segment_dist(p1, p2, path_point(seg-1), path_point(seg));
+        if (seg_dp.distance < SMARTRTL_PRUNING_DELTA) {
+            found = seg;
+            dp = seg_dp;
+        }
+    };
+
+    // long segments may come close from any cell
+    for (uint16_t seg = _prune.hash_long; seg != 0; seg = _prune.hash_next[seg]) {
+        check_segment(seg);
+    }
+
+    // the first point of a short segment within SMARTRTL_PRUNING_DELTA is at most a cell further away
+    const float cell_size = _prune.hash_cell_size;
+    const float reach = cell_size + SMARTRTL_PRUNING_DELTA;
+    int32_t x_min, y_min, x_max, y_max;
+    prune_hash_cell(Vector3f(MIN(p1.x, p2.x) - reach, MIN(p1.y, p2.y) - reach, 0.0f), x_min, y_min);
+    prune_hash_cell(Vector3f(MAX(p1.x, p2.x) + reach, MAX(p1.y, p2.y) + reach, 0.0f), x_max, y_max);
+    const uint32_t num_x = x_max - x_min + 1;
+    const uint32_t num_y = y_max - y_min + 1;
+    if ((num_x > last_segment) || (num_y > last_segment) || (num_x * num_y > last_segment)) {
+        // more cells than segments, quicker to check every segment
+        for (uint16_t seg = 1; seg <= last_segment; seg++) {
+            check_segment(seg);
+        }
+    } else {
+        for (int32_t x = x_min; x <= x_max; x++) {
+            for (int32_t y = y_min; y <= y_max; y++) {
+                for (uint16_t seg = _prune.hash_buckets[prune_hash_bucket(x, y)]; seg != 0; seg = _prune.hash_next[seg]) {
+                    // skip segments from other cells sharing this bucket
+                    int32_t seg_x, seg_y;
+                    prune_hash_cell(path_point(seg-1), seg_x, seg_y);
+                    if ((seg_x == x) && (seg_y == y)) {
+                        check_segment(seg);
+                    }
+                }
+            }
+        }
+    }
+
+    if (found == 0) {
+        return false;
+    }
+    loop_start = found;
+    return true;
+}
+
+// get the spatial hash cell holding a point
+void AP_SmartRTL::prune_hash_cell(const Vector3f& point, int32_t &cell_x, int32_t &cell_y) const
+{
+    cell_x = constrain_float(floorf(point.x / _prune.hash_cell_size), -INT16_MAX, INT16_MAX);
+    cell_y = constrain_float(floorf(point.y / _prune.hash_cell_size), -INT16_MAX, INT16_MAX);
+}
+
+// get the spatial hash bucket holding a cell
+uint16_t AP_SmartRTL::prune_hash_bucket(int32_t cell_x, int32_t cell_y) const
+{
+    uint32_t hash = ((uint32_t)cell_x * 73856093U) ^ ((uint32_t)cell_y * 19349663U);
+    hash ^= hash >> 16;
+    return hash & (_prune.hash_num_buckets - 1);
+}
+
 // restart simplify if new points have been added to path
 // path_points_count is _path_points_count but passed in to avoid having to take the semaphore
 void AP_SmartRTL::restart_simplify_if_new_points(uint16_t path_points_count)
@@ -613,8 +802,15 @@ void AP_SmartRTL::restart_pruning(uint16_t path_points_count)
 {
     _prune.complete = false;
     _prune.i = (path_points_count > 0) ? path_points_count - 1 : 0;
-    _prune.j = 0;
     _prune.path_points_count = path_points_count;
+
+    // clear spatial hash, detect_loops adds the segments again
+    _prune.hash_count = 0;
+    _prune.hash_long = 0;
+    _prune.hash_cell_size = MAX(SMARTRTL_PRUNING_CELL_SIZE, 1.0f);
+    if (_prune.hash_buckets != nullptr) {
+        memset(_prune.hash_buckets, 0, _prune.hash_num_buckets * sizeof(_prune.hash_buckets[0]));
+    }
 }
 
 // reset pruning algorithm so that it will re-check all points in the path
@@ -636,7 +832,7 @@ void AP_SmartRTL::remove_points_by_simplify_bitmask()
     uint16_t removed = 0;
     for (uint16_t src = 1; src < _path_points_count; src++) {
         if (!_simplify.bitmask.get(src)) {
-            log_action(SRTL_POINT_SIMPLIFY, _path[src]);
+            log_action(SRTL_POINT_SIMPLIFY, path_point(src));
             removed++;
         } else {
             _path[dest] = _path[src];
@@ -683,12 +879,12 @@ bool AP_SmartRTL::remove_points_by_loops(uint16_t num_points_to_remove)
         prune_loop_t loop = _prune.loops[i];
 
         // midpoint goes into start_index (this is the end point of the first segment)
-        _path[loop.start_index] = loop.midpoint;
+        set_path_point(loop.start_index, loop.midpoint);
 
         // shift points after the end of the loop down by the number of points in the loop
         uint16_t loop_num_points_to_remove = loop.end_index - loop.start_index;
         for (uint16_t dest = loop.start_index + 1; dest < _path_points_count - loop_num_points_to_remove; dest++) {
-            log_action(SRTL_POINT_PRUNE, _path[dest]);
+            log_action(SRTL_POINT_PRUNE, path_point(dest));
             _path[dest] = _path[dest + loop_num_points_to_remove];
         }
 
@@ -739,9 +935,9 @@ bool AP_SmartRTL::add_loop(uint16_t start_index, uint16_t end_index, const Vecto
 
     // create new loop structure and calculate length squared of loop
     prune_loop_t new_loop = {start_index, end_index, midpoint, 0.0f};
-    new_loop.length_squared = midpoint.distance_squared(_path[start_index]) + midpoint.distance_squared(_path[end_index]);
+    new_loop.length_squared = midpoint.distance_squared(path_point(start_index)) + midpoint.distance_squared(path_point(end_index));
     for (uint16_t i = start_index; i < end_index; i++) {
-        new_loop.length_squared += _path[i].distance_squared(_path[i+1]);
+        new_loop.length_squared += path_point(i).distance_squared(path_point(i+1));
     }
 
     // look for overlapping loops and find their combined length
@@ -825,6 +1021,33 @@ AP_SmartRTL::dist_point AP_SmartRTL::segment_segment_dist(const Vector3f &p1, co
     return {dP.length(), midpoint};
 }
 
+// get a point on the path
+Vector3f AP_SmartRTL::path_point(uint16_t index) const
+{
+#if SMARTRTL_COMPACT_POINTS
+    const compact_point &p = _path[index];
+    return Vector3f(p.x, p.y, p.z) * _compact_resolution;
+#else
+    return _path[index];
+#endif
+}
+
+// set a point on the path
+// returns false if the point cannot be stored because it is too far from the EKF origin
+bool AP_SmartRTL::set_path_point(uint16_t index, const Vector3f& point)
+{
+#if SMARTRTL_COMPACT_POINTS
+    const Vector3f scaled = point / _compact_resolution;
+    if (scaled.is_nan() || (fabsf(scaled.x) > INT16_MAX) || (fabsf(scaled.y) > INT16_MAX) || (fabsf(scaled.z) > INT16_MAX)) {
+        return false;
+    }
+    _path[index] = compact_point {(int16_t)roundf(scaled.x), (int16_t)roundf(scaled.y), (int16_t)roundf(scaled.z)};
+#else
+    _path[index] = point;
+#endif
+    return true;
+}
+
 // de-activate SmartRTL, send warning to GCS and logger
 void AP_SmartRTL::deactivate(SRTL_Actions action, const char *reason)
 {
@@ -6,8 +6,8 @@
 
 // definitions and macros
 #define SMARTRTL_ACCURACY_DEFAULT        2.0f   // default _ACCURACY parameter value.  Points will be no closer than this distance (in meters) together.
-#define SMARTRTL_POINTS_DEFAULT          300    // default _POINTS parameter value.  High numbers improve path pruning but use more memory and CPU for cleanup. Memory used will be 20bytes * this number.
-#define SMARTRTL_POINTS_MAX              500    // the absolute maximum number of points this library can support.
+#define SMARTRTL_POINTS_DEFAULT          300    // default _POINTS parameter value.  High numbers improve path pruning but use more memory and CPU for cleanup. Memory used will be 23bytes * this number (17bytes with SMARTRTL_COMPACT_POINTS).
+#define SMARTRTL_POINTS_MAX              1000   // the absolute maximum number of points this library can support.
 #define SMARTRTL_TIMEOUT                 15000  // the time in milliseconds with no points saved to the path (for whatever reason), before SmartRTL is disabled for the flight
 #define SMARTRTL_CLEANUP_POINT_TRIGGER   50     // simplification will trigger when this many points are added to the path
 #define SMARTRTL_CLEANUP_START_MARGIN    10     // routine cleanup algorithms begin when the path array has only this many empty slots remaining
@@ -20,8 +20,18 @@
 #define SMARTRTL_PRUNING_DELTA (_accuracy * 0.99)   // How many meters apart must two points be, such that we can assume that there is no obstacle between them.  must be smaller than _ACCURACY parameter
 #define SMARTRTL_PRUNING_LOOP_BUFFER_LEN_MULT 0.25f // pruning loop buffer size as compared to maximum number of points
 #define SMARTRTL_PRUNING_LOOP_TIME_US    200    // maximum time (in microseconds) that the loop finding algorithm will run before returning
+#define SMARTRTL_PRUNING_CELL_SIZE (_accuracy * 5.0f)  // size (in meters) of the cells used to find nearby segments when detecting loops. Segments longer than this are checked against every segment
+#define SMARTRTL_STREAM_WINDOW           16     // maximum number of points that may be replaced by the last point on the path as points are added
+
+// store points as 16-bit multiples of SMARTRTL_COMPACT_RESOLUTION instead of floats, halving the memory used by the path.
+// Points must then be within 32767 * SMARTRTL_COMPACT_RESOLUTION of the EKF origin (16km horizontally and vertically with the default accuracy)
+#ifndef SMARTRTL_COMPACT_POINTS
+#define SMARTRTL_COMPACT_POINTS          0
+#endif
+#define SMARTRTL_COMPACT_RESOLUTION (_accuracy * 0.25f)
 
 class AP_SmartRTL {
+    friend class AP_SmartRTL_Test;
 
 public:
 
@@ -38,7 +48,7 @@ public:
     uint16_t get_num_points() const;
 
     // get a point on the path
-    const Vector3f& get_point(uint16_t index) const { return _path[index]; }
+    Vector3f get_point(uint16_t index) const { return path_point(index); }
 
     // get next point on the path to home, returns true on success
     bool pop_point(Vector3f& point);
@@ -92,8 +102,20 @@ private:
         SRTL_DEACTIVATED_BAD_POSITION_TIMEOUT,
         SRTL_DEACTIVATED_PATH_FULL_TIMEOUT,
         SRTL_DEACTIVATED_PROGRAM_ERROR,
+        SRTL_DEACTIVATED_OUT_OF_RANGE,
     };
 
+    // get or set a point on the path
+    // set_path_point returns false if the point cannot be stored because it is too far from the EKF origin
+    Vector3f path_point(uint16_t index) const;
+    bool set_path_point(uint16_t index, const Vector3f& point);
+
+    // returns true if the last point on the path may be moved by add_point to absorb the point being added
+    bool try_stream_simplify(const Vector3f& point);
+
+    // prevent the last point on the path from being moved by add_point
+    void stream_close();
+
     // add point to end of path
     bool add_point(const Vector3f& point);
 
@@ -155,6 +177,17 @@ private:
     // get the closest distance between 2 line segments and the point midway between the closest points
     static dist_point segment_segment_dist(const Vector3f& p1, const Vector3f& p2, const Vector3f& p3, const Vector3f& p4);
 
+    // add segment (the segment ending at point "index") to the spatial hash used by detect_loops
+    void prune_hash_insert(uint16_t index);
+
+    // find the earliest segment (ending at a point below "index" - 1) which comes within SMARTRTL_PRUNING_DELTA of
+    // the segment ending at point "index".  returns false if there is no such segment
+    bool prune_hash_find_loop(uint16_t index, uint16_t &loop_start, dist_point &dp) const;
+
+    // get the spatial hash cell holding a point and the bucket holding a cell
+    void prune_hash_cell(const Vector3f& point, int32_t &cell_x, int32_t &cell_y) const;
+    uint16_t prune_hash_bucket(int32_t cell_x, int32_t cell_y) const;
+
     // de-activate SmartRTL, send warning to GCS and logger
     void deactivate(SRTL_Actions action, const char *reason);
 
@@ -177,12 +210,30 @@ private:
     ThoroughCleanupType _thorough_clean_type;   // used by example sketch to test simplify and prune separately
 
     // path variables
+#if SMARTRTL_COMPACT_POINTS
+    struct compact_point {
+        int16_t x, y, z;
+    };
+    compact_point* _path;       // points are stored in multiples of _compact_resolution from EKF origin in NED
+    float _compact_resolution;  // copy of SMARTRTL_COMPACT_RESOLUTION taken at init so that changes to the accuracy parameter do not corrupt the path
+#else
     Vector3f* _path;    // points are stored in meters from EKF origin in NED
+#endif
     uint16_t _path_points_max;  // after the array has been allocated, we will need to know how big it is. We can't use the parameter, because a user could change the parameter in-flight
     uint16_t _path_points_count;// number of points in the path array
     uint16_t _path_points_completed_limit;  // set by main thread to the path_point_count when a point is popped.  used by simplify and prune algorithms to detect path shrinking
     HAL_Semaphore _path_sem;   // semaphore for updating path
 
+    // Streaming simplification
+    // as each point is added it may replace the last point on the path if the last point and the points it
+    // previously replaced are all within SMARTRTL_SIMPLIFY_EPSILON of the line from the second last point to
+    // the new point.  The last point is not seen by the background cleanup while it may still move
+    struct {
+        bool tail_open;         // true if the last point on the path may be moved.  only changed while holding _path_sem
+        uint8_t count;          // number of points in the window
+        Vector3f window[SMARTRTL_STREAM_WINDOW];    // points replaced by the last point on the path
+    } _stream;
+
     // Simplify
     // structure and buffer to hold the "to-do list" for the simplify algorithm.
     typedef struct {
@@ -212,7 +263,12 @@ private:
         uint16_t path_points_count;  // copy of _path_points_count taken when the prune algorithm started
         uint16_t path_points_completed; // number of points in that path that have already been checked for loops and should be ignored
         uint16_t i;     // loop search's outer loop index
-        uint16_t j;     // loop search's inner loop index
+        uint16_t hash_count;    // number of segments added to the spatial hash
+        uint16_t* hash_next;    // next segment in the same bucket, or in the list of long segments (indexed by segment end point)
+        uint16_t* hash_buckets; // first segment in each bucket of the spatial hash
+        uint16_t hash_num_buckets;  // number of buckets in the spatial hash (a power of two)
+        uint16_t hash_long;     // first segment in the list of segments longer than the cell size
+        float hash_cell_size;   // copy of SMARTRTL_PRUNING_CELL_SIZE taken when the spatial hash was started
         prune_loop_t* loops;// the result of the pruning algorithm
         uint16_t loops_max; // maximum number of elements in the _prunable_loops array
         uint16_t loops_count;   // number of elements in the _prunable_loops array
@@ -0,0 +1,365 @@
+#include <AP_gtest.h>
+
+#include <stdlib.h>
+#include <vector>
+
+#include <AP_SmartRTL/AP_SmartRTL.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+/*
+  reach into AP_SmartRTL to check the spatial hash used to find loops
+  against a scan of every segment, and the storage of path points
+ */
+class AP_SmartRTL_Test {
+public:
+    typedef AP_SmartRTL::dist_point dist_point;
+
+    // allocated so that, as for the vehicle's instance, it starts zeroed
+    AP_SmartRTL_Test() :
+        srtl(new AP_SmartRTL(true)) {
+        srtl->init();
+    }
+
+    ~AP_SmartRTL_Test() {
+        delete srtl;
+    }
+
+    void set_path(const std::vector<Vector3f> &path) {
+        for (uint16_t i=0; i<path.size(); i++) {
+            ASSERT_TRUE(srtl->set_path_point(i, path[i]));
+        }
+        srtl->_path_points_count = path.size();
+    }
+
+    // add every segment to the spatial hash, as detect_loops does
+    void build_hash() {
+        srtl->restart_pruning(srtl->_path_points_count);
+        for (uint16_t i=1; i<srtl->_path_points_count; i++) {
+            srtl->prune_hash_insert(i);
+        }
+    }
+
+    bool find_loop_hashed(uint16_t index, uint16_t &loop_start, dist_point &dp) const {
+        return srtl->prune_hash_find_loop(index, loop_start, dp);
+    }
+
+    // the earliest segment within SMARTRTL_PRUNING_DELTA, checking every one
+    bool find_loop_pairwise(uint16_t index, uint16_t &loop_start, dist_point &dp) const {
+        const float delta = srtl->_accuracy * 0.99;
+        for (uint16_t j=1; j<=index-2; j++) {
+            const dist_point seg_dp = AP_SmartRTL::segment_segment_dist(srtl->path_point(index), srtl->path_point(index-1),
+                                                                    srtl->path_point(j-1), srtl->path_point(j));
+            if (seg_dp.distance < delta) {
+                loop_start = j;
+                dp = seg_dp;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool set_point(uint16_t index, const Vector3f &point) {
+        return srtl->set_path_point(index, point);
+    }
+
+    Vector3f point(uint16_t index) const {
+        return srtl->path_point(index);
+    }
+
+    bool tail_open() const { return srtl->_stream.tail_open; }
+    uint8_t window_count() const { return srtl->_stream.count; }
+
+    // the number of points the background cleanup last started simplifying
+    uint16_t simplify_count() const { return srtl->_simplify.path_points_count; }
+
+    AP_SmartRTL *srtl;
+};
+
+static float rand_float(float min, float max)
+{
+    return min + (max - min) * (float(random()) / RAND_MAX);
+}
+
+/*
+  a vehicle wandering about: mostly short legs turning a little, with
+  the odd long leg and sharp turn, so the path crosses itself and
+  segments span several hash cells
+ */
+static std::vector<Vector3f> random_walk(uint16_t num_points, float area)
+{
+    std::vector<Vector3f> path;
+    Vector3f pos;
+    float heading = rand_float(0, M_2PI);
+    path.push_back(pos);
+    while (path.size() < num_points) {
+        float leg = rand_float(2, 8);
+        switch (random() % 10) {
+        case 0:
+            leg = rand_float(10, 60);
+            FALLTHROUGH;
+        case 1:
+            heading += rand_float(-M_PI, M_PI);
+            break;
+        default:
+            heading += rand_float(-0.5f, 0.5f);
+            break;
+        }
+        pos.x += cosf(heading) * leg;
+        pos.y += sinf(heading) * leg;
+        pos.z = constrain_float(pos.z + rand_float(-1, 1), -20, 0);
+        // turn back towards home when wandering off
+        if (norm(pos.x, pos.y) > area) {
+            heading = atan2f(-pos.y, -pos.x) + rand_float(-0.5f, 0.5f);
+        }
+        path.push_back(pos);
+    }
+    return path;
+}
+
+TEST(AP_SmartRTL, LoopsHashedMatchPairwise)
+{
+    srandom(19);
+    AP_SmartRTL_Test t;
+
+    uint32_t loops_found = 0;
+    for (uint8_t walk=0; walk<20; walk++) {
+        // from tight knots to paths that rarely cross, some far enough
+        // from the origin for negative and large cell coordinates
+        const float area = 20.0f + walk * 25.0f;
+        std::vector<Vector3f> path = random_walk(SMARTRTL_POINTS_DEFAULT, area);
+        const Vector3f shift(rand_float(-500, 500), rand_float(-500, 500), 0);
+        for (Vector3f &p : path) {
+            p += shift;
+        }
+        t.set_path(path);
+        t.build_hash();
+
+        for (uint16_t i=path.size()-1; i>=4; i--) {
+            uint16_t start_hashed = 0, start_pairwise = 0;
+            AP_SmartRTL_Test::dist_point dp_hashed {}, dp_pairwise {};
+            const bool found = t.find_loop_pairwise(i, start_pairwise, dp_pairwise);
+            ASSERT_EQ(t.find_loop_hashed(i, start_hashed, dp_hashed), found) << "walk " << unsigned(walk) << " point " << i;
+            if (found) {
+                loops_found++;
+                EXPECT_EQ(start_hashed, start_pairwise) << "walk " << unsigned(walk) << " point " << i;
+                EXPECT_FLOAT_EQ(dp_hashed.distance, dp_pairwise.distance);
+                EXPECT_TRUE(dp_hashed.midpoint == dp_pairwise.midpoint);
+            }
+        }
+    }
+    // the walks must actually exercise loop detection
+    EXPECT_GT(loops_found, 500U);
+}
+
+TEST(AP_SmartRTL, PathPointRoundTrip)
+{
+    srandom(20);
+    AP_SmartRTL_Test t;
+
+#if SMARTRTL_COMPACT_POINTS
+    const float resolution = SMARTRTL_ACCURACY_DEFAULT * 0.25f;
+    const float range = INT16_MAX * resolution;
+#else
+    const float resolution = 0;
+    const float range = 100000;
+#endif
+
+    for (uint16_t i=0; i<SMARTRTL_POINTS_DEFAULT; i++) {
+        const Vector3f p(rand_float(-range, range), rand_float(-range, range), rand_float(-range, range));
+        ASSERT_TRUE(t.set_point(i, p));
+        const Vector3f diff = t.point(i) - p;
+        EXPECT_LE(fabsf(diff.x), resolution * 0.5f) << p.x;
+        EXPECT_LE(fabsf(diff.y), resolution * 0.5f) << p.y;
+        EXPECT_LE(fabsf(diff.z), resolution * 0.5f) << p.z;
+    }
+
+#if SMARTRTL_COMPACT_POINTS
+    // points beyond the range of the compact points are refused
+    const Vector3f stored = t.point(0);
+    EXPECT_FALSE(t.set_point(0, Vector3f(range + resolution, 0, 0)));
+    EXPECT_FALSE(t.set_point(0, Vector3f(0, -range - resolution, 0)));
+    EXPECT_FALSE(t.set_point(0, Vector3f(0, 0, range + resolution)));
+    EXPECT_FALSE(t.set_point(0, Vector3f(NAN, 0, 0)));
+    EXPECT_TRUE(t.point(0) == stored);
+#endif
+}
+
+TEST(AP_SmartRTL, FarFromOrigin)
+{
+    AP_SmartRTL_Test t;
+    t.srtl->set_home(true, Vector3f(10, -10, -5));
+    ASSERT_TRUE(t.srtl->is_active());
+    t.srtl->update(true, Vector3f(100, 100, -5));
+    EXPECT_TRUE(t.srtl->is_active());
+    EXPECT_EQ(t.srtl->get_num_points(), 2U);
+
+    // flying further from the origin than a compact point can hold
+    // deactivates SmartRTL rather than storing a wrong point
+    t.srtl->update(true, Vector3f(20000, -10, -5));
+#if SMARTRTL_COMPACT_POINTS
+    EXPECT_FALSE(t.srtl->is_active());
+    EXPECT_EQ(t.srtl->get_num_points(), 2U);
+#else
+    EXPECT_TRUE(t.srtl->is_active());
+    EXPECT_EQ(t.srtl->get_num_points(), 3U);
+    EXPECT_TRUE(t.srtl->get_point(2) == Vector3f(20000, -10, -5));
+#endif
+}
+
+/*
+  a path in a straight line only keeps home and the last point, the
+  last point moving along the line as each point is added
+ */
+TEST(AP_SmartRTL, StreamCollinear)
+{
+    AP_SmartRTL_Test t;
+    t.srtl->set_home(true, Vector3f(0, 0, -10));
+    for (uint8_t i=1; i<=10; i++) {
+        t.srtl->update(true, Vector3f(i*5, i*5, -10));
+        EXPECT_EQ(t.srtl->get_num_points(), 2U) << unsigned(i);
+        EXPECT_TRUE(t.srtl->get_point(1) == Vector3f(i*5, i*5, -10)) << unsigned(i);
+        EXPECT_TRUE(t.tail_open());
+        EXPECT_EQ(t.window_count(), i-1);
+    }
+    // a point too close to the last one is not added, and doesn't move it
+    t.srtl->update(true, Vector3f(51, 51, -10));
+    EXPECT_EQ(t.srtl->get_num_points(), 2U);
+    EXPECT_TRUE(t.srtl->get_point(1) == Vector3f(50, 50, -10));
+}
+
+/*
+  the last point only replaces SMARTRTL_STREAM_WINDOW points before it
+  is left in place, then the next point starts a new window
+ */
+TEST(AP_SmartRTL, StreamWindow)
+{
+    AP_SmartRTL_Test t;
+    t.srtl->set_home(true, Vector3f(0, 0, -10));
+    uint16_t i = 1;
+    for (; i<=SMARTRTL_STREAM_WINDOW+1; i++) {
+        t.srtl->update(true, Vector3f(i*5, 0, -10));
+        EXPECT_EQ(t.srtl->get_num_points(), 2U) << i;
+    }
+    EXPECT_EQ(t.window_count(), SMARTRTL_STREAM_WINDOW);
+    const Vector3f window_end(i*5 - 5, 0, -10);
+
+    // the window is full so the next point on the line is added
+    t.srtl->update(true, Vector3f(i*5, 0, -10));
+    EXPECT_EQ(t.srtl->get_num_points(), 3U);
+    EXPECT_TRUE(t.srtl->get_point(1) == window_end);
+    EXPECT_EQ(t.window_count(), 0);
+    i++;
+
+    // and moves along the line in turn
+    for (uint8_t j=0; j<5; j++, i++) {
+        t.srtl->update(true, Vector3f(i*5, 0, -10));
+        EXPECT_EQ(t.srtl->get_num_points(), 3U);
+        EXPECT_TRUE(t.srtl->get_point(1) == window_end);
+        EXPECT_TRUE(t.srtl->get_point(2) == Vector3f(i*5, 0, -10));
+    }
+}
+
+/*
+  a point off the line is added, leaving the last point where it was
+  and closing its window
+ */
+TEST(AP_SmartRTL, StreamOffLine)
+{
+    AP_SmartRTL_Test t;
+    t.srtl->set_home(true, Vector3f(0, 0, -10));
+    for (uint8_t i=1; i<=4; i++) {
+        t.srtl->update(true, Vector3f(i*10, 0, -10));
+    }
+    EXPECT_EQ(t.window_count(), 3);
+
+    // a turn of 90 degrees
+    t.srtl->update(true, Vector3f(40, 10, -10));
+    EXPECT_EQ(t.srtl->get_num_points(), 3U);
+    EXPECT_TRUE(t.srtl->get_point(1) == Vector3f(40, 0, -10));
+    EXPECT_EQ(t.window_count(), 0);
+
+    // points on the new line move the new last point
+    t.srtl->update(true, Vector3f(40, 20, -10));
+    EXPECT_EQ(t.srtl->get_num_points(), 3U);
+    EXPECT_TRUE(t.srtl->get_point(1) == Vector3f(40, 0, -10));
+    EXPECT_TRUE(t.srtl->get_point(2) == Vector3f(40, 20, -10));
+
+    // the last point is close to the new line but a point it replaced
+    // earlier is not
+    AP_SmartRTL_Test t2;
+    t2.srtl->set_home(true, Vector3f(0, 0, -10));
+    const float epsilon = SMARTRTL_ACCURACY_DEFAULT * 0.5f;
+    t2.srtl->update(true, Vector3f(10, epsilon * 0.9f, -10));
+    t2.srtl->update(true, Vector3f(20, 0, -10));
+    EXPECT_EQ(t2.srtl->get_num_points(), 2U);
+    t2.srtl->update(true, Vector3f(30, -epsilon * 0.9f, -10));
+    EXPECT_EQ(t2.srtl->get_num_points(), 3U);
+    EXPECT_TRUE(t2.srtl->get_point(1) == Vector3f(20, 0, -10));
+}
+
+/*
+  popping a point or asking for a thorough cleanup fixes the last
+  point in place
+ */
+TEST(AP_SmartRTL, StreamClose)
+{
+    AP_SmartRTL_Test t;
+    t.srtl->set_home(true, Vector3f(0, 0, -10));
+    t.srtl->update(true, Vector3f(10, 0, -10));
+    t.srtl->update(true, Vector3f(10, 10, -10));
+    EXPECT_EQ(t.srtl->get_num_points(), 3U);
+    EXPECT_TRUE(t.tail_open());
+
+    Vector3f point;
+    ASSERT_TRUE(t.srtl->pop_point(point));
+    EXPECT_TRUE(point == Vector3f(10, 10, -10));
+    EXPECT_FALSE(t.tail_open());
+
+    // the point now last has been seen by the cleanup so is not moved
+    t.srtl->update(true, Vector3f(20, 0, -10));
+    EXPECT_EQ(t.srtl->get_num_points(), 3U);
+    EXPECT_TRUE(t.srtl->get_point(1) == Vector3f(10, 0, -10));
+    EXPECT_TRUE(t.tail_open());
+
+    EXPECT_FALSE(t.srtl->request_thorough_cleanup());
+    EXPECT_FALSE(t.tail_open());
+    t.srtl->update(true, Vector3f(30, 0, -10));
+    EXPECT_EQ(t.srtl->get_num_points(), 4U);
+    EXPECT_TRUE(t.srtl->get_point(2) == Vector3f(20, 0, -10));
+    t.srtl->cancel_request_for_thorough_cleanup();
+}
+
+/*
+  the background cleanup leaves out the last point while it may still
+  move, and includes it once it is fixed
+ */
+TEST(AP_SmartRTL, StreamBackgroundCleanup)
+{
+    for (const bool close : {false, true}) {
+        AP_SmartRTL_Test t;
+        t.srtl->set_home(true, Vector3f(0, 0, -10));
+        // a zigzag, so no point replaces another
+        for (uint8_t i=1; i<=SMARTRTL_CLEANUP_POINT_TRIGGER+10; i++) {
+            t.srtl->update(true, Vector3f(i*5, (i % 2) * 10, -10));
+        }
+        const uint16_t num_points = t.srtl->get_num_points();
+        ASSERT_EQ(num_points, SMARTRTL_CLEANUP_POINT_TRIGGER+11);
+        ASSERT_TRUE(t.tail_open());
+        if (close) {
+            t.srtl->request_thorough_cleanup();
+            ASSERT_FALSE(t.tail_open());
+        }
+
+        uint16_t seen = 0;
+        for (uint8_t i=0; i<50; i++) {
+            t.srtl->run_background_cleanup();
+            seen = MAX(seen, t.simplify_count());
+        }
+        EXPECT_EQ(seen, close ? num_points : num_points - 1);
+        EXPECT_EQ(t.srtl->get_num_points(), num_points);
+        t.srtl->cancel_request_for_thorough_cleanup();
+    }
+}
+
+AP_GTEST_MAIN()
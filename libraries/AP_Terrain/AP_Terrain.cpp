@@ -320,6 +320,11 @@ void AP_Terrain::update(void)
     // check for pending rally data
     update_rally_data();
 
+#if AP_TERRAIN_LARGE_CACHE
+    // load the blocks we will need soon
+    update_prefetch();
+#endif
+
     // update capabilities and status
     if (allocate()) {
         if (!pos_valid) {
@@ -388,6 +393,17 @@ bool AP_Terrain::allocate(void)
         memory_alloc_failed = true;
         return false;
     }
+#if AP_TERRAIN_LARGE_CACHE
+    cache_hash = (uint16_t *)malloc(TERRAIN_CACHE_HASH_SIZE * sizeof(cache_hash[0]));
+    if (cache_hash == nullptr) {
+        free(cache);
+        cache = nullptr;
+        gcs().send_text(MAV_SEVERITY_CRITICAL, "Terrain: Allocation failed");
+        memory_alloc_failed = true;
+        return false;
+    }
+    memset(cache_hash, 0xFF, TERRAIN_CACHE_HASH_SIZE * sizeof(cache_hash[0]));
+#endif
     cache_size = TERRAIN_GRID_BLOCK_CACHE_SIZE;
     return true;
 }
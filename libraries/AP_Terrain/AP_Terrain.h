@@ -51,8 +51,39 @@
 #define TERRAIN_GRID_BLOCK_SIZE_X (TERRAIN_GRID_MAVLINK_SIZE*TERRAIN_GRID_BLOCK_MUL_X)
 #define TERRAIN_GRID_BLOCK_SIZE_Y (TERRAIN_GRID_MAVLINK_SIZE*TERRAIN_GRID_BLOCK_MUL_Y)
 
+/*
+  boards with plenty of memory keep a large hashed cache, read the
+  degree files through a memory mapping and prefetch grid_blocks
+  along the velocity vector and the mission legs ahead
+ */
+#ifndef AP_TERRAIN_LARGE_CACHE
+#define AP_TERRAIN_LARGE_CACHE (CONFIG_HAL_BOARD == HAL_BOARD_LINUX)
+#endif
+
 // number of grid_blocks in the LRU memory cache
+#ifndef TERRAIN_GRID_BLOCK_CACHE_SIZE
+#if AP_TERRAIN_LARGE_CACHE
+#define TERRAIN_GRID_BLOCK_CACHE_SIZE 512
+#else
 #define TERRAIN_GRID_BLOCK_CACHE_SIZE 12
+#endif
+#endif
+
+#if AP_TERRAIN_LARGE_CACHE
+// number of hash chains over the cache, must be a power of 2
+#define TERRAIN_CACHE_HASH_SIZE 256
+#define TERRAIN_CACHE_HASH_NONE 0xFFFF
+
+// how far ahead along the velocity vector to prefetch, in seconds
+#define TERRAIN_PREFETCH_TIME 60
+
+// limit on prefetched grid_blocks along the velocity vector and
+// along each mission leg
+#define TERRAIN_PREFETCH_MAX_BLOCKS 64
+
+// number of mission legs ahead of the current one to prefetch
+#define TERRAIN_PREFETCH_LEGS 4
+#endif
 
 // format of grid on disk
 #define TERRAIN_GRID_FORMAT_VERSION 1
@@ -74,6 +105,8 @@
  */
 
 class AP_Terrain {
+    friend class AP_Terrain_Test;
+
 public:
     AP_Terrain(const AP_Mission &_mission);
 
@@ -248,6 +281,12 @@ private:
 
         // the last time access was requested to this block, used for LRU
         uint32_t last_access_ms;
+
+#if AP_TERRAIN_LARGE_CACHE
+        // next block in the same hash chain. A block is in a chain
+        // whenever its state is not GRID_CACHE_INVALID
+        uint16_t hash_next;
+#endif
     };
 
     /*
@@ -287,6 +326,26 @@ private:
     */
     struct grid_cache &find_grid_cache(const struct grid_info &info);
 
+#if AP_TERRAIN_LARGE_CACHE
+    // hash chain for a grid_block SW corner
+    uint16_t grid_hash(int32_t lat, int32_t lon) const;
+    void hash_remove(uint16_t idx);
+
+    /*
+      make sure the grid_block holding a location is in the cache,
+      loading it from disk if need be
+     */
+    void prefetch(const Location &loc);
+    void prefetch_step(const Location &from, const Location &to);
+    void prefetch_line(const Location &from, const Location &to);
+    void update_prefetch(void);
+    void prefetch_mission_leg(void);
+
+    // map the degree file, at least len bytes
+    bool map_file(uint32_t len);
+    void unmap_file(void);
+#endif
+
     /*
       calculate bit number in grid_block bitmap. This corresponds to a
       bit representing a 4x4 mavlink transmitted block
@@ -324,6 +383,7 @@ private:
     void check_disk_write(void);
     void io_timer(void);
     void open_file(void);
+    uint32_t grid_file_offset(const struct grid_block &block) const;
     void seek_offset(void);
     void write_block(void);
     void read_block(void);
@@ -348,9 +408,25 @@ private:
     const AP_Mission &mission;
 
     // cache of grids in memory, LRU
-    uint8_t cache_size = 0;
+    uint16_t cache_size = 0;
     struct grid_cache *cache = nullptr;
 
+#if AP_TERRAIN_LARGE_CACHE
+    // first cache index of each hash chain
+    uint16_t *cache_hash = nullptr;
+
+    // mission leg prefetch state
+    uint16_t prefetch_nav_index;
+    uint16_t prefetch_mission_index;
+    uint8_t prefetch_leg;
+    uint32_t prefetch_mission_change_ms;
+    Location prefetch_loc;
+
+    // memory mapping of the open degree file, owned by the IO thread
+    uint8_t *file_map = nullptr;
+    uint32_t file_map_len;
+#endif
+
     // a grid_cache block waiting for disk IO
     enum DiskIoState {
         DiskIoIdle      = 0,
@@ -28,6 +28,11 @@
 
 #include <AP_Filesystem/AP_Filesystem.h>
 
+#if AP_TERRAIN_LARGE_CACHE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 extern const AP_HAL::HAL& hal;
 
 /*
@@ -74,12 +79,6 @@ void AP_Terrain::schedule_disk_io(void)
 
     switch (disk_io_state) {
     case DiskIoIdle:
-        // look for a block that needs reading or writing
-        check_disk_read();
-        if (disk_io_state == DiskIoIdle) {
-            // still idle, check for writes
-            check_disk_write();            
-        }
         break;
         
     case DiskIoDoneRead: {
@@ -115,6 +114,17 @@ void AP_Terrain::schedule_disk_io(void)
         // waiting for io_timer()
         break;
     }
+
+    if (disk_io_state == DiskIoIdle) {
+        // look for a block that needs reading or writing, including
+        // straight after completing one so a backlog of reads
+        // doesn't take one call per block
+        check_disk_read();
+        if (disk_io_state == DiskIoIdle) {
+            // still idle, check for writes
+            check_disk_write();            
+        }
+    }
 }
 
 
@@ -188,6 +198,9 @@ void AP_Terrain::open_file(void)
         }
     }
 
+#if AP_TERRAIN_LARGE_CACHE
+    unmap_file();
+#endif
     if (fd != -1) {
         AP::FS().close(fd);
     }
@@ -206,11 +219,10 @@ void AP_Terrain::open_file(void)
 }
 
 /*
-  seek to the right offset for disk_block
+  offset of a grid_block in its degree file
  */
-void AP_Terrain::seek_offset(void)
+uint32_t AP_Terrain::grid_file_offset(const struct grid_block &block) const
 {
-    struct grid_block &block = disk_block.block;
     // work out how many longitude blocks there are at this latitude
     Location loc1, loc2;
     loc1.lat = block.lat_degrees*10*1000*1000L;
@@ -223,8 +235,16 @@ void AP_Terrain::seek_offset(void)
     const Vector2f offset = loc1.get_distance_NE(loc2);
     uint16_t east_blocks = offset.y / (grid_spacing*TERRAIN_GRID_BLOCK_SIZE_Y);
 
-    uint32_t file_offset = (east_blocks * block.grid_idx_x + 
-                            block.grid_idx_y) * sizeof(union grid_io_block);
+    return (east_blocks * block.grid_idx_x + 
+            block.grid_idx_y) * sizeof(union grid_io_block);
+}
+
+/*
+  seek to the right offset for disk_block
+ */
+void AP_Terrain::seek_offset(void)
+{
+    const uint32_t file_offset = grid_file_offset(disk_block.block);
     if (AP::FS().lseek(fd, file_offset, SEEK_SET) != (off_t)file_offset) {
 #if TERRAIN_DEBUG
         hal.console->printf("Seek %lu failed - %s\n",
@@ -274,14 +294,24 @@ void AP_Terrain::write_block(void)
  */
 void AP_Terrain::read_block(void)
 {
-    seek_offset();
-    if (io_failure) {
-        return;
-    }
     int32_t lat = disk_block.block.lat;
     int32_t lon = disk_block.block.lon;
 
-    ssize_t ret = AP::FS().read(fd, &disk_block, sizeof(disk_block));
+    ssize_t ret;
+#if AP_TERRAIN_LARGE_CACHE
+    const uint32_t file_offset = grid_file_offset(disk_block.block);
+    if (map_file(file_offset + sizeof(disk_block))) {
+        memcpy(&disk_block, &file_map[file_offset], sizeof(disk_block));
+        ret = sizeof(disk_block);
+    } else
+#endif
+    {
+        seek_offset();
+        if (io_failure) {
+            return;
+        }
+        ret = AP::FS().read(fd, &disk_block, sizeof(disk_block));
+    }
     if (ret != sizeof(disk_block) || 
         disk_block.block.lat != lat || 
         disk_block.block.lon != lon ||
@@ -313,6 +343,48 @@ void AP_Terrain::read_block(void)
     disk_io_state = DiskIoDoneRead;
 }
 
+#if AP_TERRAIN_LARGE_CACHE
+/*
+  map the open degree file, making sure at least len bytes are
+  mapped. Returns false if the file is shorter than that or can't be
+  mapped, leaving the read to go through the file handle.
+
+  Blocks written through the file handle show up in the mapping as
+  both go through the page cache, so only growth of the file needs a
+  new mapping
+ */
+bool AP_Terrain::map_file(uint32_t len)
+{
+    if (file_map != nullptr && len <= file_map_len) {
+        return true;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)len) {
+        return false;
+    }
+    unmap_file();
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    // the files are a few MB at most, so ask for all of it now
+    // rather than waiting on a page fault for each block
+    madvise(p, st.st_size, MADV_WILLNEED);
+    file_map = (uint8_t *)p;
+    file_map_len = st.st_size;
+    return true;
+}
+
+void AP_Terrain::unmap_file(void)
+{
+    if (file_map != nullptr) {
+        munmap(file_map, file_map_len);
+        file_map = nullptr;
+        file_map_len = 0;
+    }
+}
+#endif // AP_TERRAIN_LARGE_CACHE
+
 /*
   timer called to do disk IO
  */
@@ -0,0 +1,164 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+  prefetch terrain grid_blocks ahead of the vehicle, so that lookups
+  along the route find their block already in the cache. Blocks that
+  aren't on disk are requested from the GCS like any other cache miss
+ */
+
+#include <AP_HAL/AP_HAL.h>
+#include <AP_Common/AP_Common.h>
+#include <AP_Math/AP_Math.h>
+#include <GCS_MAVLink/GCS_MAVLink.h>
+#include <GCS_MAVLink/GCS.h>
+#include "AP_Terrain.h"
+#include <AP_AHRS/AP_AHRS.h>
+
+#if AP_TERRAIN_AVAILABLE && AP_TERRAIN_LARGE_CACHE
+
+extern const AP_HAL::HAL& hal;
+
+/*
+  make sure the grid_block holding a location is in the cache
+ */
+void AP_Terrain::prefetch(const Location &loc)
+{
+    struct grid_info info;
+    calculate_grid_info(loc, info);
+    find_grid_cache(info);
+}
+
+/*
+  prefetch the grid_block holding the end of a step along a line. A
+  step that changes both the row and the column of the block can cut
+  across the corner of one more block, so the two blocks beside that
+  corner are prefetched too
+ */
+void AP_Terrain::prefetch_step(const Location &from, const Location &to)
+{
+    struct grid_info info_from, info_to;
+    calculate_grid_info(from, info_from);
+    calculate_grid_info(to, info_to);
+    if (info_from.grid_lat != info_to.grid_lat &&
+        info_from.grid_lon != info_to.grid_lon) {
+        const Vector2f ne = from.get_distance_NE(to);
+        Location loc = from;
+        loc.offset(ne.x, 0);
+        prefetch(loc);
+        loc = from;
+        loc.offset(0, ne.y);
+        prefetch(loc);
+    }
+    find_grid_cache(info_to);
+}
+
+/*
+  prefetch the grid_blocks along a straight line. The step is a bit
+  less than the size of a grid_block, so a step moves at most one
+  block north or south and one east or west
+ */
+void AP_Terrain::prefetch_line(const Location &from, const Location &to)
+{
+    const float step = 0.7f * TERRAIN_GRID_BLOCK_SPACING_X * grid_spacing;
+    const float length = from.get_distance(to);
+    const float distance = MIN(length, step * TERRAIN_PREFETCH_MAX_BLOCKS);
+    const float bearing = from.get_bearing_to(to) * 0.01f;
+    prefetch(from);
+    Location last = from;
+    for (float d = step; d < distance; d += step) {
+        Location loc = from;
+        loc.offset_bearing(bearing, d);
+        prefetch_step(last, loc);
+        last = loc;
+    }
+    if (distance < length) {
+        // the line was cut short, so only the far end is fetched
+        prefetch(to);
+    } else {
+        prefetch_step(last, to);
+    }
+}
+
+/*
+  prefetch one mission leg per call, starting from the leg we are on
+  and working through the next TERRAIN_PREFETCH_LEGS legs, then
+  starting again
+ */
+void AP_Terrain::prefetch_mission_leg(void)
+{
+    const uint16_t nav_index = mission.get_current_nav_index();
+    if (nav_index != prefetch_nav_index ||
+        mission.last_change_time_ms() != prefetch_mission_change_ms ||
+        prefetch_leg >= TERRAIN_PREFETCH_LEGS ||
+        prefetch_mission_index == 0) {
+        // start again from the current position
+        if (!AP::ahrs().get_position(prefetch_loc)) {
+            return;
+        }
+        prefetch_nav_index = nav_index;
+        prefetch_mission_change_ms = mission.last_change_time_ms();
+        prefetch_mission_index = MAX(nav_index, 1);
+        prefetch_leg = 0;
+    }
+
+    // find the next waypoint with a location
+    AP_Mission::Mission_Command cmd;
+    while (true) {
+        if (!mission.read_cmd_from_storage(prefetch_mission_index, cmd)) {
+            // end of the mission, start again next time
+            prefetch_leg = TERRAIN_PREFETCH_LEGS;
+            return;
+        }
+        if ((cmd.id == MAV_CMD_NAV_WAYPOINT ||
+             cmd.id == MAV_CMD_NAV_SPLINE_WAYPOINT) &&
+            (cmd.content.location.lat != 0 || cmd.content.location.lng != 0)) {
+            break;
+        }
+        prefetch_mission_index++;
+    }
+
+    prefetch_line(prefetch_loc, cmd.content.location);
+
+    prefetch_loc = cmd.content.location;
+    prefetch_mission_index++;
+    prefetch_leg++;
+}
+
+/*
+  prefetch along the velocity vector and the mission legs ahead.
+  Called from update()
+ */
+void AP_Terrain::update_prefetch(void)
+{
+    if (!allocate() || grid_spacing <= 0) {
+        return;
+    }
+
+    const AP_AHRS &ahrs = AP::ahrs();
+    Location loc;
+    Vector3f vel;
+    if (ahrs.get_position(loc) && ahrs.get_velocity_NED(vel)) {
+        const float speed = norm(vel.x, vel.y);
+        if (speed > 1) {
+            Location ahead = loc;
+            ahead.offset(vel.x * TERRAIN_PREFETCH_TIME, vel.y * TERRAIN_PREFETCH_TIME);
+            prefetch_line(loc, ahead);
+        }
+    }
+
+    prefetch_mission_leg();
+}
+
+#endif // AP_TERRAIN_AVAILABLE && AP_TERRAIN_LARGE_CACHE
@@ -104,6 +104,32 @@ void AP_Terrain::calculate_grid_info(const Location &loc, struct grid_info &info
 }
 
 
+#if AP_TERRAIN_LARGE_CACHE
+/*
+  hash chain for a grid_block SW corner
+ */
+uint16_t AP_Terrain::grid_hash(int32_t lat, int32_t lon) const
+{
+    const uint32_t h = (uint32_t(lat) * 2654435761U) ^ (uint32_t(lon) * 2246822519U);
+    return (h >> 16) & (TERRAIN_CACHE_HASH_SIZE-1);
+}
+
+/*
+  remove a cache entry from its hash chain
+ */
+void AP_Terrain::hash_remove(uint16_t idx)
+{
+    uint16_t *p = &cache_hash[grid_hash(cache[idx].grid.lat, cache[idx].grid.lon)];
+    while (*p != TERRAIN_CACHE_HASH_NONE) {
+        if (*p == idx) {
+            *p = cache[idx].hash_next;
+            return;
+        }
+        p = &cache[*p].hash_next;
+    }
+}
+#endif // AP_TERRAIN_LARGE_CACHE
+
 /*
   find a grid structure given a grid_info
  */
@@ -111,6 +137,28 @@ AP_Terrain::grid_cache &AP_Terrain::find_grid_cache(const struct grid_info &info
 {
     uint16_t oldest_i = 0;
 
+#if AP_TERRAIN_LARGE_CACHE
+    // see if we have that grid
+    const uint16_t h = grid_hash(info.grid_lat, info.grid_lon);
+    for (uint16_t i=cache_hash[h]; i != TERRAIN_CACHE_HASH_NONE; i=cache[i].hash_next) {
+        if (cache[i].grid.lat == info.grid_lat &&
+            cache[i].grid.lon == info.grid_lon &&
+            cache[i].grid.spacing == grid_spacing) {
+            cache[i].last_access_ms = AP_HAL::millis();
+            return cache[i];
+        }
+    }
+
+    // only look for the oldest on a miss
+    for (uint16_t i=1; i<cache_size; i++) {
+        if (cache[i].last_access_ms < cache[oldest_i].last_access_ms) {
+            oldest_i = i;
+        }
+    }
+    if (cache[oldest_i].state != GRID_CACHE_INVALID) {
+        hash_remove(oldest_i);
+    }
+#else
     // see if we have that grid
     for (uint16_t i=0; i<cache_size; i++) {
         if (cache[i].grid.lat == info.grid_lat && 
@@ -123,6 +171,7 @@ AP_Terrain::grid_cache &AP_Terrain::find_grid_cache(const struct grid_info &info
             oldest_i = i;
         }
     }
+#endif
 
     // Not found. Use the oldest grid and make it this grid,
     // initially unpopulated
@@ -142,6 +191,11 @@ AP_Terrain::grid_cache &AP_Terrain::find_grid_cache(const struct grid_info &info
     // mark as waiting for disk read
     grid.state = GRID_CACHE_DISKWAIT;
 
+#if AP_TERRAIN_LARGE_CACHE
+    grid.hash_next = cache_hash[h];
+    cache_hash[h] = oldest_i;
+#endif
+
     return grid;
 }
 
@@ -0,0 +1,371 @@
+#include <AP_gtest.h>
+
+#include <fcntl.h>
+#include <map>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include <AP_Filesystem/AP_Filesystem.h>
+#include <AP_Terrain/AP_Terrain.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+#if AP_TERRAIN_AVAILABLE
+
+static AP_Mission mission{nullptr, nullptr, nullptr};
+
+/*
+  reach into AP_Terrain to check the grid_block cache against a model
+  of an LRU cache, and the reads of the degree files
+ */
+class AP_Terrain_Test {
+public:
+    typedef AP_Terrain::grid_info grid_info;
+    typedef AP_Terrain::grid_cache grid_cache;
+    typedef AP_Terrain::grid_block grid_block;
+    typedef std::pair<int32_t, int32_t> corner;
+
+    // allocated so that, as for the vehicle's instance, it starts zeroed
+    AP_Terrain_Test() {
+        AP_Terrain::singleton = nullptr;
+        terrain = new AP_Terrain(mission);
+        terrain->allocate();
+    }
+
+    ~AP_Terrain_Test() {
+#if AP_TERRAIN_LARGE_CACHE
+        terrain->unmap_file();
+        free(terrain->cache_hash);
+#endif
+        if (terrain->fd != -1) {
+            AP::FS().close(terrain->fd);
+        }
+        free(terrain->cache);
+        free(terrain->file_path);
+        delete terrain;
+        AP_Terrain::singleton = nullptr;
+        if (!dir.empty()) {
+            unlink(file.c_str());
+            rmdir(dir.c_str());
+        }
+    }
+
+    static bool waiting_for_disk(const grid_cache &g) { return g.state == AP_Terrain::GRID_CACHE_DISKWAIT; }
+    static bool valid(const grid_cache &g) { return g.state == AP_Terrain::GRID_CACHE_VALID; }
+    static void set_valid(grid_cache &g) { g.state = AP_Terrain::GRID_CACHE_VALID; }
+
+    uint16_t cache_size() const { return terrain->cache_size; }
+    uint16_t grid_spacing() const { return terrain->grid_spacing; }
+
+    grid_info info_at(const Location &loc) const {
+        grid_info info;
+        terrain->calculate_grid_info(loc, info);
+        return info;
+    }
+
+    /*
+      the grid_blocks north and east of a point in the degree square,
+      24 to a row. The rows of a degree file are a little narrower
+      than the degree, so rows this short don't overlap in the file
+     */
+    std::vector<grid_info> blocks(uint16_t n) const {
+        const float north = TERRAIN_GRID_BLOCK_SPACING_X * grid_spacing();
+        const float east = TERRAIN_GRID_BLOCK_SPACING_Y * grid_spacing();
+        std::vector<grid_info> ret;
+        for (uint16_t i=0; i<n; i++) {
+            Location loc;
+            loc.lat = -355000000;
+            loc.lng = 1490000000;
+            loc.offset((i / 24 + 0.5f) * north, (i % 24 + 0.5f) * east);
+            ret.push_back(info_at(loc));
+        }
+        return ret;
+    }
+
+    grid_cache &find(const grid_info &info) {
+        return terrain->find_grid_cache(info);
+    }
+
+    // true if the block is in the cache, without touching the cache
+    bool cached(const grid_info &info) const {
+        for (uint16_t i=0; i<cache_size(); i++) {
+            const grid_cache &g = terrain->cache[i];
+            if (g.state != AP_Terrain::GRID_CACHE_INVALID &&
+                g.grid.lat == info.grid_lat && g.grid.lon == info.grid_lon) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // blocks in the cache
+    std::vector<corner> contents() const {
+        std::vector<corner> ret;
+        for (uint16_t i=0; i<cache_size(); i++) {
+            const grid_cache &g = terrain->cache[i];
+            if (g.state != AP_Terrain::GRID_CACHE_INVALID) {
+                ret.push_back(corner(g.grid.lat, g.grid.lon));
+            }
+        }
+        return ret;
+    }
+
+#if AP_TERRAIN_LARGE_CACHE
+    /*
+      each block in the cache is on the chain for its hash exactly
+      once, and the chains hold nothing else
+     */
+    void check_chains() const {
+        std::vector<bool> seen(cache_size());
+        uint16_t chained = 0;
+        for (uint16_t h=0; h<TERRAIN_CACHE_HASH_SIZE; h++) {
+            for (uint16_t i=terrain->cache_hash[h]; i != TERRAIN_CACHE_HASH_NONE; i=terrain->cache[i].hash_next) {
+                ASSERT_LT(i, cache_size());
+                ASSERT_FALSE(seen[i]) << "block " << i << " chained twice";
+                seen[i] = true;
+                const grid_cache &g = terrain->cache[i];
+                EXPECT_NE(g.state, AP_Terrain::GRID_CACHE_INVALID);
+                EXPECT_EQ(terrain->grid_hash(g.grid.lat, g.grid.lon), h);
+                chained++;
+            }
+        }
+        EXPECT_EQ(chained, contents().size());
+    }
+
+    void prefetch_line(const Location &from, const Location &to) {
+        terrain->prefetch_line(from, to);
+    }
+
+    /*
+      write the degree files to a directory of our own
+     */
+    void use_temp_dir() {
+        char tmpl[] = "/tmp/ap_terrain_XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+        terrain->file_path = strdup((dir + "/NxxExxx.DAT").c_str());
+        terrain->directory_created = true;
+    }
+
+    // a block with every 4x4 grid filled in
+    AP_Terrain::grid_block make_block(const grid_info &info, int16_t base) const {
+        AP_Terrain::grid_block block {};
+        block.lat = info.grid_lat;
+        block.lon = info.grid_lon;
+        block.spacing = grid_spacing();
+        block.version = TERRAIN_GRID_FORMAT_VERSION;
+        block.grid_idx_x = info.grid_idx_x;
+        block.grid_idx_y = info.grid_idx_y;
+        block.lat_degrees = info.lat_degrees;
+        block.lon_degrees = info.lon_degrees;
+        block.bitmap = AP_Terrain::bitmap_mask;
+        for (uint8_t x=0; x<TERRAIN_GRID_BLOCK_SIZE_X; x++) {
+            for (uint8_t y=0; y<TERRAIN_GRID_BLOCK_SIZE_Y; y++) {
+                block.height[x][y] = base + x*TERRAIN_GRID_BLOCK_SIZE_Y + y;
+            }
+        }
+        return block;
+    }
+
+    // write a block through the IO timer, returning it as written
+    AP_Terrain::grid_block write(const AP_Terrain::grid_block &block) {
+        terrain->disk_block.block = block;
+        terrain->disk_io_state = AP_Terrain::DiskIoWaitWrite;
+        terrain->io_timer();
+        EXPECT_FALSE(terrain->io_failure);
+        EXPECT_EQ(terrain->disk_io_state, AP_Terrain::DiskIoDoneWrite);
+        terrain->disk_io_state = AP_Terrain::DiskIoIdle;
+        file = terrain->file_path;
+        return terrain->disk_block.block;
+    }
+
+    // read a block through the IO timer, as a cache miss does
+    AP_Terrain::grid_block read(const grid_info &info) {
+        AP_Terrain::grid_block block = make_block(info, 0);
+        block.bitmap = 0;
+        terrain->disk_block.block = block;
+        terrain->disk_io_state = AP_Terrain::DiskIoWaitRead;
+        terrain->io_timer();
+        EXPECT_FALSE(terrain->io_failure);
+        EXPECT_EQ(terrain->disk_io_state, AP_Terrain::DiskIoDoneRead);
+        terrain->disk_io_state = AP_Terrain::DiskIoIdle;
+        return terrain->disk_block.block;
+    }
+
+    // read a block from the degree file with a plain read()
+    bool read_file(const grid_info &info, AP_Terrain::grid_block &block) const {
+        AP_Terrain::grid_block b = make_block(info, 0);
+        const int fd = ::open(file.c_str(), O_RDONLY);
+        if (fd == -1) {
+            return false;
+        }
+        AP_Terrain::grid_io_block io;
+        const ssize_t ret = pread(fd, &io, sizeof(io), terrain->grid_file_offset(b));
+        ::close(fd);
+        block = io.block;
+        return ret == sizeof(io);
+    }
+
+    bool mapped() const { return terrain->file_map != nullptr; }
+    uint32_t mapped_len() const { return terrain->file_map_len; }
+#endif // AP_TERRAIN_LARGE_CACHE
+
+private:
+    AP_Terrain *terrain;
+    std::string dir;
+    std::string file;
+};
+
+/*
+  access blocks at random, more of them than fit in the cache. Every
+  lookup must find a cached block and every miss must replace the
+  least recently used one
+ */
+TEST(AP_Terrain, CacheEviction)
+{
+    AP_Terrain_Test t;
+    const uint16_t n = t.cache_size();
+    const std::vector<AP_Terrain_Test::grid_info> blocks = t.blocks(n + n/2 + 1);
+
+    // model of the cache: the last access of each cached block
+    std::map<AP_Terrain_Test::corner, uint32_t> model;
+    uint32_t now = 1;
+
+    srandom(42);
+    for (uint16_t step=0; step<10*n; step++) {
+        // the first accesses fill the cache in order
+        const AP_Terrain_Test::grid_info &info = step < n ? blocks[step] : blocks[random() % blocks.size()];
+        const AP_Terrain_Test::corner c(info.grid_lat, info.grid_lon);
+        const bool hit = model.count(c) != 0;
+
+        AP_Terrain_Test::grid_cache &g = t.find(info);
+        ASSERT_EQ(g.grid.lat, info.grid_lat);
+        ASSERT_EQ(g.grid.lon, info.grid_lon);
+        if (hit) {
+            // a hit returns the block as it was left
+            ASSERT_TRUE(AP_Terrain_Test::valid(g)) << "step " << step;
+        } else {
+            ASSERT_TRUE(AP_Terrain_Test::waiting_for_disk(g)) << "step " << step;
+            if (model.size() == n) {
+                auto oldest = model.begin();
+                for (auto it = model.begin(); it != model.end(); ++it) {
+                    if (it->second < oldest->second) {
+                        oldest = it;
+                    }
+                }
+                model.erase(oldest);
+            }
+        }
+        // mark it as read from disk, and order the accesses ourselves
+        // rather than by the millisecond clock
+        AP_Terrain_Test::set_valid(g);
+        g.last_access_ms = now;
+        model[c] = now++;
+
+        std::vector<AP_Terrain_Test::corner> contents = t.contents();
+        ASSERT_EQ(contents.size(), model.size()) << "step " << step;
+        for (const auto &cc : contents) {
+            ASSERT_EQ(model.count(cc), 1U) << "step " << step;
+        }
+#if AP_TERRAIN_LARGE_CACHE
+        if (step % 64 == 0 || step == n) {
+            t.check_chains();
+        }
+#endif
+    }
+#if AP_TERRAIN_LARGE_CACHE
+    t.check_chains();
+#endif
+}
+
+#if AP_TERRAIN_LARGE_CACHE
+/*
+  every block along a prefetched line is in the cache, including the
+  ones a line only cuts the corner of
+ */
+TEST(AP_Terrain, PrefetchLine)
+{
+    for (const float bearing : {0.0f, 37.0f, 90.0f, 151.0f, 224.0f, 315.0f}) {
+        AP_Terrain_Test t;
+
+        Location from;
+        from.lat = -355000000;
+        from.lng = 1495000000;
+        Location to = from;
+        to.offset_bearing(bearing, 20000);
+
+        t.prefetch_line(from, to);
+        t.check_chains();
+
+        const float distance = from.get_distance(to);
+        for (float d = 0; d <= distance; d += 20) {
+            Location loc = from;
+            loc.offset_bearing(bearing, d);
+            EXPECT_TRUE(t.cached(t.info_at(loc))) << d << "m along the line at " << bearing;
+        }
+        EXPECT_TRUE(t.cached(t.info_at(to)));
+        EXPECT_LT(t.contents().size(), t.cache_size());
+    }
+}
+
+/*
+  blocks read through the mapping of the degree file match a read()
+  of the file, including after the file grows and after a block is
+  rewritten
+ */
+TEST(AP_Terrain, MappedReads)
+{
+    AP_Terrain_Test t;
+    t.use_temp_dir();
+
+    const std::vector<AP_Terrain_Test::grid_info> blocks = t.blocks(96);
+    std::vector<AP_Terrain_Test::grid_block> written;
+    for (uint16_t i=0; i<blocks.size(); i++) {
+        written.push_back(AP_Terrain_Test::grid_block());
+    }
+
+    // write the first half, then read it back
+    for (uint16_t i=0; i<48; i++) {
+        written[i] = t.write(t.make_block(blocks[i], i*100));
+    }
+    for (uint16_t i=0; i<48; i++) {
+        const AP_Terrain_Test::grid_block block = t.read(blocks[i]);
+        EXPECT_TRUE(t.mapped());
+        EXPECT_EQ(memcmp(&block, &written[i], sizeof(block)), 0) << "block " << i;
+        AP_Terrain_Test::grid_block from_file;
+        ASSERT_TRUE(t.read_file(blocks[i], from_file));
+        EXPECT_EQ(memcmp(&block, &from_file, sizeof(block)), 0) << "block " << i;
+    }
+    const uint32_t len = t.mapped_len();
+
+    // the rest grows the file past the mapping
+    for (uint16_t i=48; i<blocks.size(); i++) {
+        written[i] = t.write(t.make_block(blocks[i], i*100));
+    }
+    // and a block already mapped is written again
+    written[5] = t.write(t.make_block(blocks[5], -500));
+
+    for (uint16_t i=0; i<blocks.size(); i++) {
+        const AP_Terrain_Test::grid_block block = t.read(blocks[i]);
+        EXPECT_EQ(memcmp(&block, &written[i], sizeof(block)), 0) << "block " << i;
+        AP_Terrain_Test::grid_block from_file;
+        ASSERT_TRUE(t.read_file(blocks[i], from_file));
+        EXPECT_EQ(memcmp(&block, &from_file, sizeof(block)), 0) << "block " << i;
+    }
+    EXPECT_GT(t.mapped_len(), len);
+
+    // a block past the end of the file reads as empty
+    const std::vector<AP_Terrain_Test::grid_info> more = t.blocks(24*12);
+    const AP_Terrain_Test::grid_block block = t.read(more.back());
+    EXPECT_EQ(block.bitmap, 0U);
+    EXPECT_EQ(block.lat, more.back().grid_lat);
+    EXPECT_EQ(block.lon, more.back().grid_lon);
+}
+#endif // AP_TERRAIN_LARGE_CACHE
+
+#endif // AP_TERRAIN_AVAILABLE
+
+AP_GTEST_MAIN()
@@ -0,0 +1,191 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+/*
+  a bank of cascaded biquad filters for 3-axis sensor data
+
+  Each channel (for example one IMU) runs its samples through a chain
+  of STAGES biquads, such as a low pass, a notch and the harmonics of
+  a harmonic notch. The state and coefficients of a stage are kept as
+  four-wide vectors, one lane per axis with the fourth unused, so a
+  stage costs a handful of SSE or NEON operations for all three axes.
+  The stages of a chain depend on each other, so the gain comes from
+  the axes being done together, not from running stages in parallel.
+
+  Coefficients are normalised so that a0 is 1, for
+    y = b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2
+  The coefficients are taken from the existing filter classes through
+  their get_coefficients() methods, so the filter design stays in one
+  place. Unused stages pass their input straight through.
+
+  Build with BIQUAD_BANK_SIMD=0 for plain scalar loops.
+ */
+
+#include <AP_Math/AP_Math.h>
+
+#ifndef BIQUAD_BANK_SIMD
+#if defined(__SSE__) || defined(__ARM_NEON)
+#define BIQUAD_BANK_SIMD 1
+#else
+#define BIQUAD_BANK_SIMD 0
+#endif
+#endif
+
+#if BIQUAD_BANK_SIMD && defined(__SSE__)
+#include <xmmintrin.h>
+#elif BIQUAD_BANK_SIMD && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+  normalised biquad coefficients
+ */
+struct BiquadCoeffs {
+    float b0, b1, b2, a1, a2;
+
+    // a stage that passes its input straight through
+    void set_passthrough() {
+        b0 = 1;
+        b1 = b2 = a1 = a2 = 0;
+    }
+};
+
+template <uint8_t CHANNELS, uint8_t STAGES>
+class BiquadFilterBank {
+public:
+    BiquadFilterBank() {
+        BiquadCoeffs c;
+        c.set_passthrough();
+        for (uint8_t ch=0; ch<CHANNELS; ch++) {
+            for (uint8_t s=0; s<STAGES; s++) {
+                set_stage(ch, s, c);
+            }
+            reset(ch);
+        }
+    }
+
+    // set the coefficients of one stage, keeping its state
+    void set_stage(uint8_t channel, uint8_t stage, const BiquadCoeffs &c) {
+        struct stage &st = _stages[channel][stage];
+        for (uint8_t i=0; i<4; i++) {
+            st.b0[i] = c.b0;
+            st.b1[i] = c.b1;
+            st.b2[i] = c.b2;
+            st.a1[i] = c.a1;
+            st.a2[i] = c.a2;
+        }
+    }
+
+    // zero the state of all the stages of a channel
+    void reset(uint8_t channel) {
+        for (uint8_t s=0; s<STAGES; s++) {
+            struct stage &st = _stages[channel][s];
+            for (uint8_t i=0; i<4; i++) {
+                st.x1[i] = st.x2[i] = st.y1[i] = st.y2[i] = 0;
+            }
+        }
+    }
+
+    // filter one sample through all the stages of a channel
+    Vector3f apply(uint8_t channel, const Vector3f &sample) {
+        float v[4] { sample.x, sample.y, sample.z, 0 };
+        run(_stages[channel], v);
+        return Vector3f(v[0], v[1], v[2]);
+    }
+
+    // filter a burst of samples, such as a sensor FIFO read. in and
+    // out may be the same array
+    void apply_block(uint8_t channel, const Vector3f *in, Vector3f *out, uint16_t n) {
+        struct stage *stages = _stages[channel];
+        for (uint16_t i=0; i<n; i++) {
+            float v[4] { in[i].x, in[i].y, in[i].z, 0 };
+            run(stages, v);
+            out[i] = Vector3f(v[0], v[1], v[2]);
+        }
+    }
+
+    // filter one sample for each channel
+    void apply_all(const Vector3f *in, Vector3f *out) {
+        for (uint8_t ch=0; ch<CHANNELS; ch++) {
+            out[ch] = apply(ch, in[ch]);
+        }
+    }
+
+private:
+    struct stage {
+        float b0[4], b1[4], b2[4], a1[4], a2[4];
+        float x1[4], x2[4], y1[4], y2[4];
+    };
+
+    struct stage _stages[CHANNELS][STAGES];
+
+#if BIQUAD_BANK_SIMD && defined(__SSE__)
+    static void run(struct stage *stages, float v[4]) {
+        __m128 x = _mm_loadu_ps(v);
+        for (uint8_t s=0; s<STAGES; s++) {
+            struct stage &st = stages[s];
+            const __m128 x1 = _mm_loadu_ps(st.x1);
+            const __m128 y1 = _mm_loadu_ps(st.y1);
+            __m128 y = _mm_mul_ps(_mm_loadu_ps(st.b0), x);
+            y = _mm_add_ps(y, _mm_mul_ps(_mm_loadu_ps(st.b1), x1));
+            y = _mm_add_ps(y, _mm_mul_ps(_mm_loadu_ps(st.b2), _mm_loadu_ps(st.x2)));
+            y = _mm_sub_ps(y, _mm_mul_ps(_mm_loadu_ps(st.a1), y1));
+            y = _mm_sub_ps(y, _mm_mul_ps(_mm_loadu_ps(st.a2), _mm_loadu_ps(st.y2)));
+            _mm_storeu_ps(st.x2, x1);
+            _mm_storeu_ps(st.x1, x);
+            _mm_storeu_ps(st.y2, y1);
+            _mm_storeu_ps(st.y1, y);
+            x = y;
+        }
+        _mm_storeu_ps(v, x);
+    }
+#elif BIQUAD_BANK_SIMD && defined(__ARM_NEON)
+    static void run(struct stage *stages, float v[4]) {
+        float32x4_t x = vld1q_f32(v);
+        for (uint8_t s=0; s<STAGES; s++) {
+            struct stage &st = stages[s];
+            const float32x4_t x1 = vld1q_f32(st.x1);
+            const float32x4_t y1 = vld1q_f32(st.y1);
+            float32x4_t y = vmulq_f32(vld1q_f32(st.b0), x);
+            y = vmlaq_f32(y, vld1q_f32(st.b1), x1);
+            y = vmlaq_f32(y, vld1q_f32(st.b2), vld1q_f32(st.x2));
+            y = vmlsq_f32(y, vld1q_f32(st.a1), y1);
+            y = vmlsq_f32(y, vld1q_f32(st.a2), vld1q_f32(st.y2));
+            vst1q_f32(st.x2, x1);
+            vst1q_f32(st.x1, x);
+            vst1q_f32(st.y2, y1);
+            vst1q_f32(st.y1, y);
+            x = y;
+        }
+        vst1q_f32(v, x);
+    }
+#else
+    static void run(struct stage *stages, float v[4]) {
+        for (uint8_t s=0; s<STAGES; s++) {
+            struct stage &st = stages[s];
+            for (uint8_t i=0; i<3; i++) {
+                const float y = st.b0[i]*v[i] + st.b1[i]*st.x1[i] + st.b2[i]*st.x2[i]
+                    - st.a1[i]*st.y1[i] - st.a2[i]*st.y2[i];
+                st.x2[i] = st.x1[i];
+                st.x1[i] = v[i];
+                st.y2[i] = st.y1[i];
+                st.y1[i] = y;
+                v[i] = y;
+            }
+        }
+    }
+#endif
+};
@@ -16,7 +16,6 @@
 #include "HarmonicNotchFilter.h"
 #include <GCS_MAVLink/GCS.h>
 
-#define HNF_MAX_FILTERS 3
 #define HNF_MAX_HARMONICS 8
 
 // table of user settable parameters
@@ -211,6 +210,20 @@ void HarmonicNotchFilter<T>::reset()
     }
 }
 
+/*
+  get the coefficients of the i'th filter that apply() uses, or a
+  pass through if there are fewer than i+1
+ */
+template <class T>
+void HarmonicNotchFilter<T>::get_coefficients(uint8_t i, BiquadCoeffs &c) const
+{
+    if (!_initialised || i >= _num_enabled_filters) {
+        c.set_passthrough();
+        return;
+    }
+    _filters[i].get_coefficients(c);
+}
+
 /*
   create parameters for the harmonic notch filter and initialise defaults
  */
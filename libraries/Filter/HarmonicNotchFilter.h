@@ -19,6 +19,8 @@
 #include <AP_Param/AP_Param.h>
 #include "NotchFilter.h"
 
+#define HNF_MAX_FILTERS 3
+
 /*
   a filter that manages a set of notch filters targetted at a fundamental center frequency
   and multiples of that fundamental frequency
@@ -37,6 +39,8 @@ public:
     T apply(const T &sample);
     // reset each of the underlying filters
     void reset();
+    // coefficients of the i'th filter applied, for a BiquadFilterBank stage
+    void get_coefficients(uint8_t i, BiquadCoeffs &c) const;
 
 private:
     // underlying bank of notch filters
@@ -99,6 +99,19 @@ void LowPassFilter2p<T>::reset(void) {
     return _filter.reset();
 }
 
+template <class T>
+void LowPassFilter2p<T>::get_coefficients(BiquadCoeffs &c) const {
+    if (!is_positive(_params.cutoff_freq) || is_zero(_params.sample_freq)) {
+        c.set_passthrough();
+        return;
+    }
+    c.b0 = _params.b0;
+    c.b1 = _params.b1;
+    c.b2 = _params.b2;
+    c.a1 = _params.a1;
+    c.a2 = _params.a2;
+}
+
 /* 
  * Make an instances
  * Otherwise we have to move the constructor implementations to the header file :P
@@ -17,6 +17,7 @@
 #include <AP_Math/AP_Math.h>
 #include <cmath>
 #include <inttypes.h>
+#include "BiquadFilterBank.h"
 
 
 /// @file   LowPassFilter2p.h
@@ -59,6 +60,8 @@ public:
     float get_sample_freq(void) const;
     T apply(const T &sample);
     void reset(void);
+    // coefficients for a BiquadFilterBank stage
+    void get_coefficients(BiquadCoeffs &c) const;
 
 protected:
     struct DigitalBiquadFilter<T>::biquad_params _params;
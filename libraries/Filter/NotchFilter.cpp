@@ -95,6 +95,23 @@ void NotchFilter<T>::reset()
     signal2 = signal1 = T();
 }
 
+/*
+  coefficients normalised by a0, as used by BiquadFilterBank
+ */
+template <class T>
+void NotchFilter<T>::get_coefficients(BiquadCoeffs &c) const
+{
+    if (!initialised) {
+        c.set_passthrough();
+        return;
+    }
+    c.b0 = b0 * a0_inv;
+    c.b1 = b1 * a0_inv;
+    c.b2 = b2 * a0_inv;
+    c.a1 = a1 * a0_inv;
+    c.a2 = a2 * a0_inv;
+}
+
 // table of user settable parameters
 const AP_Param::GroupInfo NotchFilterParams::var_info[] = {
 
@@ -24,6 +24,7 @@
 #include <cmath>
 #include <inttypes.h>
 #include <AP_Param/AP_Param.h>
+#include "BiquadFilterBank.h"
 
 
 template <class T>
@@ -34,6 +35,8 @@ public:
     void init_with_A_and_Q(float sample_freq_hz, float center_freq_hz, float A, float Q);
     T apply(const T &sample);
     void reset();
+    // coefficients for a BiquadFilterBank stage
+    void get_coefficients(BiquadCoeffs &c) const;
 
     // calculate attenuation and quality from provided center frequency and bandwidth
     static void calculate_A_and_Q(float center_freq_hz, float bandwidth_hz, float attenuation_dB, float& A, float& Q); 
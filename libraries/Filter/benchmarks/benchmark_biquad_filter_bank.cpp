@@ -0,0 +1,111 @@
+#include <AP_gbenchmark.h>
+
+#include <Filter/LowPassFilter2p.h>
+#include <Filter/NotchFilter.h>
+#include <Filter/HarmonicNotchFilter.h>
+#include <Filter/BiquadFilterBank.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+/*
+  cost of the gyro filtering in AP_InertialSensor for three IMUs at
+  8kHz, with the low pass, the notch and a harmonic notch on three
+  harmonics, comparing the filter classes against BiquadFilterBank
+ */
+
+#define SAMPLE_RATE 8000.0f
+#define NUM_IMUS 3
+#define NUM_SAMPLES 64
+
+static Vector3f samples[NUM_SAMPLES];
+
+// static as the notch filters rely on zeroed memory, as they get in
+// AP_InertialSensor
+static LowPassFilter2pVector3f lpf[NUM_IMUS];
+static NotchFilterVector3f notch[NUM_IMUS];
+static HarmonicNotchFilterVector3f hnotch[NUM_IMUS];
+
+static void setup_filters(void)
+{
+    static bool done;
+    if (done) {
+        return;
+    }
+    done = true;
+
+    for (uint8_t i=0; i<NUM_SAMPLES; i++) {
+        const float t = i / SAMPLE_RATE;
+        samples[i] = Vector3f(sinf(2 * M_PI * 80 * t), cosf(2 * M_PI * 160 * t), sinf(2 * M_PI * 240 * t));
+    }
+    for (uint8_t imu=0; imu<NUM_IMUS; imu++) {
+        lpf[imu].set_cutoff_frequency(SAMPLE_RATE, 80);
+        notch[imu].init(SAMPLE_RATE, 1000, 100, 30);
+        hnotch[imu].allocate_filters(0x7);
+        hnotch[imu].init(SAMPLE_RATE, 80, 20, 15);
+    }
+}
+
+static void BM_GyroFilterClasses(benchmark::State& state)
+{
+    setup_filters();
+    while (state.KeepRunning()) {
+        for (uint8_t i=0; i<NUM_SAMPLES; i++) {
+            for (uint8_t imu=0; imu<NUM_IMUS; imu++) {
+                Vector3f v = lpf[imu].apply(samples[i]);
+                v = notch[imu].apply(v);
+                v = hnotch[imu].apply(v);
+                gbenchmark_escape(&v);
+            }
+        }
+    }
+}
+
+static void setup_bank(BiquadFilterBank<NUM_IMUS, 2+HNF_MAX_FILTERS> &bank)
+{
+    setup_filters();
+    BiquadCoeffs c;
+    for (uint8_t imu=0; imu<NUM_IMUS; imu++) {
+        lpf[imu].get_coefficients(c);
+        bank.set_stage(imu, 0, c);
+        notch[imu].get_coefficients(c);
+        bank.set_stage(imu, 1, c);
+        for (uint8_t i=0; i<HNF_MAX_FILTERS; i++) {
+            hnotch[imu].get_coefficients(i, c);
+            bank.set_stage(imu, 2+i, c);
+        }
+    }
+}
+
+static void BM_GyroFilterBank(benchmark::State& state)
+{
+    BiquadFilterBank<NUM_IMUS, 2+HNF_MAX_FILTERS> bank;
+    setup_bank(bank);
+    while (state.KeepRunning()) {
+        for (uint8_t i=0; i<NUM_SAMPLES; i++) {
+            for (uint8_t imu=0; imu<NUM_IMUS; imu++) {
+                Vector3f v = bank.apply(imu, samples[i]);
+                gbenchmark_escape(&v);
+            }
+        }
+    }
+}
+
+static void BM_GyroFilterBankBlock(benchmark::State& state)
+{
+    // a whole FIFO read at a time
+    BiquadFilterBank<NUM_IMUS, 2+HNF_MAX_FILTERS> bank;
+    setup_bank(bank);
+    Vector3f out[NUM_SAMPLES];
+    while (state.KeepRunning()) {
+        for (uint8_t imu=0; imu<NUM_IMUS; imu++) {
+            bank.apply_block(imu, samples, out, NUM_SAMPLES);
+            gbenchmark_escape(out);
+        }
+    }
+}
+
+BENCHMARK(BM_GyroFilterClasses);
+BENCHMARK(BM_GyroFilterBank);
+BENCHMARK(BM_GyroFilterBankBlock);
+
+BENCHMARK_MAIN()
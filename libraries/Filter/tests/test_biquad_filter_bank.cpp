@@ -0,0 +1,112 @@
+#include <AP_gtest.h>
+
+#include <Filter/LowPassFilter2p.h>
+#include <Filter/NotchFilter.h>
+#include <Filter/HarmonicNotchFilter.h>
+#include <Filter/BiquadFilterBank.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+#define SAMPLE_RATE 8000.0f
+
+// a gyro signal with noise at the notch frequencies
+static Vector3f gyro_sample(uint32_t i)
+{
+    const float t = i / SAMPLE_RATE;
+    return Vector3f(0.3f * sinf(2 * M_PI * 3 * t) + 0.05f * sinf(2 * M_PI * 80 * t),
+                    -0.2f * cosf(2 * M_PI * 5 * t) + 0.05f * sinf(2 * M_PI * 160 * t),
+                    0.1f + 0.05f * sinf(2 * M_PI * 240 * t) + 0.02f * sinf(2 * M_PI * 1000 * t));
+}
+
+TEST(BiquadFilterBankTest, MatchesFilterClasses)
+{
+    static LowPassFilter2pVector3f lpf(SAMPLE_RATE, 80);
+    static NotchFilterVector3f notch;
+    notch.init(SAMPLE_RATE, 1000, 100, 30);
+    static HarmonicNotchFilterVector3f hnotch;
+    hnotch.allocate_filters(0x7);
+    hnotch.init(SAMPLE_RATE, 80, 20, 15);
+
+    BiquadFilterBank<2, 2+HNF_MAX_FILTERS> bank;
+    BiquadCoeffs c;
+    lpf.get_coefficients(c);
+    bank.set_stage(1, 0, c);
+    notch.get_coefficients(c);
+    bank.set_stage(1, 1, c);
+    for (uint8_t i=0; i<HNF_MAX_FILTERS; i++) {
+        hnotch.get_coefficients(i, c);
+        bank.set_stage(1, 2+i, c);
+    }
+
+    for (uint32_t i=0; i<8000; i++) {
+        const Vector3f sample = gyro_sample(i);
+        const Vector3f expected = hnotch.apply(notch.apply(lpf.apply(sample)));
+        const Vector3f filtered = bank.apply(1, sample);
+        EXPECT_NEAR(expected.x, filtered.x, 1.0e-4f);
+        EXPECT_NEAR(expected.y, filtered.y, 1.0e-4f);
+        EXPECT_NEAR(expected.z, filtered.z, 1.0e-4f);
+
+        // channel 0 is all pass through
+        const Vector3f passed = bank.apply(0, sample);
+        EXPECT_EQ(sample.x, passed.x);
+        EXPECT_EQ(sample.y, passed.y);
+        EXPECT_EQ(sample.z, passed.z);
+    }
+}
+
+TEST(BiquadFilterBankTest, UnsetFiltersPassThrough)
+{
+    // static as the notch filters rely on zeroed memory, as they get
+    // in AP_InertialSensor
+    static LowPassFilter2pVector3f lpf;
+    static NotchFilterVector3f notch;
+    static HarmonicNotchFilterVector3f hnotch;
+    BiquadCoeffs c;
+
+    lpf.get_coefficients(c);
+    EXPECT_EQ(1, c.b0);
+    EXPECT_EQ(0, c.a1);
+    notch.get_coefficients(c);
+    EXPECT_EQ(1, c.b0);
+    EXPECT_EQ(0, c.a1);
+    hnotch.get_coefficients(0, c);
+    EXPECT_EQ(1, c.b0);
+    EXPECT_EQ(0, c.a1);
+}
+
+TEST(BiquadFilterBankTest, BlockMatchesSingle)
+{
+    LowPassFilter2pVector3f lpf(SAMPLE_RATE, 40);
+    BiquadCoeffs c;
+    lpf.get_coefficients(c);
+
+    BiquadFilterBank<1, 3> single;
+    BiquadFilterBank<1, 3> block;
+    for (uint8_t s=0; s<3; s++) {
+        single.set_stage(0, s, c);
+        block.set_stage(0, s, c);
+    }
+
+    Vector3f samples[32];
+    for (uint32_t n=0; n<10; n++) {
+        for (uint8_t i=0; i<ARRAY_SIZE(samples); i++) {
+            samples[i] = gyro_sample(n*ARRAY_SIZE(samples) + i);
+        }
+        Vector3f expected[ARRAY_SIZE(samples)];
+        for (uint8_t i=0; i<ARRAY_SIZE(samples); i++) {
+            expected[i] = single.apply(0, samples[i]);
+        }
+        block.apply_block(0, samples, samples, ARRAY_SIZE(samples));
+        for (uint8_t i=0; i<ARRAY_SIZE(samples); i++) {
+            EXPECT_EQ(expected[i].x, samples[i].x);
+            EXPECT_EQ(expected[i].y, samples[i].y);
+            EXPECT_EQ(expected[i].z, samples[i].z);
+        }
+    }
+
+    block.reset(0);
+    const Vector3f out = block.apply(0, Vector3f());
+    EXPECT_TRUE(out.is_zero());
+}
+
+AP_GTEST_MAIN()
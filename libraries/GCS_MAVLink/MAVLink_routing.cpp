@@ -27,7 +27,12 @@ extern const AP_HAL::HAL& hal;
 #define ROUTING_DEBUG 0
 
 // constructor
-MAVLink_routing::MAVLink_routing(void) : num_routes(0) {}
+MAVLink_routing::MAVLink_routing(void) :
+    num_routes(0),
+    route_channel_mask(0)
+{
+    memset(route_hash, 0, sizeof(route_hash));
+}
 
 /*
   forward a MAVLink message to the right port. This also
@@ -134,42 +139,50 @@ bool MAVLink_routing::check_and_forward(mavlink_channel_t in_channel, const mavl
         return true;
     }
 
-    // forward on any channels matching the targets
+    // find the channels matching the targets
+    uint16_t mask;
+    if (broadcast_system) {
+        mask = route_channel_mask;
+    } else if (broadcast_component || !match_system) {
+        mask = find_channel_mask(system_key(target_system));
+    } else {
+        mask = find_channel_mask(route_key(target_system, target_component));
+    }
+
+    // private channels only get messages targeted at a sysid/compid seen on them
+    uint16_t private_ok_mask = 0;
+    if (target_system > 0 && target_component >= 0) {
+        private_ok_mask = find_channel_mask(route_key(target_system, target_component));
+    }
+
+    // never send back on the incoming channel
+    mask &= ~(1U<<(in_channel-MAVLINK_COMM_0));
+
+    // forward the message unchanged on each of the channels
     bool forwarded = false;
-    bool sent_to_chan[MAVLINK_COMM_NUM_BUFFERS];
-    memset(sent_to_chan, 0, sizeof(sent_to_chan));
-    for (uint8_t i=0; i<num_routes; i++) {
-    
-        // Skip if channel is private and the target system or component IDs do not match
-        if ((GCS_MAVLINK::is_private(routes[i].channel)) &&
-            (target_system != routes[i].sysid ||
-             target_component != routes[i].compid)) {
+    for (uint8_t i=0; i<MAVLINK_COMM_NUM_BUFFERS && mask != 0; i++) {
+        const uint16_t chan_bit = 1U<<i;
+        if (!(mask & chan_bit)) {
             continue;
         }
-
-        if (broadcast_system || (target_system == routes[i].sysid &&
-                                 (broadcast_component || 
-                                  target_component == routes[i].compid ||
-                                  !match_system))) {
-
-            if (in_channel != routes[i].channel && !sent_to_chan[routes[i].channel]) {
-                
-                if (comm_get_txspace(routes[i].channel) >= ((uint16_t)msg.len) +
-                    GCS_MAVLINK::packet_overhead_chan(routes[i].channel)) {
+        mask &= ~chan_bit;
+        const mavlink_channel_t channel = (mavlink_channel_t)(MAVLINK_COMM_0 + i);
+        if (GCS_MAVLINK::is_private(channel) && !(private_ok_mask & chan_bit)) {
+            continue;
+        }
+        if (comm_get_txspace(channel) >= ((uint16_t)msg.len) +
+            GCS_MAVLINK::packet_overhead_chan(channel)) {
 #if ROUTING_DEBUG
-                    ::printf("fwd msg %u from chan %u on chan %u sysid=%d compid=%d\n",
-                             msg.msgid,
-                             (unsigned)in_channel,
-                             (unsigned)routes[i].channel,
-                             (int)target_system,
-                             (int)target_component);
+            ::printf("fwd msg %u from chan %u on chan %u sysid=%d compid=%d\n",
+                     msg.msgid,
+                     (unsigned)in_channel,
+                     (unsigned)channel,
+                     (int)target_system,
+                     (int)target_component);
 #endif
-                    _mavlink_resend_uart(routes[i].channel, &msg);
-                }
-                sent_to_chan[routes[i].channel] = true;
-                forwarded = true;
-            }
+            _mavlink_resend_uart(channel, &msg);
         }
+        forwarded = true;
     }
 
     if (!forwarded && match_system) {
@@ -195,43 +208,45 @@ void MAVLink_routing::send_to_components(uint32_t msgid, const char *pkt, uint8_
 
 void MAVLink_routing::send_to_components(const char *pkt, const mavlink_msg_entry_t *entry, const uint8_t pkt_len)
 {
-    bool sent_to_chan[MAVLINK_COMM_NUM_BUFFERS] {};
+    // channels our system ID has been seen on
+    uint16_t mask = find_channel_mask(system_key(mavlink_system.sysid));
+    if (mask == 0) {
+        return;
+    }
 
-    // check learned routes
-    for (uint8_t i=0; i<num_routes; i++) {
-        if (routes[i].sysid != mavlink_system.sysid) {
-            // our system ID hasn't been seen on this link
-            continue;
-        }
-        if (sent_to_chan[routes[i].channel]) {
-            // we've already send it on this link
+#if CONFIG_HAL_BOARD == HAL_BOARD_SITL
+    if (entry->max_msg_len > pkt_len) {
+        AP_HAL::panic("Passed packet message length (%u > %u)",
+                      entry->max_msg_len, pkt_len);
+    }
+#endif
+    const uint8_t len = MIN(entry->max_msg_len, pkt_len);
+
+    // each channel has its own sequence number and signing so the
+    // message is finalized separately for each of them
+    for (uint8_t i=0; i<MAVLINK_COMM_NUM_BUFFERS && mask != 0; i++) {
+        const uint16_t chan_bit = 1U<<i;
+        if (!(mask & chan_bit)) {
             continue;
         }
-        if (comm_get_txspace(routes[i].channel) <
-            ((uint16_t)entry->max_msg_len) + GCS_MAVLINK::packet_overhead_chan(routes[i].channel)) {
+        mask &= ~chan_bit;
+        const mavlink_channel_t channel = (mavlink_channel_t)(MAVLINK_COMM_0 + i);
+        if (comm_get_txspace(channel) <
+            ((uint16_t)entry->max_msg_len) + GCS_MAVLINK::packet_overhead_chan(channel)) {
             // it doesn't fit on this channel
             continue;
         }
 #if ROUTING_DEBUG
-        ::printf("send msg %u on chan %u sysid=%u compid=%u\n",
-                 msg.msgid,
-                 (unsigned)routes[i].channel,
-                 (unsigned)routes[i].sysid,
-                 (unsigned)routes[i].compid);
-#endif
-#if CONFIG_HAL_BOARD == HAL_BOARD_SITL
-        if (entry->max_msg_len > pkt_len) {
-            AP_HAL::panic("Passed packet message length (%u > %u)",
-                          entry->max_msg_len, pkt_len);
-        }
+        ::printf("send msg %u on chan %u\n",
+                 (unsigned)entry->msgid,
+                 (unsigned)channel);
 #endif
-        _mav_finalize_message_chan_send(routes[i].channel,
+        _mav_finalize_message_chan_send(channel,
                                         entry->msgid,
                                         pkt,
                                         entry->min_msg_len,
-                                        MIN(entry->max_msg_len, pkt_len),
+                                        len,
                                         entry->crc_extra);
-        sent_to_chan[routes[i].channel] = true;
     }
 }
 
@@ -266,6 +281,12 @@ void MAVLink_routing::learn_route(mavlink_channel_t in_channel, const mavlink_me
          msg.compid == mavlink_system.compid)) {
         return;
     }
+    const uint16_t chan_bit = 1U<<(in_channel-MAVLINK_COMM_0);
+    if ((find_channel_mask(route_key(msg.sysid, msg.compid)) & chan_bit) &&
+        msg.msgid != MAVLINK_MSG_ID_HEARTBEAT) {
+        // route already known, heartbeats may still need to fill in the mavtype
+        return;
+    }
     for (i=0; i<num_routes; i++) {
         if (routes[i].sysid == msg.sysid &&
             routes[i].compid == msg.compid &&
@@ -284,6 +305,9 @@ void MAVLink_routing::learn_route(mavlink_channel_t in_channel, const mavlink_me
             routes[i].mavtype = mavlink_msg_heartbeat_get_type(&msg);
         }
         num_routes++;
+        add_channel_mask(route_key(msg.sysid, msg.compid), chan_bit);
+        add_channel_mask(system_key(msg.sysid), chan_bit);
+        route_channel_mask |= chan_bit;
 #if ROUTING_DEBUG
         ::printf("learned route %u %u via %u\n",
                  (unsigned)msg.sysid,
@@ -311,10 +335,8 @@ void MAVLink_routing::handle_heartbeat(mavlink_channel_t in_channel, const mavli
     mask &= ~no_route_mask;
     
     // mask out channels that are known sources for this sysid/compid
-    for (uint8_t i=0; i<num_routes; i++) {
-        if (routes[i].sysid == msg.sysid && routes[i].compid == msg.compid) {
-            mask &= ~(1U<<((unsigned)(routes[i].channel-MAVLINK_COMM_0)));
-        }
+    if (msg.sysid != 0) {
+        mask &= ~find_channel_mask(route_key(msg.sysid, msg.compid));
     }
 
     if (mask == 0) {
@@ -361,3 +383,35 @@ void MAVLink_routing::get_targets(const mavlink_message_t &msg, int16_t &sysid,
     }
 }
 
+/*
+  get the mask of channels recorded for a key in the route hash table,
+  zero if the key has not been seen
+*/
+uint16_t MAVLink_routing::find_channel_mask(uint16_t key) const
+{
+    if (key == 0) {
+        return 0;
+    }
+    uint16_t slot = ((key * 40503U) >> 8) & (MAVLINK_ROUTE_HASH_SIZE-1);
+    while (route_hash[slot].key != 0) {
+        if (route_hash[slot].key == key) {
+            return route_hash[slot].channel_mask;
+        }
+        slot = (slot + 1) & (MAVLINK_ROUTE_HASH_SIZE-1);
+    }
+    return 0;
+}
+
+/*
+  add to the mask of channels recorded for a key in the route hash
+  table. The table is sized so it can't fill
+*/
+void MAVLink_routing::add_channel_mask(uint16_t key, uint16_t mask)
+{
+    uint16_t slot = ((key * 40503U) >> 8) & (MAVLINK_ROUTE_HASH_SIZE-1);
+    while (route_hash[slot].key != 0 && route_hash[slot].key != key) {
+        slot = (slot + 1) & (MAVLINK_ROUTE_HASH_SIZE-1);
+    }
+    route_hash[slot].key = key;
+    route_hash[slot].channel_mask |= mask;
+}
@@ -10,6 +10,13 @@
 // we make more extensive use of MAVLink forwarding
 #define MAVLINK_MAX_ROUTES 20
 
+// number of slots in the hash table indexing the routes. Each route
+// adds at most two entries, so a table of more than twice that many
+// slots can never fill and keeps probe sequences short
+#define MAVLINK_ROUTE_HASH_SIZE 64
+static_assert((MAVLINK_ROUTE_HASH_SIZE & (MAVLINK_ROUTE_HASH_SIZE-1)) == 0, "MAVLINK_ROUTE_HASH_SIZE must be a power of two");
+static_assert(MAVLINK_ROUTE_HASH_SIZE > 2*MAVLINK_MAX_ROUTES, "MAVLINK_ROUTE_HASH_SIZE too small");
+
 /*
   object to handle MAVLink packet routing
  */
@@ -45,8 +52,8 @@ public:
     bool find_by_mavtype(uint8_t mavtype, uint8_t &sysid, uint8_t &compid, mavlink_channel_t &channel);
 
 private:
-    // a simple linear routing table. We don't expect to have a lot of
-    // routes, so a scalable structure isn't worthwhile yet.
+    // a simple linear routing table, indexed by route_hash for the
+    // lookups made for every message
     uint8_t num_routes;
     struct route {
         uint8_t sysid;
@@ -57,6 +64,28 @@ private:
     
     // a channel mask to block routing as required
     uint8_t no_route_mask;
+
+    // hash table of the channels each sysid/compid has been seen on,
+    // keyed by (sysid<<8)|compid, and of the channels any component
+    // of each system has been seen on, keyed by sysid. Routes never
+    // have a sysid of zero so the two kinds of key can't collide, and
+    // a key of zero marks an empty slot
+    struct route_hash_entry {
+        uint16_t key;
+        uint16_t channel_mask;
+    } route_hash[MAVLINK_ROUTE_HASH_SIZE];
+
+    // mask of the channels any route has been learned on
+    uint16_t route_channel_mask;
+
+    static uint16_t route_key(uint8_t sysid, uint8_t compid) { return (uint16_t(sysid)<<8) | compid; }
+    static uint16_t system_key(uint8_t sysid) { return sysid; }
+
+    // get the mask of channels recorded for a key, zero if none
+    uint16_t find_channel_mask(uint16_t key) const;
+
+    // add to the mask of channels recorded for a key
+    void add_channel_mask(uint16_t key, uint16_t mask);
     
     // learn new routes
     void learn_route(mavlink_channel_t in_channel, const mavlink_message_t &msg);
@@ -0,0 +1,157 @@
+#include <AP_gbenchmark.h>
+
+#include <AP_HAL/AP_HAL.h>
+#include <GCS_MAVLink/GCS.h>
+#include <GCS_MAVLink/GCS_MAVLink.h>
+#include <GCS_MAVLink/GCS_Dummy.h>
+#include <AP_SerialManager/AP_SerialManager.h>
+
+/*
+  cost of routing one second of traffic at 5kHz aggregate, for a
+  vehicle with two GCSs, a companion computer with two cameras behind
+  it, a gimbal, and an ADS-B receiver sharing a port with a UAVCAN
+  bridge. The time per iteration is the CPU time routing costs
+  per second of flight
+ */
+
+const AP_HAL::HAL &hal = AP_HAL::get_HAL();
+
+AP_SerialManager _serialmanager;
+GCS_Dummy _gcs;
+
+const AP_Param::GroupInfo GCS_MAVLINK_Parameters::var_info[] = {
+    AP_GROUPEND
+};
+
+#define MESSAGES_PER_SECOND 5000
+
+// a UART which discards everything written to it
+class SinkUARTDriver : public AP_HAL::UARTDriver {
+public:
+    void begin(uint32_t baud) override {}
+    void begin(uint32_t baud, uint16_t rxSpace, uint16_t txSpace) override {}
+    void end() override {}
+    void flush() override {}
+    bool is_initialized() override { return true; }
+    void set_blocking_writes(bool blocking) override {}
+    bool tx_pending() override { return false; }
+    uint32_t available() override { return 0; }
+    uint32_t txspace() override { return 4096; }
+    int16_t read() override { return -1; }
+    using AP_HAL::BetterStream::read;
+    size_t write(uint8_t c) override { return 1; }
+    size_t write(const uint8_t *buffer, size_t size) override { return size; }
+};
+
+static SinkUARTDriver sink[MAVLINK_COMM_NUM_BUFFERS];
+
+struct component {
+    uint8_t chan;
+    uint8_t sysid;
+    uint8_t compid;
+    uint8_t type;
+};
+
+static const component components[] {
+    { 0, 255, 190, MAV_TYPE_GCS },
+    { 1, 254, 190, MAV_TYPE_GCS },
+    { 2, 1, MAV_COMP_ID_ONBOARD_COMPUTER, MAV_TYPE_ONBOARD_CONTROLLER },
+    { 2, 1, MAV_COMP_ID_CAMERA, MAV_TYPE_CAMERA },
+    { 2, 1, MAV_COMP_ID_CAMERA2, MAV_TYPE_CAMERA },
+    { 3, 1, MAV_COMP_ID_GIMBAL, MAV_TYPE_GIMBAL },
+    { 4, 1, MAV_COMP_ID_ADSB, MAV_TYPE_ADSB },
+    { 4, 1, MAV_COMP_ID_UAVCAN, MAV_TYPE_GENERIC },
+};
+
+static MAVLink_routing routing;
+
+static struct {
+    mavlink_channel_t chan;
+    mavlink_message_t msg;
+} traffic[MESSAGES_PER_SECOND];
+
+static void setup_routing(void)
+{
+    static bool done;
+    if (done) {
+        return;
+    }
+    done = true;
+
+    mavlink_system.sysid = 1;
+    mavlink_system.compid = MAV_COMP_ID_AUTOPILOT1;
+    for (uint8_t i=0; i<MAVLINK_COMM_NUM_BUFFERS; i++) {
+        mavlink_comm_port[i] = &sink[i];
+    }
+
+    // learn the routes from each component's heartbeat
+    for (const component &c : components) {
+        mavlink_heartbeat_t heartbeat {};
+        heartbeat.type = c.type;
+        mavlink_message_t msg;
+        mavlink_msg_heartbeat_encode(c.sysid, c.compid, &msg, &heartbeat);
+        routing.check_and_forward((mavlink_channel_t)(MAVLINK_COMM_0 + c.chan), msg);
+    }
+
+    // a mix of untargeted telemetry, commands for the autopilot and
+    // commands for the other components
+    for (uint16_t i=0; i<MESSAGES_PER_SECOND; i++) {
+        const component &src = components[i % ARRAY_SIZE(components)];
+        const component &dst = components[(i * 7 + 3) % ARRAY_SIZE(components)];
+        traffic[i].chan = (mavlink_channel_t)(MAVLINK_COMM_0 + src.chan);
+        mavlink_message_t &msg = traffic[i].msg;
+        switch (i % 4) {
+        case 0: {
+            mavlink_attitude_t attitude {};
+            mavlink_msg_attitude_encode(src.sysid, src.compid, &msg, &attitude);
+            break;
+        }
+        case 1: {
+            mavlink_command_long_t cmd {};
+            cmd.target_system = mavlink_system.sysid;
+            cmd.target_component = mavlink_system.compid;
+            mavlink_msg_command_long_encode(src.sysid, src.compid, &msg, &cmd);
+            break;
+        }
+        case 2: {
+            mavlink_command_long_t cmd {};
+            cmd.target_system = dst.sysid;
+            cmd.target_component = dst.compid;
+            mavlink_msg_command_long_encode(src.sysid, src.compid, &msg, &cmd);
+            break;
+        }
+        default: {
+            mavlink_param_set_t param_set {};
+            param_set.target_system = dst.sysid;
+            mavlink_msg_param_set_encode(src.sysid, src.compid, &msg, &param_set);
+            break;
+        }
+        }
+    }
+}
+
+static void BM_RoutingCheckAndForward(benchmark::State& state)
+{
+    setup_routing();
+    while (state.KeepRunning()) {
+        for (uint16_t i=0; i<MESSAGES_PER_SECOND; i++) {
+            bool process_locally = routing.check_and_forward(traffic[i].chan, traffic[i].msg);
+            gbenchmark_escape(&process_locally);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * MESSAGES_PER_SECOND);
+}
+
+static void BM_RoutingSendToComponents(benchmark::State& state)
+{
+    setup_routing();
+    mavlink_command_long_t cmd {};
+    while (state.KeepRunning()) {
+        routing.send_to_components(MAVLINK_MSG_ID_COMMAND_LONG, (const char *)&cmd, sizeof(cmd));
+    }
+}
+
+BENCHMARK(BM_RoutingCheckAndForward);
+BENCHMARK(BM_RoutingSendToComponents);
+
+BENCHMARK_MAIN()
@@ -198,7 +198,7 @@ void Aircraft::time_advance()
         time_now_us += frame_time_us;
     }
     last_time_us = time_now_us;
-    if (use_time_sync) {
+    if (use_time_sync && !max_speed) {
         sync_frame_time();
     }
 }
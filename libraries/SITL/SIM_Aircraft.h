@@ -48,6 +48,13 @@ public:
      */
     void set_speedup(float speedup);
 
+    /*
+      run as fast as possible, never sleeping to match wall clock time
+     */
+    void set_max_speed(bool enable) {
+        max_speed = enable;
+    }
+
     /*
       set instance number
      */
@@ -187,6 +194,7 @@ protected:
     const char *autotest_dir;
     const char *frame;
     bool use_time_sync = true;
+    bool max_speed = false;
     float last_speedup = -1.0f;
     const char *config_ = "";
 